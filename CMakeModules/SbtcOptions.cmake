@@ -14,6 +14,7 @@ macro(configure_project)
     option(HAVE_CONFIG_H "Build with tests" ON)
     option(HAVE_SYS_SELECT_H "Build with tests" ON)
     option(TESTS "Build with tests" OFF)
+    option(BENCH "Build benchmarks" OFF)
     option(ENABLE_ZMQ_FLAG "Build with tests" OFF)
 	option(ENABLE_STATIC_FLAG "enable static falg" ON)
 	option(REVISIVE_FLAG " enable REVISIVE falg" ON)
@@ -77,6 +78,7 @@ macro(print_config)
 	message("-- HAVE_CONFIG_H       Have config                           ${HAVE_CONFIG_H}")
 	message("-- HAVE_SYS_SELECT_H   Have sys function select              ${HAVE_SYS_SELECT_H}")
     message("-- TESTS               Build tests                           ${TESTS}")
+    message("-- BENCH               Build benchmarks                      ${BENCH}")
     message("-- ENABLE_ZMQ          enable ZMQ flag                       ${ENABLE_ZMQ}")
 	message("-- ENABLE_STATIC_FLAG  enable static falg                    ${ENABLE_STATIC_FLAG}")
 	message("-- EREVISIVE_FLAG  	enable revisive falg                    ${REVISIVE_FLAG}")
@@ -4,12 +4,16 @@
 
 #include "bench.h"
 #include "perf.h"
+#include "sbtccore/clientversion.h"
 
 #include <assert.h>
 #include <iostream>
 #include <iomanip>
+#include <regex>
 #include <sys/time.h>
 
+#include <univalue.h>
+
 benchmark::BenchRunner::BenchmarkMap &benchmark::BenchRunner::benchmarks()
 {
     static std::map<std::string, benchmark::BenchFunction> benchmarks_map;
@@ -28,19 +32,77 @@ benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction f
     benchmarks().insert(std::make_pair(name, func));
 }
 
-void
-benchmark::BenchRunner::RunAll(double elapsedTimeForOne)
+static void PrintCSV(const std::vector<benchmark::Result> &results)
 {
-    perf_init();
     std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << ","
               << "min_cycles" << "," << "max_cycles" << "," << "average_cycles" << "\n";
+    for (const auto &r : results)
+    {
+        std::cout << std::fixed << std::setprecision(15) << r.name << "," << r.count << "," << r.minTime << ","
+                  << r.maxTime << "," << r.averageTime << ","
+                  << r.minCycles << "," << r.maxCycles << "," << r.averageCycles << "\n";
+    }
+    std::cout.copyfmt(std::ios(nullptr));
+}
+
+static void PrintJSON(const std::vector<benchmark::Result> &results)
+{
+    UniValue benches(UniValue::VARR);
+    for (const auto &r : results)
+    {
+        UniValue bench(UniValue::VOBJ);
+        bench.push_back(Pair("name", r.name));
+        bench.push_back(Pair("count", r.count));
+        bench.push_back(Pair("min", r.minTime));
+        bench.push_back(Pair("max", r.maxTime));
+        bench.push_back(Pair("average", r.averageTime));
+        bench.push_back(Pair("min_cycles", r.minCycles));
+        bench.push_back(Pair("max_cycles", r.maxCycles));
+        bench.push_back(Pair("average_cycles", r.averageCycles));
+        benches.push_back(bench);
+    }
+
+    UniValue out(UniValue::VOBJ);
+    out.push_back(Pair("version", FormatFullVersion()));
+    out.push_back(Pair("benchmarks", benches));
+    std::cout << out.write(2) << "\n";
+}
 
+void
+benchmark::BenchRunner::RunAll(const std::string &format, const std::string &filter, double elapsedTimeForOne)
+{
+    std::regex reFilter(filter);
+    std::vector<Result> results;
+
+    perf_init();
     for (const auto &p: benchmarks())
     {
+        if (!std::regex_match(p.first, reFilter))
+            continue;
+
         State state(p.first, elapsedTimeForOne);
         p.second(state);
+        if (state.result.count > 0)
+            results.push_back(state.result);
     }
     perf_fini();
+
+    if (format == "json")
+        PrintJSON(results);
+    else
+        PrintCSV(results);
+}
+
+void benchmark::State::PauseTiming()
+{
+    pauseBeginTime = gettimedouble();
+    pauseBeginCycles = perf_cpucycles();
+}
+
+void benchmark::State::ResumeTiming()
+{
+    pausedTime += gettimedouble() - pauseBeginTime;
+    pausedCycles += perf_cpucycles() - pauseBeginCycles;
 }
 
 bool benchmark::State::KeepRunning()
@@ -50,15 +112,16 @@ bool benchmark::State::KeepRunning()
         ++count;
         return true;
     }
+    // Time spent between PauseTiming() and ResumeTiming() is taken off the clock.
     double now;
     uint64_t nowCycles;
     if (count == 0)
     {
-        lastTime = beginTime = now = gettimedouble();
-        lastCycles = beginCycles = nowCycles = perf_cpucycles();
+        lastTime = beginTime = now = gettimedouble() - pausedTime;
+        lastCycles = beginCycles = nowCycles = perf_cpucycles() - pausedCycles;
     } else
     {
-        now = gettimedouble();
+        now = gettimedouble() - pausedTime;
         double elapsed = now - lastTime;
         double elapsedOne = elapsed * countMaskInv;
         if (elapsedOne < minTime)
@@ -67,7 +130,7 @@ bool benchmark::State::KeepRunning()
             maxTime = elapsedOne;
 
         // We only use relative values, so don't have to handle 64-bit wrap-around specially
-        nowCycles = perf_cpucycles();
+        nowCycles = perf_cpucycles() - pausedCycles;
         uint64_t elapsedOneCycles = (nowCycles - lastCycles) * countMaskInv;
         if (elapsedOneCycles < minCycles)
             minCycles = elapsedOneCycles;
@@ -108,13 +171,14 @@ bool benchmark::State::KeepRunning()
 
     assert(count != 0 && "count == 0 => (now == 0 && beginTime == 0) => return above");
 
-    // Output results
-    double average = (now - beginTime) / count;
-    int64_t averageCycles = (nowCycles - beginCycles) / count;
-    std::cout << std::fixed << std::setprecision(15) << name << "," << count << "," << minTime << "," << maxTime << ","
-              << average << ","
-              << minCycles << "," << maxCycles << "," << averageCycles << "\n";
-    std::cout.copyfmt(std::ios(nullptr));
+    result.name = name;
+    result.count = count;
+    result.minTime = minTime;
+    result.maxTime = maxTime;
+    result.averageTime = (now - beginTime) / count;
+    result.minCycles = minCycles;
+    result.maxCycles = maxCycles;
+    result.averageCycles = (nowCycles - beginCycles) / count;
 
     return false;
 }
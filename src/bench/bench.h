@@ -9,6 +9,7 @@
 #include <limits>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/stringize.hpp>
@@ -33,11 +34,23 @@ static void CODE_TO_TIME(benchmark::State& state)
 
 BENCHMARK(CODE_TO_TIME);
 
+Work that has to happen between iterations but should not be measured (such
+as undoing what the iteration did) goes between state.PauseTiming() and
+state.ResumeTiming().
+
  */
 
 namespace benchmark
 {
 
+    struct Result
+    {
+        std::string name;
+        uint64_t count;
+        double minTime, maxTime, averageTime;
+        uint64_t minCycles, maxCycles, averageCycles;
+    };
+
     class State
     {
         std::string name;
@@ -50,8 +63,13 @@ namespace benchmark
         uint64_t lastCycles;
         uint64_t minCycles;
         uint64_t maxCycles;
+        double pausedTime, pauseBeginTime;
+        uint64_t pausedCycles, pauseBeginCycles;
     public:
-        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0)
+        Result result;
+
+        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0),
+                                                       pausedTime(0), pausedCycles(0), result()
         {
             minTime = std::numeric_limits<double>::max();
             maxTime = std::numeric_limits<double>::min();
@@ -62,6 +80,10 @@ namespace benchmark
         }
 
         bool KeepRunning();
+
+        void PauseTiming();
+
+        void ResumeTiming();
     };
 
     typedef std::function<void(State &)> BenchFunction;
@@ -75,7 +97,10 @@ namespace benchmark
     public:
         BenchRunner(std::string name, BenchFunction func);
 
-        static void RunAll(double elapsedTimeForOne = 1.0);
+        /** Run every benchmark whose name matches the filter regex and print the results
+         *  in the given format ("csv" or "json"). */
+        static void RunAll(const std::string &format = "csv", const std::string &filter = ".*",
+                           double elapsedTimeForOne = 1.0);
     };
 }
 
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "bench_node.h"
 
 #include "crypto/sha256.h"
 #include "wallet/key.h"
@@ -10,16 +11,58 @@
 #include "utils/util.h"
 #include "random.h"
 
+#include <iostream>
+
+static const char *DEFAULT_BENCH_PRINTER = "csv";
+static const char *DEFAULT_BENCH_FILTER = ".*";
+static const double DEFAULT_BENCH_TIME = 1.0;
+
+static bool GetOption(const std::string &arg, const std::string &name, std::string &value)
+{
+    if (arg.compare(0, name.size() + 1, name + "=") != 0)
+        return false;
+    value = arg.substr(name.size() + 1);
+    return true;
+}
+
 int
 main(int argc, char **argv)
 {
+    std::string printer = DEFAULT_BENCH_PRINTER;
+    std::string filter = DEFAULT_BENCH_FILTER;
+    double elapsedTimeForOne = DEFAULT_BENCH_TIME;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i], value;
+        if (GetOption(arg, "-printer", value) && (value == "csv" || value == "json"))
+        {
+            printer = value;
+        } else if (GetOption(arg, "-filter", value))
+        {
+            filter = value;
+        } else if (GetOption(arg, "-time", value) && atof(value.c_str()) > 0)
+        {
+            elapsedTimeForOne = atof(value.c_str());
+        } else
+        {
+            std::cout << "Usage: bench_sbtc [options]\n"
+                      << "  -printer=<csv|json>  Output format (default: " << DEFAULT_BENCH_PRINTER << ")\n"
+                      << "  -filter=<regex>      Only run the benchmarks whose name matches (default: "
+                      << DEFAULT_BENCH_FILTER << ")\n"
+                      << "  -time=<seconds>      Minimum time to spend on each benchmark (default: "
+                      << DEFAULT_BENCH_TIME << ")\n";
+            return arg == "-help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
     SHA256AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
-    fPrintToDebugLog = false; // don't want to write to debug.log file
 
-    benchmark::BenchRunner::RunAll();
+    benchmark::BenchRunner::RunAll(printer, filter, elapsedTimeForOne);
 
+    // Only started by the benchmarks that need a chain.
+    CBenchNode::Shutdown();
     ECC_Stop();
 }
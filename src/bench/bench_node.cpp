@@ -0,0 +1,166 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_node.h"
+
+#include "sbtcd/baseimpl.hpp"
+#include "p2p/netcomponent.h"
+#include "rpc/rpccomponent.h"
+#include "chaincontrol/chaincomponent.h"
+#include "mempool/mempoolcomponent.h"
+#include "wallet/walletcomponent.h"
+#include "miner/minercomponent.h"
+#include "contract-api/contractcomponent.h"
+#include "interface/ichaincomponent.h"
+#include "block/validation.h"
+#include "config/chainparams.h"
+#include "miner/miner.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "utils/util.h"
+#include "utils/utiltime.h"
+
+#include <fstream>
+#include <limits>
+
+CApp gApp;
+
+appbase::IBaseApp *GetApp()
+{
+    return &gApp;
+}
+
+static CBenchNode *pBenchNode = nullptr;
+
+CBenchNode &CBenchNode::Get()
+{
+    if (!pBenchNode)
+    {
+        pBenchNode = new CBenchNode();
+    }
+    return *pBenchNode;
+}
+
+void CBenchNode::Shutdown()
+{
+    delete pBenchNode;
+    pBenchNode = nullptr;
+}
+
+CBenchNode::CBenchNode() : nExtraNonce(0)
+{
+    datadir = fs::temp_directory_path() / fs::unique_path("bench_sbtc_%%%%-%%%%-%%%%");
+    fs::create_directories(datadir);
+    {
+        // Only errors are logged, so the log files do not show up in the timings.
+        std::ofstream logconf((datadir / "log.conf").string());
+        logconf << "log4cpp.rootCategory=ERROR,rootlog\n"
+                << "log4cpp.appender.rootlog=FileAppender\n"
+                << "log4cpp.appender.rootlog.fileName=${logpath}/sbtc.log\n"
+                << "log4cpp.appender.rootlog.layout=PatternLayout\n"
+                << "log4cpp.appender.rootlog.layout.ConversionPattern=[%p] %d{%H:%M:%S} (%c): %m%n\n";
+    }
+
+    std::vector<std::string> args = {"bench_sbtc", "-regtest", "-datadir=" + datadir.string(), "-server=no",
+                                     "-listen=no", "-dnsseed=no", "-discover=no", "-upnp=no", "-disablewallet=yes",
+                                     "-logasync=no"};
+    std::vector<char *> argv;
+    for (auto &arg : args)
+    {
+        argv.push_back(&arg[0]);
+    }
+    int argc = (int)argv.size();
+    char **pargv = argv.data();
+
+    // The sanity checks start the ECC context again.
+    ECC_Stop();
+
+    gApp.RelayoutArgs(argc, pargv);
+    gApp.RegisterComponent(new CChainComponent);
+    gApp.RegisterComponent(new CContractComponent);
+    gApp.RegisterComponent(new CMempoolComponent);
+    gApp.RegisterComponent(new CHttpRpcComponent);
+    gApp.RegisterComponent(new CNetComponent);
+    gApp.RegisterComponent(new CWalletComponent);
+    gApp.RegisterComponent(new CMinerComponent);
+    bool fStarted = gApp.Initialize(argc, pargv) && gApp.Startup();
+    assert(fStarted);
+
+    GET_CHAIN_INTERFACE(ifChainObj);
+    while (true)
+    {
+        {
+            LOCK(cs_main);
+            if (ifChainObj->GetActiveChain().Tip())
+                break;
+        }
+        MilliSleep(10);
+    }
+
+    coinbaseKey.MakeNewKey(true);
+    keystore.AddKey(coinbaseKey);
+    coinbaseScript = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+
+    vCoinbase.resize(CHAIN_LENGTH + 1);
+    for (int i = 0; i < CHAIN_LENGTH; i++)
+    {
+        MineBlock();
+    }
+}
+
+CBenchNode::~CBenchNode()
+{
+    gApp.Shutdown();
+    fs::remove_all(datadir);
+}
+
+const CBlockIndex *CBenchNode::MineBlock()
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CChain &chainActive = ifChainObj->GetActiveChain();
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbaseScript));
+    assert(pblocktemplate);
+    CBlock *pblock = &pblocktemplate->block;
+    {
+        LOCK(cs_main);
+        SetExtraNonce(pblock, chainActive.Tip(), ++nExtraNonce);
+    }
+
+    uint32_t nNonce;
+    bool fFound = CNonceScanner(*pblock, Params().GetConsensus()).Scan(0, std::numeric_limits<uint32_t>::max(),
+                                                                       nNonce);
+    assert(fFound);
+    pblock->nNonce = nNonce;
+
+    bool fAccepted = ifChainObj->ProcessNewBlock(std::make_shared<const CBlock>(*pblock), true, nullptr);
+    assert(fAccepted);
+
+    LOCK(cs_main);
+    const CBlockIndex *pindex = chainActive.Tip();
+    assert(pindex->GetBlockHash() == pblock->GetHash());
+    if ((int)vCoinbase.size() <= pindex->nHeight)
+    {
+        vCoinbase.resize(pindex->nHeight + 1);
+    }
+    vCoinbase[pindex->nHeight] = pblock->vtx[0];
+    return pindex;
+}
+
+CTransactionRef CBenchNode::GetCoinbase(int nHeight) const
+{
+    assert(nHeight > 0 && nHeight < (int)vCoinbase.size() && vCoinbase[nHeight]);
+    return vCoinbase[nHeight];
+}
+
+CTransactionRef CBenchNode::Spend(const CTransactionRef &prev, uint32_t n, const std::vector<CTxOut> &vout) const
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(prev->GetHash(), n);
+    mtx.vout = vout;
+    bool fSigned = SignSignature(keystore, *prev, mtx, 0, SIGHASH_ALL | SIGHASH_SBTC_FORK);
+    assert(fSigned);
+    return MakeTransactionRef(std::move(mtx));
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_NODE_H
+#define BITCOIN_BENCH_BENCH_NODE_H
+
+#include "wallet/key.h"
+#include "wallet/keystore.h"
+#include "transaction/transaction.h"
+#include "script/script.h"
+#include "utils/fs.h"
+
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * A complete regtest node for the end-to-end benchmarks.
+ *
+ * It runs the same components as sbtcd in a temporary data directory, with
+ * networking and RPC turned off. The first call to Get() starts it and mines
+ * CHAIN_LENGTH blocks paying to one key, so the chain is past both the
+ * contract fork and the SBTC fork, and the coinbases below height
+ * CHAIN_LENGTH - COINBASE_MATURITY can be spent. Regtest never retargets,
+ * so mining a block costs a couple of hashes.
+ */
+class CBenchNode
+{
+public:
+    static const int CHAIN_LENGTH = 1000;
+
+    static CBenchNode &Get();
+
+    /** Stop the node if it was started and remove its data directory. */
+    static void Shutdown();
+
+    const CScript &GetCoinbaseScript() const
+    {
+        return coinbaseScript;
+    }
+
+    /** Mine a block with the current mempool on top of the tip. */
+    const CBlockIndex *MineBlock();
+
+    /** The coinbase of the block at nHeight in the active chain. */
+    CTransactionRef GetCoinbase(int nHeight) const;
+
+    /** A transaction spending output n of prev to vout, signed with the coinbase key. */
+    CTransactionRef Spend(const CTransactionRef &prev, uint32_t n, const std::vector<CTxOut> &vout) const;
+
+private:
+    CBenchNode();
+
+    ~CBenchNode();
+
+    fs::path datadir;
+    unsigned int nExtraNonce;
+
+    CKey coinbaseKey;
+    CBasicKeyStore keystore;
+    CScript coinbaseScript;
+    //! Indexed by height; blocks disconnected and reconnected by a benchmark keep their coinbase.
+    std::vector<CTransactionRef> vCoinbase;
+};
+
+#endif // BITCOIN_BENCH_BENCH_NODE_H
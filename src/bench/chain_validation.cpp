@@ -0,0 +1,321 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_node.h"
+
+#include "block/validation.h"
+#include "chaincontrol/coins.h"
+#include "config/chainparams.h"
+#include "contract-api/contractconfig.h"
+#include "contract-api/contractcomponent.h"
+#include "interface/ichaincomponent.h"
+#include "interface/icontractcomponent.h"
+#include "interface/iminercomponent.h"
+#include "interface/imempoolcomponent.h"
+#include "mempool/txmempool.h"
+#include "miner/miner.h"
+
+#include <algorithm>
+
+// End-to-end benchmarks on the regtest chain of CBenchNode. The coinbases
+// spent by each benchmark come from separate height ranges, so they can run
+// in any order and any subset.
+
+static const CAmount BENCH_TX_FEE = 10000;
+
+static const int CONNECT_BLOCKS = 1000;
+
+static const int CONTRACT_TXS = 100;
+static const int CONTRACT_FIRST_HEIGHT = 1;
+static const uint64_t CONTRACT_GAS_LIMIT = 1000000;
+
+static const int MEMPOOL_TXS = 500;
+static const int MEMPOOL_FIRST_HEIGHT = 101;
+
+static const int ASSEMBLE_FANOUT_TXS = 50;
+static const int ASSEMBLE_FANOUT_OUTPUTS = 1000;
+static const int ASSEMBLE_FIRST_HEIGHT = 601;
+static const CAmount ASSEMBLE_FANOUT_FEE = 100000;
+
+static void AcceptTransaction(CTxMemPool &mempool, const CTransactionRef &tx)
+{
+    CValidationState state;
+    bool fAccepted = mempool.AcceptToMemoryPool(state, tx, false, nullptr, nullptr, true);
+    assert(fAccepted);
+}
+
+// 50k independent spends of the outputs of fan-out transactions, which are
+// mined the first time they are needed.
+static const std::vector<CTransactionRef> &GetAssembleSpends()
+{
+    static std::vector<CTransactionRef> vSpends;
+    if (!vSpends.empty())
+        return vSpends;
+
+    CBenchNode &node = CBenchNode::Get();
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+
+    std::vector<CTransactionRef> vFanout;
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < ASSEMBLE_FANOUT_TXS; i++)
+        {
+            CTransactionRef coinbase = node.GetCoinbase(ASSEMBLE_FIRST_HEIGHT + i);
+            CAmount nValue = (coinbase->vout[0].nValue - ASSEMBLE_FANOUT_FEE) / ASSEMBLE_FANOUT_OUTPUTS;
+            std::vector<CTxOut> vout(ASSEMBLE_FANOUT_OUTPUTS, CTxOut(nValue, node.GetCoinbaseScript()));
+            vFanout.push_back(node.Spend(coinbase, 0, vout));
+            AcceptTransaction(mempool, vFanout.back());
+        }
+    }
+    while (mempool.size() > 0)
+    {
+        node.MineBlock();
+    }
+
+    for (const auto &fanout : vFanout)
+    {
+        for (uint32_t n = 0; n < fanout->vout.size(); n++)
+        {
+            CTxOut txout(fanout->vout[n].nValue - BENCH_TX_FEE, node.GetCoinbaseScript());
+            vSpends.push_back(node.Spend(fanout, n, {txout}));
+        }
+    }
+    return vSpends;
+}
+
+static void AcceptAssembleSpends(CTxMemPool &mempool)
+{
+    LOCK(cs_main);
+    for (const auto &tx : GetAssembleSpends())
+    {
+        AcceptTransaction(mempool, tx);
+    }
+}
+
+// BlockAssembler::CreateNewBlock on a mempool of 50k independent transactions.
+static void AssembleBlock50k(benchmark::State &state)
+{
+    CBenchNode &node = CBenchNode::Get();
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+    AcceptAssembleSpends(mempool);
+
+    while (state.KeepRunning())
+    {
+        std::unique_ptr<CBlockTemplate> pblocktemplate(
+                BlockAssembler(Params()).CreateNewBlock(node.GetCoinbaseScript()));
+        assert(pblocktemplate);
+    }
+
+    mempool.clear();
+}
+
+// The miner component's GetBlockTemplate on the same mempool, when one of the
+// transactions in the kept template was replaced since the last call. This is
+// what getblocktemplate costs between two blocks.
+static void AssembleBlockIncremental(benchmark::State &state)
+{
+    CBenchNode &node = CBenchNode::Get();
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    GET_MINER_INTERFACE(ifMinerObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+    AcceptAssembleSpends(mempool);
+
+    std::vector<CTransactionRef> vtx;
+    {
+        std::unique_ptr<CBlockTemplate> pblocktemplate = ifMinerObj->GetBlockTemplate(node.GetCoinbaseScript());
+        assert(pblocktemplate);
+        for (const auto &tx : pblocktemplate->block.vtx)
+        {
+            if (!tx->IsCoinBase() && !tx->IsCoinBase2())
+                vtx.push_back(tx);
+        }
+    }
+    assert(!vtx.empty());
+
+    size_t i = 0;
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        const CTransactionRef &tx = vtx[i++ % vtx.size()];
+        mempool.removeRecursive(*tx);
+        {
+            LOCK(cs_main);
+            AcceptTransaction(mempool, tx);
+        }
+        state.ResumeTiming();
+
+        std::unique_ptr<CBlockTemplate> pblocktemplate = ifMinerObj->GetBlockTemplate(node.GetCoinbaseScript());
+        assert(pblocktemplate);
+    }
+
+    // Removed one by one, so that the kept template hears about it.
+    for (const auto &tx : GetAssembleSpends())
+    {
+        mempool.removeRecursive(*tx);
+    }
+}
+
+// Reconnects the last 1000 blocks through ActivateBestChain, ConnectTip and
+// ConnectBlock. They are disconnected, untimed, with invalidateblock and
+// reconsiderblock the way the RPCs do it.
+static void ChainConnectBlocks1000(benchmark::State &state)
+{
+    CBenchNode::Get();
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CChain &chainActive = ifChainObj->GetActiveChain();
+
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        CBlockIndex *pindexTip;
+        {
+            LOCK(cs_main);
+            pindexTip = chainActive.Tip();
+            CBlockIndex *pindex = chainActive[pindexTip->nHeight - CONNECT_BLOCKS + 1];
+            CValidationState validationState;
+            bool fInvalidated = ifChainObj->InvalidateBlock(validationState, Params(), pindex);
+            assert(fInvalidated);
+            ifChainObj->ResetBlockFailureFlags(pindex);
+        }
+        state.ResumeTiming();
+
+        CValidationState validationState;
+        bool fActivated = ifChainObj->ActivateBestChain(validationState, Params(), nullptr);
+        assert(fActivated && chainActive.Tip() == pindexTip);
+    }
+}
+
+// ContractTxConnectBlock for a block of contract creations, each running a
+// storage-heavy constructor. The state the transactions wrote is rolled back
+// after every round.
+static void ContractConnectBlock(benchmark::State &state)
+{
+    CBenchNode &node = CBenchNode::Get();
+    GET_CHAIN_INTERFACE(ifChainObj);
+    GET_CONTRACT_INTERFACE(ifContractObj);
+
+    CBlock block;
+    int nHeight;
+    {
+        std::unique_ptr<CBlockTemplate> pblocktemplate(
+                BlockAssembler(Params()).CreateNewBlock(node.GetCoinbaseScript()));
+        assert(pblocktemplate);
+        block = pblocktemplate->block;
+        block.vtx.resize(1);
+        LOCK(cs_main);
+        nHeight = ifChainObj->GetActiveChain().Height() + 1;
+    }
+
+    // PUSH1 8, JUMPDEST, DUP1, DUP1, SSTORE, PUSH1 1, SWAP1, SUB, DUP1, PUSH1 2, JUMPI, STOP
+    std::vector<unsigned char> code = {0x60, 0x08, 0x5b, 0x80, 0x80, 0x55, 0x60, 0x01, 0x90, 0x03, 0x80, 0x60, 0x02,
+                                       0x57, 0x00};
+    uint64_t nGasLimit = std::min<uint64_t>(CONTRACT_GAS_LIMIT,
+                                            ifContractObj->GetBlockGasLimit(nHeight) / CONTRACT_TXS);
+    uint64_t nGasPrice = std::max<uint64_t>(ifContractObj->GetMinGasPrice(nHeight), DEFAULT_GAS_PRICE);
+    CScript scriptCreate = CScript() << CScriptNum(VersionVM::GetEVMDefault().toRaw()) << CScriptNum(nGasLimit)
+                                     << CScriptNum(nGasPrice) << code << OP_CREATE;
+    for (int i = 0; i < CONTRACT_TXS; i++)
+    {
+        CTransactionRef coinbase = node.GetCoinbase(CONTRACT_FIRST_HEIGHT + i);
+        CAmount nChange = coinbase->vout[0].nValue - nGasLimit * nGasPrice - BENCH_TX_FEE;
+        block.vtx.push_back(node.Spend(coinbase, 0, {CTxOut(0, scriptCreate),
+                                                     CTxOut(nChange, node.GetCoinbaseScript())}));
+    }
+
+    std::map<dev::Address, std::pair<CHeightTxIndexKey, std::vector<uint256>>> heightIndexes;
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        LOCK(cs_main);
+        uint256 hashStateRoot, hashUTXORoot;
+        ifContractObj->GetState(hashStateRoot, hashUTXORoot);
+        {
+            CContractBlockState contractBlockState(ifContractObj);
+            CCoinsViewCache view(ifChainObj->GetCoinsTip());
+            state.ResumeTiming();
+
+            for (uint32_t i = 1; i < block.vtx.size(); i++)
+            {
+                ByteCodeExecResult bcer;
+                int level = 0;
+                std::string errinfo;
+                bool fConnected = ifContractObj->ContractTxConnectBlock(*block.vtx[i], i, &view, block, nHeight, bcer,
+                                                                        false, true, heightIndexes, level, errinfo);
+                assert(fConnected);
+            }
+
+            state.PauseTiming();
+        }
+        ifContractObj->UpdateState(hashStateRoot, hashUTXORoot);
+        ifContractObj->ClearCacheResult();
+        state.ResumeTiming();
+    }
+}
+
+// AcceptToMemoryPool throughput for independent signed spends of confirmed
+// coinbases. Every round signs new transactions so that neither the signature
+// cache nor the script execution cache is hit. With fPreVerify the scripts are
+// first verified as one batch on the mempool verification threads.
+static void MempoolAccept(benchmark::State &state, bool fPreVerify)
+{
+    // Shared by both benchmarks, so the second one does not sign the transactions of the first again.
+    static CAmount nFee = BENCH_TX_FEE;
+
+    CBenchNode &node = CBenchNode::Get();
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+
+    std::vector<CTransactionRef> vtx(MEMPOOL_TXS);
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        nFee++;
+        for (int i = 0; i < MEMPOOL_TXS; i++)
+        {
+            CTransactionRef coinbase = node.GetCoinbase(MEMPOOL_FIRST_HEIGHT + i);
+            vtx[i] = node.Spend(coinbase, 0, {CTxOut(coinbase->vout[0].nValue - nFee, node.GetCoinbaseScript())});
+        }
+        state.ResumeTiming();
+
+        if (fPreVerify)
+        {
+            std::vector<std::vector<COutPoint>> vCoinsToUncache;
+            ifTxMempoolObj->PreVerifyTransactions(vtx, vCoinsToUncache);
+        }
+        {
+            LOCK(cs_main);
+            for (const auto &tx : vtx)
+            {
+                AcceptTransaction(mempool, tx);
+            }
+        }
+
+        state.PauseTiming();
+        for (const auto &tx : vtx)
+        {
+            mempool.removeRecursive(*tx);
+        }
+        state.ResumeTiming();
+    }
+}
+
+static void MempoolAcceptTransactions(benchmark::State &state)
+{
+    MempoolAccept(state, false);
+}
+
+static void MempoolAcceptPreVerified(benchmark::State &state)
+{
+    MempoolAccept(state, true);
+}
+
+BENCHMARK(AssembleBlock50k);
+BENCHMARK(AssembleBlockIncremental);
+BENCHMARK(ChainConnectBlocks1000);
+BENCHMARK(ContractConnectBlock);
+BENCHMARK(MempoolAcceptTransactions);
+BENCHMARK(MempoolAcceptPreVerified);
@@ -3,11 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "bench_node.h"
 
 #include "config/chainparams.h"
 #include "block/validation.h"
+#include "block/merkle.h"
 #include "sbtccore/streams.h"
 #include "chaincontrol/validation.h"
+#include "interface/ichaincomponent.h"
 
 namespace block_bench
 {
@@ -45,6 +48,8 @@ static void DeserializeAndCheckBlockTest(benchmark::State &state)
     stream.write(&a, 1); // Prevent compaction
 
     const auto chainParams = CreateChainParams(CChainParams::MAIN);
+    CBenchNode::Get();
+    GET_CHAIN_INTERFACE(ifChainObj);
 
     while (state.KeepRunning())
     {
@@ -53,9 +58,26 @@ static void DeserializeAndCheckBlockTest(benchmark::State &state)
         assert(stream.Rewind(sizeof(block_bench::block413567)));
 
         CValidationState validationState;
-        assert(CheckBlock(block, validationState, chainParams->GetConsensus()));
+        assert(ifChainObj->CheckBlock(block, validationState, chainParams->GetConsensus(), true, true));
+    }
+}
+
+static void BlockMerkleRootTest(benchmark::State &state)
+{
+    CDataStream stream((const char *)block_bench::block413567,
+                       (const char *)&block_bench::block413567[sizeof(block_bench::block413567)],
+                       SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    while (state.KeepRunning())
+    {
+        bool mutated;
+        uint256 root = BlockMerkleRoot(block, &mutated);
+        assert(root == block.hashMerkleRoot && !mutated);
     }
 }
 
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(BlockMerkleRootTest);
@@ -54,6 +54,15 @@ static void SHA256_32b(benchmark::State &state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State &state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning())
+    {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
 static void SHA512(benchmark::State &state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -106,6 +115,7 @@ BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
 BENCHMARK(SipHash_32b);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
@@ -0,0 +1,6 @@
+# Turns a raw binary file into a C array for the benchmarks.
+# Usage: cmake -DRAW_FILE=<in> -DHEADER_FILE=<out> -DARRAY_NAME=<name> -P rawtoheader.cmake
+
+file(READ ${RAW_FILE} hex HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+file(WRITE ${HEADER_FILE} "static unsigned const char ${ARRAY_NAME}[] = {\n${bytes}\n};\n")
@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include <map>
+#include <libevm/VM.h>
+#include <libevm/ExtVMFace.h>
+
+// These benchmarks drive the interpreter directly, without a state or an
+// Executive, so that only opcode dispatch and the opcodes themselves are
+// measured. The dispatch mode is fixed at compile time (see VMConfig.h):
+// run them once from a default build (jump table) and once from a build
+// configured with -DEVM_JUMP_DISPATCH=false (switch loop) to compare.
+
+using namespace dev;
+using namespace dev::eth;
+
+static const unsigned int EVM_LOOP_ITERATIONS = 1000;
+
+class BenchExtVM : public ExtVMFace
+{
+public:
+    BenchExtVM(EnvInfo const &_envInfo, bytes const &_code)
+            : ExtVMFace(_envInfo, Address(), Address(), Address(), 0, 0, bytesConstRef(), _code, sha3(_code), 0)
+    {
+    }
+
+    u256 store(u256 _key) override
+    {
+        auto it = storage.find(_key);
+        return it == storage.end() ? 0 : it->second;
+    }
+
+    void setStore(u256 _key, u256 _value) override
+    {
+        storage[_key] = _value;
+    }
+
+    boost::optional<owning_bytes_ref> call(CallParameters &) override
+    {
+        return boost::none;
+    }
+
+    EVMSchedule const &evmSchedule() const override
+    {
+        return EIP158Schedule;
+    }
+
+    std::map<u256, u256> storage;
+};
+
+// PUSH2 <n>, JUMPDEST, <body>, PUSH1 1, SWAP1, SUB, DUP1, PUSH1 3, JUMPI, STOP
+static bytes LoopCode(bytes const &body)
+{
+    bytes code = {0x61, (byte)(EVM_LOOP_ITERATIONS >> 8), (byte)EVM_LOOP_ITERATIONS, 0x5b};
+    code.insert(code.end(), body.begin(), body.end());
+    bytes tail = {0x60, 0x01, 0x90, 0x03, 0x80, 0x60, 0x03, 0x57, 0x00};
+    code.insert(code.end(), tail.begin(), tail.end());
+    return code;
+}
+
+static void RunLoop(benchmark::State &state, bytes const &body)
+{
+    EnvInfo envInfo;
+    envInfo.setGasLimit(std::numeric_limits<int64_t>::max());
+    bytes code = LoopCode(body);
+    while (state.KeepRunning())
+    {
+        BenchExtVM ext(envInfo, code);
+        VM vm;
+        u256 gas = std::numeric_limits<int64_t>::max();
+        vm.exec(gas, ext, OnOpFunc());
+    }
+}
+
+static void EVMArithmeticLoop(benchmark::State &state)
+{
+    // DUP1, DUP1, MUL, DUP2, ADD, PUSH1 7, MOD, POP
+    RunLoop(state, {0x80, 0x80, 0x02, 0x81, 0x01, 0x60, 0x07, 0x06, 0x50});
+}
+
+static void EVMStorageLoop(benchmark::State &state)
+{
+    // DUP1, DUP1, SSTORE
+    RunLoop(state, {0x80, 0x80, 0x55});
+}
+
+static void EVMKeccakLoop(benchmark::State &state)
+{
+    // DUP1, PUSH1 0, MSTORE, PUSH1 32, PUSH1 0, SHA3, POP
+    RunLoop(state, {0x80, 0x60, 0x00, 0x52, 0x60, 0x20, 0x60, 0x00, 0x20, 0x50});
+}
+
+BENCHMARK(EVMArithmeticLoop);
+BENCHMARK(EVMStorageLoop);
+BENCHMARK(EVMKeccakLoop);
@@ -0,0 +1,89 @@
+// Copyright (c) 2011-2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "sbtccore/transaction/policy.h"
+#include "mempool/txmempool.h"
+
+#include <cassert>
+#include <vector>
+
+static const int CHAIN_LENGTH = 500;
+static const int BLOCK_TXS = 50;
+
+static void AddTx(const CTransactionRef &tx, CTxMemPool &pool)
+{
+    LockPoints lp;
+    pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, false, 4, lp));
+}
+
+static std::vector<CTransactionRef> CreateChain(int nLength)
+{
+    std::vector<CTransactionRef> vtx;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    for (int i = 0; i < nLength; i++)
+    {
+        vtx.push_back(MakeTransactionRef(tx));
+        tx.vin[0].prevout = COutPoint(vtx.back()->GetHash(), 0);
+    }
+    return vtx;
+}
+
+// A long chain of unconfirmed transactions mined a block at a time: each
+// block updates the ancestor state of the rest of the chain.
+static void MempoolRemoveForBlockChain(benchmark::State &state)
+{
+    const std::vector<CTransactionRef> vtx = CreateChain(CHAIN_LENGTH);
+    CTxMemPool pool;
+
+    while (state.KeepRunning())
+    {
+        for (const CTransactionRef &tx : vtx)
+        {
+            AddTx(tx, pool);
+        }
+        for (int i = 0; i < CHAIN_LENGTH; i += BLOCK_TXS)
+        {
+            std::vector<CTransactionRef> vBlock(vtx.begin() + i, vtx.begin() + i + BLOCK_TXS);
+            pool.removeForBlock(vBlock, 1);
+        }
+        assert(pool.size() == 0);
+    }
+}
+
+// The head of a long chain comes back from a disconnected block while its
+// tail is still in the mempool.
+static void MempoolUpdateFromBlockChain(benchmark::State &state)
+{
+    const std::vector<CTransactionRef> vtx = CreateChain(CHAIN_LENGTH);
+    std::vector<uint256> vHashesToUpdate;
+    for (int i = 0; i < CHAIN_LENGTH / 2; i++)
+    {
+        vHashesToUpdate.push_back(vtx[i]->GetHash());
+    }
+    CTxMemPool pool;
+
+    while (state.KeepRunning())
+    {
+        for (int i = CHAIN_LENGTH / 2; i < CHAIN_LENGTH; i++)
+        {
+            AddTx(vtx[i], pool);
+        }
+        for (int i = 0; i < CHAIN_LENGTH / 2; i++)
+        {
+            AddTx(vtx[i], pool);
+        }
+        pool.UpdateTransactionsFromBlock(vHashesToUpdate);
+        assert(pool.mapTx.find(vtx[0]->GetHash())->GetCountWithDescendants() == CHAIN_LENGTH);
+        pool.clear();
+    }
+}
+
+BENCHMARK(MempoolRemoveForBlockChain);
+BENCHMARK(MempoolUpdateFromBlockChain);
@@ -113,3 +113,44 @@ static void MempoolEviction(benchmark::State &state)
 }
 
 BENCHMARK(MempoolEviction);
+
+// Fills a mempool with chains of transactions and trims it back, for the cost
+// of the mempool's own bookkeeping: the entries, their links and the indexes.
+static void MempoolEvictionChains(benchmark::State &state)
+{
+    const int nChains = 500;
+    const int nChainLength = 4;
+
+    std::vector<CTransactionRef> vtx;
+    for (int i = 0; i < nChains; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << i;
+        tx.vout.resize(2);
+        for (int j = 0; j < nChainLength; j++)
+        {
+            tx.vout[0].scriptPubKey = CScript() << j << OP_EQUAL;
+            tx.vout[0].nValue = 10 * COIN;
+            tx.vout[1].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            tx.vout[1].nValue = COIN;
+            vtx.push_back(MakeTransactionRef(tx));
+            tx.vin[0].prevout = COutPoint(vtx.back()->GetHash(), 0);
+            tx.vin[0].scriptSig = CScript() << OP_1;
+        }
+    }
+
+    CTxMemPool pool;
+
+    while (state.KeepRunning())
+    {
+        for (size_t i = 0; i < vtx.size(); i++)
+        {
+            AddTx(*vtx[i], 1000 + (i * 7919) % 10000, pool);
+        }
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+        pool.TrimToSize(0);
+    }
+}
+
+BENCHMARK(MempoolEvictionChains);
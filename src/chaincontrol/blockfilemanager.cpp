@@ -11,6 +11,7 @@
 #include "utils/utilstrencodings.h"
 #include "sbtccore/streams.h"
 #include "sbtccore/clientversion.h"
+#include "utils/hash.h"
 
 SET_CPP_SCOPED_LOG_CATEGORY(CID_BLOCK_CHAIN);
 
@@ -103,6 +104,74 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char> &vBlock, const CDiskBlockPos &pos, const uint256 &hashBlock,
+                          const CMessageHeader::MessageStartChars &messageStart)
+{
+    // The block is preceded by the message start and its size, see WriteBlockToDisk.
+    static const unsigned int BLOCK_HEADER_PREFIX = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nPos < BLOCK_HEADER_PREFIX)
+    {
+        ELogFormat("ReadRawBlockFromDisk: no block at %s", pos.ToString());
+        return false;
+    }
+
+    CDiskBlockPos posPrefix(pos.nFile, pos.nPos - BLOCK_HEADER_PREFIX);
+    CAutoFile filein(OpenBlockFile(posPrefix, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+    {
+        ELogFormat("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        return false;
+    }
+
+    try
+    {
+        CMessageHeader::MessageStartChars blockStart;
+        unsigned int nSize;
+        filein >> FLATDATA(blockStart) >> nSize;
+        if (memcmp(blockStart, messageStart, CMessageHeader::MESSAGE_START_SIZE) ||
+            nSize < 80 || nSize > MAX_SIZE)
+        {
+            ELogFormat("ReadRawBlockFromDisk: bad block prefix at %s", pos.ToString());
+            return false;
+        }
+        vBlock.resize(nSize);
+        filein.read((char *)vBlock.data(), nSize);
+    }
+    catch (const std::exception &e)
+    {
+        ELogFormat("Read error - %s at %s", e.what(), pos.ToString());
+        return false;
+    }
+
+    // The header is the first 80 bytes, and is all that goes into the hash.
+    if (Hash(vBlock.begin(), vBlock.begin() + 80) != hashBlock)
+    {
+        ELogFormat("ReadRawBlockFromDisk: hash doesn't match index for %s at %s", hashBlock.ToString(),
+                   pos.ToString());
+        return false;
+    }
+    return true;
+}
+
+VM_STATE_ROOT GetBlockVMState(const CBlockIndex *pindex, uint256 &hashStateRoot, uint256 &hashUTXORoot,
+                              const Consensus::Params &consensusParams)
+{
+    if (pindex->HaveVMState())
+    {
+        hashStateRoot = pindex->hashStateRoot;
+        hashUTXORoot = pindex->hashUTXORoot;
+        return pindex->IsSBTCContractEnabled() ? RET_VM_STATE_OK : RET_CONTRACT_UNENBALE;
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, consensusParams))
+    {
+        ELogFormat("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        return RET_VM_STATE_ERR;
+    }
+    return block.GetVMState(hashStateRoot, hashUTXORoot);
+}
+
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos, const uint256 &hashBlock)
 {
     // Open history file to read
@@ -30,6 +30,18 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos, const Consensus:
 
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex, const Consensus::Params &consensusParams);
 
+/**
+ * Read a block as it is stored, which is its serialization with witnesses,
+ * without deserializing it. Needs no lock: the position and hash are to be
+ * taken from the index entry beforehand.
+ */
+bool ReadRawBlockFromDisk(std::vector<unsigned char> &vBlock, const CDiskBlockPos &pos, const uint256 &hashBlock,
+                          const CMessageHeader::MessageStartChars &messageStart);
+
+/** Contract state roots of a block, from its index entry or from disk for entries that don't carry them */
+VM_STATE_ROOT GetBlockVMState(const CBlockIndex *pindex, uint256 &hashStateRoot, uint256 &hashUTXORoot,
+                              const Consensus::Params &consensusParams);
+
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos, const uint256 &hashBlock);
 
 bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos, const CMessageHeader::MessageStartChars &messageStart);
@@ -0,0 +1,201 @@
+#include "blockfilterindex.h"
+#include "blockfilemanager.h"
+#include "chain.h"
+#include "config/chainparams.h"
+#include "interface/ichaincomponent.h"
+#include "sbtccore/block/validation.h"
+#include "sbtcd/baseimpl.hpp"
+#include "utils/util.h"
+
+static const char DB_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory, bool fWipe)
+        : filterType(filterTypeIn),
+          db(GetDataDir() / "indexes" / "blockfilter" / BlockFilterTypeName(filterTypeIn), nCacheSize, fMemory, fWipe),
+          pindexBest(nullptr), fSynced(false), fInterrupt(false), fSyncWake(false)
+{
+    uint256 hashBest;
+    if (db.Read(DB_BEST_BLOCK, hashBest))
+    {
+        GET_CHAIN_INTERFACE(ifChainObj);
+        LOCK(cs_main);
+        pindexBest = ifChainObj->GetBlockIndex(hashBest);
+    }
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+    Stop();
+}
+
+void CBlockFilterIndex::Start()
+{
+    fInterrupt = false;
+    RegisterValidationInterface(this);
+    threadSync = std::thread(&TraceThread<std::function<void()> >, "blkfilter",
+                             std::function<void()>(std::bind(&CBlockFilterIndex::ThreadSync, this)));
+}
+
+void CBlockFilterIndex::Stop()
+{
+    UnregisterValidationInterface(this);
+    {
+        std::lock_guard<std::mutex> lock(mutexSync);
+        fInterrupt = true;
+    }
+    condSync.notify_all();
+    if (threadSync.joinable())
+        threadSync.join();
+}
+
+void CBlockFilterIndex::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork,
+                                        bool fInitialDownload)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexSync);
+        fSyncWake = true;
+    }
+    condSync.notify_one();
+}
+
+bool CBlockFilterIndex::ReadEntry(const uint256 &hashBlock, CFilterEntry &entry) const
+{
+    return db.Read(std::make_pair(DB_FILTER, hashBlock), entry);
+}
+
+bool CBlockFilterIndex::WriteBlock(const CBlockIndex *pindex)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return rLogError("%s: failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+
+    CBlockUndo blockundo;
+    uint256 hashPrevHeader;
+    if (pindex->pprev)
+    {
+        if (!UndoReadFromDisk(blockundo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))
+            return rLogError("%s: failed to read undo data of block %s from disk", __func__,
+                             pindex->GetBlockHash().ToString());
+
+        CFilterEntry prevEntry;
+        if (!ReadEntry(pindex->pprev->GetBlockHash(), prevEntry))
+            return rLogError("%s: filter of block %s is not indexed", __func__,
+                             pindex->pprev->GetBlockHash().ToString());
+        hashPrevHeader = prevEntry.header;
+    }
+
+    BlockFilter filter(filterType, block, blockundo);
+    CFilterEntry entry;
+    entry.hash = filter.GetHash();
+    entry.header = filter.ComputeHeader(hashPrevHeader);
+    entry.filter = filter.GetEncodedFilter();
+
+    CDBBatch batch(db);
+    batch.Write(std::make_pair(DB_FILTER, pindex->GetBlockHash()), entry);
+    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+    if (!db.WriteBatch(batch))
+        return rLogError("%s: failed to write filter of block %s", __func__, pindex->GetBlockHash().ToString());
+
+    pindexBest = pindex;
+    return true;
+}
+
+void CBlockFilterIndex::ThreadSync()
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    int64_t nLastLog = 0;
+    while (!fInterrupt)
+    {
+        const CBlockIndex *pindexNext = nullptr;
+        {
+            LOCK(cs_main);
+            const CChain &chainActive = ifChainObj->GetActiveChain();
+            const CBlockIndex *pindex = pindexBest;
+            if (pindex == nullptr)
+                pindexNext = chainActive.Genesis();
+            else
+                pindexNext = chainActive.Next(chainActive.FindFork(pindex));
+            fSynced = pindexNext == nullptr;
+        }
+
+        if (pindexNext == nullptr)
+        {
+            std::unique_lock<std::mutex> lock(mutexSync);
+            condSync.wait_for(lock, std::chrono::seconds(10), [this]
+            { return fSyncWake || fInterrupt; });
+            fSyncWake = false;
+            continue;
+        }
+
+        if (!WriteBlock(pindexNext))
+        {
+            // The block may have been pruned or reorganised away meanwhile: retry
+            // from the active chain later.
+            std::unique_lock<std::mutex> lock(mutexSync);
+            condSync.wait_for(lock, std::chrono::seconds(10), [this]
+            { return fInterrupt.load(); });
+            continue;
+        }
+
+        int64_t nNow = GetTime();
+        if (nNow - nLastLog >= 30)
+        {
+            NLogFormat("Syncing %s block filter index with block chain from height %d", BlockFilterTypeName(filterType),
+                       pindexNext->nHeight);
+            nLastLog = nNow;
+        }
+    }
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex *pindex, BlockFilter &filter) const
+{
+    CFilterEntry entry;
+    if (!ReadEntry(pindex->GetBlockHash(), entry))
+        return false;
+
+    filter = BlockFilter(filterType, pindex->GetBlockHash(), std::move(entry.filter));
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex *pindex, uint256 &header) const
+{
+    CFilterEntry entry;
+    if (!ReadEntry(pindex->GetBlockHash(), entry))
+        return false;
+
+    header = entry.header;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex *pindexStop,
+                                          std::vector<BlockFilter> &filters) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+
+    filters.resize(pindexStop->nHeight - nStartHeight + 1);
+    for (const CBlockIndex *pindex = pindexStop; pindex && pindex->nHeight >= nStartHeight; pindex = pindex->pprev)
+    {
+        if (!LookupFilter(pindex, filters[pindex->nHeight - nStartHeight]))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex *pindexStop,
+                                              std::vector<uint256> &hashes) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+
+    hashes.resize(pindexStop->nHeight - nStartHeight + 1);
+    for (const CBlockIndex *pindex = pindexStop; pindex && pindex->nHeight >= nStartHeight; pindex = pindex->pprev)
+    {
+        CFilterEntry entry;
+        if (!ReadEntry(pindex->GetBlockHash(), entry))
+            return false;
+        hashes[pindex->nHeight - nStartHeight] = entry.hash;
+    }
+    return true;
+}
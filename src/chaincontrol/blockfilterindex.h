@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "framework/validationinterface.h"
+#include "sbtccore/block/blockfilter.h"
+#include "utils/dbwrapper.h"
+
+class CBlockIndex;
+
+/** Default for -blockfilterindex */
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+//! Max memory allocated to the block filter index DB specific cache (MiB)
+static const int64_t nMaxBlockFilterIndexCache = 1024;
+/** Interval between the filter headers sent in a cfcheckpt message */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * Index of the filters (BIP 158) of the blocks of the active chain, in its own
+ * database under indexes/blockfilter/<type>. The filters are computed by a
+ * background thread from the blocks and undo data on disk: it catches up with
+ * the chain at startup, and is woken when the tip changes, so that connecting
+ * blocks is not slowed down.
+ *
+ * Entries are keyed by block hash, so the ones of blocks disconnected by a
+ * reorganisation stay valid, and lookups walk the block index to find the
+ * blocks of a range.
+ */
+class CBlockFilterIndex : public CValidationInterface
+{
+public:
+    CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    ~CBlockFilterIndex();
+
+    /** Start the thread building the index. */
+    void Start();
+
+    /** Interrupt and join the thread building the index. */
+    void Stop();
+
+    BlockFilterType GetFilterType() const
+    {
+        return filterType;
+    }
+
+    /** Whether the index has caught up with the tip of the active chain. */
+    bool IsSynced() const
+    {
+        return fSynced;
+    }
+
+    /** The last block indexed, or nullptr. */
+    const CBlockIndex *GetBestBlockIndex() const
+    {
+        return pindexBest;
+    }
+
+    bool LookupFilter(const CBlockIndex *pindex, BlockFilter &filter) const;
+
+    bool LookupFilterHeader(const CBlockIndex *pindex, uint256 &header) const;
+
+    /** The filters of the blocks from nStartHeight to pindexStop, false unless all are indexed. */
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex *pindexStop, std::vector<BlockFilter> &filters) const;
+
+    /** The filter hashes of the blocks from nStartHeight to pindexStop, false unless all are indexed. */
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex *pindexStop, std::vector<uint256> &hashes) const;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
+private:
+    struct CFilterEntry
+    {
+        uint256 hash;    //!< Hash of the encoded filter
+        uint256 header;  //!< Filter header, committing to the previous ones
+        std::vector<unsigned char> filter;
+
+        ADD_SERIALIZE_METHODS;
+
+        template<typename Stream, typename Operation>
+        inline void SerializationOp(Stream &s, Operation ser_action)
+        {
+            READWRITE(hash);
+            READWRITE(header);
+            READWRITE(filter);
+        }
+    };
+
+    const BlockFilterType filterType;
+    CDBWrapper db;
+
+    std::atomic<const CBlockIndex *> pindexBest;
+    std::atomic<bool> fSynced;
+    std::atomic<bool> fInterrupt;
+
+    std::thread threadSync;
+    std::mutex mutexSync;
+    std::condition_variable condSync;
+    /** Set to wake the sync thread, protected by mutexSync */
+    bool fSyncWake;
+
+    bool ReadEntry(const uint256 &hashBlock, CFilterEntry &entry) const;
+
+    /** Compute and store the filter of a block whose parent is indexed. */
+    bool WriteBlock(const CBlockIndex *pindex);
+
+    void ThreadSync();
+};
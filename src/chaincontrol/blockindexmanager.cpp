@@ -473,6 +473,44 @@ bool CBlockIndexManager::LoadBlockIndexDB(const Consensus::Params &consensus)
 
     pBlcokTreee->ReadFlag("logevents", bLogEvents);//sbtc-vm
     NLogFormat("logevents %s", bLogEvents ? "enabled" : "disabled");
+
+    return UpgradeVMStateIndex(consensus);
+}
+
+//sbtc-vm, index entries written before the state roots were stored get them from their block once
+bool CBlockIndexManager::UpgradeVMStateIndex(const Consensus::Params &consensus)
+{
+    int iUpgraded = 0;
+    for (const auto &item : mBlockIndex)
+    {
+        CBlockIndex *pIndex = item.second;
+        if (pIndex->HaveVMState() || !(pIndex->nStatus & BLOCK_HAVE_DATA) ||
+            !pIndex->IsValid(BLOCK_VALID_SCRIPTS) || pIndex->nHeight <= consensus.SBTCContractForkHeight)
+        {
+            continue;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pIndex, consensus))
+        {
+            return rLogError("%s: ReadBlockFromDisk failed at %d, hash=%s", __func__, pIndex->nHeight,
+                             pIndex->GetBlockHash().ToString());
+        }
+        if (block.GetVMState(pIndex->hashStateRoot, pIndex->hashUTXORoot) != RET_VM_STATE_OK)
+        {
+            return rLogError("%s: GetVMState failed at %d, hash=%s", __func__, pIndex->nHeight,
+                             pIndex->GetBlockHash().ToString());
+        }
+        pIndex->nStatus |= BLOCK_HAVE_VM_STATE;
+        setDirtyBlockIndex.insert(pIndex);
+        iUpgraded++;
+    }
+
+    if (iUpgraded > 0)
+    {
+        NLogFormat("upgraded %d block index entries with contract state roots", iUpgraded);
+        return Flush();
+    }
     return true;
 }
 
@@ -233,6 +233,8 @@ private:
 
     bool LoadBlockIndexDB(const Consensus::Params &consensus);
 
+    bool UpgradeVMStateIndex(const Consensus::Params &consensus);
+
     void UnLoadBlockIndex();
 
     //! Returns last CBlockIndex* in mapBlockIndex that is a checkpoint
@@ -185,6 +185,8 @@ enum BlockStatus : uint32_t
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS = 128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_HAVE_VM_STATE = 256, //!< hashStateRoot/hashUTXORoot of the block are stored in the index
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -243,6 +245,10 @@ public:
     //! (memory only) Maximum nTime in the chain upto and including this block.
     unsigned int nTimeMax;
 
+    //! contract state roots committed by this block's coinbase2, valid if HaveVMState()
+    uint256 hashStateRoot;
+    uint256 hashUTXORoot;
+
     void SetNull()
     {
         phashBlock = nullptr;
@@ -258,6 +264,8 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        hashStateRoot = uint256();
+        hashUTXORoot = uint256();
 
         nVersion = 0;
         hashMerkleRoot = uint256();
@@ -322,6 +330,12 @@ public:
         return (nVersion & (((uint32_t)1) << VERSIONBITS_SBTC_CONTRACT));
     }
 
+    //! Whether hashStateRoot/hashUTXORoot can be used without reading the block. Blocks without contracts have none.
+    bool HaveVMState() const
+    {
+        return !IsSBTCContractEnabled() || (nStatus & BLOCK_HAVE_VM_STATE);
+    }
+
 
     uint256 GetBlockHash() const
     {
@@ -450,6 +464,13 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
+
+        //sbtc-vm, entries written before the roots were indexed don't carry them
+        if (nStatus & BLOCK_HAVE_VM_STATE)
+        {
+            READWRITE(hashStateRoot);
+            READWRITE(hashUTXORoot);
+        }
     }
 
     uint256 GetBlockHash() const
@@ -114,6 +114,7 @@ bool CChainComponent::ComponentInitialize()
     bReIndex = Args().GetArg<bool>("-reindex", false);
     bool bReindexChainState = Args().GetArg<bool>("-reindex-chainstate", false);
     bool bTxIndex = Args().GetArg<bool>("-txindex", DEFAULT_TXINDEX);
+    bool bBlockFilterIndex = Args().GetArg<bool>("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
 
     // cache size calculations
     int64_t iTotalCache = (Args().GetArg<int64_t>("-dbcache", nDefaultDbCache) << 20);
@@ -124,6 +125,8 @@ bool CChainComponent::ComponentInitialize()
                                  (Args().GetArg<bool>("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache
                                                                                    : nMaxBlockDBCache) << 20);
     iTotalCache -= iBlockTreeDBCache;
+    int64_t iFilterIndexCache = bBlockFilterIndex ? std::min(iTotalCache / 8, nMaxBlockFilterIndexCache << 20) : 0;
+    iTotalCache -= iFilterIndexCache;
     int64_t iCoinDBCache = std::min(iTotalCache / 2,
                                     (iTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     iCoinDBCache = std::min(iCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
@@ -131,6 +134,8 @@ bool CChainComponent::ComponentInitialize()
     iCoinCacheUsage = iTotalCache; // the rest goes to in-memory cache
     NLogFormat("Cache configuration:");
     NLogFormat("* Using %.1fMiB for block index database", iBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (bBlockFilterIndex)
+        NLogFormat("* Using %.1fMiB for block filter index database", iFilterIndexCache * (1.0 / 1024 / 1024));
     NLogFormat("* Using %.1fMiB for chain state database", iCoinDBCache * (1.0 / 1024 / 1024));
     NLogFormat("* Using %.1fMiB for in-memory UTXO set ", iCoinCacheUsage * (1.0 / 1024 / 1024));
 
@@ -307,6 +312,12 @@ bool CChainComponent::ComponentInitialize()
         NLogFormat(" block index %15dms", GetTimeMillis() - iStart);
     }
 
+    if (bBlockFilterIndex)
+    {
+        pBlockFilterIndex.reset(new CBlockFilterIndex(BASIC_FILTER, iFilterIndexCache, false, bReIndex));
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     // if pruning, unset the service bit and perform the initial blockstore prune
     // after any wallet rescanning has taken place.
     if (fPruneMode)
@@ -341,6 +352,9 @@ bool CChainComponent::ComponentStartup()
     NLogStream() << "startup chain component";
     bRequestShutdown = false;
 
+    if (pBlockFilterIndex)
+        pBlockFilterIndex->Start();
+
     ThreadImport();
     //    std::thread t(&CChainComponent::ThreadImport, this);
     //    t.detach();
@@ -354,6 +368,9 @@ bool CChainComponent::ComponentShutdown()
     threadGroup.interrupt_all();
     threadGroup.join_all();
 
+    if (pBlockFilterIndex)
+        pBlockFilterIndex->Stop();
+
     if (cViewManager.GetCoinsTip() != nullptr)
     {
         FlushStateToDisk();
@@ -388,6 +405,11 @@ bool CChainComponent::IsTxIndex() const
     return cIndexManager.IsTxIndex();
 }
 
+CBlockFilterIndex *CChainComponent::GetBlockFilterIndex()
+{
+    return pBlockFilterIndex.get();
+}
+
 bool CChainComponent::IsLogEvents()
 {
     bool IsEnabled =  [&]()->bool{
@@ -1194,6 +1216,8 @@ CChainComponent::ConnectBlock(const CBlock &block, CValidationState &state, CBlo
 
     //sbtc-vm
     GET_CONTRACT_INTERFACE(ifContractObj);
+    // contract execution of this block stays in memory until the block is fully connected
+    CContractBlockState contractBlockState(ifContractObj);
     CBlock checkBlock(block.GetBlockHeader());
     std::vector<CTxOut> checkVouts;
 
@@ -1370,10 +1394,11 @@ CChainComponent::ConnectBlock(const CBlock &block, CValidationState &state, CBlo
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
+            // Contract and OP_SPEND scripts only depend on the transaction and the spent output, so they are
+            // verified by the check queue like any other input while the EVM runs below. If one fails after
+            // its contract has executed, the block is rejected and contractBlockState drops the execution.
             if (!tx.CheckInputs(state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i],
-                    //                                nScriptCheckThreads ? &vChecks : nullptr))
-                                (hasOpSpend || tx.HasCreateOrCall()) ? nullptr : (nScriptCheckThreads ? &vChecks
-                                                                                                      : nullptr)))
+                                nScriptCheckThreads ? &vChecks : nullptr))
             {
                 return rLogError("CheckInputs on %s failed with %s",
                                  tx.GetHash().ToString(), FormatStateMessage(state));
@@ -1585,16 +1610,13 @@ CChainComponent::ConnectBlock(const CBlock &block, CValidationState &state, CBlo
 
         uint256 hashStateRoot;
         uint256 hashUTXORoot;
-        CBlock prevblock;
-        if (ReadBlockFromDisk(prevblock, pindex->pprev, Params().GetConsensus())) {
-            if(prevblock.GetVMState(hashStateRoot, hashUTXORoot) == RET_VM_STATE_ERR)
-            {
-                ILogFormat("GetVMState err");
-                return false;
-            }
+        if (GetBlockVMState(pindex->pprev, hashStateRoot, hashUTXORoot, chainparams.GetConsensus()) ==
+            RET_VM_STATE_ERR)
+        {
+            ILogFormat("GetVMState err");
+            return false;
         }
 
-//        if (pindex->pprev->hashStateRoot != uint256() && pindex->pprev->hashUTXORoot != uint256())
         if (hashStateRoot != uint256() && hashUTXORoot != uint256()) {
             prevHashStateRoot = hashStateRoot;
             prevHashUTXORoot = hashUTXORoot;
@@ -1627,6 +1649,13 @@ CChainComponent::ConnectBlock(const CBlock &block, CValidationState &state, CBlo
         cIndexManager.SetDirtyIndex(pindex);
     }
     //sbtc-vm
+    if (!(pindex->nStatus & BLOCK_HAVE_VM_STATE))
+    {
+        pindex->hashStateRoot = blockhashStateRoot;
+        pindex->hashUTXORoot = blockhashUTXORoot;
+        pindex->nStatus |= BLOCK_HAVE_VM_STATE;
+        cIndexManager.SetDirtyIndex(pindex);
+    }
     if (IsLogEvents())
     {
         for (const auto &e: heightIndexes)
@@ -1651,6 +1680,7 @@ CChainComponent::ConnectBlock(const CBlock &block, CValidationState &state, CBlo
     nTimeCallbacks += nTime6 - nTime5;
     ILogFormat("Callbacks: %.2fms [%.2fs]", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
     //sbtc-vm
+    contractBlockState.Commit();
     if (IsLogEvents())
     {
         ifContractObj->CommitResults();
@@ -6,6 +6,7 @@
 #include "interface/ichaincomponent.h"
 #include "blockfilemanager.h"
 #include "blockindexmanager.h"
+#include "blockfilterindex.h"
 #include "viewmanager.h"
 #include "mempool/txmempool.h"
 #include "sbtccore/checkqueue.h"
@@ -180,6 +181,8 @@ public:
 
     bool IsTxIndex() const override;
 
+    CBlockFilterIndex *GetBlockFilterIndex() override;
+
     bool IsLogEvents() override;
 
     bool IsInitialBlockDownload() override;
@@ -295,6 +298,8 @@ private:
     uint256 hashAssumeValid;
 
     boost::thread_group threadGroup;
+    /** Filter index built when -blockfilterindex is set */
+    std::unique_ptr<CBlockFilterIndex> pBlockFilterIndex;
     CCheckQueue<CScriptCheck> scriptCheckQueue;
     int nScriptCheckThreads = 0;
 
@@ -551,123 +551,175 @@ bool CChainComponent::NetRequestBlockData(ExNode *xnode, uint256 blockHash, int
         fWitnessesPresentInARecentCompactBlock = fWitnessesPresentInMostRecentCompactBlock;
     }
 
-    CBlockIndex *bi = cIndexManager.GetBlockIndex(blockHash);
-    if (bi != nullptr)
+    // What is needed from the index is taken under cs_main, so that the
+    // block can be read from disk and sent without it.
+    CBlockIndex *bi;
+    CDiskBlockPos pos;
+    bool fSendCmpct = false;
+    bool fWitnessEnabled;
     {
-        if (bi->nChainTx && !bi->IsValid(BLOCK_VALID_SCRIPTS) && bi->IsValid(BLOCK_VALID_TREE))
-        {
-            // If we have the block and all of its parents, but have not yet validated it,
-            // we might be in the middle of connecting it (ie in the unlock of cs_main
-            // before ActivateBestChain but after AcceptBlock).
-            // In this case, we need to run ActivateBestChain prior to checking the relay
-            // conditions below.
-            CValidationState dummy;
-            ActivateBestChain(dummy, Params(), a_recent_block);
-        }
+        LOCK(cs_main);
 
-        if (cIndexManager.GetChain().Contains(bi))
+        bi = cIndexManager.GetBlockIndex(blockHash);
+        if (bi != nullptr)
         {
-            isOK = true;
-        } else
-        {
-            static const int nOneMonth = 30 * 24 * 60 * 60;
-            // To prevent fingerprinting attacks, only send blocks outside of the active
-            // chain if they are valid, and no more than a month older (both in time, and in
-            // best equivalent proof of work) than the best header chain we know about.
-            isOK = bi->IsValid(BLOCK_VALID_SCRIPTS) && (GetIndexBestHeader() != nullptr) &&
-                   (GetIndexBestHeader()->GetBlockTime() - bi->GetBlockTime() < nOneMonth) &&
-                   (GetBlockProofEquivalentTime(*GetIndexBestHeader(), *bi, *GetIndexBestHeader(),
-                                                consensusParams) < nOneMonth);
-            if (!isOK)
+            if (bi->nChainTx && !bi->IsValid(BLOCK_VALID_SCRIPTS) && bi->IsValid(BLOCK_VALID_TREE))
             {
-                WLogFormat("ignoring request from peer=%i for old block that isn't in the main chain", xnode->nodeID);
+                // If we have the block and all of its parents, but have not yet validated it,
+                // we might be in the middle of connecting it (ie in the unlock of cs_main
+                // before ActivateBestChain but after AcceptBlock).
+                // In this case, we need to run ActivateBestChain prior to checking the relay
+                // conditions below.
+                CValidationState dummy;
+                ActivateBestChain(dummy, Params(), a_recent_block);
+            }
+
+            if (cIndexManager.GetChain().Contains(bi))
+            {
+                isOK = true;
+            } else
+            {
+                static const int nOneMonth = 30 * 24 * 60 * 60;
+                // To prevent fingerprinting attacks, only send blocks outside of the active
+                // chain if they are valid, and no more than a month older (both in time, and in
+                // best equivalent proof of work) than the best header chain we know about.
+                isOK = bi->IsValid(BLOCK_VALID_SCRIPTS) && (GetIndexBestHeader() != nullptr) &&
+                       (GetIndexBestHeader()->GetBlockTime() - bi->GetBlockTime() < nOneMonth) &&
+                       (GetBlockProofEquivalentTime(*GetIndexBestHeader(), *bi, *GetIndexBestHeader(),
+                                                    consensusParams) < nOneMonth);
+                if (!isOK)
+                {
+                    WLogFormat("ignoring request from peer=%i for old block that isn't in the main chain", xnode->nodeID);
+                }
             }
         }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        // never disconnect whitelisted nodes
+        static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
+        if (isOK && ifNetObj->OutboundTargetReached(true) && (((GetIndexBestHeader() != nullptr) &&
+                                                               (GetIndexBestHeader()->GetBlockTime() -
+                                                                bi->GetBlockTime() > nOneWeek)) ||
+                                                              blockType == MSG_FILTERED_BLOCK) &&
+            !IsFlagsBitOn(xnode->flags, NF_WHITELIST))
+        {
+            WLogFormat("historical block serving limit reached, disconnect peer=%d", xnode->nodeID);
+
+            //disconnect node
+            SetFlagsBit(xnode->retFlags, NF_DISCONNECT);
+            isOK = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!isOK || !(bi->nStatus & BLOCK_HAVE_DATA))
+            return isOK;
+
+        pos = bi->GetBlockPos();
+        // Blocks from before segwit cannot have witnesses, so they are
+        // stored the way peers not asking for witnesses want them.
+        fWitnessEnabled = IsWitnessEnabled(bi->pprev, consensusParams);
+        if (blockType == MSG_CMPCT_BLOCK)
+        {
+            bool fCanDirectFetch = Tip()->GetBlockTime() > (GetAdjustedTime() - consensusParams.nPowTargetSpacing * 20);
+            fSendCmpct = fCanDirectFetch && bi->nHeight >= cIndexManager.GetChain().Height() - MAX_CMPCTBLOCK_DEPTH;
+        }
+    }
+
+    bool fRecent = a_recent_block && a_recent_block->GetHash() == blockHash;
+    bool fPeerWantsWitness = IsFlagsBitOn(xnode->flags, NF_WANTCMPCTWITNESS);
+
+    // A full block in the disk format is sent as read, without being
+    // deserialized and serialized again.
+    bool fSendRaw = false;
+    if (!fRecent)
+    {
+        if (blockType == MSG_WITNESS_BLOCK)
+            fSendRaw = true;
+        else if (blockType == MSG_BLOCK)
+            fSendRaw = !fWitnessEnabled;
+        else if (blockType == MSG_CMPCT_BLOCK && !fSendCmpct)
+            fSendRaw = fPeerWantsWitness || !fWitnessEnabled;
     }
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    // never disconnect whitelisted nodes
-    static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
-    if (isOK && ifNetObj->OutboundTargetReached(true) && (((GetIndexBestHeader() != nullptr) &&
-                                                           (GetIndexBestHeader()->GetBlockTime() -
-                                                            bi->GetBlockTime() > nOneWeek)) ||
-                                                          blockType == MSG_FILTERED_BLOCK) &&
-        !IsFlagsBitOn(xnode->flags, NF_WHITELIST))
-    {
-        WLogFormat("historical block serving limit reached, disconnect peer=%d", xnode->nodeID);
-
-        //disconnect node
+
+    std::shared_ptr<const CBlock> pblock;
+    std::vector<unsigned char> vRawBlock;
+    bool fRead;
+    if (fRecent)
+    {
+        pblock = a_recent_block;
+        fRead = true;
+    } else if (fSendRaw)
+    {
+        fRead = ReadRawBlockFromDisk(vRawBlock, pos, blockHash, Params().MessageStart());
+    } else
+    {
+        // Send block from disk
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        fRead = ReadBlockFromDisk(*pblockRead, pos, consensusParams) && pblockRead->GetHash() == blockHash;
+        pblock = pblockRead;
+    }
+    if (!fRead)
+    {
+        // Without cs_main, the block may have been pruned since.
+        LOCK(cs_main);
+        if (bi->nStatus & BLOCK_HAVE_DATA)
+            assert(!"cannot load block from disk");
+        WLogFormat("block %s was pruned before it could be sent to peer=%d", blockHash.ToString(), xnode->nodeID);
         SetFlagsBit(xnode->retFlags, NF_DISCONNECT);
-        isOK = false;
+        return false;
     }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (isOK && (bi->nStatus & BLOCK_HAVE_DATA))
+
+    if (fSendRaw)
     {
-        std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == bi->GetBlockHash())
-        {
-            pblock = a_recent_block;
-        } else
+        ifNetObj->SendNetMessage(xnode->nodeID, NetMsgType::BLOCK, std::move(vRawBlock));
+    } else if (blockType == MSG_BLOCK)
+    {
+        SendNetMessage(xnode->nodeID, NetMsgType::BLOCK, xnode->sendVersion, SERIALIZE_TRANSACTION_NO_WITNESS,
+                       *pblock);
+    } else if (blockType == MSG_WITNESS_BLOCK)
+    {
+        SendNetMessage(xnode->nodeID, NetMsgType::BLOCK, xnode->sendVersion, 0, *pblock);
+    } else if (blockType == MSG_FILTERED_BLOCK)
+    {
+        if (filter)
         {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, bi, consensusParams))
-                assert(!"cannot load block from disk");
-            pblock = pblockRead;
+            CMerkleBlock merkleBlock = CMerkleBlock(*pblock, *(CBloomFilter *)filter);
+            SendNetMessage(xnode->nodeID, NetMsgType::MERKLEBLOCK, xnode->sendVersion, 0, merkleBlock);
+            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+            // This avoids hurting performance by pointlessly requiring a round-trip
+            // Note that there is currently no way for a node to request any single transactions we didn't send here -
+            // they must either disconnect and retry or request the full block.
+            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+            // however we MUST always provide at least what the remote peer needs
+            typedef std::pair<unsigned int, uint256> PairType;
+            for (PairType &pair : merkleBlock.vMatchedTxn)
+                SendNetMessage(xnode->nodeID, NetMsgType::TX, xnode->sendVersion, SERIALIZE_TRANSACTION_NO_WITNESS,
+                               *pblock->vtx[pair.first]);
         }
-        if (blockType == MSG_BLOCK)
-        {
-            SendNetMessage(xnode->nodeID, NetMsgType::BLOCK, xnode->sendVersion, SERIALIZE_TRANSACTION_NO_WITNESS,
-                           *pblock);
-        } else if (blockType == MSG_WITNESS_BLOCK)
-        {
-            SendNetMessage(xnode->nodeID, NetMsgType::BLOCK, xnode->sendVersion, 0, *pblock);
-        } else if (blockType == MSG_FILTERED_BLOCK)
-        {
-            if (filter)
-            {
-                CMerkleBlock merkleBlock = CMerkleBlock(*pblock, *(CBloomFilter *)filter);
-                SendNetMessage(xnode->nodeID, NetMsgType::MERKLEBLOCK, xnode->sendVersion, 0, merkleBlock);
-                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                // This avoids hurting performance by pointlessly requiring a round-trip
-                // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                // they must either disconnect and retry or request the full block.
-                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                // however we MUST always provide at least what the remote peer needs
-                typedef std::pair<unsigned int, uint256> PairType;
-                for (PairType &pair : merkleBlock.vMatchedTxn)
-                    SendNetMessage(xnode->nodeID, NetMsgType::TX, xnode->sendVersion, SERIALIZE_TRANSACTION_NO_WITNESS,
-                                   *pblock->vtx[pair.first]);
-            }
-            // else
-            // no response
-        } else if (blockType == MSG_CMPCT_BLOCK)
+        // else
+        // no response
+    } else if (blockType == MSG_CMPCT_BLOCK)
+    {
+        // If a peer is asking for old blocks, we're almost guaranteed
+        // they won't have a useful mempool to match against a compact block,
+        // and we don't feel like constructing the object for them, so
+        // instead we respond with the full, non-compact block.
+        int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+        if (fSendCmpct)
         {
-            // If a peer is asking for old blocks, we're almost guaranteed
-            // they won't have a useful mempool to match against a compact block,
-            // and we don't feel like constructing the object for them, so
-            // instead we respond with the full, non-compact block.
-            bool fPeerWantsWitness = IsFlagsBitOn(xnode->flags, NF_WANTCMPCTWITNESS);
-            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-            bool fCanDirectFetch = Tip()->GetBlockTime() > (GetAdjustedTime() - consensusParams.nPowTargetSpacing * 20);
-            if (fCanDirectFetch &&
-                bi->nHeight >= cIndexManager.GetChain().Height() - MAX_CMPCTBLOCK_DEPTH)
+            if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) &&
+                a_recent_compact_block &&
+                a_recent_compact_block->header.GetHash() == blockHash)
             {
-                if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) &&
-                    a_recent_compact_block &&
-                    a_recent_compact_block->header.GetHash() == bi->GetBlockHash())
-                {
-                    SendNetMessage(xnode->nodeID, NetMsgType::CMPCTBLOCK, xnode->sendVersion, nSendFlags,
-                                   *a_recent_compact_block);
-                } else
-                {
-                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                    SendNetMessage(xnode->nodeID, NetMsgType::CMPCTBLOCK, xnode->sendVersion, nSendFlags, cmpctblock);
-                }
+                SendNetMessage(xnode->nodeID, NetMsgType::CMPCTBLOCK, xnode->sendVersion, nSendFlags,
+                               *a_recent_compact_block);
             } else
             {
-                SendNetMessage(xnode->nodeID, NetMsgType::BLOCK, xnode->sendVersion, nSendFlags, *pblock);
+                CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
+                SendNetMessage(xnode->nodeID, NetMsgType::CMPCTBLOCK, xnode->sendVersion, nSendFlags, cmpctblock);
             }
+        } else
+        {
+            SendNetMessage(xnode->nodeID, NetMsgType::BLOCK, xnode->sendVersion, nSendFlags, *pblock);
         }
     }
     return isOK;
@@ -139,19 +139,11 @@ CViewManager::DisconnectBlock(const CBlock &block, const CBlockIndex *pindex, CC
     GET_CONTRACT_INTERFACE(ifContractObj);
     uint256 hashStateRoot;
     uint256 hashUTXORoot;
-    CBlock prevblock;
-    if (!ReadBlockFromDisk(prevblock, pindex->pprev, Params().GetConsensus())) {
-        //TODO  LogError
-        rLogError("ReadBlockFromDisk failed at %d, hash=%s", pindex->pprev->nHeight,
-                         pindex->pprev->GetBlockHash().ToString());
-    } else {
-        if(prevblock.GetVMState(hashStateRoot, hashUTXORoot) == RET_VM_STATE_ERR)
-        {
-            ILogFormat("GetVMState err");
-        }
+    if (GetBlockVMState(pindex->pprev, hashStateRoot, hashUTXORoot, Params().GetConsensus()) == RET_VM_STATE_ERR)
+    {
+        ILogFormat("GetVMState err");
     }
     ifContractObj->UpdateState(hashStateRoot, hashUTXORoot);
-   // ifContractObj->UpdateState(pindex->pprev->hashStateRoot, pindex->pprev->hashUTXORoot);
 
     GET_CHAIN_INTERFACE(ifChainObj);
     if (pfClean == NULL && ifChainObj->IsLogEvents())
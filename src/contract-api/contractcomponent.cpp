@@ -12,13 +12,20 @@
 #include "univalue/include/univalue.h"
 #include "utils/timedata.h"
 #include "contractconfig.h"
+#include "hash.h"
 
 static std::unique_ptr<SbtcState> globalState;
 static std::shared_ptr<dev::eth::SealEngineFace> globalSealEngine;
+static std::unique_ptr<dev::eth::ChainParams> globalChainParams;
 static StorageResults *pstorageresult = NULL;
 static bool fRecordLogOpcodes = false;
 static bool fIsVMlogFile = false;
 static bool fGettingValuesDGP = false;
+static bool fBlockWriteSet = false;
+static SbtcDGPCache dgpCache;
+static SbtcExecCache execCache;
+// The tip state mempool admission executes contracts on, forked again when the tip moves
+static std::shared_ptr<SbtcStateSnapshot> mempoolSnapshot;
 
 SET_CPP_SCOPED_LOG_CATEGORY(CID_CONTRACT);
 
@@ -182,8 +189,16 @@ std::vector<ResultExecute> CallContract(const dev::Address &addrContract, std::v
     block.nTime = GetAdjustedTime();
     block.vtx.erase(block.vtx.begin() + 1, block.vtx.end());
 
-    SbtcDGP sbtcDGP(globalState.get(), fGettingValuesDGP);
-    uint64_t blockGasLimit = sbtcDGP.getBlockGasLimit(pTip->nHeight + 1);
+    DGPParams dgpParams;
+    uint64_t blockGasLimit = 0;
+    if (dgpCache.get(globalState->rootHash(), pTip->nHeight + 1, dgpParams))
+    {
+        blockGasLimit = dgpParams.blockGasLimit;
+    } else
+    {
+        SbtcDGP sbtcDGP(globalState.get(), fGettingValuesDGP);
+        blockGasLimit = sbtcDGP.getBlockGasLimit(pTip->nHeight + 1);
+    }
 
     if (gasLimit == 0)
     {
@@ -206,6 +221,25 @@ std::vector<ResultExecute> CallContract(const dev::Address &addrContract, std::v
 }
 
 
+DGPParams GetDGPParams(unsigned int height)
+{
+    DGPParams params;
+    dev::h256 stateRoot = globalState->rootHash();
+    if (dgpCache.get(stateRoot, height, params))
+    {
+        return params;
+    }
+
+    SbtcDGP sbtcDGP(globalState.get(), fGettingValuesDGP);
+    params.gasSchedule = sbtcDGP.getGasSchedule(height);
+    params.minGasPrice = sbtcDGP.getMinGasPrice(height);
+    params.blockGasLimit = sbtcDGP.getBlockGasLimit(height);
+    params.blockSize = sbtcDGP.getBlockSize(height);
+    dgpCache.put(stateRoot, height, params);
+    return params;
+}
+
+
 CContractComponent::CContractComponent()
 {
 
@@ -249,7 +283,8 @@ bool CContractComponent::ContractInit()
     globalState = std::unique_ptr<SbtcState>(
             new SbtcState(dev::u256(0), SbtcState::openDB(dirSbtc, hashDB, dev::WithExisting::Trust), dirSbtc,
                           existstate));
-    dev::eth::ChainParams cp((dev::eth::genesisInfo(dev::eth::Network::sbtcMainNetwork)));
+    globalChainParams.reset(new dev::eth::ChainParams(dev::eth::genesisInfo(dev::eth::Network::sbtcMainNetwork)));
+    dev::eth::ChainParams &cp = *globalChainParams;
     globalSealEngine = std::unique_ptr<dev::eth::SealEngineFace>(cp.createSealEngine());
 
     pstorageresult = new StorageResults(stateDir.string());
@@ -263,26 +298,17 @@ bool CContractComponent::ContractInit()
     if (IsEnabled)
     {
         CBlockIndex *pTip = ifChainObj->GetActiveChain().Tip();
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pTip, Params().GetConsensus()))
+        uint256 hashStateRoot;
+        uint256 hashUTXORoot;
+        if (GetBlockVMState(pTip, hashStateRoot, hashUTXORoot, Params().GetConsensus()) != RET_VM_STATE_OK)
         {
-            rLogError("ReadBlockFromDisk failed at %d, hash=%s", pTip->nHeight,
-                      pTip->GetBlockHash().ToString());
+            ELogFormat("GetVMState failed at %d, hash=%s", pTip->nHeight, pTip->GetBlockHash().ToString());
             assert(0);
             return false;
         } else
         {
-            uint256 hashStateRoot;
-            uint256 hashUTXORoot;
-            if(block.GetVMState(hashStateRoot, hashUTXORoot) != RET_VM_STATE_OK)
-            {
-                assert(0);
-                rLogError("GetVMState failed");
-                return false;
-            }else {
-                globalState->setRoot(uintToh256(hashStateRoot));
-                globalState->setRootUTXO(uintToh256(hashUTXORoot));
-            }
+            globalState->setRoot(uintToh256(hashStateRoot));
+            globalState->setRootUTXO(uintToh256(hashUTXORoot));
         }
     } else
     {
@@ -294,6 +320,9 @@ bool CContractComponent::ContractInit()
     globalState->db().commit();
     globalState->dbUtxo().commit();
 
+    globalState->setWatchedAddresses({GasScheduleDGP, BlockSizeDGP, GasPriceDGP, DGPCONTRACT4, BlockGasLimitDGP});
+    dgpCache.clear();
+
     fRecordLogOpcodes = Args().IsArgSet("-record-log-opcodes");
     fIsVMlogFile = boost::filesystem::exists(GetDataDir() / "vmExecLogs.json");
 
@@ -318,8 +347,10 @@ bool CContractComponent::ComponentShutdown()
 
     delete pstorageresult;
     pstorageresult = NULL;
+    mempoolSnapshot.reset();
     delete globalState.release();
     globalSealEngine.reset();
+    globalChainParams.reset();
     return true;
 }
 
@@ -337,9 +368,9 @@ uint64_t CContractComponent::GetMinGasPrice(int height)
         return 0;
     }
 
-    SbtcDGP sbtcDGP(globalState.get(), fGettingValuesDGP);
-    globalSealEngine->setSbtcSchedule(sbtcDGP.getGasSchedule(height));
-    minGasPrice = sbtcDGP.getMinGasPrice(height);
+    DGPParams params = GetDGPParams(height);
+    globalSealEngine->setSbtcSchedule(params.gasSchedule);
+    minGasPrice = params.minGasPrice;
 
     return minGasPrice;
 }
@@ -358,9 +389,9 @@ uint64_t CContractComponent::GetBlockGasLimit(int height)
         return 0;
     }
 
-    SbtcDGP sbtcDGP(globalState.get(), fGettingValuesDGP);
-    globalSealEngine->setSbtcSchedule(sbtcDGP.getGasSchedule(height));
-    blockGasLimit = sbtcDGP.getBlockGasLimit(height);
+    DGPParams params = GetDGPParams(height);
+    globalSealEngine->setSbtcSchedule(params.gasSchedule);
+    blockGasLimit = params.blockGasLimit;
 
     return blockGasLimit;
 }
@@ -382,7 +413,7 @@ bool CContractComponent::AddressInUse(string contractaddress)
 }
 
 bool CContractComponent::CheckContractTx(const CTransaction tx, const CAmount nFees,
-                                         CAmount &nMinGasPrice, int &level,
+                                         CAmount &nMinGasPrice, uint64_t &nGasLimit, int &level,
                                          string &errinfo, const CAmount nAbsurdFee, bool rawTx)
 {
     dev::u256 txMinGasPrice = 0;
@@ -531,11 +562,79 @@ bool CContractComponent::CheckContractTx(const CTransaction tx, const CAmount nF
     }
 
     nMinGasPrice = CAmount(txMinGasPrice);
+    nGasLimit = uint64_t(gasAllTxs);
 
     return true;
 }
 
-bool CContractComponent::RunContractTx(CTransaction tx, CCoinsViewCache *v, CBlock *pblock,
+static uint256 ExecCacheKey(const CTransaction &tx, uint32_t transactionIndex, const CBlock &block,
+                            uint64_t blockGasLimit)
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    return SbtcExecCache::key(globalState->rootHash(), globalState->rootHashUTXO(), tx, transactionIndex,
+                              ifChainObj->GetActiveChain().Tip()->GetBlockHash(), block, blockGasLimit);
+}
+
+//the same as performByteCode followed by processingResults for the execution the entry recorded
+static void ApplyExecCacheEntry(const SbtcExecCache::Entry &entry, std::vector<ResultExecute> &resultExec,
+                                ByteCodeExecResult &resultBCE)
+{
+    dev::h256 oldHashStateRoot(globalState->rootHash());
+    globalState->setRoot(entry.stateRoot);
+    globalState->setRootUTXO(entry.utxoRoot);
+    if (entry.fWatchedAddressChanged)
+    {
+        dgpCache.clear();
+    } else
+    {
+        dgpCache.advance(oldHashStateRoot, entry.stateRoot);
+    }
+
+    for (const ResultExecute &re : entry.results)
+    {
+        resultExec.push_back(re);
+    }
+    resultBCE.usedGas += entry.bcer.usedGas;
+    resultBCE.refundSender += entry.bcer.refundSender;
+    for (const CTxOut &vout : entry.bcer.refundOutputs)
+    {
+        resultBCE.refundOutputs.push_back(vout);
+    }
+    for (const CTransaction &t : entry.bcer.valueTransfers)
+    {
+        resultBCE.valueTransfers.push_back(t);
+    }
+}
+
+void SbtcStateSnapshot::GetState(uint256 &hashStateRoot, uint256 &hashUTXORoot) const
+{
+    hashStateRoot = h256Touint(state->rootHash());
+    hashUTXORoot = h256Touint(state->rootHashUTXO());
+}
+
+void SbtcStateSnapshot::UpdateState(uint256 hashStateRoot, uint256 hashUTXORoot)
+{
+    state->setRoot(uintToh256(hashStateRoot));
+    state->setRootUTXO(uintToh256(hashUTXORoot));
+}
+
+std::shared_ptr<SbtcStateSnapshot> CContractComponent::ForkTipState()
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CBlockIndex *pTip = ifChainObj->GetActiveChain().Tip();
+    if (!globalState || pTip == nullptr || !pTip->IsSBTCContractEnabled())
+    {
+        return nullptr;
+    }
+
+    // the seal engine keeps per-execution state, each snapshot gets its own
+    std::unique_ptr<dev::eth::SealEngineFace> sealEngine(globalChainParams->createSealEngine());
+    sealEngine->setSbtcSchedule(GetDGPParams(pTip->nHeight + 1).gasSchedule);
+    return std::make_shared<SbtcStateSnapshot>(*globalState, std::move(sealEngine), pTip);
+}
+
+bool CContractComponent::RunContractTx(SbtcStateSnapshot &snapshot, CTransaction tx, CCoinsViewCache *v,
+                                       CBlock *pblock,
                                        uint64_t minGasPrice,
                                        uint64_t hardBlockGasLimit,
                                        uint64_t softBlockGasLimit,
@@ -543,16 +642,6 @@ bool CContractComponent::RunContractTx(CTransaction tx, CCoinsViewCache *v, CBlo
                                        uint64_t usedGas,
                                        ByteCodeExecResult &testExecResult)
 {
-    bool IsEnabled =  [&]()->bool{
-        GET_CHAIN_INTERFACE(ifChainObj);
-        if(ifChainObj->GetActiveChain().Tip()== nullptr) return false;
-        return ifChainObj->GetActiveChain().Tip()->IsSBTCContractEnabled();
-    }();
-    if (!IsEnabled)
-    {
-        return false;
-    }
-
     SbtcTxConverter convert(tx, v, &pblock->vtx);
 
     ExtractSbtcTX resultConverter;
@@ -584,8 +673,13 @@ bool CContractComponent::RunContractTx(CTransaction tx, CCoinsViewCache *v, CBlo
             return false;
         }
     }
+    // The transaction goes at the end of the block if it is added.
+    SbtcState &state = snapshot.getState();
+    uint256 execKey = SbtcExecCache::key(state.rootHash(), state.rootHashUTXO(), tx, pblock->vtx.size(),
+                                         snapshot.getTip()->GetBlockHash(), *pblock, hardBlockGasLimit);
+
     // We need to pass the DGP's block gas limit (not the soft limit) since it is consensus critical.
-    ByteCodeExec exec(*pblock, sbtcTransactions, hardBlockGasLimit);
+    ByteCodeExec exec(*pblock, sbtcTransactions, hardBlockGasLimit, &snapshot);
     if (!exec.performByteCode())
     {
         //error, don't add contract
@@ -596,6 +690,13 @@ bool CContractComponent::RunContractTx(CTransaction tx, CCoinsViewCache *v, CBlo
     {
         return false;
     }
+
+    // The VM log needs every block executed when it connects, see ContractTxConnectBlock
+    if (!fRecordLogOpcodes)
+    {
+        execCache.put(execKey, SbtcExecCache::Entry{state.rootHash(), state.rootHashUTXO(),
+                                                    exec.watchedAddressChanged(), exec.getResult(), testExecResult});
+    }
     return true;
 }
 
@@ -681,6 +782,55 @@ uint32_t GetExcepted(dev::eth::TransactionException status)
     }
 }
 
+bool CContractComponent::PreExecuteContractTx(const CTransaction &tx, CCoinsViewCache *v, uint64_t &gasUsed,
+                                              uint32_t &excepted)
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CBlockIndex *pTip = ifChainObj->GetActiveChain().Tip();
+    if (!mempoolSnapshot || mempoolSnapshot->getTip() != pTip)
+    {
+        mempoolSnapshot = ForkTipState();
+        if (!mempoolSnapshot)
+        {
+            return false;
+        }
+    }
+
+    SbtcTxConverter convert(tx, v);
+    ExtractSbtcTX resultConverter;
+    if (!convert.extractionSbtcTransactions(resultConverter))
+    {
+        return false;
+    }
+
+    // the next block as far as the EVM can tell before it is assembled
+    CBlock block;
+    block.nTime = GetAdjustedTime();
+    block.nBits = pTip->nBits;
+    CMutableTransaction coinbase;
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+    // Reverted executions leave the snapshot as it was, so it serves every transaction until the tip moves
+    ByteCodeExec exec(block, resultConverter.first, GetBlockGasLimit(pTip->nHeight + 1), mempoolSnapshot.get());
+    if (!exec.performByteCode(dev::eth::Permanence::Reverted))
+    {
+        return false;
+    }
+
+    gasUsed = 0;
+    excepted = 0;
+    for (const ResultExecute &result : exec.getResult())
+    {
+        gasUsed += (uint64_t)result.execRes.gasUsed;
+        if (excepted == 0)
+        {
+            excepted = GetExcepted(result.execRes.excepted);
+        }
+    }
+    return true;
+}
+
 string CContractComponent::GetExceptedInfo(uint32_t index)
 {
     bool IsEnabled =  [&]()->bool{
@@ -847,19 +997,33 @@ bool CContractComponent::ContractTxConnectBlock(CTransaction tx, uint32_t transa
         }
     }
 
-    if (!exec.performByteCode())
+    std::vector<ResultExecute> resultExec;
+    // With the VM log on, the block is executed again so that the log records it as it runs
+    std::shared_ptr<const SbtcExecCache::Entry> cached;
+    if (!fRecordLogOpcodes)
     {
-        level = 100;
-        errinfo = "bad-tx-unknown-error";
-        return false;
+        cached = execCache.get(ExecCacheKey(tx, transactionIndex, block, blockGasLimit));
     }
-
-    std::vector<ResultExecute> resultExec(exec.getResult());
-    if (!exec.processingResults(bcer))
+    if (cached)
     {
-        level = 100;
-        errinfo = "bad-vm-exec-processing";
-        return false;
+        //executed exactly like this when we assembled the block
+        ApplyExecCacheEntry(*cached, resultExec, bcer);
+    } else
+    {
+        if (!exec.performByteCode())
+        {
+            level = 100;
+            errinfo = "bad-tx-unknown-error";
+            return false;
+        }
+
+        resultExec = std::vector<ResultExecute>(exec.getResult());
+        if (!exec.processingResults(bcer))
+        {
+            level = 100;
+            errinfo = "bad-vm-exec-processing";
+            return false;
+        }
     }
 
     countCumulativeGasUsed += bcer.usedGas;
@@ -946,6 +1110,38 @@ void CContractComponent::UpdateState(uint256 hashStateRoot, uint256 hashUTXORoot
     globalState->setRootUTXO(uintToh256(hashUTXORoot));
 }
 
+void CContractComponent::BeginBlockState()
+{
+    if (!globalState)
+    {
+        return;
+    }
+    fBlockWriteSet = true;
+}
+
+void CContractComponent::CommitBlockState()
+{
+    if (!globalState || !fBlockWriteSet)
+    {
+        return;
+    }
+    // the state trie and the utxo trie live in separate LevelDB instances, each gets one WriteBatch
+    globalState->db().commit();
+    globalState->dbUtxo().commit();
+    fBlockWriteSet = false;
+}
+
+void CContractComponent::DiscardBlockState()
+{
+    if (!globalState || !fBlockWriteSet)
+    {
+        return;
+    }
+    globalState->db().rollback();
+    globalState->dbUtxo().rollback();
+    fBlockWriteSet = false;
+}
+
 void CContractComponent::DeleteResults(std::vector<CTransactionRef> const &txs)
 {
     bool IsEnabled =  [&]()->bool{
@@ -1176,6 +1372,9 @@ void CContractComponent::RPCCallContract(UniValue &result, const string addrCont
 
 bool ByteCodeExec::performByteCode(dev::eth::Permanence type)
 {
+    SbtcState &state = snapshot ? snapshot->getState() : *globalState;
+    dev::eth::SealEngineFace &sealEngine = snapshot ? snapshot->getSealEngine() : *globalSealEngine;
+    dev::h256 oldHashStateRoot(state.rootHash());
     for (SbtcTransaction &tx : txs)
     {
         //validate VM version
@@ -1184,7 +1383,7 @@ bool ByteCodeExec::performByteCode(dev::eth::Permanence type)
             return false;
         }
         dev::eth::EnvInfo envInfo(BuildEVMEnvironment());
-        if (!tx.isCreation() && !globalState->addressInUse(tx.receiveAddress()))
+        if (!tx.isCreation() && !state.addressInUse(tx.receiveAddress()))
         {
             ILogFormat("performByteCode execption====="); //sbtc debug
             dev::eth::ExecutionResult execRes;
@@ -1195,11 +1394,27 @@ bool ByteCodeExec::performByteCode(dev::eth::Permanence type)
             continue;
         }
         ILogFormat("performByteCode start exec====="); //sbtc debug
-        result.push_back(globalState->execute(envInfo, *globalSealEngine.get(), tx, type, OnOpFunc()));
+        result.push_back(state.execute(envInfo, sealEngine, tx, type, OnOpFunc()));
     }
-    globalState->db().commit();
-    globalState->dbUtxo().commit();
-    globalSealEngine.get()->deleteAddresses.clear();
+    if (snapshot || !fBlockWriteSet)
+    {
+        state.db().commit();
+        state.dbUtxo().commit();
+    }
+    fWatchedAddressChanged = state.watchedAddressChanged();
+    state.resetWatchedAddressChanged();
+    //the DGP cache follows the global state only
+    if (!snapshot)
+    {
+        if (fWatchedAddressChanged)
+        {
+            dgpCache.clear();
+        } else
+        {
+            dgpCache.advance(oldHashStateRoot, state.rootHash());
+        }
+    }
+    sealEngine.deleteAddresses.clear();
     return true;
 }
 
@@ -1260,7 +1475,7 @@ dev::eth::EnvInfo ByteCodeExec::BuildEVMEnvironment()
     GET_CHAIN_INTERFACE(ifChainObj);
 
     dev::eth::EnvInfo env;
-    CBlockIndex *tip = ifChainObj->GetActiveChain().Tip();
+    const CBlockIndex *tip = snapshot ? snapshot->getTip() : ifChainObj->GetActiveChain().Tip();
     env.setNumber(dev::u256(tip->nHeight + 1));
     env.setTimestamp(dev::u256(block.nTime));
     env.setDifficulty(dev::u256(block.nBits));
@@ -1432,4 +1647,36 @@ SbtcTransaction SbtcTxConverter::createEthTX(const EthTransactionParams &etp, ui
     return txEth;
 }
 
+uint256 SbtcExecCache::key(const dev::h256 &stateRoot, const dev::h256 &utxoRoot, const CTransaction &tx,
+                           uint32_t transactionIndex, const uint256 &tipHash, const CBlock &block,
+                           uint64_t blockGasLimit)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << h256Touint(stateRoot) << h256Touint(utxoRoot) << tx.GetHash() << transactionIndex;
+    ss << tipHash << block.nTime << block.nBits << block.vtx[0]->vout[0].scriptPubKey << blockGasLimit;
+    return ss.GetHash();
+}
 
+std::shared_ptr<const SbtcExecCache::Entry> SbtcExecCache::get(const uint256 &key) const
+{
+    LOCK(cs);
+    auto it = entries.find(key);
+    return it == entries.end() ? nullptr : it->second;
+}
+
+void SbtcExecCache::put(const uint256 &key, Entry &&entry)
+{
+    std::shared_ptr<const Entry> pentry = std::make_shared<const Entry>(std::move(entry));
+    LOCK(cs);
+    if (entries.size() >= MAX_EXEC_CACHE_ENTRIES && !entries.count(key))
+    {
+        entries.clear();
+    }
+    entries[key] = std::move(pentry);
+}
+
+void SbtcExecCache::clear()
+{
+    LOCK(cs);
+    entries.clear();
+}
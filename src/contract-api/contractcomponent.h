@@ -82,15 +82,71 @@ private:
 };
 
 
+/**
+ * A copy-on-write fork of the contract state at pindexPrev, for assembling a block on top of it.
+ * It reads the same databases as the global state but has its own roots, overlay and seal engine,
+ * so contracts executed in it never move the global state, and it needs neither the active chain
+ * nor cs_main once forked. Trie nodes it writes are flushed to the databases, which only ever adds
+ * nodes, so its executions can be recorded in the exec cache.
+ */
+class SbtcStateSnapshot
+{
+
+public:
+
+    SbtcStateSnapshot(const SbtcState &_state, std::unique_ptr<dev::eth::SealEngineFace> _sealEngine,
+                      const CBlockIndex *_pindexPrev) : state(new SbtcState(_state)),
+                                                        sealEngine(std::move(_sealEngine)),
+                                                        pindexPrev(_pindexPrev)
+    {
+    }
+
+    SbtcState &getState()
+    {
+        return *state;
+    }
+
+    dev::eth::SealEngineFace &getSealEngine()
+    {
+        return *sealEngine;
+    }
+
+    const CBlockIndex *getTip() const
+    {
+        return pindexPrev;
+    }
+
+    void GetState(uint256 &hashStateRoot, uint256 &hashUTXORoot) const;
+
+    //move back to roots the snapshot went through, e.g. to undo a transaction left out of the block
+    void UpdateState(uint256 hashStateRoot, uint256 hashUTXORoot);
+
+    SbtcStateSnapshot(const SbtcStateSnapshot &) = delete;
+
+    SbtcStateSnapshot &operator=(const SbtcStateSnapshot &) = delete;
+
+private:
+
+    std::unique_ptr<SbtcState> state;
+
+    std::unique_ptr<dev::eth::SealEngineFace> sealEngine;
+
+    const CBlockIndex *pindexPrev;
+
+};
+
+
 class ByteCodeExec
 {
 
 public:
 
-    ByteCodeExec(const CBlock &_block, std::vector<SbtcTransaction> _txs, const uint64_t _blockGasLimit) : txs(_txs),
-                                                                                                           block(_block),
-                                                                                                           blockGasLimit(
-                                                                                                                   _blockGasLimit)
+    //executes against the global state at the active tip, or against snapshot if there is one
+    ByteCodeExec(const CBlock &_block, std::vector<SbtcTransaction> _txs, const uint64_t _blockGasLimit,
+                 SbtcStateSnapshot *_snapshot = nullptr) : txs(_txs),
+                                                           block(_block),
+                                                           blockGasLimit(_blockGasLimit),
+                                                           snapshot(_snapshot)
     {
     }
 
@@ -103,6 +159,12 @@ public:
         return result;
     }
 
+    //a DGP contract was written by the transactions
+    bool watchedAddressChanged() const
+    {
+        return fWatchedAddressChanged;
+    }
+
 private:
 
     dev::eth::EnvInfo BuildEVMEnvironment();
@@ -117,6 +179,54 @@ private:
 
     const uint64_t blockGasLimit;
 
+    SbtcStateSnapshot *snapshot;
+
+    bool fWatchedAddressChanged = false;
+
+};
+
+static const size_t MAX_EXEC_CACHE_ENTRIES = 5000;
+
+/**
+ * Contract executions done while assembling a block, so that TestBlockValidity on the template, and
+ * connecting the block once it is mined, move to the resulting state instead of running the EVM again.
+ * An entry is keyed by everything the execution reads: the state and UTXO roots before it, the
+ * transaction and its index in the block, and the EVM environment (tip, time, bits, author, gas limit).
+ * Only executions whose writes went to the state database are recorded, so the roots they lead to
+ * can always be reopened.
+ */
+class SbtcExecCache
+{
+
+public:
+
+    struct Entry
+    {
+        dev::h256 stateRoot;
+        dev::h256 utxoRoot;
+        bool fWatchedAddressChanged;
+        std::vector<ResultExecute> results;
+        ByteCodeExecResult bcer;
+    };
+
+    static uint256 key(const dev::h256 &stateRoot, const dev::h256 &utxoRoot, const CTransaction &tx,
+                       uint32_t transactionIndex, const uint256 &tipHash, const CBlock &block,
+                       uint64_t blockGasLimit);
+
+    //nullptr if there is no entry for the key
+    std::shared_ptr<const Entry> get(const uint256 &key) const;
+
+    void put(const uint256 &key, Entry &&entry);
+
+    void clear();
+
+private:
+
+    //templates can be assembled on snapshots while a block is connected
+    mutable CCriticalSection cs;
+
+    std::map<uint256, std::shared_ptr<const Entry>> entries;
+
 };
 
 class CContractComponent : public IContractComponent
@@ -141,10 +251,15 @@ public:
     bool AddressInUse(string contractaddress) override;
 
     bool CheckContractTx(const CTransaction tx, const CAmount nFees,
-                         CAmount &nMinGasPrice, int &level,
+                         CAmount &nMinGasPrice, uint64_t &nGasLimit, int &level,
                          string &errinfo, const CAmount nAbsurdFee = 0, bool rawTx = false) override;
 
-    bool RunContractTx(CTransaction tx, CCoinsViewCache *v, CBlock *pblock,
+    std::shared_ptr<SbtcStateSnapshot> ForkTipState() override;
+
+    bool PreExecuteContractTx(const CTransaction &tx, CCoinsViewCache *v, uint64_t &gasUsed,
+                              uint32_t &excepted) override;
+
+    bool RunContractTx(SbtcStateSnapshot &snapshot, CTransaction tx, CCoinsViewCache *v, CBlock *pblock,
                        uint64_t minGasPrice,
                        uint64_t hardBlockGasLimit,
                        uint64_t softBlockGasLimit,
@@ -164,6 +279,12 @@ public:
 
     void UpdateState(uint256 hashStateRoot, uint256 hashUTXORoot) override;
 
+    void BeginBlockState() override;
+
+    void CommitBlockState() override;
+
+    void DiscardBlockState() override;
+
     void DeleteResults(std::vector<CTransactionRef> const &txs) override;
 
     std::vector<TransactionReceiptInfo> GetResult(uint256 const &hashTx) override;
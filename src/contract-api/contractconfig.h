@@ -26,6 +26,9 @@ static const uint64_t MINIMUM_GAS_LIMIT = 10000;
 
 static const uint64_t MEMPOOL_MIN_GAS_LIMIT = 22000;
 
+/** Default for -mempoolcontractexec, executing contract transactions on top of the tip when they enter the mempool **/
+static const bool DEFAULT_MEMPOOL_CONTRACT_EXEC = false;
+
 #define CONTRACT_STATE_DIR "stateContract"
 
 static const uint256 DEFAULT_HASH_STATE_ROOT = uint256S(
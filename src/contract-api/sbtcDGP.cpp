@@ -306,3 +306,46 @@ void SbtcDGP::clear()
     storageTemplate.clear();
     paramsInstance.clear();
 }
+
+bool SbtcDGPCache::get(const dev::h256 &stateRoot, unsigned int blockHeight, DGPParams &result) const
+{
+    if (!roots.count(stateRoot))
+        return false;
+    auto it = params.find(blockHeight);
+    if (it == params.end())
+        return false;
+    result = it->second;
+    return true;
+}
+
+void SbtcDGPCache::put(const dev::h256 &stateRoot, unsigned int blockHeight, const DGPParams &value)
+{
+    if (!roots.count(stateRoot))
+    {
+        clear();
+        roots.insert(stateRoot);
+    }
+    if (params.size() >= MAX_DGP_CACHE_HEIGHTS && !params.count(blockHeight))
+    {
+        params.erase(params.begin());
+    }
+    params[blockHeight] = value;
+}
+
+void SbtcDGPCache::advance(const dev::h256 &oldRoot, const dev::h256 &newRoot)
+{
+    if (!roots.count(oldRoot) || roots.count(newRoot))
+        return;
+    if (roots.size() >= MAX_DGP_CACHE_ROOTS)
+    {
+        clear();
+        return;
+    }
+    roots.insert(newRoot);
+}
+
+void SbtcDGPCache::clear()
+{
+    roots.clear();
+    params.clear();
+}
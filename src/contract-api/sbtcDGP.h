@@ -24,6 +24,43 @@ static const uint64_t MIN_BLOCK_GAS_LIMIT_DGP = 1000000;
 static const uint64_t MAX_BLOCK_GAS_LIMIT_DGP = 1000000000;
 static const uint64_t DEFAULT_BLOCK_GAS_LIMIT_DGP = 40000000;
 
+static const size_t MAX_DGP_CACHE_HEIGHTS = 16;
+static const size_t MAX_DGP_CACHE_ROOTS = 10000;
+
+struct DGPParams
+{
+    dev::eth::EVMSchedule gasSchedule;
+    uint64_t minGasPrice;
+    uint64_t blockGasLimit;
+    uint32_t blockSize;
+};
+
+/**
+ * DGP parameters per block height. Entries stay valid for every state root reached from the one they
+ * were computed on without writing a DGP contract (0x80-0x84); any other root, as after a reorg, misses.
+ */
+class SbtcDGPCache
+{
+
+public:
+
+    bool get(const dev::h256 &stateRoot, unsigned int blockHeight, DGPParams &params) const;
+
+    void put(const dev::h256 &stateRoot, unsigned int blockHeight, const DGPParams &params);
+
+    //state moved from oldRoot to newRoot without touching a DGP contract
+    void advance(const dev::h256 &oldRoot, const dev::h256 &newRoot);
+
+    void clear();
+
+private:
+
+    dev::h256Hash roots;
+
+    std::map<unsigned int, DGPParams> params;
+
+};
+
 class SbtcDGP
 {
 
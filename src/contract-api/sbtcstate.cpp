@@ -19,6 +19,15 @@ SbtcState::SbtcState(u256 const &_accountStartNonce, OverlayDB const &_db, const
     stateUTXO = SecureTrieDB<Address, OverlayDB>(&dbUTXO);
 }
 
+SbtcState::SbtcState(SbtcState const &_s) :
+        State(_s),
+        dbUTXO(_s.dbUTXO),
+        stateUTXO(&dbUTXO, _s.stateUTXO.root(), Verification::Skip),
+        cacheUTXO(_s.cacheUTXO),
+        watchedAddresses(_s.watchedAddresses)
+{
+}
+
 SbtcState::SbtcState() : dev::eth::State(dev::Invalid256, dev::OverlayDB(), dev::eth::BaseState::PreExisting)
 {
     dbUTXO = OverlayDB();
@@ -101,6 +110,15 @@ SbtcState::execute(EnvInfo const &_envInfo, SealEngineFace const &_sealEngine, S
                 printfErrorLog(res.excepted);
             }
 
+            for (dev::Address const &addr : watchedAddresses)
+            {
+                auto it = m_cache.find(addr);
+                if (it != m_cache.end() && it->second.isDirty())
+                {
+                    fWatchedChanged = true;
+                }
+            }
+
             ILogFormat("SbtcState::execute commit"); //sbtc debug
             sbtc::commit(cacheUTXO, stateUTXO, m_cache);
             cacheUTXO.clear();
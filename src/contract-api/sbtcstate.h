@@ -76,6 +76,12 @@ public:
     SbtcState(dev::u256 const &_accountStartNonce, dev::OverlayDB const &_db, const std::string &_path,
               dev::eth::BaseState _bs = dev::eth::BaseState::PreExisting);
 
+    //sbtc fork of _s at its current roots: the databases are shared, the in-memory overlays are copied,
+    //so what one of them writes is invisible to the other until it is committed and reopened by root
+    SbtcState(SbtcState const &_s);
+
+    SbtcState &operator=(SbtcState const &_s) = delete;
+
     ResultExecute
     execute(dev::eth::EnvInfo const &_envInfo, dev::eth::SealEngineFace const &_sealEngine, SbtcTransaction const &_t,
             dev::eth::Permanence _p = dev::eth::Permanence::Committed, dev::eth::OnOpFunc const &_onOp = OnOpFunc());
@@ -98,6 +104,22 @@ public:
 
     std::unordered_map<dev::Address, Vin> vins() const; // temp
 
+    //sbtc addresses whose account changes are flagged by execute(), used to invalidate the DGP cache
+    void setWatchedAddresses(std::set<dev::Address> const &_addrs)
+    {
+        watchedAddresses = _addrs;
+    }
+
+    bool watchedAddressChanged() const
+    {
+        return fWatchedChanged;
+    }
+
+    void resetWatchedAddressChanged()
+    {
+        fWatchedChanged = false;
+    }
+
     dev::OverlayDB const &dbUtxo() const
     {
         return dbUTXO;
@@ -145,6 +167,10 @@ private:
     dev::eth::SecureTrieDB<dev::Address, dev::OverlayDB> stateUTXO;
 
     std::unordered_map<dev::Address, Vin> cacheUTXO;
+
+    std::set<dev::Address> watchedAddresses;
+
+    bool fWatchedChanged = false;
 };
 
 
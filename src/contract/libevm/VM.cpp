@@ -157,9 +157,6 @@ void VM::fetchInstruction()
     m_runGas = toInt63(m_schedule->tierStepGas[static_cast<unsigned>(metric.gasPriceTier)]);
     m_newMemSize = m_mem.size();
     m_copyMemSize = 0;
-
-    ILogFormat("pc = %ld",m_PC);
-    ILogFormat("m_OP = %ld",static_cast<size_t>(m_OP));
 }
 
 #if EVM_HACK_ON_OPERATION
@@ -246,7 +243,6 @@ void VM::interpretCases()
                     size_t s = (size_t)*m_SP--;
                     m_output = owning_bytes_ref{std::move(m_mem), b, s};
                     m_bounce = 0;
-                    ILogFormat("RETURN");
                 }
                 BREAK
 
@@ -266,7 +262,6 @@ void VM::interpretCases()
                     updateIOGas();
                     m_ext->suicide(dest);
                     m_bounce = 0;
-                    ILogFormat("SUICIDE");
                 }
                 BREAK
 
@@ -275,7 +270,6 @@ void VM::interpretCases()
                     ON_OP();
                     updateIOGas();
                     m_bounce = 0;
-                    ILogFormat("STOP");
                 }
                 BREAK;
 
@@ -687,7 +681,6 @@ void VM::interpretCases()
                     if (u512(*m_SP) + 31 < m_ext->data.size())
                     {
                         *m_SP = (u256)*(h256 const *)(m_ext->data.data() + (size_t)*m_SP);
-                        ILogFormat("m_SP/data01 = %s",toHex(*m_SP));
                     } else if (*m_SP >= m_ext->data.size())
                     {
                         *m_SP = u256(0);
@@ -697,7 +690,6 @@ void VM::interpretCases()
                         for (uint64_t i = (uint64_t)*m_SP, e = (uint64_t)*m_SP + (uint64_t)32, j = 0; i < e; ++i, ++j)
                             r[j] = i < m_ext->data.size() ? m_ext->data[i] : 0;
                         *m_SP = (u256)r;
-                        ILogFormat("funstionid/data03 = %s",toHex(*m_SP));
                     }
                 }
                 NEXT
@@ -33,9 +33,12 @@ namespace dev
         //
         // EVM_TRACE              - provides various levels of tracing
 
+        // The jump table is the default wherever labels-as-values are available
+        // (gcc and clang); build with -DEVM_JUMP_DISPATCH=false to get the
+        // portable switch loop back, e.g. to compare both with bench_bitcoin.
 #ifndef EVM_JUMP_DISPATCH
 #ifdef __GNUC__
-#define EVM_JUMP_DISPATCH false
+#define EVM_JUMP_DISPATCH true
 #else
 #define EVM_JUMP_DISPATCH false
 #endif
@@ -219,16 +222,16 @@ namespace dev
             &&NUMBER,  \
             &&DIFFICULTY,  \
             &&GASLIMIT,  \
+            &&INVALID,  \
+            &&INVALID,  \
+            &&INVALID,  \
+            &&INVALID,  \
             &&JUMPTO,  \
             &&JUMPIF,  \
             &&JUMPV,  \
             &&JUMPSUB,  \
             &&JUMPSUBV,  \
             &&RETURNSUB,  \
-            &&BEGINSUB,  \
-            &&BEGINDATA,  \
-            &&INVALID,  \
-            &&INVALID,  \
             &&POP,           /* 50, */  \
             &&MLOAD,  \
             &&MSTORE,  \
@@ -241,8 +244,8 @@ namespace dev
             &&MSIZE,  \
             &&GAS,  \
             &&JUMPDEST,  \
-            &&BEGINDATA,  \
             &&BEGINSUB,  \
+            &&BEGINDATA,  \
             &&INVALID,  \
             &&INVALID,  \
             &&PUSH1,         /* 60, */  \
@@ -7,7 +7,10 @@
 #include "utils/util.h"
 #include "utils/utilstrencodings.h"
 
+#include <algorithm>
+#include <map>
 #include <stdio.h>
+#include <tuple>
 
 #include <boost/thread.hpp>
 
@@ -178,3 +181,107 @@ void DeleteLock(void* cs)
 }
 
 #endif /* DEBUG_LOCKORDER */
+
+std::atomic<bool> fLockProfiling(false);
+
+namespace {
+struct CLockSite
+{
+    const char *pszName;
+    const char *pszFile;
+    int nLine;
+
+    bool operator<(const CLockSite &other) const
+    {
+        if (pszFile != other.pszFile)
+            return pszFile < other.pszFile;
+        if (nLine != other.nLine)
+            return nLine < other.nLine;
+        return pszName < other.pszName;
+    }
+};
+
+// The sites are spread over a few independently locked maps so that the
+// threads recording them do not all queue on one mutex.
+static const size_t LOCK_PROFILE_SHARDS = 16;
+
+struct LockProfileData {
+    // As in LockData, locks can still be released by global destructors
+    // after this is gone.
+    bool available;
+    LockProfileData() : available(true) {}
+    ~LockProfileData() { available = false; }
+
+    struct Shard {
+        boost::mutex mutex;
+        std::map<CLockSite, CLockSiteStats> sites;
+    } shards[LOCK_PROFILE_SHARDS];
+} static lockprofile;
+}
+
+void RecordLockProfile(const char *pszName, const char *pszFile, int nLine, bool fContended, int64_t nWaitMicros,
+                       int64_t nHoldMicros)
+{
+    if (!lockprofile.available)
+        return;
+
+    CLockSite site = {pszName, pszFile, nLine};
+    LockProfileData::Shard &shard = lockprofile.shards[((size_t)pszFile + nLine) % LOCK_PROFILE_SHARDS];
+    boost::unique_lock<boost::mutex> lock(shard.mutex);
+    auto it = shard.sites.find(site);
+    if (it == shard.sites.end())
+    {
+        CLockSiteStats stats = {pszName, pszFile, nLine, 0, 0, 0, 0, 0, 0};
+        it = shard.sites.emplace(site, stats).first;
+    }
+    CLockSiteStats &stats = it->second;
+    stats.nCount++;
+    stats.nContended += fContended;
+    stats.nWaitMicros += nWaitMicros;
+    stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, nWaitMicros);
+    stats.nHoldMicros += nHoldMicros;
+    stats.nMaxHoldMicros = std::max(stats.nMaxHoldMicros, nHoldMicros);
+}
+
+std::vector<CLockSiteStats> GetLockProfile()
+{
+    // A header locked from several translation units has one __FILE__
+    // string in each, so the sites are merged by their text.
+    std::map<std::tuple<std::string, int, std::string>, CLockSiteStats> mapMerged;
+    for (LockProfileData::Shard &shard : lockprofile.shards)
+    {
+        boost::unique_lock<boost::mutex> lock(shard.mutex);
+        for (const auto &it : shard.sites)
+        {
+            const CLockSiteStats &stats = it.second;
+            auto ret = mapMerged.emplace(std::make_tuple(stats.strFile, stats.nLine, stats.strName), stats);
+            if (ret.second)
+                continue;
+            CLockSiteStats &merged = ret.first->second;
+            merged.nCount += stats.nCount;
+            merged.nContended += stats.nContended;
+            merged.nWaitMicros += stats.nWaitMicros;
+            merged.nMaxWaitMicros = std::max(merged.nMaxWaitMicros, stats.nMaxWaitMicros);
+            merged.nHoldMicros += stats.nHoldMicros;
+            merged.nMaxHoldMicros = std::max(merged.nMaxHoldMicros, stats.nMaxHoldMicros);
+        }
+    }
+
+    std::vector<CLockSiteStats> vStats;
+    vStats.reserve(mapMerged.size());
+    for (const auto &it : mapMerged)
+        vStats.push_back(it.second);
+    std::sort(vStats.begin(), vStats.end(), [](const CLockSiteStats &a, const CLockSiteStats &b) {
+        return a.nWaitMicros + a.nHoldMicros > b.nWaitMicros + b.nHoldMicros;
+    });
+    return vStats;
+}
+
+void ResetLockProfile()
+{
+    for (LockProfileData::Shard &shard : lockprofile.shards)
+    {
+        boost::unique_lock<boost::mutex> lock(shard.mutex);
+        shard.sites.clear();
+    }
+}
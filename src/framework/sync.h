@@ -8,6 +8,12 @@
 
 #include "framework/threadsafety.h"
 
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
@@ -120,6 +126,43 @@ typedef boost::condition_variable CConditionVariable;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lock profiling (-lockprofile). While enabled, every LOCK, LOCK2 and TRY_LOCK
+ * records how long it waited for the mutex and how long it held it, by call
+ * site. Nested acquisitions of a recursive lock are counted as well, without
+ * waiting.
+ */
+extern std::atomic<bool> fLockProfiling;
+
+static const bool DEFAULT_LOCKPROFILE = false;
+
+struct CLockSiteStats
+{
+    std::string strName; //!< The expression that was locked, as written at the call site
+    std::string strFile;
+    int nLine;
+    uint64_t nCount; //!< Times the lock was taken here
+    uint64_t nContended; //!< Times it was held by another thread when asked for
+    int64_t nWaitMicros;
+    int64_t nMaxWaitMicros;
+    int64_t nHoldMicros;
+    int64_t nMaxHoldMicros;
+};
+
+static inline int64_t GetLockProfileMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RecordLockProfile(const char *pszName, const char *pszFile, int nLine, bool fContended, int64_t nWaitMicros,
+                       int64_t nHoldMicros);
+
+/** The statistics of every call site recorded so far, busiest lock first. */
+std::vector<CLockSiteStats> GetLockProfile();
+
+void ResetLockProfile();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template<typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
@@ -127,9 +170,38 @@ class SCOPED_LOCKABLE CMutexLock
 private:
     boost::unique_lock<Mutex> lock;
 
+    // Set when the acquisition is profiled, to be recorded on release.
+    const char *pszProfileName;
+    const char *pszProfileFile;
+    int nProfileLine;
+    bool fProfileContended;
+    int64_t nProfileWait;
+    int64_t nProfileLocked;
+
+    void StartProfile(const char *pszName, const char *pszFile, int nLine, bool fContended, int64_t nWait,
+                      int64_t nLocked)
+    {
+        pszProfileName = pszName;
+        pszProfileFile = pszFile;
+        nProfileLine = nLine;
+        fProfileContended = fContended;
+        nProfileWait = nWait;
+        nProfileLocked = nLocked;
+    }
+
     void Enter(const char *pszName, const char *pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void *)(lock.mutex()));
+        if (fLockProfiling.load(std::memory_order_relaxed))
+        {
+            int64_t nStart = GetLockProfileMicros();
+            bool fContended = !lock.try_lock();
+            if (fContended)
+                lock.lock();
+            int64_t nLocked = GetLockProfileMicros();
+            StartProfile(pszName, pszFile, nLine, fContended, nLocked - nStart, nLocked);
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -146,12 +218,14 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (fLockProfiling.load(std::memory_order_relaxed))
+            StartProfile(pszName, pszFile, nLine, false, 0, GetLockProfileMicros()); // a try-lock never waits
         return lock.owns_lock();
     }
 
 public:
     CMutexLock(Mutex &mutexIn, const char *pszName, const char *pszFile, int nLine,
-               bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock)
+               bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock), nProfileLocked(0)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -160,7 +234,7 @@ public:
     }
 
     CMutexLock(Mutex *pmutexIn, const char *pszName, const char *pszFile, int nLine,
-               bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
+               bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn) : nProfileLocked(0)
     {
         if (!pmutexIn)
             return;
@@ -175,7 +249,14 @@ public:
     ~CMutexLock() UNLOCK_FUNCTION()
     {
         if (lock.owns_lock())
+        {
+            int64_t nHold = nProfileLocked ? GetLockProfileMicros() - nProfileLocked : 0;
             LeaveCritical();
+            // Recorded once released, so that the other threads do not wait on the profiler.
+            lock.unlock();
+            if (nProfileLocked)
+                RecordLockProfile(pszProfileName, pszProfileFile, nProfileLine, fProfileContended, nProfileWait, nHold);
+        }
     }
 
     operator bool()
@@ -21,6 +21,8 @@ enum NetNodeFlags
     NF_NEWBLOCK = (1 << 13),
     NF_NEWTRANSACTION = (1 << 14),
     NF_LASTBLOCKANNOUNCE = (1 << 15),
+    NF_REJECTTRANSACTION = (1 << 16),
+    NF_PREVERIFIED = (1 << 17),
 
 };
 
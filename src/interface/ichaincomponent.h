@@ -13,6 +13,8 @@
 
 class CBlock;
 
+class CBlockFilterIndex;
+
 class CDataStream;
 
 enum FlushStateMode
@@ -54,6 +56,9 @@ public:
 
     virtual bool IsTxIndex() const = 0;
 
+    /** The block filter index, or nullptr if -blockfilterindex is not set. */
+    virtual CBlockFilterIndex *GetBlockFilterIndex() = 0;
+
     virtual bool IsLogEvents() = 0;
 
     virtual bool IsInitialBlockDownload() = 0;
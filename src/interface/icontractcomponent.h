@@ -11,6 +11,10 @@
 #include "contract-api/contractbase.h"
 #include "contract-api/storageresults.h"
 
+#include <memory>
+
+class SbtcStateSnapshot;
+
 class IContractComponent : public appbase::TComponent<IContractComponent>
 {
 public:
@@ -43,10 +47,20 @@ public:
     virtual bool AddressInUse(string contractaddress) = 0;
 
     virtual bool CheckContractTx(const CTransaction tx, const CAmount nFees,
-                                 CAmount &nMinGasPrice, int &level,
+                                 CAmount &nMinGasPrice, uint64_t &nGasLimit, int &level,
                                  string &errinfo, const CAmount nAbsurdFee = 0, bool rawTx = false) = 0;
 
-    virtual bool RunContractTx(CTransaction tx, CCoinsViewCache *v, CBlock *pblock,
+    // Copy-on-write fork of the state at the active tip for block assembly, nullptr before the
+    // contract fork. Requires cs_main; the snapshot itself does not.
+    virtual std::shared_ptr<SbtcStateSnapshot> ForkTipState() = 0;
+
+    // Executes the contract outputs of tx on top of the active tip without keeping the changes, for the
+    // gas they use and the first exception they raise (see GetExceptedInfo). Requires cs_main.
+    virtual bool PreExecuteContractTx(const CTransaction &tx, CCoinsViewCache *v, uint64_t &gasUsed,
+                                      uint32_t &excepted) = 0;
+
+    // Executes tx at the end of pblock in snapshot, which is left at the resulting state.
+    virtual bool RunContractTx(SbtcStateSnapshot &snapshot, CTransaction tx, CCoinsViewCache *v, CBlock *pblock,
                                uint64_t minGasPrice,
                                uint64_t hardBlockGasLimit,
                                uint64_t softBlockGasLimit,
@@ -67,6 +81,14 @@ public:
 
     virtual void UpdateState(uint256 hashStateRoot, uint256 hashUTXORoot) = 0;
 
+    // Block-level write set: while active, contract execution keeps its trie nodes in memory
+    // and nothing reaches the state databases until CommitBlockState().
+    virtual void BeginBlockState() = 0;
+
+    virtual void CommitBlockState() = 0;
+
+    virtual void DiscardBlockState() = 0;
+
     virtual void DeleteResults(std::vector<CTransactionRef> const &txs) = 0;
 
     virtual std::vector<TransactionReceiptInfo> GetResult(uint256 const &hashTx) = 0;
@@ -98,3 +120,35 @@ public:
 
 #define GET_CONTRACT_INTERFACE(ifObj) \
     auto ifObj = GetApp()->FindComponent<IContractComponent>()
+
+/** Scope of one block's contract state write set, discarded on destruction unless committed. */
+class CContractBlockState
+{
+public:
+    explicit CContractBlockState(IContractComponent *_ifContractObj) : ifContractObj(_ifContractObj), fDone(false)
+    {
+        ifContractObj->BeginBlockState();
+    }
+
+    ~CContractBlockState()
+    {
+        if (!fDone)
+        {
+            ifContractObj->DiscardBlockState();
+        }
+    }
+
+    void Commit()
+    {
+        ifContractObj->CommitBlockState();
+        fDone = true;
+    }
+
+    CContractBlockState(const CContractBlockState &) = delete;
+
+    CContractBlockState &operator=(const CContractBlockState &) = delete;
+
+private:
+    IContractComponent *ifContractObj;
+    bool fDone;
+};
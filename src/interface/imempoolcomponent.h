@@ -52,6 +52,22 @@ public:
 
     virtual bool RemoveOrphanTxForBlock(const CBlock *pblock) = 0;
 
+    /**
+     * Verify the input scripts of vtx on the mempool verification threads,
+     * and cache the ones that pass so that AcceptToMemoryPool does not verify
+     * them again under cs_main. Transactions failing the checks that come
+     * before the scripts in AcceptToMemoryPool are not verified.
+     * vCoinsToUncache[i] receives the coins fetched into the coins cache for
+     * vtx[i]; pass it to UncacheUnaccepted once vtx has been submitted.
+     * Must be called without cs_main held.
+     */
+    virtual void PreVerifyTransactions(const std::vector<CTransactionRef> &vtx,
+                                       std::vector<std::vector<COutPoint>> &vCoinsToUncache) = 0;
+
+    /** Drop the coins PreVerifyTransactions fetched for the transactions of vtx that are not in the mempool. */
+    virtual void UncacheUnaccepted(const std::vector<CTransactionRef> &vtx,
+                                   const std::vector<std::vector<COutPoint>> &vCoinsToUncache) = 0;
+
     //add other interface methods here ...
 
 };
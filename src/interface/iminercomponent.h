@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include "base/base.hpp"
 #include "componentid.h"
@@ -10,6 +11,10 @@
 
 class CBlock;
 
+class CScript;
+
+struct CBlockTemplate;
+
 class IMinerComponent : public appbase::TComponent<IMinerComponent>
 {
 public:
@@ -33,6 +38,10 @@ public:
 
     virtual bool ComponentShutdown() = 0;
 
+    /** The block template on top of the active tip, kept up to date between calls. */
+    virtual std::unique_ptr<CBlockTemplate>
+    GetBlockTemplate(const CScript &scriptPubKeyIn, bool fMineWitnessTx = true) = 0;
+
     //add other interface methods here ...
 
 };
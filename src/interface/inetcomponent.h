@@ -36,6 +36,8 @@ public:
 
     virtual bool SendNetMessage(int64_t nodeID, const std::string &command, const std::vector<unsigned char> &data) = 0;
 
+    virtual bool SendNetMessage(int64_t nodeID, const std::string &command, std::vector<unsigned char> &&data) = 0;
+
     virtual bool BroadcastTransaction(uint256 txHash) = 0;
 
     virtual bool RelayCmpctBlock(const CBlockIndex *pindex, void *pcmpctblock, bool fWitnessEnabled) = 0;
@@ -10,12 +10,30 @@
 #include "sbtccore/clientversion.h"
 #include "p2p/net_processing.h"
 #include "wallet/fees.h"
+#include "interface/ichaincomponent.h"
+#include "sbtccore/block/validation.h"
+#include "sbtccore/transaction/policy.h"
+#include "sbtccore/transaction/script/scriptcheck.h"
+
+#include <boost/bind.hpp>
 
 SET_CPP_SCOPED_LOG_CATEGORY(CID_TX_MEMPOOL);
 
 static const char *FEE_ESTIMATES_FILENAME = "fee_estimates.dat";
 
+/** Number of transactions read from mempool.dat and verified together */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+/** Records the mempool journal may hold before being rewritten into mempool.dat, if the mempool is smaller */
+static const size_t MEMPOOL_JOURNAL_MIN_RECORDS = 1000;
+
+void CMempoolComponent::ThreadScriptCheck()
+{
+    RenameThread("super_bitcoin-mempoolch");
+    scriptCheckQueue.Thread();
+}
+
 CMempoolComponent::CMempoolComponent()
+        : scriptCheckQueue(16)
 {
 
 }
@@ -30,6 +48,18 @@ bool CMempoolComponent::ComponentInitialize()
 
     InitializeForNet();
 
+    // -parmempool=0 means autodetect, but nScriptCheckThreads==0 means verifying on the calling thread
+    nScriptCheckThreads = Args().GetArg<int32_t>("-parmempool", DEFAULT_MEMPOOL_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += GetNumCores();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    NLogFormat("Using %u threads for mempool script verification.", nScriptCheckThreads);
+    for (int i = 0; i < nScriptCheckThreads; i++)
+        threadGroup.create_thread(boost::bind(&CMempoolComponent::ThreadScriptCheck, this));
+
     InitFeeEstimate();
     GetMemPool().SetEstimator(&feeEstimator);
 
@@ -37,6 +67,17 @@ bool CMempoolComponent::ComponentInitialize()
     {
         LoadMempool();
         bDumpMempoolLater = true;
+
+        mempool.NotifyEntryAdded.connect(boost::bind(&CMempoolComponent::MarkDumpDirty, this, _1));
+        mempool.NotifyEntryRemoved.connect(boost::bind(&CMempoolComponent::MarkDumpDirty, this, _1));
+        unsigned int nDumpInterval = Args().GetArg<unsigned int>("-mempooldumpinterval",
+                                                                 DEFAULT_MEMPOOL_DUMP_INTERVAL);
+        if (nDumpInterval)
+            GetApp()->GetScheduler().scheduleEvery(std::bind(&CMempoolComponent::DumpMempoolIncremental, this),
+                                                   nDumpInterval * 60 * 1000);
+
+        if (!vLoadedUnverified.empty())
+            threadGroup.create_thread(boost::bind(&CMempoolComponent::ThreadVerifyLoaded, this));
     }
     return true;
 }
@@ -54,8 +95,13 @@ bool CMempoolComponent::ComponentShutdown()
     if (bDumpMempoolLater && Args().GetArg<bool>("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
     {
         DumpMempool();
+        mempool.NotifyEntryAdded.disconnect(boost::bind(&CMempoolComponent::MarkDumpDirty, this, _1));
+        mempool.NotifyEntryRemoved.disconnect(boost::bind(&CMempoolComponent::MarkDumpDirty, this, _1));
     }
     FlushFeeEstimate();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
     return true;
 }
 
@@ -64,6 +110,98 @@ CTxMemPool &CMempoolComponent::GetMemPool()
     return mempool;
 }
 
+static fs::path GetMempoolJournalPath()
+{
+    return Args().GetDataDir() / "mempool.journal";
+}
+
+static void ApplyDumpBatch(CMempoolDumpBatch &batch, uint256 &hashTip, std::map<uint256, CMempoolDumpEntry> &mapEntries,
+                           std::map<uint256, CAmount> &mapDeltas)
+{
+    hashTip = batch.hashTip;
+    for (CMempoolDumpEntry &dumped : batch.vEntries)
+    {
+        uint256 hash = dumped.tx->GetHash();
+        mapEntries[hash] = std::move(dumped);
+    }
+    for (const uint256 &hash : batch.vRemoved)
+    {
+        mapEntries.erase(hash);
+    }
+    mapDeltas.swap(batch.mapDeltas);
+}
+
+/** Replays the journal written against the mempool.dat identified by nDumpId. */
+static void ReadMempoolJournal(uint64_t nDumpId, uint256 &hashTip, std::map<uint256, CMempoolDumpEntry> &mapEntries,
+                               std::map<uint256, CAmount> &mapDeltas)
+{
+    CAutoFile file(fsbridge::fopen(GetMempoolJournalPath(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+    {
+        return;
+    }
+
+    int nBatches = 0;
+    try
+    {
+        uint64_t version;
+        uint64_t nFileDumpId;
+        file >> version;
+        file >> nFileDumpId;
+        if (version != MEMPOOL_DUMP_VERSION || nFileDumpId != nDumpId)
+        {
+            return;
+        }
+        while (true)
+        {
+            CMempoolDumpBatch batch;
+            file >> batch;
+            ApplyDumpBatch(batch, hashTip, mapEntries, mapDeltas);
+            nBatches++;
+        }
+    } catch (const std::exception &)
+    {
+        // The end of the journal, or a batch cut short by an unclean shutdown.
+    }
+    NLogFormat("Replayed %d batches of changes to the mempool from disk", nBatches);
+}
+
+/** Orders the entries so that parents come before their children. */
+static void SortDumpEntries(std::map<uint256, CMempoolDumpEntry> &mapEntries, std::vector<CMempoolDumpEntry> &vEntries)
+{
+    std::vector<uint256> vOrder;
+    std::map<uint256, size_t> mapParentsLeft;
+    std::multimap<uint256, uint256> mapChildren;
+    for (const auto &i : mapEntries)
+    {
+        std::set<uint256> setParents;
+        for (const CTxIn &txin : i.second.tx->vin)
+        {
+            if (mapEntries.count(txin.prevout.hash) && setParents.insert(txin.prevout.hash).second)
+                mapChildren.emplace(txin.prevout.hash, i.first);
+        }
+        if (setParents.empty())
+            vOrder.push_back(i.first);
+        else
+            mapParentsLeft[i.first] = setParents.size();
+    }
+    for (size_t i = 0; i < vOrder.size(); i++)
+    {
+        auto range = mapChildren.equal_range(vOrder[i]);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (--mapParentsLeft[it->second] == 0)
+                vOrder.push_back(it->second);
+        }
+    }
+
+    vEntries.reserve(vOrder.size());
+    for (const uint256 &hash : vOrder)
+    {
+        vEntries.push_back(std::move(mapEntries[hash]));
+    }
+}
+
 bool CMempoolComponent::LoadMempool(void)
 {
     const CChainParams &chainparams = Params();
@@ -80,35 +218,110 @@ bool CMempoolComponent::LoadMempool(void)
     int64_t failed = 0;
     int64_t nNow = GetTime();
 
+    // The tip the stored entries were valid on top of, null if unknown.
+    uint256 hashTip;
+    std::map<uint256, CMempoolDumpEntry> mapEntries;
+    std::map<uint256, CAmount> mapDeltas;
     try
     {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION)
+        if (version == MEMPOOL_DUMP_VERSION_V1)
+        {
+            uint64_t num;
+            file >> num;
+            while (num)
+            {
+                num--;
+                CMempoolDumpEntry dumped;
+                int64_t nFeeDelta;
+                file >> dumped.tx;
+                file >> dumped.nTime;
+                file >> nFeeDelta;
+                uint256 hash = dumped.tx->GetHash();
+                if (nFeeDelta)
+                    mapDeltas[hash] = nFeeDelta;
+                mapEntries[hash] = std::move(dumped);
+            }
+            std::map<uint256, CAmount> mapOtherDeltas;
+            file >> mapOtherDeltas;
+            mapDeltas.insert(mapOtherDeltas.begin(), mapOtherDeltas.end());
+        } else if (version == MEMPOOL_DUMP_VERSION)
+        {
+            uint64_t nFileDumpId;
+            CMempoolDumpBatch batch;
+            file >> nFileDumpId;
+            file >> batch;
+            ApplyDumpBatch(batch, hashTip, mapEntries, mapDeltas);
+            ReadMempoolJournal(nFileDumpId, hashTip, mapEntries, mapDeltas);
+        } else
         {
             return false;
         }
-        uint64_t num;
-        file >> num;
-        while (num--)
+    } catch (const std::exception &e)
+    {
+        return rLogError("Failed to deserialize mempool data on disk: %s. Continuing anyway", e.what());
+    }
+
+    for (const auto &i : mapDeltas)
+    {
+        mempool.PrioritiseTransaction(i.first, i.second);
+    }
+
+    std::vector<CMempoolDumpEntry> vEntries;
+    SortDumpEntries(mapEntries, vEntries);
+
+    // While the tip is the one the entries were stored on top of, they are
+    // added back as they were, and only their scripts are verified again, in
+    // the background. Otherwise they go through AcceptToMemoryPool.
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CCoinsViewCache *pcoinsTip = ifChainObj->GetCoinsTip();
+    bool fTrusted = !hashTip.IsNull();
+    for (size_t nStart = 0; nStart < vEntries.size(); nStart += MEMPOOL_LOAD_BATCH_SIZE)
+    {
+        const size_t nEnd = std::min(vEntries.size(), nStart + MEMPOOL_LOAD_BATCH_SIZE);
+        std::vector<const CMempoolDumpEntry *> vBatch;
+        for (size_t i = nStart; i < nEnd; i++)
         {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
+            if (vEntries[i].nTime + nExpiryTimeout > nNow)
+                vBatch.push_back(&vEntries[i]);
+            else
+                ++skipped;
+        }
 
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta)
+        if (fTrusted)
+        {
+            LOCK2(cs_main, mempool.cs);
+            const CBlockIndex *pindexTip = ifChainObj->GetActiveChain().Tip();
+            fTrusted = pindexTip && pindexTip->GetBlockHash() == hashTip;
+            for (size_t i = 0; fTrusted && i < vBatch.size(); i++)
+            {
+                if (AddLoadedEntry(*vBatch[i], pcoinsTip, pindexTip))
+                {
+                    ++count;
+                } else
+                {
+                    ++failed;
+                }
+            }
+        }
+        if (!fTrusted)
+        {
+            // The scripts of a batch are verified together first. A transaction spending
+            // another one of the same batch is left to AcceptToMemoryPool.
+            std::vector<CTransactionRef> vtx;
+            for (const CMempoolDumpEntry *dumped : vBatch)
             {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                vtx.push_back(dumped->tx);
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow)
+            std::vector<std::vector<COutPoint>> vCoinsToUncache;
+            PreVerifyTransactions(vtx, vCoinsToUncache);
+            for (const CMempoolDumpEntry *dumped : vBatch)
             {
-                LOCK(cs);
-                mempool.AcceptToMemoryPoolWithTime(chainparams, state, tx, true, nullptr, nTime, nullptr, false, 0);
+                CValidationState state;
+                LOCK2(cs_main, cs);
+                mempool.AcceptToMemoryPoolWithTime(chainparams, state, dumped->tx, true, nullptr, dumped->nTime,
+                                                   nullptr, false, 0);
                 if (state.IsValid())
                 {
                     ++count;
@@ -116,44 +329,268 @@ bool CMempoolComponent::LoadMempool(void)
                 {
                     ++failed;
                 }
+            }
+            UncacheUnaccepted(vtx, vCoinsToUncache);
+        }
+        if (GetApp()->ShutdownRequested())
+            return false;
+    }
+
+    if (!vLoadedUnverified.empty())
+    {
+        // AcceptToMemoryPool limits the size as it goes.
+        LOCK(cs_main);
+        mempool.LimitMempoolSize(Args().GetArg<uint32_t>("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+                                 nExpiryTimeout);
+    }
+
+    NLogFormat("Imported mempool transactions from disk: %i successes (%u awaiting script checks), %i failed, %i expired",
+               count, vLoadedUnverified.size(), failed, skipped);
+    return true;
+}
+
+bool CMempoolComponent::AddLoadedEntry(const CMempoolDumpEntry &dumped, CCoinsViewCache *pcoinsTip,
+                                       const CBlockIndex *pindexTip)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    const CTransaction &tx = *dumped.tx;
+    if (mempool.exists(tx.GetHash()))
+        return false;
+
+    // Each input must still be there, and not be spent by another transaction
+    // of the mempool.
+    CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+    std::vector<CTxOut> vSpent;
+    for (const CTxIn &txin : tx.vin)
+    {
+        Coin coin;
+        if (mempool.mapNextTx.count(txin.prevout) || !viewMemPool.GetCoin(txin.prevout, coin))
+            return false;
+        vSpent.push_back(coin.out);
+    }
+
+    LockPoints lp;
+    if (!mempool.CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+        return false;
+
+    CTxMemPoolEntry entry(dumped.tx, dumped.nFee, dumped.nTime, dumped.nHeight, dumped.fSpendsCoinbase,
+                          dumped.nSigOpCost, lp, dumped.nMinGasPrice, dumped.nGasLimit);
+    // A result worked out on top of another tip is dropped, the entry is executed again. //sbtc-vm
+    if (!dumped.hashExecTip.IsNull() && dumped.hashExecTip == pindexTip->GetBlockHash())
+        entry.UpdateContractExec(dumped.nGasEstimate, dumped.nExcepted, pindexTip);
+    mempool.addUnchecked(tx.GetHash(), entry, false);
+    // Neither relayed nor mined until ThreadVerifyLoaded has checked its scripts
+    mempool.setUnverified.insert(tx.GetHash());
+    vLoadedUnverified.emplace_back(dumped.tx, std::move(vSpent));
+    return true;
+}
+
+void CMempoolComponent::ThreadVerifyLoaded()
+{
+    RenameThread("super_bitcoin-mempoolld");
+
+    std::vector<std::pair<CTransactionRef, std::vector<CTxOut>>> vLoaded;
+    vLoaded.swap(vLoadedUnverified);
+
+    size_t nInvalid = 0;
+    for (size_t nStart = 0; nStart < vLoaded.size(); nStart += MEMPOOL_LOAD_BATCH_SIZE)
+    {
+        boost::this_thread::interruption_point();
+
+        const size_t nEnd = std::min(vLoaded.size(), nStart + MEMPOOL_LOAD_BATCH_SIZE);
+        std::vector<CTxScriptCheck> vChecks;
+        std::vector<char> vValid(nEnd - nStart, false);
+        for (size_t i = nStart; i < nEnd; i++)
+        {
+            vChecks.emplace_back(vLoaded[i].first, vLoaded[i].second, STANDARD_SCRIPT_VERIFY_FLAGS,
+                                 &vValid[i - nStart]);
+        }
+        {
+            // A batch handed to the check queue is seen through.
+            boost::this_thread::disable_interruption di;
+            RunScriptChecks(vChecks);
+        }
+
+        LOCK(cs_main);
+        for (size_t i = nStart; i < nEnd; i++)
+        {
+            const CTransaction &tx = *vLoaded[i].first;
+            if (vValid[i - nStart])
+            {
+                scriptExecutionCache.insert(GetScriptExecutionCacheEntry(tx, STANDARD_SCRIPT_VERIFY_FLAGS));
+                mempool.markVerified(tx.GetHash());
             } else
             {
-                ++skipped;
+                WLogFormat("Removing %s loaded from disk: script verification failed", tx.GetHash().ToString());
+                mempool.removeRecursive(tx);
+                ++nInvalid;
             }
-            if (GetApp()->ShutdownRequested())
-                return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
+    }
+    NLogFormat("Verified the scripts of %u transactions loaded from disk, %u failed", vLoaded.size(), nInvalid);
+}
+
+void CMempoolComponent::RunScriptChecks(std::vector<CTxScriptCheck> &vChecks)
+{
+    if (nScriptCheckThreads)
+    {
+        CCheckQueueControl<CTxScriptCheck> control(&scriptCheckQueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else
+    {
+        for (auto &check : vChecks)
+            check();
+    }
+}
+
+void CMempoolComponent::PreVerifyTransactions(const std::vector<CTransactionRef> &vtx,
+                                              std::vector<std::vector<COutPoint>> &vCoinsToUncache)
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CCoinsViewCache *pcoinsTip = ifChainObj->GetCoinsTip();
+
+    vCoinsToUncache.assign(vtx.size(), std::vector<COutPoint>());
 
-        for (const auto &i : mapDeltas)
+    // Copy the outputs each transaction spends, so that the scripts run without
+    // cs_main. Transactions that AcceptToMemoryPool would turn down without
+    // looking at their scripts, or with missing inputs, are left to it.
+    std::vector<size_t> vChecked;
+    std::vector<CTxScriptCheck> vChecks;
+    std::vector<char> vValid(vtx.size(), false);
+    {
+        LOCK2(cs_main, mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        const size_t nMaxMempool = Args().GetArg<uint32_t>("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+        for (size_t i = 0; i < vtx.size(); i++)
         {
-            mempool.PrioritiseTransaction(i.first, i.second);
+            const CTransactionRef &ptx = vtx[i];
+            CValidationState state;
+            if (!ptx->PreCheck(ENTER_MEMPOOL, state) || mempool.exists(ptx->GetHash()) ||
+                scriptExecutionCache.contains(GetScriptExecutionCacheEntry(*ptx, STANDARD_SCRIPT_VERIFY_FLAGS), false))
+                continue;
+
+            std::vector<CTxOut> vSpent;
+            std::vector<COutPoint> &vUncache = vCoinsToUncache[i];
+            CAmount nValueIn = 0;
+            for (const CTxIn &txin : ptx->vin)
+            {
+                if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+                    vUncache.push_back(txin.prevout);
+                Coin coin;
+                if (!viewMemPool.GetCoin(txin.prevout, coin))
+                    break;
+                nValueIn += coin.out.nValue;
+                vSpent.push_back(coin.out);
+            }
+
+            bool fSkip = vSpent.size() < ptx->vin.size();
+            if (!fSkip)
+            {
+                CAmount nModifiedFees = nValueIn - ptx->GetValueOut();
+                mempool.ApplyDelta(ptx->GetHash(), nModifiedFees);
+                int64_t nSize = GetVirtualTransactionSize(*ptx);
+                fSkip = nModifiedFees < mempool.GetMinFee(nMaxMempool).GetFee(nSize) ||
+                        nModifiedFees < ::minRelayTxFee.GetFee(nSize);
+            }
+            if (fSkip)
+            {
+                for (const COutPoint &outpoint : vUncache)
+                    pcoinsTip->Uncache(outpoint);
+                vUncache.clear();
+                continue;
+            }
+
+            vChecks.emplace_back(ptx, vSpent, STANDARD_SCRIPT_VERIFY_FLAGS, &vValid[i]);
+            vChecked.push_back(i);
         }
-    } catch (const std::exception &e)
+    }
+
+    if (vChecks.empty())
+        return;
+
+    RunScriptChecks(vChecks);
+
+    // Only the successes are cached: AcceptToMemoryPool verifies a failed
+    // transaction again and reports why it was rejected.
+    LOCK(cs_main);
+    for (size_t i : vChecked)
     {
-        return rLogError("Failed to deserialize mempool data on disk: %s. Continuing anyway", e.what());
+        if (vValid[i])
+        {
+            scriptExecutionCache.insert(GetScriptExecutionCacheEntry(*vtx[i], STANDARD_SCRIPT_VERIFY_FLAGS));
+        } else
+        {
+            for (const COutPoint &outpoint : vCoinsToUncache[i])
+                pcoinsTip->Uncache(outpoint);
+            vCoinsToUncache[i].clear();
+        }
     }
+}
 
-    NLogFormat("Imported mempool transactions from disk: %i successes, %i failed, %i expired", count, failed,
-               skipped);
-    return true;
+void CMempoolComponent::UncacheUnaccepted(const std::vector<CTransactionRef> &vtx,
+                                          const std::vector<std::vector<COutPoint>> &vCoinsToUncache)
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CCoinsViewCache *pcoinsTip = ifChainObj->GetCoinsTip();
+
+    LOCK2(cs_main, mempool.cs);
+    for (size_t i = 0; i < vtx.size() && i < vCoinsToUncache.size(); i++)
+    {
+        if (mempool.exists(vtx[i]->GetHash()))
+            continue;
+        for (const COutPoint &outpoint : vCoinsToUncache[i])
+            pcoinsTip->Uncache(outpoint);
+    }
+}
+
+/** Adds the entries to batch, parents before children as they have fewer ancestors. */
+static void AddDumpEntries(std::vector<CTxMemPool::txiter> &vEntries, CMempoolDumpBatch &batch)
+{
+    std::sort(vEntries.begin(), vEntries.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b)
+    {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    });
+    batch.vEntries.reserve(batch.vEntries.size() + vEntries.size());
+    for (CTxMemPool::txiter it : vEntries)
+    {
+        batch.vEntries.emplace_back(*it);
+    }
+}
+
+void CMempoolComponent::MarkDumpDirty(CTransactionRef tx)
+{
+    LOCK(csDumpDirty);
+    setDumpDirty.insert(tx->GetHash());
 }
 
 void CMempoolComponent::DumpMempool(void)
 {
     int64_t start = GetTimeMicros();
 
-    std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
-
+    LOCK(csDump);
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CMempoolDumpBatch batch;
     {
-        LOCK(cs);
-        for (const auto &i : mempool.mapDeltas)
+        // cs_main, so that the entries are all valid on top of the tip.
+        LOCK2(cs_main, mempool.cs);
+        {
+            LOCK(csDumpDirty);
+            setDumpDirty.clear();
+        }
+        const CBlockIndex *pindexTip = ifChainObj->GetActiveChain().Tip();
+        if (pindexTip)
+            batch.hashTip = pindexTip->GetBlockHash();
+        batch.mapDeltas = mempool.mapDeltas;
+        std::vector<CTxMemPool::txiter> vEntries;
+        vEntries.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
         {
-            mapDeltas[i.first] = i.second;
+            vEntries.push_back(it);
         }
-        vinfo = mempool.infoAll();
+        AddDumpEntries(vEntries, batch);
     }
 
     int64_t mid = GetTimeMicros();
@@ -169,21 +606,18 @@ void CMempoolComponent::DumpMempool(void)
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
+        uint64_t nNewDumpId = GetRand(std::numeric_limits<uint64_t>::max() - 1) + 1;
         file << version;
+        file << nNewDumpId;
+        file << batch;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto &i : vinfo)
-        {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetHash());
-        }
-
-        file << mapDeltas;
         FileCommit(file.Get());
         file.fclose();
         RenameOver(Args().GetDataDir() / "mempool.dat.new", Args().GetDataDir() / "mempool.dat");
+        // The old journal belongs to the old mempool.dat, a leftover one is ignored for its id.
+        fs::remove(GetMempoolJournalPath());
+        nDumpId = nNewDumpId;
+        nJournalRecords = 0;
         int64_t last = GetTimeMicros();
         NLogFormat("Dumped mempool: %gs to copy, %gs to dump", (mid - start) * 0.000001, (last - mid) * 0.000001);
     } catch (const std::exception &e)
@@ -192,6 +626,81 @@ void CMempoolComponent::DumpMempool(void)
     }
 }
 
+void CMempoolComponent::DumpMempoolIncremental()
+{
+    LOCK(csDump);
+    // A journal needs a mempool.dat of this process, and is rewritten into one
+    // once it holds more records than the mempool has entries.
+    if (!nDumpId)
+    {
+        DumpMempool();
+        return;
+    }
+    size_t nDirty;
+    {
+        LOCK(csDumpDirty);
+        nDirty = setDumpDirty.size();
+    }
+    if (!nDirty)
+        return;
+    if (nJournalRecords + nDirty > std::max(mempool.size(), MEMPOOL_JOURNAL_MIN_RECORDS))
+    {
+        DumpMempool();
+        return;
+    }
+
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CMempoolDumpBatch batch;
+    {
+        LOCK2(cs_main, mempool.cs);
+        std::set<uint256> setDirty;
+        {
+            LOCK(csDumpDirty);
+            setDirty.swap(setDumpDirty);
+        }
+
+        const CBlockIndex *pindexTip = ifChainObj->GetActiveChain().Tip();
+        if (pindexTip)
+            batch.hashTip = pindexTip->GetBlockHash();
+        batch.mapDeltas = mempool.mapDeltas;
+        std::vector<CTxMemPool::txiter> vAdded;
+        for (const uint256 &hash : setDirty)
+        {
+            CTxMemPool::txiter it = mempool.mapTx.find(hash);
+            if (it != mempool.mapTx.end())
+                vAdded.push_back(it);
+            else
+                batch.vRemoved.push_back(hash);
+        }
+        AddDumpEntries(vAdded, batch);
+    }
+
+    try
+    {
+        bool fNew = !fs::exists(GetMempoolJournalPath());
+        CAutoFile file(fsbridge::fopen(GetMempoolJournalPath(), "ab"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+        {
+            nDumpId = 0;
+            return;
+        }
+        if (fNew)
+        {
+            uint64_t version = MEMPOOL_DUMP_VERSION;
+            file << version;
+            file << nDumpId;
+        }
+        file << batch;
+        FileCommit(file.Get());
+        nJournalRecords += batch.vEntries.size() + batch.vRemoved.size();
+    } catch (const std::exception &e)
+    {
+        // What was taken from setDumpDirty is lost, so the next dump is a whole one.
+        nDumpId = 0;
+        ELogFormat("Failed to append to the mempool journal: %s. Continuing anyway", e.what());
+    }
+}
+
 void CMempoolComponent::InitFeeEstimate()
 {
     fs::path est_path = Args().GetDataDir() / FEE_ESTIMATES_FILENAME;
@@ -8,10 +8,14 @@
 
 #include <stdint.h>
 #include <log4cpp/Category.hh>
+#include <boost/thread.hpp>
 #include "util.h"
 #include "interface/imempoolcomponent.h"
 #include "orphantx.h"
 #include "txmempool.h"
+#include "txscriptcheck.h"
+#include "mempooldump.h"
+#include "sbtccore/checkqueue.h"
 
 class CMempoolComponent : public ITxMempoolComponent
 {
@@ -43,6 +47,24 @@ public:
 
     bool RemoveOrphanTxForBlock(const CBlock *pblock) override;
 
+    void PreVerifyTransactions(const std::vector<CTransactionRef> &vtx,
+                               std::vector<std::vector<COutPoint>> &vCoinsToUncache) override;
+
+    void UncacheUnaccepted(const std::vector<CTransactionRef> &vtx,
+                           const std::vector<std::vector<COutPoint>> &vCoinsToUncache) override;
+
+    /** Dump the mempool to disk, and start a new journal. */
+    void DumpMempool();
+
+    /** Append what changed since the last dump to the journal. */
+    void DumpMempoolIncremental();
+
+    /** Load the mempool from disk. */
+    bool LoadMempool();
+
+    /** Verifies the scripts of the entries LoadMempool added back without, and removes what fails. */
+    void ThreadVerifyLoaded();
+
 private:
 
     void InitializeForNet();
@@ -56,11 +78,29 @@ private:
 
     bool bDumpMempoolLater = false;
 
-    /** Dump the mempool to disk. */
-    void DumpMempool();
+    boost::thread_group threadGroup;
+    CCheckQueue<CTxScriptCheck> scriptCheckQueue;
+    int nScriptCheckThreads = 0;
 
-    /** Load the mempool from disk. */
-    bool LoadMempool();
+    CCriticalSection csDump; //!< Held while writing mempool.dat or mempool.journal
+    uint64_t nDumpId = 0; //!< Written in mempool.dat and its journal, 0 until this process wrote mempool.dat
+    size_t nJournalRecords = 0; //!< Entries and removals appended to the journal since mempool.dat
+
+    CCriticalSection csDumpDirty;
+    std::set<uint256> setDumpDirty; //!< Transactions added or removed since the last dump
+
+    /** Loaded from disk without their scripts being verified, with the outputs they spend */
+    std::vector<std::pair<CTransactionRef, std::vector<CTxOut>>> vLoadedUnverified;
+
+    void ThreadScriptCheck();
+
+    /** Runs the checks on the script check threads, or on this one if there are none. */
+    void RunScriptChecks(std::vector<CTxScriptCheck> &vChecks);
+
+    void MarkDumpDirty(CTransactionRef tx);
+
+    /** Add an entry loaded from disk as it was, its scripts aside. */
+    bool AddLoadedEntry(const CMempoolDumpEntry &dumped, CCoinsViewCache *pcoinsTip, const CBlockIndex *pindexTip);
 
     void InitFeeEstimate();
 
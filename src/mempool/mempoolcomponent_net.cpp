@@ -142,6 +142,26 @@ bool CMempoolComponent::NetReceiveTxData(ExNode *xnode, CDataStream &stream, uin
     txHash = tx.GetHash();
     CInv inv(MSG_TX, txHash);
 
+    // Verify the scripts before taking cs_main for the rest of the acceptance,
+    // so that the other peers and the RPC are not held up meanwhile, unless
+    // that was done with the batch the transaction arrived in.
+    const std::vector<CTransactionRef> vtx{ptx};
+    std::vector<std::vector<COutPoint>> vCoinsToUncache;
+    if (!IsFlagsBitOn(xnode->flags, NF_PREVERIFIED))
+    {
+        bool fExists;
+        {
+            LOCK(cs_main);
+            fExists = DoesTxExist(txHash);
+        }
+        if (!fExists)
+        {
+            PreVerifyTransactions(vtx, vCoinsToUncache);
+        }
+    }
+
+    LOCK(cs_main);
+
     std::deque<COutPoint> vWorkQueue;
     std::vector<uint256> vEraseQueue;
 
@@ -285,6 +305,9 @@ bool CMempoolComponent::NetReceiveTxData(ExNode *xnode, CDataStream &stream, uin
         }
     } else
     {
+        if (!state.IsValid())
+            SetFlagsBit(xnode->retFlags, NF_REJECTTRANSACTION);
+
         if (!tx.HasWitness() && !state.CorruptionPossible())
         {
             // Do not use rejection cache for witness transactions or
@@ -327,6 +350,8 @@ bool CMempoolComponent::NetReceiveTxData(ExNode *xnode, CDataStream &stream, uin
         }
     }
 
+    UncacheUnaccepted(vtx, vCoinsToUncache);
+
     for (const CTransactionRef &removedTx : lRemovedTxn)
         AddToCompactExtraTransactions(removedTx);
 
@@ -92,6 +92,39 @@ private:
     int64_t feeDelta;
 };
 
+struct update_gas_estimate
+{
+    update_gas_estimate(uint64_t _gasUsed) : gasUsed(_gasUsed)
+    {
+    }
+
+    void operator()(CTxMemPoolEntry &e)
+    {
+        e.UpdateGasEstimate(gasUsed);
+    }
+
+private:
+    uint64_t gasUsed;
+};
+
+struct update_contract_exec
+{
+    update_contract_exec(uint64_t _gasUsed, uint32_t _excepted, const CBlockIndex *_pindex)
+            : gasUsed(_gasUsed), excepted(_excepted), pindex(_pindex)
+    {
+    }
+
+    void operator()(CTxMemPoolEntry &e)
+    {
+        e.UpdateContractExec(gasUsed, excepted, pindex);
+    }
+
+private:
+    uint64_t gasUsed;
+    uint32_t excepted;
+    const CBlockIndex *pindex;
+};
+
 struct update_lock_points
 {
     update_lock_points(const LockPoints &_lp) : lp(_lp)
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include "chaincontrol/chain.h"
+#include "sbtccore/serialize.h"
+#include "sbtccore/transaction/transaction.h"
+#include "txmempoolentry.h"
+
+/**
+ * A mempool entry as written to mempool.dat, with what was worked out when it
+ * was accepted, so that it can be added back without being validated again
+ * while the tip is the same.
+ */
+struct CMempoolDumpEntry
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    CAmount nFee;
+    int64_t nSigOpCost;
+    uint32_t nHeight;
+    bool fSpendsCoinbase;
+    //sbtc-vm
+    CAmount nMinGasPrice;
+    uint64_t nGasLimit;
+    uint64_t nGasEstimate;
+    uint32_t nExcepted;
+    uint256 hashExecTip; //!< Tip nGasEstimate and nExcepted were worked out on top of, null if never executed
+
+    CMempoolDumpEntry() : nTime(0), nFee(0), nSigOpCost(0), nHeight(0), fSpendsCoinbase(false),
+                          nMinGasPrice(0), nGasLimit(0), nGasEstimate(0), nExcepted(0)
+    {
+    }
+
+    explicit CMempoolDumpEntry(const CTxMemPoolEntry &entry)
+            : tx(entry.GetSharedTx()), nTime(entry.GetTime()), nFee(entry.GetFee()),
+              nSigOpCost(entry.GetSigOpCost()), nHeight(entry.GetHeight()),
+              fSpendsCoinbase(entry.GetSpendsCoinbase()), nMinGasPrice(entry.GetMinGasPrice()),
+              nGasLimit(entry.GetGasLimit()), nGasEstimate(entry.GetGasEstimate()), nExcepted(entry.GetExcepted())
+    {
+        if (entry.GetExecTip())
+            hashExecTip = entry.GetExecTip()->GetBlockHash();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template<typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(tx);
+        READWRITE(nTime);
+        READWRITE(nFee);
+        READWRITE(nSigOpCost);
+        READWRITE(nHeight);
+        READWRITE(fSpendsCoinbase);
+        READWRITE(nMinGasPrice);
+        READWRITE(nGasLimit);
+        READWRITE(nGasEstimate);
+        READWRITE(nExcepted);
+        READWRITE(hashExecTip);
+    }
+};
+
+/**
+ * Changes to the mempool written to disk together. mempool.dat holds one
+ * with the whole mempool, and mempool.journal the ones written periodically
+ * since, which are replayed on top of it when loading.
+ */
+struct CMempoolDumpBatch
+{
+    uint256 hashTip; //!< Tip the mempool was valid on top of when the batch was written
+    std::vector<CMempoolDumpEntry> vEntries; //!< Entries added, parents before children
+    std::vector<uint256> vRemoved; //!< Transactions no longer in the mempool
+    std::map<uint256, CAmount> mapDeltas; //!< All the prioritisations at the time, replacing earlier ones
+
+    ADD_SERIALIZE_METHODS;
+
+    template<typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(hashTip);
+        READWRITE(vEntries);
+        READWRITE(vRemoved);
+        READWRITE(mapDeltas);
+    }
+};
@@ -26,6 +26,7 @@
 #include "utils/net/netmessagehelper.h"
 #include "orphantx.h"
 #include "chaincontrol/utils.h"
+#include "contract-api/contractconfig.h"
 
 using namespace appbase;
 
@@ -231,6 +232,7 @@ bool CTxMemPool::AcceptToMemoryPoolWorker(const CChainParams &chainparams, CVali
         //////////////////////////////////////////////////////////// //sbtc-vm
         // check contract tx
         CAmount nMinGasPrice = 0;
+        uint64_t nGasLimit = 0;
         if (tx.HasCreateOrCall())
         {
             if (!tx.CheckSenderScript(view))
@@ -242,7 +244,7 @@ bool CTxMemPool::AcceptToMemoryPoolWorker(const CChainParams &chainparams, CVali
             string errinfo;
 
             GET_CONTRACT_INTERFACE(ifContractObj);
-            if (!ifContractObj->CheckContractTx(tx, nFees, nMinGasPrice, level, errinfo, nAbsurdFee, rawTx))
+            if (!ifContractObj->CheckContractTx(tx, nFees, nMinGasPrice, nGasLimit, level, errinfo, nAbsurdFee, rawTx))
             {
                 if(REJECT_HIGHFEE == level){
                     return state.DoS(level, false, REJECT_HIGHFEE, errinfo);
@@ -271,7 +273,7 @@ bool CTxMemPool::AcceptToMemoryPoolWorker(const CChainParams &chainparams, CVali
 
         GET_CHAIN_INTERFACE(ifChainObj);
         CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, ifChainObj->GetActiveChain().Height(),
-                              fSpendsCoinbase, nSigOpsCost, lp, nMinGasPrice);
+                              fSpendsCoinbase, nSigOpsCost, lp, nMinGasPrice, nGasLimit);
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -535,6 +537,19 @@ bool CTxMemPool::AcceptToMemoryPoolWorker(const CChainParams &chainparams, CVali
             }
         }
 
+        //sbtc-vm
+        // Only now that it is known to get in, so a rejected transaction is never executed
+        if (tx.HasCreateOrCall() && Args().GetArg<bool>("-mempoolcontractexec", DEFAULT_MEMPOOL_CONTRACT_EXEC))
+        {
+            uint64_t nGasUsed;
+            uint32_t nExcepted;
+            GET_CONTRACT_INTERFACE(ifContractObj);
+            if (ifContractObj->PreExecuteContractTx(tx, &view, nGasUsed, nExcepted))
+            {
+                entry.UpdateContractExec(nGasUsed, nExcepted, ifChainObj->GetActiveChain().Tip());
+            }
+        }
+
         // Remove conflicting transactions from the mempool
         for (const CTxMemPool::txiter it : allConflicting)
         {
@@ -789,57 +804,164 @@ CTxMemPool::CheckInputsFromMempoolAndCache(const CTransaction &tx, CValidationSt
     return tx.CheckInputs(state, view, true, flags, cacheSigStore, true, txdata);
 }
 
-// Update the given tx for any in-mempool descendants.
-// Assumes that setMemPoolChildren is correct for the given tx and all
-// descendants.
-void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
+uint32_t CTxMemPool::NewEpoch()
+{
+    if (++nEpoch == 0)
+    {
+        // Wrapped around: entries last reached 2^32 traversals ago would look reached.
+        for (const CTxMemPoolEntry &entry : mapTx)
+        {
+            entry.nEpoch = 0;
+        }
+        nEpoch = 1;
+    }
+    return nEpoch;
+}
+
+void CTxMemPool::CalculateBatchStats(const std::vector<txiter> &vBatch, bool fDescendants, std::vector<txiter> &vRegion,
+                                     std::vector<BatchStats> &vFromBatch, std::vector<BatchStats> *pvToOthers)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    // Links are followed forward (in the direction of fDescendants) to find
+    // the region, and backward to find what an entry is reachable from.
+    auto forward = [this, fDescendants](txiter it) -> const vecLinks & {
+        return fDescendants ? GetMemPoolChildren(it) : GetMemPoolParents(it);
+    };
+    auto backward = [this, fDescendants](txiter it) -> const vecLinks & {
+        return fDescendants ? GetMemPoolParents(it) : GetMemPoolChildren(it);
+    };
 
-    while (!stageEntries.empty())
+    // Entries of the region are marked with the epoch, and nEpochIdx is their
+    // position in vRegion. The first nBatch positions are the batch.
+    const uint32_t epoch = NewEpoch();
+    const size_t nBatch = vBatch.size();
+    vRegion.clear();
+    vRegion.reserve(nBatch);
+    for (txiter it : vBatch)
+    {
+        assert(it->nEpoch != epoch);
+        it->nEpoch = epoch;
+        it->nEpochIdx = vRegion.size();
+        vRegion.push_back(it);
+    }
+    for (size_t i = 0; i < vRegion.size(); i++)
+    {
+        for (txiter next : forward(vRegion[i]))
+        {
+            if (next->nEpoch != epoch)
+            {
+                next->nEpoch = epoch;
+                next->nEpochIdx = vRegion.size();
+                vRegion.push_back(next);
+            }
+        }
+    }
+    const size_t nRegion = vRegion.size();
+
+    // Order the region so that every entry comes after those it is reachable
+    // from. The region is closed going forward, but not going backward.
+    std::vector<uint32_t> vLinksIn(nRegion, 0);
+    std::vector<uint32_t> vOrder;
+    vOrder.reserve(nRegion);
+    for (size_t i = 0; i < nRegion; i++)
+    {
+        for (txiter prev : backward(vRegion[i]))
+        {
+            if (prev->nEpoch == epoch)
+                vLinksIn[i]++;
+        }
+        if (vLinksIn[i] == 0)
+            vOrder.push_back(i);
+    }
+    std::vector<uint32_t> vPending(vLinksIn);
+    for (size_t k = 0; k < vOrder.size(); k++)
     {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        for (const txiter childEntry : setChildren)
+        for (txiter next : forward(vRegion[vOrder[k]]))
         {
-            cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
-            if (cacheIt != cachedDescendants.end())
+            if (--vPending[next->nEpochIdx] == 0)
+                vOrder.push_back(next->nEpochIdx);
+        }
+    }
+    assert(vOrder.size() == nRegion);
+
+    // Walks mark the entries they pass with their number in vWalked, so that
+    // entries reachable over several paths are counted once.
+    std::vector<uint32_t> vWalked(nRegion, 0);
+    uint32_t nWalk = 0;
+    std::vector<txiter> vStack;
+
+    // Everything outside the region an entry is reachable from is outside the
+    // batch too, or it would be in the region.
+    vFromBatch.assign(nRegion, BatchStats());
+    for (uint32_t i : vOrder)
+    {
+        if (vLinksIn[i] == 1)
+        {
+            for (txiter prev : backward(vRegion[i]))
             {
-                // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
-                for (const txiter cacheEntry : cacheIt->second)
+                if (prev->nEpoch == epoch)
                 {
-                    setAllDescendants.insert(cacheEntry);
+                    vFromBatch[i] = vFromBatch[prev->nEpochIdx];
+                    if (prev->nEpochIdx < nBatch)
+                        vFromBatch[i].Add(*prev);
                 }
-            } else if (!setAllDescendants.count(childEntry))
+            }
+        } else if (vLinksIn[i] > 1)
+        {
+            nWalk++;
+            vStack.assign(1, vRegion[i]);
+            while (!vStack.empty())
             {
-                // Schedule for later processing
-                stageEntries.insert(childEntry);
+                txiter it = vStack.back();
+                vStack.pop_back();
+                for (txiter prev : backward(it))
+                {
+                    if (prev->nEpoch != epoch || vWalked[prev->nEpochIdx] == nWalk)
+                        continue;
+                    vWalked[prev->nEpochIdx] = nWalk;
+                    if (prev->nEpochIdx < nBatch)
+                        vFromBatch[i].Add(*prev);
+                    vStack.push_back(prev);
+                }
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
-    // Update and add to cached descendant map
-    int64_t modifySize = 0;
-    CAmount modifyFee = 0;
-    int64_t modifyCount = 0;
-    for (txiter cit : setAllDescendants)
+
+    if (!pvToOthers)
+        return;
+
+    // Everything reachable from an entry of the region is in the region.
+    std::vector<BatchStats> &vToOthers = *pvToOthers;
+    vToOthers.assign(nRegion, BatchStats());
+    for (auto rit = vOrder.rbegin(); rit != vOrder.rend(); ++rit)
     {
-        if (!setExclude.count(cit->GetTx().GetHash()))
+        const uint32_t i = *rit;
+        const vecLinks &links = forward(vRegion[i]);
+        if (links.size() == 1)
+        {
+            const txiter next = links[0];
+            vToOthers[i] = vToOthers[next->nEpochIdx];
+            if (next->nEpochIdx >= nBatch)
+                vToOthers[i].Add(*next);
+        } else if (links.size() > 1)
         {
-            modifySize += cit->GetTxSize();
-            modifyFee += cit->GetModifiedFee();
-            modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
-            // Update ancestor state for each descendant
-            mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1,
-                                                    updateIt->GetSigOpCost()));
+            nWalk++;
+            vStack.assign(1, vRegion[i]);
+            while (!vStack.empty())
+            {
+                txiter it = vStack.back();
+                vStack.pop_back();
+                for (txiter next : forward(it))
+                {
+                    if (vWalked[next->nEpochIdx] == nWalk)
+                        continue;
+                    vWalked[next->nEpochIdx] = nWalk;
+                    if (next->nEpochIdx >= nBatch)
+                        vToOthers[i].Add(*next);
+                    vStack.push_back(next);
+                }
+            }
         }
     }
-    mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
 }
 
 // vHashesToUpdate is the set of transaction hashes from a disconnected block
@@ -850,47 +972,45 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
 {
     LOCK(cs);
-    // For each entry in vHashesToUpdate, store the set of in-mempool, but not
-    // in-vHashesToUpdate transactions, so that we don't have to recalculate
-    // descendants when we come across a previously seen entry.
-    cacheMap mapMemPoolDescendantsToUpdate;
-
-    // Use a set for lookups into vHashesToUpdate (these entries are already
-    // accounted for in the state of their ancestors)
-    std::set<uint256> setAlreadyIncluded(vHashesToUpdate.begin(), vHashesToUpdate.end());
-
-    // Iterate in reverse, so that whenever we are looking at a transaction
-    // we are sure that all in-mempool descendants have already been processed.
-    // This maximizes the benefit of the descendant cache and guarantees that
-    // setMemPoolChildren will be updated, an assumption made in
-    // UpdateForDescendants.
-    for (const uint256 &hash : reverse_iterate(vHashesToUpdate))
-    {
-        // we cache the in-mempool children to avoid duplicate updates
-        setEntries setChildren;
-        // calculate children from mapNextTx
+    std::vector<txiter> vBatch;
+    vBatch.reserve(vHashesToUpdate.size());
+    for (const uint256 &hash : vHashesToUpdate)
+    {
         txiter it = mapTx.find(hash);
         if (it == mapTx.end())
         {
             continue;
         }
+        vBatch.push_back(it);
+        // Link the in-mempool children, found through mapNextTx. Children
+        // from the block were linked when they were added, and linking them
+        // again does nothing.
         auto iter = mapNextTx.lower_bound(COutPoint(hash, 0));
-        // First calculate the children, and update setMemPoolChildren to
-        // include them, and update their setMemPoolParents to include this tx.
         for (; iter != mapNextTx.end() && iter->first->hash == hash; ++iter)
         {
-            const uint256 &childHash = iter->second->GetHash();
-            txiter childIter = mapTx.find(childHash);
+            txiter childIter = mapTx.find(iter->second->GetHash());
             assert(childIter != mapTx.end());
-            // We can skip updating entries we've encountered before or that
-            // are in the block (which are already accounted for).
-            if (setChildren.insert(childIter).second && !setAlreadyIncluded.count(childHash))
-            {
-                UpdateChild(it, childIter, true);
-                UpdateParent(childIter, it, true);
-            }
+            UpdateChild(it, childIter, true);
+            UpdateParent(childIter, it, true);
         }
-        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
+    }
+
+    // With all the links in place, the descendants outside vHashesToUpdate
+    // are accounted for in one walk. Descendants in vHashesToUpdate were added
+    // after their ancestors and are already reflected in their state.
+    std::vector<txiter> vRegion;
+    std::vector<BatchStats> vFromBatch, vToOthers;
+    CalculateBatchStats(vBatch, true, vRegion, vFromBatch, &vToOthers);
+    for (size_t i = 0; i < vBatch.size(); i++)
+    {
+        const BatchStats &stats = vToOthers[i];
+        if (stats.nCount)
+            mapTx.modify(vRegion[i], update_descendant_state(stats.nSize, stats.nFee, stats.nCount));
+    }
+    for (size_t i = vBatch.size(); i < vRegion.size(); i++)
+    {
+        const BatchStats &stats = vFromBatch[i];
+        mapTx.modify(vRegion[i], update_ancestor_state(stats.nSize, stats.nFee, stats.nCount, stats.nSigOpCost));
     }
 }
 
@@ -927,7 +1047,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        const vecLinks &parents = GetMemPoolParents(it);
+        parentHashes.insert(parents.begin(), parents.end());
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
@@ -956,7 +1077,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries &setMemPoolParents = GetMemPoolParents(stageit);
+        const vecLinks &setMemPoolParents = GetMemPoolParents(stageit);
         for (const txiter &phash : setMemPoolParents)
         {
             // If this is a new ancestor, add it.
@@ -977,7 +1098,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
+    const vecLinks &parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
     for (txiter piter : parentIters)
     {
@@ -1009,7 +1130,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
+    const vecLinks &setMemPoolChildren = GetMemPoolChildren(it);
     for (txiter updateIt : setMemPoolChildren)
     {
         UpdateParent(updateIt, it, false);
@@ -1018,61 +1139,49 @@ void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
-    // For each entry, walk back all ancestors and decrement size associated with this
-    // transaction
-    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    // The entries being removed are walked all at once, so that a chain of
+    // them is walked once rather than once per entry. Their own state is left
+    // alone. vTxLinks is only updated at the end, as the walks rely on it.
+    std::vector<txiter> vBatch(entriesToRemove.begin(), entriesToRemove.end());
+    std::vector<txiter> vRegion;
+    std::vector<BatchStats> vStats;
     if (updateDescendants)
     {
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
         // confirmed in a block.
-        // Here we only update statistics and not data in mapLinks (which
-        // we need to preserve until we're finished with all operations that
-        // need to traverse the mempool).
-        for (txiter removeIt : entriesToRemove)
+        CalculateBatchStats(vBatch, true, vRegion, vStats);
+        for (size_t i = vBatch.size(); i < vRegion.size(); i++)
         {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
-            int64_t modifySize = -((int64_t)removeIt->GetTxSize());
-            CAmount modifyFee = -removeIt->GetModifiedFee();
-            int modifySigOps = -removeIt->GetSigOpCost();
-            for (txiter dit : setDescendants)
-            {
-                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
-            }
+            const BatchStats &stats = vStats[i];
+            mapTx.modify(vRegion[i],
+                         update_ancestor_state(-stats.nSize, -stats.nFee, -stats.nCount, -stats.nSigOpCost));
         }
     }
+    // The ancestors are those reachable via vTxLinks. If we happen to be in
+    // the middle of processing a reorg, before UpdateTransactionsFromBlock()
+    // has been called, the in-mempool children aren't linked to the in-block
+    // txs yet, and vTxLinks differs from the set of mempool parents we'd
+    // calculate by searching. But it is vTxLinks whose ancestors have packages
+    // including the transactions being removed, because when we add a new
+    // transaction to the mempool in addUnchecked(), we assume it has no
+    // children.
+    CalculateBatchStats(vBatch, false, vRegion, vStats);
+    for (size_t i = vBatch.size(); i < vRegion.size(); i++)
+    {
+        const BatchStats &stats = vStats[i];
+        mapTx.modify(vRegion[i], update_descendant_state(-stats.nSize, -stats.nFee, -stats.nCount));
+    }
+    // After updating all the ancestor and descendant state, we can now sever
+    // the links between each transaction being removed and its mempool parents
+    // and children.
     for (txiter removeIt : entriesToRemove)
     {
-        setEntries setAncestors;
-        const CTxMemPoolEntry &entry = *removeIt;
-        std::string dummy;
-        // Since this is a tx that is already in the mempool, we can call CMPA
-        // with fSearchForParents = false.  If the mempool is in a consistent
-        // state, then using true or false should both be correct, though false
-        // should be a bit faster.
-        // However, if we happen to be in the middle of processing a reorg, then
-        // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of 
-        // ancestors whose packages include this transaction, because when we
-        // add a new transaction to the mempool in addUnchecked(), we assume it
-        // has no children, and in the case of a reorg where that assumption is
-        // false, the in-mempool children aren't linked to the in-block tx's
-        // until UpdateTransactionsFromBlock() is called.
-        // So if we're being called during a reorg, ie before
-        // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
-        // differ from the set of mempool parents we'd calculate by searching,
-        // and it's important that we use the mapLinks[] notion of ancestor
-        // transactions as the set of things to update for removal.
-        CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-        // Note that UpdateAncestorsOf severs the child links that point to
-        // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
-    }
-    // After updating all the ancestor sizes, we can now sever the link between each
-    // transaction being removed and any mempool children (ie, update setMemPoolParents
-    // for each direct child of a transaction being removed).
+        for (txiter piter : GetMemPoolParents(removeIt))
+        {
+            UpdateChild(piter, removeIt, false);
+        }
+    }
     for (txiter removeIt : entriesToRemove)
     {
         UpdateChildrenForRemoval(removeIt);
@@ -1099,8 +1208,13 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int(nSigOpCostWithAncestors) >= 0);
 }
 
-CTxMemPool::CTxMemPool(CBlockPolicyEstimator *estimator) : minerPolicyEstimator(estimator)
+CTxMemPool::CTxMemPool(CBlockPolicyEstimator *estimator) : minerPolicyEstimator(estimator),
+                                                             mapTx(indexed_transaction_set::ctor_args_list(),
+                                                                   indexed_transaction_set::allocator_type(
+                                                                           &txNodePool))
 {
+    nEmptyPoolUsage = txNodePool.DynamicMemoryUsage();
+    nEpoch = 0;
     _clear(); //lock free clear
 
     // Sanity checks off by default for performance, because otherwise
@@ -1142,7 +1256,9 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    vTxHashes.emplace_back(entry.GetTx().GetWitnessHash(), newit);
+    vTxLinks.emplace_back();
+    newit->vTxHashesIdx = vTxHashes.size() - 1;
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -1195,9 +1311,6 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
         minerPolicyEstimator->processTransaction(entry, validFeeEstimate);
     }
 
-    vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
-    newit->vTxHashesIdx = vTxHashes.size() - 1;
-
     return true;
 }
 
@@ -1208,20 +1321,29 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     for (const CTxIn &txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
 
+    const TxLinks &links = vTxLinks[it->vTxHashesIdx];
+    cachedInnerUsage -= memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
     if (vTxHashes.size() > 1)
     {
         vTxHashes[it->vTxHashesIdx] = std::move(vTxHashes.back());
+        vTxLinks[it->vTxHashesIdx] = std::move(vTxLinks.back());
         vTxHashes[it->vTxHashesIdx].second->vTxHashesIdx = it->vTxHashesIdx;
         vTxHashes.pop_back();
+        vTxLinks.pop_back();
         if (vTxHashes.size() * 2 < vTxHashes.capacity())
+        {
             vTxHashes.shrink_to_fit();
+            vTxLinks.shrink_to_fit();
+        }
     } else
+    {
         vTxHashes.clear();
+        vTxLinks.clear();
+    }
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
+    setUnverified.erase(hash);
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator)
@@ -1252,7 +1374,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
         setDescendants.insert(it);
         stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
+        const vecLinks &setChildren = GetMemPoolChildren(it);
         for (const txiter &childiter : setChildren)
         {
             if (!setDescendants.count(childiter))
@@ -1384,15 +1506,16 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx, unsigne
     {
         minerPolicyEstimator->processBlock(nBlockHeight, entries);
     }
+    // The transactions of the block leave together, so that the state of the
+    // transactions depending on them is updated in one pass.
+    setEntries stage;
+    for (const CTxMemPoolEntry *entry : entries)
+    {
+        stage.insert(mapTx.iterator_to(*entry));
+    }
+    RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
     for (const auto &tx : vtx)
     {
-        txiter it = mapTx.find(tx->GetHash());
-        if (it != mapTx.end())
-        {
-            setEntries stage;
-            stage.insert(it);
-            RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
-        }
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
@@ -1402,9 +1525,11 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx, unsigne
 
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
+    vTxLinks.clear();
+    vTxHashes.clear();
     mapTx.clear();
     mapNextTx.clear();
+    setUnverified.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -1452,9 +1577,8 @@ void CTxMemPool::Check(const CCoinsViewCache *pcoins) const
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction &tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
+        assert(it->vTxHashesIdx < vTxLinks.size() && vTxHashes[it->vTxHashesIdx].second == it);
+        const TxLinks &links = vTxLinks[it->vTxHashesIdx];
         innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
         bool fDependsWait = false;
         setEntries setParentCheck;
@@ -1485,7 +1609,8 @@ void CTxMemPool::Check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(setParentCheck == setEntries(links.parents.begin(), links.parents.end()));
+        assert(setParentCheck.size() == links.parents.size());
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -1521,7 +1646,8 @@ void CTxMemPool::Check(const CCoinsViewCache *pcoins) const
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(setChildrenCheck == setEntries(links.children.begin(), links.children.end()));
+        assert(setChildrenCheck.size() == links.children.size());
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
@@ -1652,7 +1778,8 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     ret.reserve(mapTx.size());
     for (auto it : iters)
     {
-        ret.push_back(GetInfo(it));
+        if (!setUnverified.count(it->GetTx().GetHash()))
+            ret.push_back(GetInfo(it));
     }
 
     return ret;
@@ -1671,7 +1798,7 @@ TxMempoolInfo CTxMemPool::info(const uint256 &hash) const
 {
     LOCK(cs);
     indexed_transaction_set::const_iterator i = mapTx.find(hash);
-    if (i == mapTx.end())
+    if (i == mapTx.end() || setUnverified.count(hash))
         return TxMempoolInfo();
     return GetInfo(i);
 }
@@ -1709,6 +1836,31 @@ void CTxMemPool::PrioritiseTransaction(const uint256 &hash, const CAmount &nFeeD
     NLogFormat("PrioritiseTransaction: %s feerate += %s", hash.ToString(), FormatMoney(nFeeDelta));
 }
 
+bool CTxMemPool::UpdateContractExec(txiter it)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs);
+
+    GET_CHAIN_INTERFACE(ifChainObj);
+    const CBlockIndex *pTip = ifChainObj->GetActiveChain().Tip();
+    if (it->GetExecTip() == pTip)
+    {
+        return true;
+    }
+
+    CCoinsViewMemPool viewMemPool(ifChainObj->GetCoinsTip(), *this);
+    CCoinsViewCache view(&viewMemPool);
+    uint64_t nGasUsed;
+    uint32_t nExcepted;
+    GET_CONTRACT_INTERFACE(ifContractObj);
+    if (!it->GetTx().HasCreateOrCall() || !ifContractObj->PreExecuteContractTx(it->GetTx(), &view, nGasUsed, nExcepted))
+    {
+        return false;
+    }
+    mapTx.modify(it, update_contract_exec(nGasUsed, nExcepted, pTip));
+    return true;
+}
+
 void CTxMemPool::ApplyDelta(const uint256 hash, CAmount &nFeeDelta) const
 {
     LOCK(cs);
@@ -1736,10 +1888,11 @@ bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
 size_t CTxMemPool::DynamicMemoryUsage() const
 {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void *)) * mapTx.size() +
-           memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) +
-           memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // txNodePool accounts for the nodes of mapTx, with the links of all its indexes, and its bucket array.
+    // What an empty mapTx already holds is left out, so that an empty mempool uses nothing.
+    return txNodePool.DynamicMemoryUsage() - nEmptyPoolUsage + memusage::DynamicUsage(mapNextTx) +
+           memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + memusage::DynamicUsage(vTxLinks) +
+           memusage::DynamicUsage(setUnverified) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason)
@@ -1781,44 +1934,45 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
     return addUnchecked(hash, entry, setAncestors, validFeeEstimate);
 }
 
-void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+// Adds or removes link in links, keeping cachedInnerUsage in step when it moves to or off the heap.
+static void UpdateLink(CTxMemPool::vecLinks &links, CTxMemPool::txiter link, bool add, uint64_t &cachedInnerUsage)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second)
+    CTxMemPool::vecLinks::iterator it = std::find(links.begin(), links.end(), link);
+    if (add == (it != links.end()))
+        return;
+
+    cachedInnerUsage -= memusage::DynamicUsage(links);
+    if (add)
     {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child))
+        links.push_back(link);
+    } else
     {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+        *it = links.back();
+        links.pop_back();
     }
+    cachedInnerUsage += memusage::DynamicUsage(links);
+}
+
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+{
+    UpdateLink(vTxLinks[entry->vTxHashesIdx].children, child, add, cachedInnerUsage);
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second)
-    {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent))
-    {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
+    UpdateLink(vTxLinks[entry->vTxHashesIdx].parents, parent, add, cachedInnerUsage);
 }
 
-const CTxMemPool::setEntries &CTxMemPool::GetMemPoolParents(txiter entry) const
+const CTxMemPool::vecLinks &CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    return vTxLinks[entry->vTxHashesIdx].parents;
 }
 
-const CTxMemPool::setEntries &CTxMemPool::GetMemPoolChildren(txiter entry) const
+const CTxMemPool::vecLinks &CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    return vTxLinks[entry->vTxHashesIdx].children;
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
@@ -35,9 +35,12 @@
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
+ * the in-mempool direct parents and direct children in vTxLinks.  Within
  * each CTxMemPoolEntry, we track the size and fees of all descendants.
  *
+ * The nodes of mapTx, which hold the entry and the links of all its indexes,
+ * are allocated from txNodePool.
+ *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
  * addUnchecked(), we:
@@ -68,7 +71,7 @@
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * vTxLinks may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -81,8 +84,13 @@
  *
  */
 #include "../interface/imempoolcomponent.h"
+#include "utils/crypto/allocators/pool.h"
+#include "sbtccore/prevector.h"
 
-const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** mempool.dat with only the transactions, their time and fee delta */
+const uint64_t MEMPOOL_DUMP_VERSION_V1 = 1;
+/** mempool.dat and mempool.journal made of CMempoolDumpBatch */
+const uint64_t MEMPOOL_DUMP_VERSION = 2;
 
 using namespace appbase;
 
@@ -92,11 +100,15 @@ private:
 
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    uint32_t nEpoch; //!< Last traversal started, see NewEpoch()
     CBlockPolicyEstimator *minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    CNodePool txNodePool; //!< Arena of the mapTx nodes, declared before mapTx so that it outlives it
+    size_t nEmptyPoolUsage; //!< txNodePool usage of an empty mapTx: its header node and first bucket array
+
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
@@ -143,7 +155,8 @@ public:
                             boost::multi_index::identity<CTxMemPoolEntry>,
                             CompareTxMemPoolEntryByAncestorFeeOrGasPrice
                     >
-            >
+            >,
+            node_pool_allocator<CTxMemPoolEntry>
     > indexed_transaction_set;
 
     mutable CCriticalSection cs;
@@ -162,9 +175,12 @@ public:
 
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries &GetMemPoolParents(txiter entry) const;
+    //! Direct parents or children of an entry, unordered. Most transactions have at most two.
+    typedef prevector<2, txiter> vecLinks;
 
-    const setEntries &GetMemPoolChildren(txiter entry) const;
+    const vecLinks &GetMemPoolParents(txiter entry) const;
+
+    const vecLinks &GetMemPoolChildren(txiter entry) const;
     /*--------------------------------------------------------------------------------------------*/
     /** (try to) add transaction to memory pool
         * plTxnReplaced will be appended to with all transactions replaced from mempool **/
@@ -211,16 +227,54 @@ public:
     CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints *lp = nullptr, bool useExistingLockPoints = false);
 
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    /** Sums of the own size, fees and sigop cost of a group of entries. */
+    struct BatchStats
+    {
+        int64_t nSize;
+        CAmount nFee;
+        int64_t nCount;
+        int64_t nSigOpCost;
+
+        BatchStats() : nSize(0), nFee(0), nCount(0), nSigOpCost(0)
+        {
+        }
+
+        void Add(const CTxMemPoolEntry &entry)
+        {
+            nSize += entry.GetTxSize();
+            nFee += entry.GetModifiedFee();
+            nCount++;
+            nSigOpCost += entry.GetSigOpCost();
+        }
+    };
 
     struct TxLinks
     {
-        setEntries parents;
-        setEntries children;
+        vecLinks parents;
+        vecLinks children;
+
+        TxLinks()
+        {
+        }
+
+        // Moved rather than copied when vTxLinks grows, so the heap blocks,
+        // and with them cachedInnerUsage, stay the same.
+        TxLinks(TxLinks &&other) noexcept
+        {
+            parents.swap(other.parents);
+            children.swap(other.children);
+        }
+
+        TxLinks &operator=(TxLinks &&other) noexcept
+        {
+            parents.swap(other.parents);
+            children.swap(other.children);
+            return *this;
+        }
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    //! Links of every entry in mapTx, at the entry's vTxHashesIdx
+    std::vector<TxLinks> vTxLinks;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
 
@@ -231,6 +285,8 @@ private:
 public:
     indirectmap<COutPoint, const CTransaction *> mapNextTx;
     std::map<uint256, CAmount> mapDeltas;
+    //! Entries loaded from disk whose scripts are not verified yet, neither relayed nor mined
+    std::set<uint256> setUnverified;
 
     /** Create a new CTxMemPool.
      */
@@ -292,6 +348,10 @@ public:
 
     void ApplyDelta(const uint256 hash, CAmount &nFeeDelta) const;
 
+    /** Execute the contract transaction of it on top of the active tip, unless its cached gas and
+     *  exception are for that tip already. False if it could not be executed. cs_main and cs must be held. */
+    bool UpdateContractExec(txiter it);
+
     void ClearPrioritisation(const uint256 hash);
 
 public:
@@ -324,7 +384,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from vTxLinks. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount,
                                    uint64_t limitAncestorSize, uint64_t limitDescendantCount,
@@ -374,10 +434,24 @@ public:
         return (mapTx.count(hash) != 0);
     }
 
+    bool isUnverified(const uint256 &hash) const
+    {
+        LOCK(cs);
+        return setUnverified.count(hash) != 0;
+    }
+
+    void markVerified(const uint256 &hash)
+    {
+        LOCK(cs);
+        setUnverified.erase(hash);
+    }
+
     CTransactionRef get(const uint256 &hash) const;
 
+    /** The entry of hash, nothing for an unverified one */
     TxMempoolInfo info(const uint256 &hash) const;
 
+    /** The verified entries, for relay */
     std::vector<TxMempoolInfo> infoAll() const;
 
     size_t DynamicMemoryUsage() const;
@@ -386,22 +460,26 @@ public:
     boost::signals2::signal<void(CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
 
 private:
-    /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
-     *  the descendants for a single transaction that has been added to the
-     *  mempool but may have child transactions in the mempool, eg during a
-     *  chain reorg.  setExclude is the set of descendant transactions in the
-     *  mempool that must not be accounted for (because any descendants in
-     *  setExclude were added to the mempool after the transaction being
-     *  updated and hence their state is already reflected in the parent
-     *  state).
+    /** Starts a traversal of the mempool: the entries whose nEpoch is not the
+     *  value returned have not been reached by it yet. Traversals do not nest.
+     */
+    uint32_t NewEpoch();
+
+    /** Walks the relatives of all the entries of vBatch at once, for the
+     *  callers that would otherwise walk them for each entry in turn.
+     *
+     *  vRegion receives vBatch, whose entries must be distinct, followed by
+     *  the entries reachable from it through children (fDescendants) or
+     *  parents. For each entry of vRegion, vFromBatch receives the sums over
+     *  the entries of vBatch it is reachable from, and *pvToOthers, if given,
+     *  the sums over the entries outside vBatch reachable from it.
      *
-     *  cachedDescendants will be updated with the descendants of the transaction
-     *  being updated, so that future invocations don't need to walk the
-     *  same transaction again, if encountered in another transaction chain.
+     *  Entries reached over a single link take their sums from the entry on
+     *  the other end, so a chain costs one step per transaction; only those
+     *  reached over more than one link have their relatives walked.
      */
-    void UpdateForDescendants(txiter updateIt,
-                              cacheMap &cachedDescendants,
-                              const std::set<uint256> &setExclude);
+    void CalculateBatchStats(const std::vector<txiter> &vBatch, bool fDescendants, std::vector<txiter> &vRegion,
+                             std::vector<BatchStats> &vFromBatch, std::vector<BatchStats> *pvToOthers = nullptr);
 
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
     void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
@@ -411,7 +489,7 @@ private:
 
     /** For each transaction being removed, update ancestors and any direct children.
       * If updateDescendants is true, then also update in-mempool descendants'
-      * ancestor state. */
+      * ancestor state. The whole set is accounted for in one walk. */
     void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants);
 
     /** Sever link between specified transaction and direct children. */
@@ -7,10 +7,11 @@
 #include "sbtccore/transaction/policy.h"
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx, const CAmount &_nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
-                                 bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp, CAmount _nMinGasPrice) :
-        tx(_tx), nFee(_nFee), nTime(_nTime), entryHeight(_entryHeight),
-        spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp),
-        nMinGasPrice(_nMinGasPrice)   //sbtc-vm
+                                 bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp, CAmount _nMinGasPrice,
+                                 uint64_t _nGasLimit) :
+        tx(_tx), nFee(_nFee), nTime(_nTime), sigOpCost(_sigOpsCost), lockPoints(lp),
+        nMinGasPrice(_nMinGasPrice), nGasLimit(_nGasLimit), nGasEstimate(_nGasLimit), pindexExec(nullptr), //sbtc-vm
+        entryHeight(_entryHeight), nExcepted(0), spendsCoinbase(_spendsCoinbase)
 {
     nTxWeight = GetTransactionWeight(*tx);
     nUsageSize = RecursiveDynamicUsage(tx);
@@ -25,6 +26,9 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx, const CAmount &_nFe
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCostWithAncestors = sigOpCost;
+
+    nEpoch = 0;
+    nEpochIdx = 0;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry &other)
@@ -44,6 +48,18 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints &lp)
     lockPoints = lp;
 }
 
+void CTxMemPoolEntry::UpdateGasEstimate(uint64_t gasUsed)
+{
+    nGasEstimate = std::min(gasUsed, nGasLimit);
+}
+
+void CTxMemPoolEntry::UpdateContractExec(uint64_t gasUsed, uint32_t excepted, const CBlockIndex *pindex)
+{
+    UpdateGasEstimate(gasUsed);
+    nExcepted = excepted;
+    pindexExec = pindex;
+}
+
 size_t CTxMemPoolEntry::GetTxSize() const
 {
     return GetVirtualTransactionSize(nTxWeight, sigOpCost);
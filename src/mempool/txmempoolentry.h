@@ -41,16 +41,15 @@ class CTxMemPoolEntry
 private:
     CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
-    size_t nTxWeight;          //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    size_t nUsageSize;         //!< ... and total memory usage
     int64_t nTime;             //!< Local time when entering the mempool
-    unsigned int entryHeight;  //!< Chain height when entering the mempool
-    bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
     int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
     //sbtc-vm
     CAmount nMinGasPrice;      //!< The minimum gas price among the contract outputs of the tx
+    uint64_t nGasLimit;        //!< The sum of the gas limits of the contract outputs of the tx
+    uint64_t nGasEstimate;     //!< Gas the tx is expected to use, its gas limit until it has been executed
+    const CBlockIndex *pindexExec; //!< Tip the tx was last executed on top of by the mempool, if any
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -65,11 +64,20 @@ private:
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
+    // The narrow fields come last, together with vTxHashesIdx, so that they
+    // pack without padding. There is one entry per mempool transaction.
+    uint32_t nTxWeight;        //!< ... and avoid recomputing tx weight (also used for GetTxSize())
+    uint32_t nUsageSize;       //!< ... and total memory usage
+    unsigned int entryHeight;  //!< Chain height when entering the mempool
+    uint32_t nExcepted;        //!< Exception raised when it was executed on top of pindexExec (0 is none) //sbtc-vm
+    bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
+
 public:
     CTxMemPoolEntry(const CTransactionRef &_tx, const CAmount &_nFee,
                     int64_t _nTime, unsigned int _entryHeight,
                     bool spendsCoinbase,
-                    int64_t nSigOpsCost, LockPoints lp, CAmount _nMinGasPrice = 0);//sbtc-vm
+                    int64_t nSigOpsCost, LockPoints lp, CAmount _nMinGasPrice = 0,
+                    uint64_t _nGasLimit = 0);//sbtc-vm
 
     CTxMemPoolEntry(const CTxMemPoolEntry &other);
 
@@ -129,6 +137,33 @@ public:
     {
         return nMinGasPrice;
     }
+
+    uint64_t GetGasLimit() const
+    {
+        return nGasLimit;
+    }
+
+    uint64_t GetGasEstimate() const
+    {
+        return nGasEstimate;
+    }
+
+    uint32_t GetExcepted() const
+    {
+        return nExcepted;
+    }
+
+    const CBlockIndex *GetExecTip() const
+    {
+        return pindexExec;
+    }
+
+    // Replaces the gas estimate with what an execution of the tx used
+    void UpdateGasEstimate(uint64_t gasUsed);
+
+    // Records the outcome of executing the tx on top of pindex
+    void UpdateContractExec(uint64_t gasUsed, uint32_t excepted, const CBlockIndex *pindex);
+
     // Adjusts the descendant state.
     void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
 
@@ -182,7 +217,9 @@ public:
         return nSigOpCostWithAncestors;
     }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint32_t vTxHashesIdx; //!< Index in mempool's vTxHashes and vTxLinks
+    mutable uint32_t nEpoch;       //!< Last traversal of the mempool that reached this entry
+    mutable uint32_t nEpochIdx;    //!< Position of this entry in that traversal
 };
 
 #endif //SUPERBITCOIN_TXMEMPOOLITEM_H
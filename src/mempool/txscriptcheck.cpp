@@ -0,0 +1,16 @@
+#include "txscriptcheck.h"
+#include "sbtccore/transaction/script/scriptcheck.h"
+
+bool CTxScriptCheck::operator()()
+{
+    const CTransaction &tx = *ptx;
+    PrecomputedTransactionData txdata(tx);
+    bool fValid = true;
+    for (unsigned int i = 0; fValid && i < tx.vin.size(); i++)
+    {
+        CScriptCheck check(vSpent[i].scriptPubKey, vSpent[i].nValue, tx, i, nFlags, true, &txdata);
+        fValid = check();
+    }
+    *pfValid = fValid;
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include "sbtccore/transaction/transaction.h"
+
+/**
+ * Closure verifying all the input scripts of one transaction before it is
+ * offered to the mempool.
+ *
+ * The outputs it spends are copied in, so it runs without cs_main. The
+ * result goes to *pfValid instead of the return value: CCheckQueue stops a
+ * batch at the first failure, and one invalid transaction must not keep the
+ * others from being verified.
+ */
+class CTxScriptCheck
+{
+private:
+    CTransactionRef ptx;
+    std::vector<CTxOut> vSpent;
+    unsigned int nFlags;
+    char *pfValid;
+
+public:
+    CTxScriptCheck() : nFlags(0), pfValid(nullptr)
+    {
+    }
+
+    CTxScriptCheck(const CTransactionRef &ptxIn, std::vector<CTxOut> &vSpentIn, unsigned int nFlagsIn,
+                   char *pfValidIn) : ptx(ptxIn), nFlags(nFlagsIn), pfValid(pfValidIn)
+    {
+        vSpent.swap(vSpentIn);
+    }
+
+    bool operator()();
+
+    void swap(CTxScriptCheck &check)
+    {
+        ptx.swap(check.ptx);
+        vSpent.swap(check.vSpent);
+        std::swap(nFlags, check.nFlags);
+        std::swap(pfValid, check.pfValid);
+    }
+};
@@ -13,6 +13,9 @@
 #include "sbtccore/block/merkle.h"
 #include "chaincontrol/validation.h"
 #include "hash.h"
+#include "crypto/sha256.h"
+#include "crypto/common.h"
+#include "sbtccore/streams.h"
 #include "block/validation.h"
 #include "p2p/net.h"
 #include "wallet/feerate.h"
@@ -28,11 +31,15 @@
 #include "interface/ichaincomponent.h"
 #include "interface/imempoolcomponent.h"
 #include "chaincontrol/utils.h"
+#include "contract-api/contractconfig.h"
 
 #include <algorithm>
+#include <limits>
 #include <queue>
 #include <utility>
 
+#include <boost/bind.hpp>
+
 SET_CPP_SCOPED_LOG_CATEGORY(CID_MINER);
 
 //////////////////////////////////////////////////////////////////////////////
@@ -100,13 +107,16 @@ BlockAssembler::Options::Options()
 {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    fGasRanking = DEFAULT_BLOCK_GAS_RANKING;
 }
 
-BlockAssembler::BlockAssembler(const CChainParams &params, const Options &options) : chainparams(params)
+BlockAssembler::BlockAssembler(const CChainParams &params, const Options &options) : chainparams(params),
+                                                                                      viewSenders(&viewSendersBase)
 {
     blockMinFeeRate = options.blockMinFeeRate;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
+    fGasRanking = options.fGasRanking;
 }
 
 static BlockAssembler::Options DefaultOptions(const CChainParams &params)
@@ -126,6 +136,7 @@ static BlockAssembler::Options DefaultOptions(const CChainParams &params)
     {
         options.blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     }
+    options.fGasRanking = Args().GetArg<bool>("-blockgasranking", DEFAULT_BLOCK_GAS_RANKING);
     return options;
 }
 
@@ -145,6 +156,11 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    bceResult = ByteCodeExecResult();
+    vContractPackages.clear();
+    setContractPackageTx.clear();
+    vContractGasUsed.clear();
 }
 
 //sbtc-vm
@@ -180,14 +196,57 @@ void BlockAssembler::RebuildRefundTransaction(uint256 hashStateRoot, uint256 has
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn, bool fMineWitnessTx)
 {
-    int64_t nTimeStart = GetTimeMicros();
+    AssembleBlock(scriptPubKeyIn, fMineWitnessTx);
+    stateSnapshot.reset();
+    return std::move(pblocktemplate);
+}
+
+void BlockAssembler::AssembleBlock(const CScript &scriptPubKeyIn, bool fMineWitnessTx)
+{
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+    GET_CHAIN_INTERFACE(ifChainObj);
+
+    while (true)
+    {
+        int64_t nTimeStart = GetTimeMicros();
+        int nPackagesSelected = 0;
+        int nDescendantsUpdated = 0;
+        {
+            LOCK2(cs_main, mempool.cs);
+            BeginBlock(scriptPubKeyIn, fMineWitnessTx, nPackagesSelected, nDescendantsUpdated);
+        }
+
+        // The contracts run on the snapshot and on copies of their transactions, so that
+        // blocks can be connected and transactions accepted meanwhile
+        int64_t nTime1 = GetTimeMicros();
+        addContractPackages(nPackagesSelected);
+        int64_t nTime2 = GetTimeMicros();
+
+        LOCK2(cs_main, mempool.cs);
+        if (pindexPrev != ifChainObj->GetActiveChain().Tip())
+        {
+            NLogFormat("CreateNewBlock(): tip changed while the contracts ran, assembling again");
+            continue;
+        }
+        CommitContractPackages();
+        FinishBlock();
+        int64_t nTime3 = GetTimeMicros();
+
+        NLogFormat("CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), contracts: %.2fms, "
+                   "validity: %.2fms (total %.2fms)", 0.001 * (nTime1 - nTimeStart), nPackagesSelected,
+                   nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime3 - nTime2),
+                   0.001 * (nTime3 - nTimeStart));
+        return;
+    }
+}
 
+void BlockAssembler::BeginBlock(const CScript &scriptPubKeyIn, bool fMineWitnessTx, int &nPackagesSelected,
+                                int &nDescendantsUpdated)
+{
     resetBlock();
 
     pblocktemplate.reset(new CBlockTemplate());
-
-    if (!pblocktemplate.get())
-        return nullptr;
     pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -195,10 +254,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
-    LOCK2(cs_main, ifTxMempoolObj->GetMemPool().cs);
     GET_CHAIN_INTERFACE(ifChainObj);
-    CBlockIndex *pindexPrev = ifChainObj->GetActiveChain().Tip();
+    pindexPrev = ifChainObj->GetActiveChain().Tip();
     nHeight = pindexPrev->nHeight + 1;
 
     pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
@@ -227,7 +284,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
 
     // Create coinbase transaction.
     CMutableTransaction coinbaseTx;
-    CMutableTransaction coinbaseTxBak;
 
     coinbaseTx.vin.resize(1);
     coinbaseTx.vin[0].prevout.SetNull();
@@ -235,11 +291,16 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
     coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
     coinbaseTx.vout[0].nValue = nFees + ifChainObj->GetBlockSubsidy(nHeight);
     coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    coinbaseTxBak = coinbaseTx; //sbtc-vm
+    originalCoinbaseTx = coinbaseTx; //sbtc-vm
     pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
 
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
+    // Fill in header. Contracts read the time and bits of the block, so they have to be final
+    // before any is executed for it to be valid, and for TestBlockValidity to reuse the executions.
+    pblock->hashPrevBlock = pindexPrev->GetBlockHash();
+    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+    pblock->nBits = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+    pblock->nNonce = 0;
+
     //    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
 
     //////////////////////////////////////////////////////// sbtc-vm
@@ -263,13 +324,16 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
     //    nBlockMaxSize = blockSizeDGP ? blockSizeDGP : nBlockMaxSize;
 
     uint256 oldHashStateRoot, oldHashUTXORoot;
-    ifContractObj->GetState(oldHashStateRoot, oldHashUTXORoot);
+    stateSnapshot = ifContractObj->ForkTipState();
+    if (stateSnapshot)
+    {
+        stateSnapshot->GetState(oldHashStateRoot, oldHashUTXORoot);
+    }
 
-    bool enablecontract = false;
-    enablecontract = ifChainObj->IsSBTCForkContractEnabled(pindexPrev->nHeight);
+    fContractEnabled = ifChainObj->IsSBTCForkContractEnabled(pindexPrev->nHeight);
 
     // Create second transaction.
-    if(enablecontract)
+    if (fContractEnabled)
     {
         CMutableTransaction coinbase2;
         coinbase2.vin.resize(2);
@@ -295,13 +359,26 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
         originalRewardTx = coinbase2;
         pblock->vtx.emplace_back();
         pblock->vtx[1] = MakeTransactionRef(std::move(coinbase2));
+        pblocktemplate->vTxFees.push_back(0);
+        pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
     }
 
     //    addPriorityTxs(minGasPrice);
-    uint256 hashStateRoot, hashUTXORoot;
     addPackageTxs(nPackagesSelected, nDescendantsUpdated);
-    ifContractObj->GetState(hashStateRoot, hashUTXORoot);
-    if (pindexPrev->nHeight + 1 > Params().GetConsensus().SBTCContractForkHeight)
+    ////////////////////////////////////////////////////////
+}
+
+void BlockAssembler::FinishBlock()
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+
+    //////////////////////////////////////////////////////// sbtc-vm
+    uint256 hashStateRoot, hashUTXORoot;
+    if (stateSnapshot)
+    {
+        stateSnapshot->GetState(hashStateRoot, hashUTXORoot);
+    }
+    if (nHeight > Params().GetConsensus().SBTCContractForkHeight)
     {
         if (hashStateRoot.IsNull())
         {
@@ -314,31 +391,26 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
     }
     //    pblock->hashStateRoot = hashStateRoot;
     //    pblock->hashUTXORoot = hashUTXORoot;
-    ifContractObj->UpdateState(oldHashStateRoot, oldHashUTXORoot);
 
     //this should already be populated by AddBlock in case of contracts, but if no contracts
     //then it won't get populated
-    if(enablecontract) {
+    if (fContractEnabled)
+    {
         RebuildRefundTransaction(hashStateRoot, hashUTXORoot);
+        pblocktemplate->vTxSigOpsCost[1] = WITNESS_SCALE_FACTOR * (*pblock->vtx[1]).GetLegacySigOpCount();
     }
 
-    coinbaseTxBak.vout[0].nValue = nFees + ifChainObj->GetBlockSubsidy(nHeight);
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTxBak));
+    CMutableTransaction coinbaseTx(originalCoinbaseTx);
+    coinbaseTx.vout[0].nValue = nFees + ifChainObj->GetBlockSubsidy(nHeight);
+    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
     ////////////////////////////////////////////////////////
 
-    int64_t nTime1 = GetTimeMicros();
-
     pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
     pblocktemplate->vTxFees[0] = -nFees;
 
     NLogFormat("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d", GetBlockWeight(*pblock), nBlockTx,
                nFees, nBlockSigOpsCost);
 
-    // Fill in header
-    pblock->hashPrevBlock = pindexPrev->GetBlockHash();
-    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-    pblock->nBits = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
-    pblock->nNonce = 0;
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * (*pblock->vtx[0]).GetLegacySigOpCount();
 
     CValidationState state;
@@ -346,14 +418,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
     {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
-    int64_t nTime2 = GetTimeMicros();
-
-    NLogFormat(
-            "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)",
-            0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1),
-            0.001 * (nTime2 - nTimeStart));
-
-    return std::move(pblocktemplate);
 }
 
 void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries &testSet)
@@ -387,6 +451,8 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost
 //   segwit activation)
 bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries &package)
 {
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    const CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
     for (const CTxMemPool::txiter it : package)
     {
         //        GET_VERIFY_INTERFACE(ifVerifyObj);
@@ -394,6 +460,9 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries &packa
             return false;
         if (!fIncludeWitness && it->GetTx().HasWitness())
             return false;
+        // Loaded from disk and not verified yet
+        if (mempool.setUnverified.count(it->GetTx().GetHash()))
+            return false;
     }
     return true;
 }
@@ -401,32 +470,63 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries &packa
 //sbtc-vm
 bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64_t minGasPrice)
 {
+    uint64_t nGasUsed = 0;
+    bool fAdded = AttemptToAddContractToBlock(CBlockCandidateTx(iter), minGasPrice, nullptr, nGasUsed);
+    // What it used on top of this block is the best guess for the next template
+    if (nGasUsed > 0)
+    {
+        GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+        ifTxMempoolObj->GetMemPool().mapTx.modify(iter, update_gas_estimate(nGasUsed));
+    }
+    if (fAdded)
+    {
+        inBlock.insert(iter);
+    }
+    return fAdded;
+}
+
+bool BlockAssembler::AttemptToAddContractToBlock(const CBlockCandidateTx &entry, uint64_t minGasPrice,
+                                                 CCoinsViewCache *pviewSenders, uint64_t &nGasUsed)
+{
+    nGasUsed = 0;
+    if (!stateSnapshot)
+    {
+        return false;
+    }
+    // Not worth an execution if it is not expected to fit the gas left. Until the mempool has
+    // executed the tx its estimate is its gas limit, which would keep it out of every block.
+    if (fGasRanking && entry.fExecuted && bceResult.usedGas + entry.nGasEstimate > softBlockGasLimit)
+    {
+        return false;
+    }
     uint256 oldHashStateRoot, oldHashUTXORoot;
     GET_CONTRACT_INTERFACE(ifContractObj);
-    ifContractObj->GetState(oldHashStateRoot, oldHashUTXORoot);
+    stateSnapshot->GetState(oldHashStateRoot, oldHashUTXORoot);
     // operate on local vars first, then later apply to `this`
     uint64_t nBlockWeight = this->nBlockWeight;
     uint64_t nBlockSigOpsCost = this->nBlockSigOpsCost;
 
     ByteCodeExecResult testExecResult;
-    if (!ifContractObj->RunContractTx(iter->GetTx(), NULL, pblock, minGasPrice, hardBlockGasLimit, softBlockGasLimit,
-                                      txGasLimit, bceResult.usedGas, testExecResult))
+    if (!ifContractObj->RunContractTx(*stateSnapshot, *entry.tx, pviewSenders, pblock, minGasPrice,
+                                      hardBlockGasLimit, softBlockGasLimit, txGasLimit, bceResult.usedGas,
+                                      testExecResult))
     {
-        ifContractObj->UpdateState(oldHashStateRoot, oldHashUTXORoot);
+        stateSnapshot->UpdateState(oldHashStateRoot, oldHashUTXORoot);
         return false;
     }
+    nGasUsed = testExecResult.usedGas;
 
     NLogFormat("AttemptToAddContractToBlock3=====");
     if (bceResult.usedGas + testExecResult.usedGas > softBlockGasLimit)
     {
         //if this transaction could cause block gas limit to be exceeded, then don't add it
-        ifContractObj->UpdateState(oldHashStateRoot, oldHashUTXORoot);
+        stateSnapshot->UpdateState(oldHashStateRoot, oldHashUTXORoot);
         return false;
     }
     NLogFormat("AttemptToAddContractToBlock4=====");
     //apply contractTx costs to local state
-    nBlockWeight += iter->GetTxWeight();
-    nBlockSigOpsCost += iter->GetSigOpCost();
+    nBlockWeight += entry.nTxWeight;
+    nBlockSigOpsCost += entry.nSigOpCost;
     //apply value-transfer txs to local state
     for (CTransaction &t : testExecResult.valueTransfers)
     {
@@ -460,7 +560,7 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
         nBlockWeight > MAX_BLOCK_WEIGHT)
     {//sbtc-vm
         //contract will not be added to block, so revert state to before we tried
-        ifContractObj->UpdateState(oldHashStateRoot, oldHashUTXORoot);
+        stateSnapshot->UpdateState(oldHashStateRoot, oldHashUTXORoot);
         return false;
     }
 
@@ -473,12 +573,12 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
                                    testExecResult.refundOutputs.end());
     bceResult.valueTransfers = std::move(testExecResult.valueTransfers);
 
-    pblock->vtx.emplace_back(iter->GetSharedTx());
-    pblocktemplate->vTxFees.push_back(iter->GetFee());
-    pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCost());
-    this->nBlockWeight += iter->GetTxWeight();
+    pblock->vtx.emplace_back(entry.tx);
+    pblocktemplate->vTxFees.push_back(entry.nFee);
+    pblocktemplate->vTxSigOpsCost.push_back(entry.nSigOpCost);
+    this->nBlockWeight += entry.nTxWeight;
     ++nBlockTx;
-    this->nBlockSigOpsCost += iter->GetSigOpCost();
+    this->nBlockSigOpsCost += entry.nSigOpCost;
 
     CAmount gasRefunds = 0;
     for (CTxOut refundVout : testExecResult.refundOutputs)
@@ -486,15 +586,16 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
         gasRefunds += refundVout.nValue;  //one contract tx, need to refund gas
     }
 
-    assert(iter->GetFee() >= gasRefunds);
-    CAmount tmpFee = (iter->GetFee() - gasRefunds);
+    assert(entry.nFee >= gasRefunds);
+    CAmount tmpFee = (entry.nFee - gasRefunds);
     assert(tmpFee >= 0);
     nFees += tmpFee;   //  xiaofei
 
-    inBlock.insert(iter);
     for (CTransaction &t : bceResult.valueTransfers)
     {
         pblock->vtx.emplace_back(MakeTransactionRef(std::move(t)));
+        pblocktemplate->vTxFees.push_back(0);
+        pblocktemplate->vTxSigOpsCost.push_back(WITNESS_SCALE_FACTOR * t.GetLegacySigOpCount());
         this->nBlockWeight += GetTransactionWeight(t);
         this->nBlockSigOpsCost += t.GetLegacySigOpCount();
         ++nBlockTx;
@@ -513,21 +614,26 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
 
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
-    pblock->vtx.emplace_back(iter->GetSharedTx());
-    pblocktemplate->vTxFees.push_back(iter->GetFee());
-    pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCost());
-    nBlockWeight += iter->GetTxWeight();
-    ++nBlockTx;
-    nBlockSigOpsCost += iter->GetSigOpCost();
-    nFees += iter->GetFee();
+    AddToBlock(CBlockCandidateTx(iter));
     inBlock.insert(iter);
+}
+
+void BlockAssembler::AddToBlock(const CBlockCandidateTx &entry)
+{
+    pblock->vtx.emplace_back(entry.tx);
+    pblocktemplate->vTxFees.push_back(entry.nFee);
+    pblocktemplate->vTxSigOpsCost.push_back(entry.nSigOpCost);
+    nBlockWeight += entry.nTxWeight;
+    ++nBlockTx;
+    nBlockSigOpsCost += entry.nSigOpCost;
+    nFees += entry.nFee;
 
     bool fPrintPriority = Args().GetArg<bool>("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority)
     {
         NLogFormat("fee %s txid %s",
-                   CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(),
-                   iter->GetTx().GetHash().ToString());
+                   CFeeRate(entry.nModifiedFee, entry.nTxSize).ToString(),
+                   entry.tx->GetHash().ToString());
     }
 }
 
@@ -611,6 +717,8 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     indexed_modified_transaction_set mapModifiedTx;
     // Keep track of entries that failed inclusion, to avoid duplicate work
     CTxMemPool::setEntries failedTx;
+    // Packages with contract transactions, left for addContractPackages when ranking by gas
+    CTxMemPool::setEntries contractTx;
 
     // Start by adding all descendants of previously added txs to mapModifiedTx
     // and modifying them for their already included ancestors
@@ -683,8 +791,13 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 
         if (packageFees < blockMinFeeRate.GetFee(packageSize))
         {
-            // Everything else we might consider has a lower fee rate
-            return;
+            // Everything else we might consider has a lower fee rate, but the contract
+            // packages set aside are ranked by gas and checked on their own
+            if (fGasRanking && iter->GetTx().HasCreateOrCall())
+            {
+                contractTx.insert(iter);
+            }
+            break;
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost))
@@ -717,6 +830,21 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         onlyUnconfirmed(ancestors);
         ancestors.insert(iter);
 
+        // Ranked by gas once the other packages are in
+        if (fGasRanking && std::any_of(ancestors.begin(), ancestors.end(), [](CTxMemPool::txiter it)
+        {
+            return it->GetTx().HasCreateOrCall();
+        }))
+        {
+            if (fUsingModified)
+            {
+                mapModifiedTx.get<ancestor_score_or_gas_price>().erase(modit);
+                failedTx.insert(iter);
+            }
+            contractTx.insert(iter);
+            continue;
+        }
+
         // Test if all tx's are Final
         if (!TestPackageTransactions(ancestors))
         {
@@ -780,6 +908,496 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
+
+    if (fGasRanking)
+    {
+        // Contract transactions sort after all the others in mapTx, so the walk may have stopped
+        // before getting to them
+        for (; mi != mempool.mapTx.get<ancestor_score_or_gas_price>().end(); ++mi)
+        {
+            CTxMemPool::txiter it = mempool.mapTx.project<0>(mi);
+            if (it->GetTx().HasCreateOrCall() && !inBlock.count(it))
+            {
+                contractTx.insert(it);
+            }
+        }
+        for (const CTxMemPoolModifiedEntry &modEntry : mapModifiedTx)
+        {
+            if (modEntry.iter->GetTx().HasCreateOrCall())
+            {
+                contractTx.insert(modEntry.iter);
+            }
+        }
+    }
+
+    PrepareContractPackages(contractTx);
+}
+
+// Contract transactions sort after all the others in mapTx, and once they run the block is
+// mostly limited by gas rather than by weight. So they are ranked by what they pay per gas,
+// using the estimates cached in the mempool, instead of by their gas price.
+void BlockAssembler::PrepareContractPackages(const CTxMemPool::setEntries &setCandidates)
+{
+    CTxMemPool::setEntries package;
+    uint64_t packageSize;
+    CAmount packageFees;
+    int64_t packageSigOpsCost;
+
+    vContractPackages.clear();
+    for (CTxMemPool::txiter iter : setCandidates)
+    {
+        if (inBlock.count(iter))
+            continue;
+        CalculatePackage(iter, package, packageSize, packageFees, packageSigOpsCost);
+        uint64_t packageGas = std::max<uint64_t>(PackageGasEstimate(package), 1);
+        vContractPackages.emplace_back();
+        CopyPackage(package, iter, vContractPackages.back());
+        vContractPackages.back().dFeePerGas = (double)packageFees / packageGas;
+    }
+    std::stable_sort(vContractPackages.begin(), vContractPackages.end(),
+                     [](const CContractPackage &a, const CContractPackage &b)
+                     {
+                         return a.dFeePerGas > b.dFeePerGas;
+                     });
+}
+
+void BlockAssembler::CopyPackage(const CTxMemPool::setEntries &package, CTxMemPool::txiter iter,
+                                 CContractPackage &copy)
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CCoinsViewCache *pcoinsTip = ifChainObj->GetCoinsTip();
+
+    std::vector<CTxMemPool::txiter> sortedEntries;
+    SortForBlock(package, iter, sortedEntries);
+    copy.vTx.clear();
+    for (CTxMemPool::txiter it : sortedEntries)
+    {
+        copy.vTx.emplace_back(it);
+        copy.vTx.back().fFinal = TestPackageTransactions(CTxMemPool::setEntries{it});
+
+        // The sender of a contract is the owner of its first input. One spending an unconfirmed
+        // output finds it in the block, where its ancestors go first.
+        const CTransaction &tx = it->GetTx();
+        if (tx.HasCreateOrCall() && !viewSenders.HaveCoinInCache(tx.vin[0].prevout))
+        {
+            const Coin &coin = pcoinsTip->AccessCoin(tx.vin[0].prevout);
+            if (!coin.IsSpent())
+            {
+                viewSenders.AddCoin(tx.vin[0].prevout, Coin(coin), false);
+            }
+        }
+    }
+}
+
+void BlockAssembler::addContractPackages(int &nPackagesSelected)
+{
+    for (const CContractPackage &package : vContractPackages)
+    {
+        // Nothing runs on less than this
+        if (bceResult.usedGas + MINIMUM_GAS_LIMIT > softBlockGasLimit)
+            break;
+
+        // Added already as the ancestor of a better package
+        if (setContractPackageTx.count(package.vTx.back().tx->GetHash()))
+            continue;
+
+        uint64_t packageSize = 0;
+        CAmount packageFees = 0;
+        int64_t packageSigOpsCost = 0;
+        uint64_t packageGas = 0;
+        bool fFinal = true;
+        for (const CBlockCandidateTx &entry : package.vTx)
+        {
+            if (setContractPackageTx.count(entry.tx->GetHash()))
+                continue;
+            packageSize += entry.nTxSize;
+            packageFees += entry.nModifiedFee;
+            packageSigOpsCost += entry.nSigOpCost;
+            if (entry.fExecuted)
+                packageGas += entry.nGasEstimate;
+            fFinal = fFinal && entry.fFinal;
+        }
+        if (packageFees < blockMinFeeRate.GetFee(packageSize))
+            continue;
+        if (bceResult.usedGas + packageGas > softBlockGasLimit)
+            continue;
+        if (!TestPackage(packageSize, packageSigOpsCost) || !fFinal)
+            continue;
+
+        bool wasAdded = true;//sbtc-vm
+        for (const CBlockCandidateTx &entry : package.vTx)
+        {
+            if (setContractPackageTx.count(entry.tx->GetHash()))
+                continue;
+            if (entry.tx->HasCreateOrCall())
+            {
+                uint64_t nGasUsed = 0;
+                wasAdded = AttemptToAddContractToBlock(entry, minGasPrice, &viewSenders, nGasUsed);
+                if (nGasUsed > 0)
+                {
+                    vContractGasUsed.emplace_back(entry.tx->GetHash(), nGasUsed);
+                }
+                if (!wasAdded)
+                    break;
+            } else
+            {
+                AddToBlock(entry);
+            }
+            setContractPackageTx.insert(entry.tx->GetHash());
+        }
+        if (wasAdded)
+            ++nPackagesSelected;
+    }
+}
+
+void BlockAssembler::CommitContractPackages()
+{
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+
+    // What left the mempool meanwhile is only in the block
+    for (const uint256 &hash : setContractPackageTx)
+    {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end())
+        {
+            inBlock.insert(it);
+        }
+    }
+    // What they used on top of this block is the best guess for the next template
+    for (const std::pair<uint256, uint64_t> &gasUsed : vContractGasUsed)
+    {
+        CTxMemPool::txiter it = mempool.mapTx.find(gasUsed.first);
+        if (it != mempool.mapTx.end())
+        {
+            mempool.mapTx.modify(it, update_gas_estimate(gasUsed.second));
+        }
+    }
+    vContractPackages.clear();
+    setContractPackageTx.clear();
+    vContractGasUsed.clear();
+}
+
+uint64_t BlockAssembler::PackageGasEstimate(const CTxMemPool::setEntries &package, bool fExecutedOnly)
+{
+    uint64_t packageGas = 0;
+    for (CTxMemPool::txiter it : package)
+    {
+        if (fExecutedOnly && !it->GetExecTip())
+            continue;
+        packageGas += it->GetGasEstimate();
+    }
+    return packageGas;
+}
+
+void BlockAssembler::CalculatePackage(CTxMemPool::txiter iter, CTxMemPool::setEntries &package, uint64_t &packageSize,
+                                      CAmount &packageFees, int64_t &packageSigOpsCost)
+{
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    package.clear();
+    ifTxMempoolObj->GetMemPool().CalculateMemPoolAncestors(*iter, package, nNoLimit, nNoLimit, nNoLimit, nNoLimit,
+                                                           dummy, false);
+    onlyUnconfirmed(package);
+    package.insert(iter);
+
+    packageSize = 0;
+    packageFees = 0;
+    packageSigOpsCost = 0;
+    for (CTxMemPool::txiter it : package)
+    {
+        packageSize += it->GetTxSize();
+        packageFees += it->GetModifiedFee();
+        packageSigOpsCost += it->GetSigOpCost();
+    }
+}
+
+// Unlike addPackageTxs this only looks at the packages of the new transactions. Their
+// ancestors that are not in the block yet come along, and a package that does not fit is
+// left out for good: making room for it means assembling the block again.
+CAmount BlockAssembler::addNewPackageTxs(const std::vector<CTxMemPool::txiter> &vNew, int &nPackagesSelected)
+{
+    CTxMemPool::setEntries package;
+    uint64_t packageSize;
+    CAmount packageFees;
+    int64_t packageSigOpsCost;
+
+    std::vector<std::pair<CFeeRate, CTxMemPool::txiter>> vByFeeRate;
+    for (CTxMemPool::txiter iter : vNew)
+    {
+        if (inBlock.count(iter))
+            continue;
+        CalculatePackage(iter, package, packageSize, packageFees, packageSigOpsCost);
+        vByFeeRate.emplace_back(CFeeRate(packageFees, packageSize), iter);
+    }
+    std::stable_sort(vByFeeRate.begin(), vByFeeRate.end(),
+                     [](const std::pair<CFeeRate, CTxMemPool::txiter> &a,
+                        const std::pair<CFeeRate, CTxMemPool::txiter> &b)
+                     {
+                         return b.first < a.first;
+                     });
+
+    CAmount nSkippedFees = 0;
+    for (const auto &entry : vByFeeRate)
+    {
+        CTxMemPool::txiter iter = entry.second;
+        // Added already as the ancestor of a better package
+        if (inBlock.count(iter))
+            continue;
+
+        CalculatePackage(iter, package, packageSize, packageFees, packageSigOpsCost);
+        if (packageFees < blockMinFeeRate.GetFee(packageSize))
+            continue;
+        if (!TestPackage(packageSize, packageSigOpsCost))
+        {
+            nSkippedFees += packageFees;
+            continue;
+        }
+        if (!TestPackageTransactions(package))
+            continue;
+
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(package, iter, sortedEntries);
+
+        bool wasAdded = true;//sbtc-vm
+        for (CTxMemPool::txiter it : sortedEntries)
+        {
+            if (it->GetTx().HasCreateOrCall())
+            {
+                wasAdded = AttemptToAddContractToBlock(it, minGasPrice);
+                if (!wasAdded)
+                    break;
+            } else
+            {
+                AddToBlock(it);
+            }
+        }
+        if (wasAdded)
+            ++nPackagesSelected;
+    }
+    return nSkippedFees;
+}
+
+bool BlockAssembler::RemoveFromBlock(const std::set<uint256> &setRemoved)
+{
+    // The coinbase, and the refund transaction once contracts are enabled, stay
+    size_t nFirstTx = fContractEnabled ? 2 : 1;
+
+    // A transaction goes if it left the mempool or spends one that goes
+    std::set<uint256> setEvicted;
+    std::vector<bool> vEvict(pblock->vtx.size(), false);
+    for (size_t i = nFirstTx; i < pblock->vtx.size(); i++)
+    {
+        const CTransaction &tx = *pblock->vtx[i];
+        bool fEvict = setRemoved.count(tx.GetHash()) > 0;
+        for (const CTxIn &txin : tx.vin)
+        {
+            fEvict = fEvict || setEvicted.count(txin.prevout.hash) > 0;
+        }
+        if (!fEvict)
+            continue;
+        if (tx.HasCreateOrCall())
+            return false;
+        setEvicted.insert(tx.GetHash());
+        vEvict[i] = true;
+    }
+    if (setEvicted.empty())
+        return true;
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOpsCost;
+    for (size_t i = 0; i < pblock->vtx.size(); i++)
+    {
+        if (vEvict[i])
+        {
+            nBlockWeight -= GetTransactionWeight(*pblock->vtx[i]);
+            nBlockSigOpsCost -= pblocktemplate->vTxSigOpsCost[i];
+            nFees -= pblocktemplate->vTxFees[i];
+            --nBlockTx;
+            continue;
+        }
+        vtx.push_back(pblock->vtx[i]);
+        vTxFees.push_back(pblocktemplate->vTxFees[i]);
+        vTxSigOpsCost.push_back(pblocktemplate->vTxSigOpsCost[i]);
+    }
+    pblock->vtx.swap(vtx);
+    pblocktemplate->vTxFees.swap(vTxFees);
+    pblocktemplate->vTxSigOpsCost.swap(vTxSigOpsCost);
+
+    // The iterators of the removed transactions are gone, find the others again
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+    inBlock.clear();
+    for (size_t i = nFirstTx; i < pblock->vtx.size(); i++)
+    {
+        CTxMemPool::txiter it = mempool.mapTx.find(pblock->vtx[i]->GetHash());
+        if (it != mempool.mapTx.end())
+        {
+            inBlock.insert(it);
+        }
+    }
+    return true;
+}
+
+/** Whether a transaction of the block creates or calls a contract. */
+static bool HasContractTx(const CBlock &block)
+{
+    for (const CTransactionRef &tx : block.vtx)
+    {
+        if (tx->HasCreateOrCall())
+            return true;
+    }
+    return false;
+}
+
+CBlockTemplateBuilder::CBlockTemplateBuilder(const CChainParams &params) : chainparams(params), fMineWitnessTx(true),
+                                                                           nTimeAssembled(0), nSkippedFees(0),
+                                                                           fAssembling(false), fPendingOverflow(false)
+{
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+    mempool.NotifyEntryAdded.connect(boost::bind(&CBlockTemplateBuilder::TransactionAdded, this, _1));
+    mempool.NotifyEntryRemoved.connect(boost::bind(&CBlockTemplateBuilder::TransactionRemoved, this, _1, _2));
+}
+
+CBlockTemplateBuilder::~CBlockTemplateBuilder()
+{
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+    mempool.NotifyEntryAdded.disconnect(boost::bind(&CBlockTemplateBuilder::TransactionAdded, this, _1));
+    mempool.NotifyEntryRemoved.disconnect(boost::bind(&CBlockTemplateBuilder::TransactionRemoved, this, _1, _2));
+}
+
+void CBlockTemplateBuilder::TransactionAdded(CTransactionRef tx)
+{
+    LOCK(cs);
+    if ((setTemplateTx.empty() && !fAssembling) || fPendingOverflow)
+        return;
+    if (vPendingAdded.size() >= MAX_TEMPLATE_PENDING_TXS)
+    {
+        fPendingOverflow = true;
+        vPendingAdded.clear();
+        return;
+    }
+    vPendingAdded.push_back(tx->GetHash());
+}
+
+void CBlockTemplateBuilder::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (fAssembling || setTemplateTx.count(tx->GetHash()))
+    {
+        setPendingRemoved.insert(tx->GetHash());
+    }
+}
+
+std::unique_ptr<CBlockTemplate> CBlockTemplateBuilder::GetBlockTemplate(const CScript &scriptPubKeyIn,
+                                                                        bool fMineWitnessTxIn)
+{
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+    GET_CHAIN_INTERFACE(ifChainObj);
+    LOCK(csBuild);
+
+    try
+    {
+        bool fAssemble;
+        {
+            LOCK2(cs_main, mempool.cs);
+
+            std::vector<uint256> vAdded;
+            std::set<uint256> setRemoved;
+            bool fOverflow;
+            {
+                LOCK(cs);
+                vAdded.swap(vPendingAdded);
+                setRemoved.swap(setPendingRemoved);
+                fOverflow = fPendingOverflow;
+                fPendingOverflow = false;
+            }
+
+            // Every new tip, not only a reorg, changes the coinbase, the contract state, the lock time
+            // cutoff and what fits in the block, so the block is assembled again
+            fAssemble = !assembler || assembler->pindexPrev != ifChainObj->GetActiveChain().Tip() ||
+                        fMineWitnessTxIn != fMineWitnessTx || fOverflow ||
+                        (nSkippedFees > 0 && GetTime() - nTimeAssembled >= TEMPLATE_REFILL_INTERVAL);
+            if (!fAssemble && !setRemoved.empty())
+            {
+                fAssemble = !assembler->RemoveFromBlock(setRemoved);
+            }
+
+            if (!fAssemble && (!vAdded.empty() || !setRemoved.empty()))
+            {
+                int64_t nTimeStart = GetTimeMicros();
+                std::vector<CTxMemPool::txiter> vNew;
+                for (const uint256 &hash : vAdded)
+                {
+                    CTxMemPool::txiter it = mempool.mapTx.find(hash);
+                    if (it != mempool.mapTx.end())
+                    {
+                        vNew.push_back(it);
+                    }
+                }
+                int nPackagesSelected = 0;
+                nSkippedFees += assembler->addNewPackageTxs(vNew, nPackagesSelected);
+                assembler->FinishBlock();
+                NLogFormat("GetBlockTemplate(): %u new, %u removed, %d packages added in %.2fms", vAdded.size(),
+                           setRemoved.size(), nPackagesSelected, 0.001 * (GetTimeMicros() - nTimeStart));
+            }
+
+            // Contracts read the coinbase script as the block author, so a block running any is
+            // assembled again for another script. Otherwise the script is only substituted below.
+            fAssemble = fAssemble || (scriptPubKeyIn != scriptPubKey && HasContractTx(*assembler->pblock));
+            if (fAssemble)
+            {
+                // The block is assembled partly without the locks, any mempool change from here
+                // on may concern it
+                LOCK(cs);
+                fAssembling = true;
+            }
+        }
+
+        if (fAssemble)
+        {
+            assembler.reset(new BlockAssembler(chainparams));
+            assembler->AssembleBlock(scriptPubKeyIn, fMineWitnessTxIn);
+            scriptPubKey = scriptPubKeyIn;
+            fMineWitnessTx = fMineWitnessTxIn;
+            nTimeAssembled = GetTime();
+            nSkippedFees = 0;
+        }
+    } catch (...)
+    {
+        assembler.reset();
+        LOCK(cs);
+        fAssembling = false;
+        setTemplateTx.clear();
+        throw;
+    }
+
+    {
+        LOCK(cs);
+        fAssembling = false;
+        setTemplateTx.clear();
+        for (const CTransactionRef &tx : assembler->pblock->vtx)
+        {
+            setTemplateTx.insert(tx->GetHash());
+        }
+    }
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate(*assembler->pblocktemplate));
+    if (scriptPubKeyIn != scriptPubKey)
+    {
+        // The witness commitment leaves the coinbase out, only the merkle root changes.
+        CBlock &block = pblocktemplate->block;
+        CMutableTransaction coinbaseTx(*block.vtx[0]);
+        coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+        block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * block.vtx[0]->GetLegacySigOpCount();
+    }
+    return pblocktemplate;
 }
 
 void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, unsigned int &nExtraNonce)
@@ -792,6 +1410,11 @@ void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, unsigned
         hashPrevBlock = pblock->hashPrevBlock;
     }
     ++nExtraNonce;
+    SetExtraNonce(pblock, pindexPrev, nExtraNonce);
+}
+
+void SetExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, unsigned int nExtraNonce)
+{
     unsigned int nHeight = pindexPrev->nHeight + 1; // Height first in coinbase required for block.version=2
     CMutableTransaction txCoinbase(*pblock->vtx[0]);
     txCoinbase.vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
@@ -800,3 +1423,50 @@ void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+const uint32_t CNonceScanner::BATCH_SIZE;
+
+CNonceScanner::CNonceScanner(const CBlockHeader &header, const Consensus::Params &params)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    assert(ss.size() == 80);
+    SHA256Midstate(midstate, (const unsigned char *)&ss[0]);
+    memcpy(tail, &ss[64], sizeof(tail));
+
+    // Same checks as CheckProofOfWork, done once instead of per nonce.
+    bool fNegative;
+    bool fOverflow;
+    bnTarget.SetCompact(header.nBits, &fNegative, &fOverflow);
+    fValidTarget = !fNegative && bnTarget != 0 && !fOverflow && bnTarget <= UintToArith256(params.powLimit);
+    nTargetTop = (bnTarget >> 224).GetLow64();
+}
+
+bool CNonceScanner::Scan(uint32_t nBegin, uint32_t nEnd, uint32_t &nNonce) const
+{
+    if (!fValidTarget)
+        return false;
+
+    unsigned char hashes[BATCH_SIZE * 32];
+    while (nBegin < nEnd)
+    {
+        uint32_t nCount = std::min(nEnd - nBegin, BATCH_SIZE);
+        SHA256D80Nonces(hashes, midstate, tail, nBegin, nCount);
+        for (uint32_t i = 0; i < nCount; i++)
+        {
+            const unsigned char *hash = hashes + 32 * i;
+            // The top 32 bits of the hash rule out almost every nonce.
+            if (ReadLE32(hash + 28) > nTargetTop)
+                continue;
+            uint256 hashBlock;
+            memcpy(hashBlock.begin(), hash, 32);
+            if (UintToArith256(hashBlock) <= bnTarget)
+            {
+                nNonce = nBegin + i;
+                return true;
+            }
+        }
+        nBegin += nCount;
+    }
+    return false;
+}
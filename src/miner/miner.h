@@ -8,6 +8,7 @@
 
 #include "block/block.h"
 #include "mempool/txmempool.h"
+#include "utils/arith_uint256.h"
 
 #include <stdint.h>
 #include <memory>
@@ -27,6 +28,10 @@ namespace Consensus
 };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+//! Seconds a kept template may miss packages that no longer fit before it is assembled again.
+static const int64_t TEMPLATE_REFILL_INTERVAL = 5;
+//! Mempool additions queued for a kept template before it is assembled again instead.
+static const size_t MAX_TEMPLATE_PENDING_TXS = 10000;
 
 struct CBlockTemplate
 {
@@ -54,6 +59,41 @@ struct CTxMemPoolModifiedEntry
     int64_t nSigOpCostWithAncestors;
 };
 
+// What the block needs of a mempool entry, copied so that the transaction can be added
+// without the mempool locked
+struct CBlockCandidateTx
+{
+    CBlockCandidateTx(CTxMemPool::txiter entry)
+    {
+        tx = entry->GetSharedTx();
+        nFee = entry->GetFee();
+        nModifiedFee = entry->GetModifiedFee();
+        nTxSize = entry->GetTxSize();
+        nTxWeight = entry->GetTxWeight();
+        nSigOpCost = entry->GetSigOpCost();
+        nGasEstimate = entry->GetGasEstimate();
+        fExecuted = entry->GetExecTip() != nullptr;
+        fFinal = true;
+    }
+
+    CTransactionRef tx;
+    CAmount nFee;
+    CAmount nModifiedFee;
+    size_t nTxSize;
+    size_t nTxWeight;
+    int64_t nSigOpCost;
+    uint64_t nGasEstimate;
+    bool fExecuted;
+    bool fFinal; //!< Passes TestPackageTransactions
+};
+
+// A package with contract transactions, in block order with the one it was selected for last
+struct CContractPackage
+{
+    std::vector<CBlockCandidateTx> vTx;
+    double dFeePerGas;
+};
+
 /** Comparator for CTxMemPool::txiter objects.
  *  It simply compares the internal memory address of the CTxMemPoolEntry object
  *  pointed to. This means it has no meaning, and is only useful for using them
@@ -165,6 +205,7 @@ private:
     CTxMemPool::setEntries inBlock;
 
     // Chain context for the block
+    CBlockIndex *pindexPrev;
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams &chainparams;
@@ -175,9 +216,23 @@ private:
     uint64_t hardBlockGasLimit;
     uint64_t softBlockGasLimit;
     uint64_t txGasLimit;
+    bool fGasRanking;
+    // Contracts run in a fork of the tip state, the global state is left alone
+    std::shared_ptr<SbtcStateSnapshot> stateSnapshot;
+    // The contract packages left for addContractPackages, best fee per estimated gas first
+    std::vector<CContractPackage> vContractPackages;
+    // The coins contract senders are read from, for the packages run without cs_main
+    CCoinsView viewSendersBase;
+    CCoinsViewCache viewSenders;
+    // What addContractPackages added and the gas the contracts it ran used, for CommitContractPackages
+    std::set<uint256> setContractPackageTx;
+    std::vector<std::pair<uint256, uint64_t>> vContractGasUsed;
 
     // The original constructed reward tx (either coinbase or coinstake) without gas refund adjustments
     CMutableTransaction originalRewardTx; // sbtc-vm
+    // The coinbase before fees and the witness commitment are filled in
+    CMutableTransaction originalCoinbaseTx;
+    bool fContractEnabled;
     /////////////////////////////////////////////
 
 public:
@@ -188,6 +243,7 @@ public:
         size_t nBlockMaxWeight;
         size_t nBlockMaxSize;
         CFeeRate blockMinFeeRate;
+        bool fGasRanking;
     };
 
     BlockAssembler(const CChainParams &params);
@@ -198,22 +254,70 @@ public:
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript &scriptPubKeyIn, bool fMineWitnessTx = true);
 
 private:
+    friend class CBlockTemplateBuilder;
+
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
 
+    /** Assemble the block in pblocktemplate. Takes cs_main and mempool.cs, which must not be held,
+      * and lets go of them while the contract packages run. */
+    void AssembleBlock(const CScript &scriptPubKeyIn, bool fMineWitnessTx);
+
+    /** Start the block on the active tip and add the packages that can be added under the
+      * locks; cs_main and mempool.cs must be held */
+    void BeginBlock(const CScript &scriptPubKeyIn, bool fMineWitnessTx, int &nPackagesSelected,
+                    int &nDescendantsUpdated);
+
+    /** Fill in the coinbase, the refund transaction and the witness commitment for the
+      * transactions in the block, and check it with TestBlockValidity */
+    void FinishBlock();
+
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
-    /** Add a contract tx to the block*/
+    void AddToBlock(const CBlockCandidateTx &entry);
+
+    /** Add a contract tx to the block, and cache the gas it used in the mempool */
     bool AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64_t minGasPrice); //sbtc-vm
 
+    /** Add a contract tx to the block, without the mempool. The sender is read from pviewSenders, or
+      * from the chain and the mempool if it is null. nGasUsed is what the tx used if it ran. */
+    bool AttemptToAddContractToBlock(const CBlockCandidateTx &entry, uint64_t minGasPrice,
+                                     CCoinsViewCache *pviewSenders, uint64_t &nGasUsed);
+
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated);
 
+    /** The package of iter in block order, copied */
+    void CopyPackage(const CTxMemPool::setEntries &package, CTxMemPool::txiter iter, CContractPackage &copy);
+
+    /** Copy the packages of setCandidates, which contain contract transactions, to
+      * vContractPackages and rank them by fee per estimated gas, for addContractPackages */
+    void PrepareContractPackages(const CTxMemPool::setEntries &setCandidates);
+
+    /** Add vContractPackages, running their contracts; needs no locks. Packages that executions
+      * by the mempool show need more gas than the block has left are skipped without executing
+      * anything. */
+    void addContractPackages(int &nPackagesSelected);
+
+    /** Mark what addContractPackages added in the block and cache the gas it used in the mempool;
+      * cs_main and mempool.cs must be held */
+    void CommitContractPackages();
+
+    /** Add the packages of vNew, transactions that entered the mempool after the block was
+      * assembled, best package feerate first. Returns the fees of the packages that did not
+      * fit any more. */
+    CAmount addNewPackageTxs(const std::vector<CTxMemPool::txiter> &vNew, int &nPackagesSelected);
+
+    /** Take the transactions in setRemoved, which left the mempool, and their descendants out of
+      * the block. Returns false, with the block unchanged, if a contract transaction would go:
+      * the contracts after it ran on its state, so the block has to be assembled again. */
+    bool RemoveFromBlock(const std::set<uint256> &setRemoved);
+
     /** Rebuild the coinbase/coinstake transaction to account for new gas refunds **/
     void RebuildRefundTransaction(uint256 hashStateRoot, uint256 hashUTXORoot); // sbtc-vm
 
@@ -221,11 +325,20 @@ private:
     /** Remove confirmed (inBlock) entries from given set */
     void onlyUnconfirmed(CTxMemPool::setEntries &testSet);
 
+    /** The gas the contract transactions of a package are expected to use. With fExecutedOnly,
+      * only the estimates that come from an execution by the mempool are counted. */
+    uint64_t PackageGasEstimate(const CTxMemPool::setEntries &package, bool fExecutedOnly = false);
+
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost);
 
+    /** The not yet included ancestors of iter and iter itself, with their size, fees and sigops */
+    void CalculatePackage(CTxMemPool::txiter iter, CTxMemPool::setEntries &package, uint64_t &packageSize,
+                          CAmount &packageFees, int64_t &packageSigOpsCost);
+
     /** Perform checks on each transaction in a package:
-      * locktime, premature-witness, serialized size (if necessary)
+      * locktime, premature-witness, serialized size (if necessary), scripts verified for
+      * entries loaded from disk
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries &package);
@@ -246,9 +359,86 @@ private:
     UpdatePackagesForAdded(const CTxMemPool::setEntries &alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Keeps the block template up to date between calls instead of assembling it from scratch
+ * each time. Transactions entering the mempool are appended as packages while they fit, and
+ * template transactions leaving it are evicted along with their descendants in the block. A new
+ * tip, an eviction that takes a contract out, or packages that stopped fitting for
+ * TEMPLATE_REFILL_INTERVAL make the next call assemble the block again. The caller's coinbase
+ * script is put in the copy returned, unless the block runs contracts, which see it.
+ */
+class CBlockTemplateBuilder
+{
+public:
+    CBlockTemplateBuilder(const CChainParams &params);
+
+    ~CBlockTemplateBuilder();
+
+    /** A copy of the template with coinbase to scriptPubKeyIn on top of the active tip */
+    std::unique_ptr<CBlockTemplate> GetBlockTemplate(const CScript &scriptPubKeyIn, bool fMineWitnessTx = true);
+
+private:
+    void TransactionAdded(CTransactionRef tx);
+
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    const CChainParams &chainparams;
+
+    // One call at a time, the block is assembled partly without cs_main and mempool.cs
+    CCriticalSection csBuild;
+
+    // The kept template and what it was assembled for; guarded by csBuild, and changed with
+    // cs_main and mempool.cs held as well except while it is assembled
+    std::unique_ptr<BlockAssembler> assembler;
+    CScript scriptPubKey; //!< In the kept coinbase, the one contracts were executed with
+    bool fMineWitnessTx;
+    int64_t nTimeAssembled;
+    CAmount nSkippedFees;
+
+    // Mempool changes since the template was last brought up to date
+    CCriticalSection cs;
+    std::set<uint256> setTemplateTx;
+    std::vector<uint256> vPendingAdded;
+    std::set<uint256> setPendingRemoved;
+    bool fAssembling; //!< Every change is pending then, not only those about setTemplateTx
+    bool fPendingOverflow;
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, unsigned int &nExtraNonce);
 
+/** Put the given extranonce in the coinbase of a block and update its merkle root */
+void SetExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, unsigned int nExtraNonce);
+
+/**
+ * Proof-of-work search over the nonce of one block header.
+ *
+ * The SHA-256 midstate of the first 64 header bytes is computed once, so a
+ * nonce only costs the last block of the first hash plus the second hash, and
+ * those are done several nonces at a time by the vectorized SHA-256 kernels.
+ * Anything but the nonce changing in the header (nTime included) requires a
+ * new scanner.
+ */
+class CNonceScanner
+{
+public:
+    //! Nonces handed to the SHA-256 kernels at once.
+    static const uint32_t BATCH_SIZE = 256;
+
+    CNonceScanner(const CBlockHeader &header, const Consensus::Params &params);
+
+    /** Try the nonces in [nBegin, nEnd) in order. Returns true and sets nNonce
+     *  to the first one whose hash meets the header's target. */
+    bool Scan(uint32_t nBegin, uint32_t nEnd, uint32_t &nNonce) const;
+
+private:
+    uint32_t midstate[8];
+    unsigned char tail[12];
+    arith_uint256 bnTarget;
+    uint32_t nTargetTop;
+    bool fValidTarget;
+};
+
 int64_t UpdateTime(CBlockHeader *pblock, const Consensus::Params &consensusParams, const CBlockIndex *pindexPrev);
 
 #endif // BITCOIN_MINER_H
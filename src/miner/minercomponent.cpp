@@ -24,6 +24,10 @@ SET_CPP_SCOPED_LOG_CATEGORY(CID_MINER);
 
 static const bool DEFAULT_GENERATE = false;
 static const int DEFAULT_GENERATE_THREADS = 1;
+//! Nonces tried between two interruption points.
+static const uint32_t MINER_NONCE_BATCH = 0x1000;
+//! Nonce batches between checks of the tip, the mempool, the peers and the clock.
+static const unsigned int MINER_CHECK_BATCHES = 16;
 
 CMinerComponent::CMinerComponent()
 {
@@ -44,6 +48,10 @@ bool CMinerComponent::ComponentInitialize()
 bool CMinerComponent::ComponentStartup()
 {
     NLogStream() << "starting CMinerComponent component";
+    {
+        LOCK(cs);
+        templateBuilder = std::make_shared<CBlockTemplateBuilder>(Params());
+    }
     // Generate coins in the background
     GenerateBitcoins(Args().GetArg<bool>("-gen", DEFAULT_GENERATE),
                      Args().GetArg<int>("-genproclimit", DEFAULT_GENERATE_THREADS), Params());
@@ -55,9 +63,28 @@ bool CMinerComponent::ComponentShutdown()
     NLogStream() << "shutdown CMinerComponent component";
 
     GenerateBitcoins(false, 0, Params());
+    {
+        LOCK(cs);
+        templateBuilder.reset();
+    }
     return true;
 }
 
+std::unique_ptr<CBlockTemplate> CMinerComponent::GetBlockTemplate(const CScript &scriptPubKeyIn, bool fMineWitnessTx)
+{
+    // Not under cs: callers may hold cs_main, which the builder takes
+    std::shared_ptr<CBlockTemplateBuilder> builder;
+    {
+        LOCK(cs);
+        builder = templateBuilder;
+    }
+    if (!builder)
+    {
+        return BlockAssembler(Params()).CreateNewBlock(scriptPubKeyIn, fMineWitnessTx);
+    }
+    return builder->GetBlockTemplate(scriptPubKeyIn, fMineWitnessTx);
+}
+
 void CMinerComponent::GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams &chainparams)
 {
     static boost::thread_group *minerThreads = NULL;
@@ -83,16 +110,20 @@ void CMinerComponent::GenerateBitcoins(bool fGenerate, int nThreads, const CChai
 
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&CMinerComponent::SbtcMiner, this, boost::cref(chainparams)));
+        minerThreads->create_thread(
+                boost::bind(&CMinerComponent::SbtcMiner, this, boost::cref(chainparams), i, nThreads));
 }
 
-void CMinerComponent::SbtcMiner(const CChainParams &chainparams)
+void CMinerComponent::SbtcMiner(const CChainParams &chainparams, int nThread, int nThreads)
 {
     NLogStream() << "SbtcMiner started\n";
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
     RenameThread("sbtc-miner");
 
+    // Thread i takes extranonces i + 1, i + 1 + nThreads, ... so that no two
+    // threads ever search the same header, even with the same coinbase script.
     unsigned int nExtraNonce = 0;
+    uint256 hashExtraNoncePrev;
 
     std::shared_ptr<CReserveScript> coinbaseScript;
     GetMainSignals().GetScriptForMining(coinbaseScript);
@@ -131,10 +162,8 @@ void CMinerComponent::SbtcMiner(const CChainParams &chainparams)
             // Create new block
             //
             unsigned int nTransactionsUpdatedLast = ifTxMempoolObj->GetMemPool().GetTransactionsUpdated();
-            CBlockIndex *pindexPrev = ifChainObj->GetActiveChain().Tip();
 
-            std::unique_ptr<CBlockTemplate> pblocktemplate(
-                    BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript));
+            std::unique_ptr<CBlockTemplate> pblocktemplate(GetBlockTemplate(coinbaseScript->reserveScript));
             if (!pblocktemplate.get())
             {
                 ELogFormat(
@@ -142,7 +171,26 @@ void CMinerComponent::SbtcMiner(const CChainParams &chainparams)
                 return;
             }
             CBlock *pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
+
+            // The tip may have moved while the template was built, so take the
+            // parent it was really built on: the coinbase height comes from it.
+            CBlockIndex *pindexPrev;
+            {
+                LOCK(cs_main);
+                pindexPrev = ifChainObj->GetBlockIndex(pblock->hashPrevBlock);
+            }
+            if (!pindexPrev)
+                continue;
+
+            if (pblock->hashPrevBlock != hashExtraNoncePrev)
+            {
+                hashExtraNoncePrev = pblock->hashPrevBlock;
+                nExtraNonce = nThread + 1;
+            } else
+            {
+                nExtraNonce += nThreads;
+            }
+            SetExtraNonce(pblock, pindexPrev, nExtraNonce);
 
             ILogFormat("Running SbtcMiner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
                        ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
@@ -151,10 +199,14 @@ void CMinerComponent::SbtcMiner(const CChainParams &chainparams)
             // Search
             //
             int64_t nStart = GetTime();
+            CNonceScanner scanner(*pblock, chainparams.GetConsensus());
+            unsigned int nBatches = 0;
             while (true)
             {
-                if (CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus()))
+                uint32_t nNonce;
+                if (scanner.Scan(pblock->nNonce, pblock->nNonce + MINER_NONCE_BATCH, nNonce))
                 {
+                    pblock->nNonce = nNonce;
                     // Found a solution
                     SetThreadPriority(THREAD_PRIORITY_NORMAL);
                     ILogFormat("SbtcMiner:\n");
@@ -170,14 +222,16 @@ void CMinerComponent::SbtcMiner(const CChainParams &chainparams)
                     break;
                 }
 
-                ++pblock->nNonce;
+                pblock->nNonce += MINER_NONCE_BATCH;
                 // Check for stop or if block needs to be rebuilt
                 boost::this_thread::interruption_point();
+                if (pblock->nNonce >= 0xffff0000)
+                    break;
+                if (++nBatches % MINER_CHECK_BATCHES != 0)
+                    continue;
                 // Regtest mode doesn't require peers
                 if ((ifNetObj->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0) && chainparams.MiningRequiresPeers())
                     break;
-                if (pblock->nNonce >= 0xffff0000)
-                    break;
                 if (ifTxMempoolObj->GetMemPool().GetTransactionsUpdated() != nTransactionsUpdatedLast &&
                     GetTime() - nStart > 60)
                     break;
@@ -187,7 +241,7 @@ void CMinerComponent::SbtcMiner(const CChainParams &chainparams)
                 // Update nTime every few seconds
                 if (UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev) < 0)
                     break; // Recreate the block if the clock has run backwards,
-
+                scanner = CNonceScanner(*pblock, chainparams.GetConsensus());
             }
         }
     }
@@ -11,6 +11,8 @@
 #include "util.h"
 #include "interface/iminercomponent.h"
 
+class CBlockTemplateBuilder;
+
 class CMinerComponent : public IMinerComponent
 {
 public:
@@ -24,14 +26,21 @@ public:
 
     bool ComponentShutdown() override;
 
+    std::unique_ptr<CBlockTemplate>
+    GetBlockTemplate(const CScript &scriptPubKeyIn, bool fMineWitnessTx = true) override;
+
 private:
 
     CCriticalSection cs;
 
+    //! Shared so that a template being built outlives shutdown; guarded by cs.
+    std::shared_ptr<CBlockTemplateBuilder> templateBuilder;
+
     /** Run the miner threads */
     void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams &chainparams);
 
-    void SbtcMiner(const CChainParams &chainparams);
+    /** Mining thread nThread of nThreads; the threads work on disjoint extranonces. */
+    void SbtcMiner(const CChainParams &chainparams, int nThread, int nThreads);
 
     bool ProcessBlockFound(const CBlock *pblock, const CChainParams &chainparams);
 };
\ No newline at end of file
@@ -43,11 +43,25 @@
 #endif
 
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 #include <math.h>
+#include <unordered_map>
 
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
+/** Size of the buffer each recv() reads into */
+static const int SOCKET_RECV_BUFFER_SIZE = 0x10000;
+/** Reads from one socket before the others are serviced, with epoll */
+static const int MAX_SOCKET_RECV_PER_WAIT = 4;
+/** Events taken from epoll at a time */
+static const int MAX_EPOLL_EVENTS = 256;
+
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
@@ -1181,76 +1195,186 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket)
 
 }
 
-void CConnman::ThreadSocketHandler()
+void CConnman::DisconnectNodes()
 {
-    unsigned int nPrevNodeCount = 0;
-    while (!interruptNet)
     {
-        //
-        // Disconnect nodes
-        //
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        std::vector<CNode *> vNodesCopy = vNodes;
+        for (CNode *pnode : vNodesCopy)
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            std::vector<CNode *> vNodesCopy = vNodes;
-            for (CNode *pnode : vNodesCopy)
+            if (pnode->fDisconnect)
             {
-                if (pnode->fDisconnect)
-                {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+                // hold in disconnected pool until all refs are released
+                pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
+    }
+}
+
+void CConnman::DeleteDisconnectedNodes()
+{
+    // Delete disconnected nodes
+    std::list<CNode *> vNodesDisconnectedCopy = vNodesDisconnected;
+    for (CNode *pnode : vNodesDisconnectedCopy)
+    {
+        // wait until threads are done using it
+        if (pnode->GetRefCount() <= 0)
         {
-            // Delete disconnected nodes
-            std::list<CNode *> vNodesDisconnectedCopy = vNodesDisconnected;
-            for (CNode *pnode : vNodesDisconnectedCopy)
+            bool fDelete = false;
             {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0)
+                TRY_LOCK(pnode->cs_inventory, lockInv);
+                if (lockInv)
                 {
-                    bool fDelete = false;
-                    {
-                        TRY_LOCK(pnode->cs_inventory, lockInv);
-                        if (lockInv)
-                        {
-                            TRY_LOCK(pnode->cs_vSend, lockSend);
-                            if (lockSend)
-                            {
-                                fDelete = true;
-                            }
-                        }
-                    }
-                    if (fDelete)
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend)
                     {
-                        vNodesDisconnected.remove(pnode);
-                        DeleteNode(pnode);
+                        fDelete = true;
                     }
                 }
             }
+            if (fDelete)
+            {
+                vNodesDisconnected.remove(pnode);
+                DeleteNode(pnode);
+            }
         }
-        size_t vNodesSize;
+    }
+}
+
+void CConnman::NotifyNumConnectionsChanged(unsigned int &nPrevNodeCount)
+{
+    size_t vNodesSize;
+    {
+        LOCK(cs_vNodes);
+        vNodesSize = vNodes.size();
+    }
+    if (vNodesSize != nPrevNodeCount)
+    {
+        nPrevNodeCount = vNodesSize;
+        if (clientInterface)
+            clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+int CConnman::SocketRecv(CNode *pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[SOCKET_RECV_BUFFER_SIZE];
+    int nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return 0;
+        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    }
+    if (nBytes > 0)
+    {
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        RecordBytesRecv(nBytes);
+        if (notify)
         {
-            LOCK(cs_vNodes);
-            vNodesSize = vNodes.size();
+            size_t nSizeAdded = 0;
+            auto it(pnode->vRecvMsg.begin());
+            for (; it != pnode->vRecvMsg.end(); ++it)
+            {
+                if (!it->complete())
+                    break;
+                nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+            }
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg,
+                                          pnode->vRecvMsg.begin(), it);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+            }
+            WakeMessageHandler(pnode);
         }
-        if (vNodesSize != nPrevNodeCount)
+    } else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
         {
-            nPrevNodeCount = vNodesSize;
-            if (clientInterface)
-                clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+            NLogFormat("socket closed");
         }
+        pnode->CloseSocketDisconnect();
+    } else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                ELogFormat("socket recv error %s", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return nBytes;
+}
+
+void CConnman::InactivityCheck(CNode *pnode)
+{
+    int64_t nTime = GetSystemTimeInSeconds();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            NLogFormat("socket no message in first 60 seconds, %d %d from %d",
+                        pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->GetId());
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            NLogFormat("socket sending timeout: %is", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60))
+        {
+            NLogFormat("socket receive timeout: %is", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        } else if (pnode->nPingNonceSent &&
+                   pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            NLogFormat("ping timeout: %fs", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        } else if (!pnode->fSuccessfullyConnected)
+        {
+            NLogFormat("version handshake timeout from %d", pnode->GetId());
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+void CConnman::ThreadSocketHandler()
+{
+#ifdef HAVE_EPOLL
+    if (hEpoll != -1)
+    {
+        ThreadSocketHandlerEpoll();
+        return;
+    }
+#endif
+
+    unsigned int nPrevNodeCount = 0;
+    while (!interruptNet)
+    {
+        //
+        // Disconnect nodes
+        //
+        DisconnectNodes();
+        DeleteDisconnectedNodes();
+        NotifyNumConnectionsChanged(nPrevNodeCount);
 
         //
         // Find which sockets have data to receive
@@ -1379,59 +1503,7 @@ void CConnman::ThreadSocketHandler()
             }
             if (recvSet || errorSet)
             {
-                // typical socket buffer is 8K-64K
-                char pchBuf[0x10000];
-                int nBytes = 0;
-                {
-                    LOCK(pnode->cs_hSocket);
-                    if (pnode->hSocket == INVALID_SOCKET)
-                        continue;
-                    nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                }
-                if (nBytes > 0)
-                {
-                    bool notify = false;
-                    if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                        pnode->CloseSocketDisconnect();
-                    RecordBytesRecv(nBytes);
-                    if (notify)
-                    {
-                        size_t nSizeAdded = 0;
-                        auto it(pnode->vRecvMsg.begin());
-                        for (; it != pnode->vRecvMsg.end(); ++it)
-                        {
-                            if (!it->complete())
-                                break;
-                            nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                        }
-                        {
-                            LOCK(pnode->cs_vProcessMsg);
-                            pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg,
-                                                      pnode->vRecvMsg.begin(), it);
-                            pnode->nProcessQueueSize += nSizeAdded;
-                            pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                        }
-                        WakeMessageHandler();
-                    }
-                } else if (nBytes == 0)
-                {
-                    // socket closed gracefully
-                    if (!pnode->fDisconnect)
-                    {
-                        NLogFormat("socket closed");
-                    }
-                    pnode->CloseSocketDisconnect();
-                } else if (nBytes < 0)
-                {
-                    // error
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                    {
-                        if (!pnode->fDisconnect)
-                            ELogFormat("socket recv error %s", NetworkErrorString(nErr));
-                        pnode->CloseSocketDisconnect();
-                    }
-                }
+                SocketRecv(pnode);
             }
 
             //
@@ -1450,49 +1522,293 @@ void CConnman::ThreadSocketHandler()
             //
             // Inactivity checking
             //
-            int64_t nTime = GetSystemTimeInSeconds();
-            if (nTime - pnode->nTimeConnected > 60)
+            InactivityCheck(pnode);
+        }
+        {
+            LOCK(cs_vNodes);
+            for (CNode *pnode : vNodesCopy)
+                pnode->Release();
+        }
+    }
+}
+
+#ifdef HAVE_EPOLL
+// epoll_event data for the sockets that aren't nodes, whose data is their id.
+static const uint64_t EPOLL_WAKE_EVENT = std::numeric_limits<uint64_t>::max();
+static const uint64_t EPOLL_LISTEN_SOCKET = uint64_t(1) << 63;
+
+bool CConnman::InitEpoll()
+{
+    hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpoll == -1)
+    {
+        WLogFormat("epoll_create1 failed (%s), polling the sockets with select", NetworkErrorString(errno));
+        return false;
+    }
+    hWakeEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    bool fOk = hWakeEvent != -1;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = EPOLL_WAKE_EVENT;
+    fOk = fOk && epoll_ctl(hEpoll, EPOLL_CTL_ADD, hWakeEvent, &event) == 0;
+    // Listen sockets stay level triggered: one connection is accepted for each wait.
+    for (size_t i = 0; fOk && i < vhListenSocket.size(); i++)
+    {
+        event.data.u64 = EPOLL_LISTEN_SOCKET | i;
+        fOk = epoll_ctl(hEpoll, EPOLL_CTL_ADD, vhListenSocket[i].socket, &event) == 0;
+    }
+    if (!fOk)
+    {
+        WLogFormat("epoll setup failed (%s), polling the sockets with select", NetworkErrorString(errno));
+        CloseEpoll();
+        return false;
+    }
+    return true;
+}
+
+void CConnman::CloseEpoll()
+{
+    if (hWakeEvent != -1)
+        close(hWakeEvent);
+    if (hEpoll != -1)
+        close(hEpoll);
+    hWakeEvent = -1;
+    hEpoll = -1;
+}
+
+void CConnman::ThreadSocketHandlerEpoll()
+{
+    unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
+    // The nodes whose socket is registered, each holding a reference.
+    std::unordered_map<NodeId, CNode *> mapRegistered;
+    // The nodes to service without waiting for new events.
+    std::set<CNode *> setPending;
+    std::vector<struct epoll_event> vEvents(MAX_EPOLL_EVENTS);
+
+    while (!interruptNet)
+    {
+        //
+        // Disconnect nodes
+        //
+        DisconnectNodes();
+        for (CNode *pnode : vNodesDisconnected)
+        {
+            if (pnode->fSocketRegistered)
             {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+                // The socket left the epoll set when it was closed.
+                pnode->fSocketRegistered = false;
+                mapRegistered.erase(pnode->GetId());
+                setPending.erase(pnode);
+                LOCK(cs_vNodes);
+                pnode->Release();
+            }
+        }
+        DeleteDisconnectedNodes();
+        NotifyNumConnectionsChanged(nPrevNodeCount);
+
+        //
+        // Register new nodes
+        //
+        {
+            LOCK(cs_vNodes);
+            if (vNodes.size() != mapRegistered.size())
+            {
+                for (CNode *pnode : vNodes)
                 {
-                    NLogFormat("socket no message in first 60 seconds, %d %d from %d",
-                                pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->GetId());
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+                    if (pnode->fSocketRegistered)
+                        continue;
+                    LOCK(pnode->cs_hSocket);
+                    if (pnode->hSocket == INVALID_SOCKET)
+                        continue;
+                    // Edge triggered: an event only comes when the socket becomes
+                    // readable or writable again, which is tracked in fRecvReady
+                    // and fSendReady in the mean time.
+                    struct epoll_event event;
+                    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                    event.data.u64 = pnode->GetId();
+                    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0)
+                    {
+                        ELogFormat("epoll_ctl failed for peer=%d: %s", pnode->GetId(), NetworkErrorString(errno));
+                        pnode->fDisconnect = true;
+                        continue;
+                    }
+                    pnode->fSocketRegistered = true;
+                    pnode->AddRef();
+                    mapRegistered.emplace(pnode->GetId(), pnode);
+                }
+            }
+        }
+
+        //
+        // Wait for events
+        //
+        int nEvents = epoll_wait(hEpoll, vEvents.data(), vEvents.size(), setPending.empty() ? 50 : 0);
+        if (interruptNet)
+            return;
+
+        if (nEvents < 0)
+        {
+            if (errno != EINTR)
+            {
+                NLogFormat("socket epoll_wait error %s", NetworkErrorString(errno));
+                if (!interruptNet.sleep_for(std::chrono::milliseconds(50)))
+                    return;
+            }
+            nEvents = 0;
+        }
+
+        for (int i = 0; i < nEvents; i++)
+        {
+            const struct epoll_event &event = vEvents[i];
+            if (event.data.u64 == EPOLL_WAKE_EVENT)
+            {
+                uint64_t nCount;
+                if (read(hWakeEvent, &nCount, sizeof(nCount)) < 0 && errno != EAGAIN)
+                    NLogFormat("eventfd read error %s", NetworkErrorString(errno));
+
+                std::vector<NodeId> vWake;
                 {
-                    NLogFormat("socket sending timeout: %is", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60))
+                    std::lock_guard<std::mutex> lock(mutexSocketWake);
+                    vWake.swap(vSocketWakeNodes);
+                }
+                for (NodeId id : vWake)
                 {
-                    NLogFormat("socket receive timeout: %is", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent &&
-                           pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+                    auto it = mapRegistered.find(id);
+                    if (it != mapRegistered.end())
+                    {
+                        // Try sending even without EPOLLOUT, see WakeSocketHandler.
+                        it->second->fSendReady = true;
+                        setPending.insert(it->second);
+                    }
+                }
+            } else if (event.data.u64 & EPOLL_LISTEN_SOCKET)
+            {
+                AcceptConnection(vhListenSocket[event.data.u64 & ~EPOLL_LISTEN_SOCKET]);
+            } else
+            {
+                auto it = mapRegistered.find((NodeId)event.data.u64);
+                if (it == mapRegistered.end())
+                    continue;
+                CNode *pnode = it->second;
+                if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    pnode->fRecvReady = true;
+                if (event.events & EPOLLOUT)
+                    pnode->fSendReady = true;
+                setPending.insert(pnode);
+            }
+        }
+
+        //
+        // Service the sockets that are ready
+        //
+        std::vector<CNode *> vService(setPending.begin(), setPending.end());
+        setPending.clear();
+        for (CNode *pnode : vService)
+        {
+            if (interruptNet)
+                return;
+
+            bool fSendPending;
+            {
+                LOCK(pnode->cs_vSend);
+                if (pnode->fSendReady && !pnode->vSendMsg.empty())
                 {
-                    NLogFormat("ping timeout: %fs", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                } else if (!pnode->fSuccessfullyConnected)
+                    size_t nBytes = SocketSendData(pnode);
+                    if (nBytes)
+                    {
+                        RecordBytesSent(nBytes);
+                    }
+                    // What is left waits for the socket to be writable again.
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSendReady = false;
+                }
+                fSendPending = !pnode->vSendMsg.empty();
+            }
+
+            // Read until the socket is drained, or the peer has sent enough
+            // for now and waits for the others. As with select(), nothing is
+            // read while our replies are still queued: the peer is not
+            // reading either, and TCP flow control holds it back. The socket
+            // stays ready, and is read once the EPOLLOUT event drains the queue.
+            for (int j = 0; !fSendPending && pnode->fRecvReady && !pnode->fPauseRecv; j++)
+            {
+                if (j == MAX_SOCKET_RECV_PER_WAIT)
                 {
-                    NLogFormat("version handshake timeout from %d", pnode->GetId());
-                    pnode->fDisconnect = true;
+                    setPending.insert(pnode);
+                    break;
                 }
+                // A short read empties the socket: data arriving later
+                // triggers a new event.
+                if (SocketRecv(pnode) < SOCKET_RECV_BUFFER_SIZE)
+                    pnode->fRecvReady = false;
             }
         }
+
+        //
+        // Inactivity checking
+        //
+        int64_t nTime = GetSystemTimeInSeconds();
+        if (nTime != nLastInactivityCheck)
         {
+            nLastInactivityCheck = nTime;
             LOCK(cs_vNodes);
-            for (CNode *pnode : vNodesCopy)
-                pnode->Release();
+            for (CNode *pnode : vNodes)
+                InactivityCheck(pnode);
         }
     }
 }
+#endif
+
+void CConnman::WakeSocketHandler(CNode *pnode)
+{
+#ifdef HAVE_EPOLL
+    if (hWakeEvent == -1)
+        return;
+
+    bool fSignal;
+    {
+        std::lock_guard<std::mutex> lock(mutexSocketWake);
+        fSignal = vSocketWakeNodes.empty();
+        if (pnode)
+            vSocketWakeNodes.push_back(pnode->GetId());
+    }
+    if (fSignal || !pnode)
+    {
+        uint64_t nOne = 1;
+        if (write(hWakeEvent, &nOne, sizeof(nOne)) < 0 && errno != EAGAIN)
+            NLogFormat("eventfd write error %s", NetworkErrorString(errno));
+    }
+#endif
+}
 
 void CConnman::WakeMessageHandler()
 {
+    for (int i = 0; i < nMessageHandlerThreads; i++)
     {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        MessageHandlerShard &shard = msgHandlerShards[i];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutexMsgProc);
+            shard.fMsgProcWake = true;
+        }
+        shard.condMsgProc.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandler(const CNode *pnode)
+{
+    MessageHandlerShard &shard = msgHandlerShards[GetMessageHandlerShard(pnode)];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutexMsgProc);
+        shard.fMsgProcWake = true;
     }
-    condMsgProc.notify_one();
+    shard.condMsgProc.notify_one();
+}
+
+size_t CConnman::GetMessageHandlerShard(const CNode *pnode) const
+{
+    return (size_t)pnode->GetId() % nMessageHandlerThreads;
 }
 
 
@@ -2102,21 +2418,29 @@ bool CConnman::OpenNetworkConnection(const CAddress &addrConnect, bool fCountFai
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    WakeSocketHandler(nullptr);
 
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(size_t nShard)
 {
+    MessageHandlerShard &shard = msgHandlerShards[nShard];
     while (!flagInterruptMsgProc)
     {
+        // Only the nodes of this shard: no other thread processes them, and
+        // whatever is shared with other nodes is guarded by cs_main or its
+        // own lock.
         std::vector<CNode *> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode *pnode : vNodesCopy)
+            for (CNode *pnode : vNodes)
             {
-                pnode->AddRef();
+                if (GetMessageHandlerShard(pnode) == nShard)
+                {
+                    pnode->AddRef();
+                    vNodesCopy.push_back(pnode);
+                }
             }
         }
 
@@ -2148,13 +2472,13 @@ void CConnman::ThreadMessageHandler()
                 pnode->Release();
         }
 
-        std::unique_lock<std::mutex> lock(mutexMsgProc);
+        std::unique_lock<std::mutex> lock(shard.mutexMsgProc);
         if (!fMoreWork)
         {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this]
-            { return fMsgProcWake; });
+            shard.condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&shard]
+            { return shard.fMsgProcWake; });
         }
-        fMsgProcWake = false;
+        shard.fMsgProcWake = false;
     }
 }
 
@@ -2349,9 +2673,12 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In)
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
+    nMessageHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
     semOutbound = nullptr;
     semAddnode = nullptr;
     flagInterruptMsgProc = false;
+    hEpoll = -1;
+    hWakeEvent = -1;
     SetTryNewOutboundPeer(false);
 
     Options connOptions;
@@ -2479,6 +2806,10 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions)
         semAddnode = new CSemaphore(nMaxAddnode);
     }
 
+#ifdef HAVE_EPOLL
+    InitEpoll();
+#endif
+
     //
     // Start threads
     //
@@ -2487,9 +2818,10 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
+    for (MessageHandlerShard &shard : msgHandlerShards)
     {
-        std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        std::unique_lock<std::mutex> lock(shard.mutexMsgProc);
+        shard.fMsgProcWake = false;
     }
 
     // Send and receive from sockets, accept connections
@@ -2513,8 +2845,16 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions)
                                             std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand",
-                                       std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+    {
+        MessageHandlerShard &shard = msgHandlerShards[i];
+        shard.strThreadName = i == 0 ? "msghand" : strprintf("msghand.%d", i);
+        shard.thread = std::thread(&TraceThread<std::function<void()> >, shard.strThreadName.c_str(),
+                                   std::function<void()>(
+                                           std::bind(&CConnman::ThreadMessageHandler, this, (size_t)i)));
+    }
+    if (nMessageHandlerThreads > 1)
+        NLogFormat("Using %d message handler threads", nMessageHandlerThreads);
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2540,13 +2880,18 @@ public:
 
 void CConnman::Interrupt()
 {
+    flagInterruptMsgProc = true;
+    for (MessageHandlerShard &shard : msgHandlerShards)
     {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        flagInterruptMsgProc = true;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutexMsgProc);
+            shard.fMsgProcWake = true;
+        }
+        shard.condMsgProc.notify_all();
     }
-    condMsgProc.notify_all();
 
     interruptNet();
+    WakeSocketHandler(nullptr);
     InterruptSocks5(true);
 
     if (semOutbound)
@@ -2568,8 +2913,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (MessageHandlerShard &shard : msgHandlerShards)
+    {
+        if (shard.thread.joinable())
+            shard.thread.join();
+    }
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2605,6 +2953,9 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+#ifdef HAVE_EPOLL
+    CloseEpoll();
+#endif
     delete semOutbound;
     semOutbound = nullptr;
     delete semAddnode;
@@ -2940,6 +3291,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fPauseRecv = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
+    fSocketRegistered = false;
+    fRecvReady = false;
+    fSendReady = false;
 
     for (const std::string &msg : getAllNetMessageTypes())
         mapRecvBytesPerMsgCmd[msg] = 0;
@@ -2996,13 +3350,18 @@ bool CConnman::NodeFullyConnected(const CNode *pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg)
+void CConnman::PushMessage(CNode *pnode, const std::string &command, const std::vector<unsigned char> &data)
 {
-    PushMessage(pnode, msg.command, msg.data);
+    CSerializedNetMsg msg;
+    msg.command = command;
+    msg.data = data;
+    PushMessage(pnode, std::move(msg));
 }
 
-void CConnman::PushMessage(CNode *pnode, const std::string &command, const std::vector<unsigned char> &data)
+void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg)
 {
+    const std::string &command = msg.command;
+    std::vector<unsigned char> &data = msg.data;
     size_t nMessageSize = data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     NLogFormat("sending %s (%d bytes) peer=%d", SanitizeString(command.c_str()), nMessageSize,
@@ -3017,6 +3376,7 @@ void CConnman::PushMessage(CNode *pnode, const std::string &command, const std::
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
     size_t nBytesSent = 0;
+    bool fWake = false;
     {
         LOCK(pnode->cs_vSend);
         bool optimisticSend(pnode->vSendMsg.empty());
@@ -3033,10 +3393,16 @@ void CConnman::PushMessage(CNode *pnode, const std::string &command, const std::
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
+        {
             nBytesSent = SocketSendData(pnode);
+            // The socket thread sends the rest.
+            fWake = !pnode->vSendMsg.empty();
+        }
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
+    if (fWake)
+        WakeSocketHandler(pnode);
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode *pnode)> func)
@@ -87,6 +87,10 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
+/** Default for -msghandlerthreads, the number of threads processing peer messages */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -152,6 +156,7 @@ public:
         NetEventsInterface *m_msgproc = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        int nMessageHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         std::vector<std::string> vSeedNodes;
@@ -172,6 +177,7 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHANDLER_THREADS));
         nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
         nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
         vWhitelistedRange = connOptions.vWhitelistedRange;
@@ -362,8 +368,19 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake all the message handler threads. */
     void WakeMessageHandler();
 
+    /** Wake the message handler thread the node is processed by. */
+    void WakeMessageHandler(const CNode *pnode);
+
+    /**
+     * Have the socket thread look at the node again, or at the nodes and
+     * listen sockets with no node given. Only needed with epoll, where
+     * select() would find out at its next poll.
+     */
+    void WakeSocketHandler(CNode *pnode);
+
 private:
     struct ListenSocket
     {
@@ -389,12 +406,35 @@ private:
 
     void ThreadOpenConnections();
 
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(size_t nShard);
+
+    /**
+     * Each node is processed by one message handler thread, so that its
+     * messages are handled in order.
+     */
+    size_t GetMessageHandlerShard(const CNode *pnode) const;
 
     void AcceptConnection(const ListenSocket &hListenSocket);
 
     void ThreadSocketHandler();
 
+    void DisconnectNodes();
+
+    void DeleteDisconnectedNodes();
+
+    void NotifyNumConnectionsChanged(unsigned int &nPrevNodeCount);
+
+    /** Read once from the socket of the node, returning what recv() did. */
+    int SocketRecv(CNode *pnode);
+
+    void InactivityCheck(CNode *pnode);
+
+    bool InitEpoll();
+
+    void CloseEpoll();
+
+    void ThreadSocketHandlerEpoll();
+
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress &ad) const;
@@ -460,6 +500,7 @@ private:
 
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
+    std::atomic<int> nMessageHandlerThreads;
 
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive;
@@ -496,20 +537,39 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** A message handler thread and what wakes it. */
+    struct MessageHandlerShard
+    {
+        std::thread thread;
+        std::string strThreadName;
+        /** flag for waking the message processor. */
+        bool fMsgProcWake;
+        std::condition_variable condMsgProc;
+        std::mutex mutexMsgProc;
+
+        MessageHandlerShard() : fMsgProcWake(false)
+        {
+        }
+    };
 
-    std::condition_variable condMsgProc;
-    std::mutex mutexMsgProc;
+    /** The first nMessageHandlerThreads are used, so that none is moved while being woken */
+    MessageHandlerShard msgHandlerShards[MAX_MSGHANDLER_THREADS];
     std::atomic<bool> flagInterruptMsgProc;
 
     CThreadInterrupt interruptNet;
 
+    /** The epoll instance the sockets are registered with, or -1 when select() is used */
+    int hEpoll;
+    /** eventfd registered with hEpoll to wake the socket thread */
+    int hWakeEvent;
+    std::mutex mutexSocketWake;
+    /** Nodes the socket thread was woken for */
+    std::vector<NodeId> vSocketWakeNodes;
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -772,6 +832,10 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // The state of the socket with epoll, only used by the socket thread.
+    bool fSocketRegistered;
+    bool fRecvReady;
+    bool fSendReady;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -782,6 +846,9 @@ public:
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // Addresses are pushed by the message handler threads of other nodes
+    // relaying them, so these are protected by cs_addrToSend
+    CCriticalSection cs_addrToSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -917,6 +984,7 @@ public:
 
     void AddAddressKnown(const CAddress &_addr)
     {
+        LOCK(cs_addrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -925,6 +993,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrToSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey()))
         {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND)
@@ -36,6 +36,7 @@
 #include "interface/ichaincomponent.h"
 #include "chaincontrol/checkpoints.h"
 #include "chaincontrol/blockfilemanager.h"
+#include "chaincontrol/blockfilterindex.h"
 
 #if defined(NDEBUG)
 # error "Super Bitcoin cannot be compiled without assertions."
@@ -48,6 +49,10 @@ SET_CPP_SCOPED_LOG_CATEGORY(CID_P2P_NET);
 std::atomic<int64_t> nTimeBestReceived(0); // Used only to inform the wallet of when we last received a block
 
 static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SHA256("main address relay")[0:8]
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static const uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static const uint32_t MAX_GETCFHEADERS_SIZE = 2000;
 
 // Internal stuff
 namespace
@@ -71,6 +76,7 @@ namespace
         const CBlockIndex *pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested, in microseconds.
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -83,6 +89,10 @@ namespace
     /** Number of peers from which we're downloading blocks. */
     int nPeersWithValidatedDownloads = 0;
 
+    /** Sum of nBlockDownloadRate over the peers, and how many have one. Protected by cs_main. */
+    int64_t nTotalBlockDownloadRate = 0;
+    int nPeersWithBlockDownloadRate = 0;
+
     /** Number of outbound peers with m_chain_sync.m_protect. */
     int g_outbound_peers_with_protect_from_disconnect = 0;
 
@@ -147,6 +157,14 @@ namespace
         int64_t nDownloadingSince;
         int nBlocksInFlight;
         int nBlocksInFlightValidHeaders;
+        //! Blocks this peer delivered after we asked for them.
+        uint64_t nBlocksDelivered;
+        //! Moving average of the bytes per second this peer delivers blocks at, or 0 before the first one.
+        int64_t nBlockDownloadRate;
+        //! Moving average of the microseconds from requesting a block not queued behind others to receiving it.
+        int64_t nBlockResponseMicros;
+        //! When the last requested block was received from this peer, in microseconds.
+        int64_t nLastBlockDelivery;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
         //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -200,6 +218,13 @@ namespace
         //! Time of last new block announcement
         int64_t m_last_block_announcement;
 
+        //! Transactions from this peer accepted to the mempool
+        uint64_t nTxAccepted;
+        //! Transactions from this peer found invalid or refused by policy
+        uint64_t nTxRejected;
+        //! Time spent handling the transactions of this peer, in microseconds
+        int64_t nTxValidationMicros;
+
         CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn)
         {
             fCurrentlyConnected = false;
@@ -216,6 +241,10 @@ namespace
             nDownloadingSince = 0;
             nBlocksInFlight = 0;
             nBlocksInFlightValidHeaders = 0;
+            nBlocksDelivered = 0;
+            nBlockDownloadRate = 0;
+            nBlockResponseMicros = 0;
+            nLastBlockDelivery = 0;
             fPreferredDownload = false;
             fPreferHeaders = false;
             fPreferHeaderAndIDs = false;
@@ -225,6 +254,9 @@ namespace
             fSupportsDesiredCmpctVersion = false;
             m_chain_sync = {0, nullptr, false, false};
             m_last_block_announcement = 0;
+            nTxAccepted = 0;
+            nTxRejected = 0;
+            nTxValidationMicros = 0;
         }
     };
 
@@ -331,7 +363,8 @@ namespace
                                                                             {hash, pindex, pindex != nullptr,
                                                                              std::unique_ptr<PartiallyDownloadedBlock>(
                                                                                      pit ? new PartiallyDownloadedBlock(
-                                                                                             &mempool) : nullptr)});
+                                                                                             &mempool) : nullptr),
+                                                                             GetTimeMicros()});
         state->nBlocksInFlight++;
         state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
         if (state->nBlocksInFlight == 1)
@@ -349,6 +382,77 @@ namespace
         return true;
     }
 
+    // Requires cs_main.
+    // Update the download rate and response time of the peer the block was
+    // requested from, when it is the one delivering it.
+    void UpdateBlockDownloadStats(NodeId nodeid, const uint256 &hash, size_t nBytes)
+    {
+        std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(
+                hash);
+        if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+            return;
+
+        CNodeState *state = State(nodeid);
+        const QueuedBlock &queuedBlock = *itInFlight->second.second;
+        int64_t nNow = GetTimeMicros();
+
+        // Blocks are requested several at a time, so the rate is measured from
+        // the previous block delivered, unless the peer had nothing to send
+        // since.
+        int64_t nElapsed = std::max<int64_t>(nNow - std::max(queuedBlock.nTimeRequested, state->nLastBlockDelivery), 1000);
+        int64_t nRate = (int64_t)nBytes * 1000000 / nElapsed;
+        if (state->nBlockDownloadRate == 0)
+        {
+            nPeersWithBlockDownloadRate++;
+            state->nBlockDownloadRate = std::max<int64_t>(nRate, 1);
+            nTotalBlockDownloadRate += state->nBlockDownloadRate;
+        } else
+        {
+            int64_t nNewRate = std::max<int64_t>(state->nBlockDownloadRate + (nRate - state->nBlockDownloadRate) / 4, 1);
+            nTotalBlockDownloadRate += nNewRate - state->nBlockDownloadRate;
+            state->nBlockDownloadRate = nNewRate;
+        }
+
+        if (queuedBlock.nTimeRequested >= state->nLastBlockDelivery)
+        {
+            int64_t nResponse = nNow - queuedBlock.nTimeRequested;
+            if (state->nBlockResponseMicros == 0)
+                state->nBlockResponseMicros = nResponse;
+            else
+                state->nBlockResponseMicros += (nResponse - state->nBlockResponseMicros) / 4;
+        }
+
+        state->nLastBlockDelivery = nNow;
+        state->nBlocksDelivered++;
+    }
+
+    // Requires cs_main.
+    // Number of blocks to keep in flight from a peer during block download:
+    // peers delivering faster than the average get more, slower ones fewer,
+    // so that the next blocks needed are not held by the slow ones.
+    int GetMaxBlocksInFlight(const CNodeState *state)
+    {
+        if (state->nBlockDownloadRate == 0 || nPeersWithBlockDownloadRate < 2)
+            return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+
+        int64_t nAverageRate = std::max<int64_t>(nTotalBlockDownloadRate / nPeersWithBlockDownloadRate, 1);
+        int64_t nMax = MAX_BLOCKS_IN_TRANSIT_PER_PEER * state->nBlockDownloadRate / nAverageRate;
+        return (int)std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER,
+                                      std::min<int64_t>(nMax, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER));
+    }
+
+    // Requires cs_main.
+    // Whether a block in flight from a peer holding back the download window
+    // should be asked from another, faster one instead: it has been in flight
+    // for more than twice what the faster peer takes to respond.
+    bool ShouldReassignBlock(const CNodeState *state, const CNodeState *stateHolder, const QueuedBlock &queuedBlock,
+                             int64_t nNow)
+    {
+        if (state->nBlockDownloadRate == 0 || state->nBlockDownloadRate < 2 * stateHolder->nBlockDownloadRate)
+            return false;
+        return nNow - queuedBlock.nTimeRequested > std::max(2 * state->nBlockResponseMicros, BLOCK_REASSIGN_MIN_TIMEOUT);
+    }
+
     /** Check whether the last unknown block a peer advertised is not yet known. */
     void ProcessBlockAvailability(NodeId nodeid)
     {
@@ -471,7 +575,8 @@ namespace
     /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
      *  at most count entries. */
     void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex *> &vBlocks,
-                                  NodeId &nodeStaller, const Consensus::Params &consensusParams)
+                                  NodeId &nodeStaller, const Consensus::Params &consensusParams,
+                                  const CBlockIndex **ppindexWaitingFor = nullptr)
     {
         if (count == 0)
             return;
@@ -516,6 +621,7 @@ namespace
         int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
         int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
         NodeId waitingfor = -1;
+        const CBlockIndex *pindexWaitingFor = nullptr;
         while (pindexWalk->nHeight < nMaxHeight)
         {
             // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
@@ -561,6 +667,11 @@ namespace
                             // We aren't able to fetch anything, but we would be if the download window was one larger.
                             nodeStaller = waitingfor;
                         }
+                        if (ppindexWaitingFor && waitingfor != nodeid)
+                        {
+                            // The block the window is waiting for, which could be asked from this peer instead.
+                            *ppindexWaitingFor = pindexWaitingFor;
+                        }
                         return;
                     }
                     vBlocks.push_back(pindex);
@@ -572,6 +683,7 @@ namespace
                 {
                     // This is the first already-in-flight block.
                     waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                    pindexWaitingFor = pindex;
                 }
             }
         }
@@ -610,6 +722,13 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats)
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlocksDelivered = state->nBlocksDelivered;
+    stats.nBlockDownloadRate = state->nBlockDownloadRate;
+    stats.nBlockResponseMicros = state->nBlockResponseMicros;
+    stats.nMaxBlocksInFlight = GetMaxBlocksInFlight(state);
+    stats.nTxAccepted = state->nTxAccepted;
+    stats.nTxRejected = state->nTxRejected;
+    stats.nTxValidationMicros = state->nTxValidationMicros;
     return true;
 }
 
@@ -689,6 +808,23 @@ bool static AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+// To prevent fingerprinting attacks, only serve data of blocks outside of the active chain
+// if they are valid, and no more than a month older (both in time, and in best equivalent
+// proof of work) than the best header chain we know about.
+static bool BlockRequestAllowed(const CBlockIndex *pindex, const Consensus::Params &consensusParams)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    if (ifChainObj->GetActiveChain().Contains(pindex))
+        return true;
+
+    static const int nOneMonth = 30 * 24 * 60 * 60;
+    const CBlockIndex *pindexBestHeader = ifChainObj->GetIndexBestHeader();
+    return pindex->IsValid(BLOCK_VALID_SCRIPTS) && pindexBestHeader != nullptr &&
+           (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() < nOneMonth) &&
+           (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) < nOneMonth);
+}
+
 static void RelayAddress(const CAddress &addr, bool fReachable, CConnman *connman)
 {
     unsigned int nRelayNodes = fReachable ? 2 : 1; // limited relaying of addresses outside our network(s)
@@ -1012,7 +1148,7 @@ static inline NodeExchangeInfo FromCNode(CNode *pfrom)
 //////////////////////////////////////////////////////////////////////////////
 
 PeerLogicValidation::PeerLogicValidation(CConnman *connmanIn, CScheduler &scheduler)
-        : connman(connmanIn), m_stale_tip_check_time(0), appArgs(Args())
+        : connman(connmanIn), m_stale_tip_check_time(0), fTxBatchVerified(false), appArgs(Args())
 {
     // Stale tip checking and peer eviction are on two different timers, but we
     // don't want them to get out of sync due to drift in the scheduler, so we
@@ -1181,103 +1317,179 @@ bool PeerLogicValidation::ProcessMessages(CNode *pfrom, std::atomic<bool> &inter
     if (pfrom->fPauseSend)
         return false;
 
+    // A peer that has already misbehaved gets no batch to verify on its behalf
+    bool fBatchTx = fRelayTxes;
+    if (fBatchTx)
+    {
+        LOCK(cs_main);
+        fBatchTx = State(pfrom->GetId())->nMisbehavior == 0;
+    }
+
     std::list<CNetMessage> msgs;
+    bool fResumeRecv;
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
             return false;
-        // Just take one message
+        // Just take one message, or a run of tx messages whose scripts are verified together
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        if (fBatchTx && msgs.front().hdr.GetCommand() == NetMsgType::TX)
+        {
+            while (!pfrom->vProcessMsg.empty() && msgs.size() < MAX_TX_PREVERIFY_BATCH &&
+                   pfrom->vProcessMsg.front().hdr.GetCommand() == NetMsgType::TX)
+            {
+                msgs.splice(msgs.end(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
+                pfrom->nProcessQueueSize -= msgs.back().vRecv.size() + CMessageHeader::HEADER_SIZE;
+            }
+        }
+        fResumeRecv = pfrom->fPauseRecv && pfrom->nProcessQueueSize <= connman->GetReceiveFloodSize();
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
-    CNetMessage &msg(msgs.front());
+    if (fResumeRecv)
+        connman->WakeSocketHandler(pfrom);
 
-    msg.SetVersion(pfrom->GetRecvVersion());
-    // Scan for message start
-    if (memcmp(msg.hdr.pchMessageStart, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0)
+    // Each transaction is still accepted by its own message below, finding its
+    // scripts in the cache; the coins fetched for the ones it turns down are
+    // dropped afterwards.
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    std::vector<CTransactionRef> vtxBatch;
+    std::vector<std::vector<COutPoint>> vCoinsToUncache;
+    if (msgs.size() > 1)
     {
-        WLogFormat("PROCESSMESSAGE: INVALID MESSAGESTART %s peer=%d", SanitizeString(msg.hdr.GetCommand()),
-                   pfrom->GetId());
-        pfrom->fDisconnect = true;
-        return false;
+        for (const CNetMessage &msg : msgs)
+        {
+            CDataStream vRecv(msg.vRecv);
+            vRecv.SetVersion(pfrom->GetRecvVersion());
+            try
+            {
+                CTransactionRef ptx;
+                vRecv >> ptx;
+                vtxBatch.push_back(ptx);
+            }
+            catch (const std::exception &)
+            {
+                // Reported when the message is processed
+            }
+        }
+        ifTxMempoolObj->PreVerifyTransactions(vtxBatch, vCoinsToUncache);
     }
 
-    // Read header
-    CMessageHeader &hdr = msg.hdr;
-    if (!hdr.IsValid(chainparams.MessageStart()))
+    bool fStop = false;
+    for (CNetMessage &msg : msgs)
     {
-        ELogFormat("PROCESSMESSAGE: ERRORS IN HEADER %s peer=%d", SanitizeString(hdr.GetCommand()), pfrom->GetId());
-        return fMoreWork;
-    }
-    std::string strCommand = hdr.GetCommand();
+        msg.SetVersion(pfrom->GetRecvVersion());
+        // Scan for message start
+        if (memcmp(msg.hdr.pchMessageStart, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0)
+        {
+            WLogFormat("PROCESSMESSAGE: INVALID MESSAGESTART %s peer=%d", SanitizeString(msg.hdr.GetCommand()),
+                       pfrom->GetId());
+            pfrom->fDisconnect = true;
+            fStop = true;
+            break;
+        }
 
-    // Message size
-    unsigned int nMessageSize = hdr.nMessageSize;
+        // Read header
+        CMessageHeader &hdr = msg.hdr;
+        if (!hdr.IsValid(chainparams.MessageStart()))
+        {
+            ELogFormat("PROCESSMESSAGE: ERRORS IN HEADER %s peer=%d", SanitizeString(hdr.GetCommand()),
+                       pfrom->GetId());
+            continue;
+        }
+        std::string strCommand = hdr.GetCommand();
 
-    // Checksum
-    CDataStream &vRecv = msg.vRecv;
-    const uint256 &hash = msg.GetMessageHash();
-    if (memcmp(hash.begin(), hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) != 0)
-    {
-        ELogFormat("%s(%s, %u bytes): CHECKSUM ERROR expected %s was %s", __func__,
-                   SanitizeString(strCommand), nMessageSize,
-                   HexStr(hash.begin(), hash.begin() + CMessageHeader::CHECKSUM_SIZE),
-                   HexStr(hdr.pchChecksum, hdr.pchChecksum + CMessageHeader::CHECKSUM_SIZE));
-        return fMoreWork;
-    }
+        // Message size
+        unsigned int nMessageSize = hdr.nMessageSize;
 
-    // Process message
-    bool fRet = false;
-    try
-    {
-        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, interruptMsgProc);
-        if (interruptMsgProc)
-            return false;
-        if (!pfrom->vRecvGetData.empty())
-            fMoreWork = true;
-    }
-    catch (const std::ios_base::failure &e)
-    {
-        connman->PushMessage(pfrom,
-                             CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::REJECT, strCommand, REJECT_MALFORMED,
-                                                                   std::string("error parsing message")));
-        if (strstr(e.what(), "end of data"))
-        {
-            // Allow exceptions from under-length message on vRecv
-            ELogFormat(
-                    "%s(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length",
-                    __func__, SanitizeString(strCommand), nMessageSize, e.what());
-        } else if (strstr(e.what(), "size too large"))
-        {
-            // Allow exceptions from over-long size
-            ELogFormat("%s(%s, %u bytes): Exception '%s' caught", __func__, SanitizeString(strCommand), nMessageSize,
-                       e.what());
-        } else if (strstr(e.what(), "non-canonical ReadCompactSize()"))
-        {
-            // Allow exceptions from non-canonical encoding
-            ELogFormat("%s(%s, %u bytes): Exception '%s' caught", __func__, SanitizeString(strCommand), nMessageSize,
-                       e.what());
-        } else
+        // Checksum
+        CDataStream &vRecv = msg.vRecv;
+        const uint256 &hash = msg.GetMessageHash();
+        if (memcmp(hash.begin(), hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) != 0)
+        {
+            ELogFormat("%s(%s, %u bytes): CHECKSUM ERROR expected %s was %s", __func__,
+                       SanitizeString(strCommand), nMessageSize,
+                       HexStr(hash.begin(), hash.begin() + CMessageHeader::CHECKSUM_SIZE),
+                       HexStr(hdr.pchChecksum, hdr.pchChecksum + CMessageHeader::CHECKSUM_SIZE));
+            continue;
+        }
+
+        // Process message
+        bool fRet = false;
+        try
+        {
+            fTxBatchVerified = !vtxBatch.empty();
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, interruptMsgProc);
+            fTxBatchVerified = false;
+            if (interruptMsgProc)
+            {
+                fStop = true;
+                break;
+            }
+            if (!pfrom->vRecvGetData.empty())
+                fMoreWork = true;
+        }
+        catch (const std::ios_base::failure &e)
+        {
+            connman->PushMessage(pfrom,
+                                 CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::REJECT, strCommand,
+                                                                       REJECT_MALFORMED,
+                                                                       std::string("error parsing message")));
+            if (strstr(e.what(), "end of data"))
+            {
+                // Allow exceptions from under-length message on vRecv
+                ELogFormat(
+                        "%s(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length",
+                        __func__, SanitizeString(strCommand), nMessageSize, e.what());
+            } else if (strstr(e.what(), "size too large"))
+            {
+                // Allow exceptions from over-long size
+                ELogFormat("%s(%s, %u bytes): Exception '%s' caught", __func__, SanitizeString(strCommand),
+                           nMessageSize, e.what());
+            } else if (strstr(e.what(), "non-canonical ReadCompactSize()"))
+            {
+                // Allow exceptions from non-canonical encoding
+                ELogFormat("%s(%s, %u bytes): Exception '%s' caught", __func__, SanitizeString(strCommand),
+                           nMessageSize, e.what());
+            } else
+            {
+                PrintExceptionContinue(&e, "ProcessMessages()");
+            }
+        }
+        catch (const std::exception &e)
         {
             PrintExceptionContinue(&e, "ProcessMessages()");
+        } catch (...)
+        {
+            PrintExceptionContinue(nullptr, "ProcessMessages()");
         }
-    }
-    catch (const std::exception &e)
-    {
-        PrintExceptionContinue(&e, "ProcessMessages()");
-    } catch (...)
-    {
-        PrintExceptionContinue(nullptr, "ProcessMessages()");
-    }
 
-    if (!fRet)
-    {
-        ELogFormat("%s(%s, %u bytes) FAILED peer=%d", __func__, SanitizeString(strCommand), nMessageSize,
-                   pfrom->GetId());
+        fTxBatchVerified = false;
+
+        if (!fRet)
+        {
+            ELogFormat("%s(%s, %u bytes) FAILED peer=%d", __func__, SanitizeString(strCommand), nMessageSize,
+                       pfrom->GetId());
+        }
+
+        // Leave the rest of the batch once the peer is to be dropped
+        if (msgs.size() > 1)
+        {
+            if (pfrom->fDisconnect)
+                break;
+            LOCK(cs_main);
+            if (State(pfrom->GetId())->fShouldBan)
+                break;
+        }
     }
 
+    if (!vtxBatch.empty())
+        ifTxMempoolObj->UncacheUnaccepted(vtxBatch, vCoinsToUncache);
+
+    if (fStop)
+        return false;
+
     LOCK(cs_main);
     SendRejectsAndCheckIfBanned(pfrom);
 
@@ -1356,6 +1568,7 @@ bool PeerLogicValidation::SendMessages(CNode *pto, std::atomic<bool> &interruptM
         if (pto->nNextAddrSend < nNow)
         {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrToSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress &addr : pto->vAddrToSend)
@@ -1843,13 +2056,15 @@ bool PeerLogicValidation::SendMessages(CNode *pto, std::atomic<bool> &interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
+        int nMaxBlocksInFlight = GetMaxBlocksInFlight(&state);
         if (!pto->fClient && (fFetch || !ifChainObj->IsInitialBlockDownload()) &&
-            state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+            state.nBlocksInFlight < nMaxBlocksInFlight)
         {
             std::vector<const CBlockIndex *> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload,
-                                     staller, consensusParams);
+            const CBlockIndex *pindexWaitingFor = nullptr;
+            FindNextBlocksToDownload(pto->GetId(), nMaxBlocksInFlight - state.nBlocksInFlight, vToDownload,
+                                     staller, consensusParams, &pindexWaitingFor);
             for (const CBlockIndex *pindex : vToDownload)
             {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
@@ -1858,6 +2073,23 @@ bool PeerLogicValidation::SendMessages(CNode *pto, std::atomic<bool> &interruptM
                 NLogFormat("Requesting block %s (%d) peer=%d", pindex->GetBlockHash().ToString(),
                            pindex->nHeight, pto->GetId());
             }
+            if (pindexWaitingFor && state.nBlocksInFlight < nMaxBlocksInFlight)
+            {
+                // The window is held back by a block in flight from another peer. Rather
+                // than waiting for it to stall, ask this one if it is much faster.
+                const std::pair<NodeId, std::list<QueuedBlock>::iterator> &holder =
+                        mapBlocksInFlight[pindexWaitingFor->GetBlockHash()];
+                if (ShouldReassignBlock(&state, State(holder.first), *holder.second, nNow))
+                {
+                    NodeId nodeHolder = holder.first;
+                    uint32_t nFetchFlags = GetFetchFlags(pto);
+                    vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindexWaitingFor->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindexWaitingFor->GetBlockHash(), pindexWaitingFor);
+                    NLogFormat("Requesting block %s (%d) peer=%d instead of slower peer=%d",
+                               pindexWaitingFor->GetBlockHash().ToString(), pindexWaitingFor->nHeight, pto->GetId(),
+                               nodeHolder);
+                }
+            }
             if (state.nBlocksInFlight == 0 && staller != -1)
             {
                 if (State(staller)->nStallingSince == 0)
@@ -1969,6 +2201,11 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool &fUpdateConnectionTim
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
+    if (state->nBlockDownloadRate != 0)
+    {
+        nPeersWithBlockDownloadRate--;
+        nTotalBlockDownloadRate -= state->nBlockDownloadRate;
+    }
     g_outbound_peers_with_protect_from_disconnect -= state->m_chain_sync.m_protect;
     assert(g_outbound_peers_with_protect_from_disconnect >= 0);
 
@@ -1980,6 +2217,8 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool &fUpdateConnectionTim
         assert(mapBlocksInFlight.empty());
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
+        assert(nPeersWithBlockDownloadRate == 0);
+        assert(nTotalBlockDownloadRate == 0);
         assert(g_outbound_peers_with_protect_from_disconnect == 0);
     }
     NLogFormat("Cleared nodestate for peer=%d", nodeid);
@@ -2161,6 +2400,21 @@ bool PeerLogicValidation::ProcessMessage(CNode *pfrom, const std::string &strCom
         return ProcessTxMsg(pfrom, vRecv);
     }
 
+    if (strCommand == NetMsgType::GETCFILTERS)
+    {
+        return ProcessGetCFiltersMsg(pfrom, vRecv);
+    }
+
+    if (strCommand == NetMsgType::GETCFHEADERS)
+    {
+        return ProcessGetCFHeadersMsg(pfrom, vRecv);
+    }
+
+    if (strCommand == NetMsgType::GETCFCHECKPT)
+    {
+        return ProcessGetCFCheckPtMsg(pfrom, vRecv);
+    }
+
     if (strCommand == NetMsgType::GETBLOCKTXN)
     {
         return ProcessGetBlockTxnMsg(pfrom, vRecv, interruptMsgProc);
@@ -2492,7 +2746,10 @@ bool PeerLogicValidation::ProcessGetAddrMsg(CNode *pfrom, CDataStream &vRecv)
     }
     pfrom->fSentAddr = true;
 
-    pfrom->vAddrToSend.clear();
+    {
+        LOCK(pfrom->cs_addrToSend);
+        pfrom->vAddrToSend.clear();
+    }
     std::vector<CAddress> vAddr = connman->GetAddresses();
     FastRandomContext insecure_rand;
     for (const CAddress &addr : vAddr)
@@ -2967,6 +3224,7 @@ bool PeerLogicValidation::ProcessGetDataMsg(CNode *pfrom, CDataStream &vRecv, co
 
 bool PeerLogicValidation::ProcessBlockMsg(CNode *pfrom, CDataStream &vRecv)
 {
+    size_t nBlockSize = vRecv.size();
     std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
     vRecv >> *pblock;
 
@@ -2976,6 +3234,7 @@ bool PeerLogicValidation::ProcessBlockMsg(CNode *pfrom, CDataStream &vRecv)
     const uint256 hash(pblock->GetHash());
     {
         LOCK(cs_main);
+        UpdateBlockDownloadStats(pfrom->GetId(), hash, nBlockSize);
         // Also always process if we requested the block explicitly, as we may
         // need it even though it is not a candidate for a new best tip.
         forceProcessing |= MarkBlockAsReceived(hash);
@@ -3000,19 +3259,33 @@ bool PeerLogicValidation::ProcessBlockMsg(CNode *pfrom, CDataStream &vRecv)
 
 bool PeerLogicValidation::ProcessTxMsg(CNode *pfrom, CDataStream &vRecv)
 {
-    LOCK(cs_main);
     NodeExchangeInfo xnode = FromCNode(pfrom);
     InitFlagsBit(xnode.flags, NF_WHITELIST, pfrom->fWhitelisted);
     InitFlagsBit(xnode.flags, NF_DISCONNECT, pfrom->fDisconnect);
     InitFlagsBit(xnode.flags, NF_OUTBOUND, !pfrom->fInbound);
     InitFlagsBit(xnode.flags, NF_RELAYTX, fRelayTxes);
-    CNodeState *state = State(pfrom->GetId());
-    InitFlagsBit(xnode.flags, NF_WITNESS, state->fHaveWitness);
+    InitFlagsBit(xnode.flags, NF_PREVERIFIED, fTxBatchVerified);
+    {
+        LOCK(cs_main);
+        CNodeState *state = State(pfrom->GetId());
+        InitFlagsBit(xnode.flags, NF_WITNESS, state->fHaveWitness);
+    }
 
     uint256 txHash;
 
+    // Takes cs_main itself, once the transaction scripts are verified.
     GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    int64_t nTimeStart = GetTimeMicros();
     bool ret = ifTxMempoolObj->NetReceiveTxData(&xnode, vRecv, txHash);
+    int64_t nTimeValidation = GetTimeMicros() - nTimeStart;
+
+    LOCK(cs_main);
+    CNodeState *state = State(pfrom->GetId());
+    state->nTxValidationMicros += nTimeValidation;
+    if (IsFlagsBitOn(xnode.retFlags, NF_NEWTRANSACTION))
+        state->nTxAccepted++;
+    else if (IsFlagsBitOn(xnode.retFlags, NF_REJECTTRANSACTION))
+        state->nTxRejected++;
 
     pfrom->AddInventoryKnown(CInv(MSG_TX, txHash));
     pfrom->setAskFor.erase(txHash);
@@ -3027,6 +3300,161 @@ bool PeerLogicValidation::ProcessTxMsg(CNode *pfrom, CDataStream &vRecv)
     return ret;
 }
 
+/**
+ * Validate a getcfilters, getcfheaders or getcfcheckpt request, disconnecting
+ * the peer if it is not one we serve: we must have the filter index of the
+ * type, and the stop block must be on a chain we validated, no more than
+ * nMaxHeightDiff blocks above the start height.
+ */
+bool PeerLogicValidation::PrepareBlockFilterRequest(CNode *pfrom, uint8_t nFilterType, uint32_t nStartHeight,
+                                                    const uint256 &hashStop, uint32_t nMaxHeightDiff,
+                                                    const CBlockIndex *&pindexStop, CBlockFilterIndex *&pFilterIndex)
+{
+    GET_CHAIN_INTERFACE(ifChainObj);
+    pFilterIndex = ifChainObj->GetBlockFilterIndex();
+    if (!(pfrom->GetLocalServices() & NODE_COMPACT_FILTERS) || !pFilterIndex ||
+        pFilterIndex->GetFilterType() != nFilterType)
+    {
+        NLogFormat("peer %d requested unsupported block filter type: %d", pfrom->GetId(), nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        pindexStop = ifChainObj->GetBlockIndex(hashStop);
+        if (!pindexStop || !BlockRequestAllowed(pindexStop, Params().GetConsensus()))
+        {
+            NLogFormat("peer %d requested invalid block hash: %s", pfrom->GetId(), hashStop.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t nStopHeight = pindexStop->nHeight;
+    if (nStartHeight > nStopHeight)
+    {
+        NLogFormat("peer %d sent invalid getcfilters/getcfheaders with start height %d and stop height %d",
+                   pfrom->GetId(), nStartHeight, nStopHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (nStopHeight - nStartHeight >= nMaxHeightDiff)
+    {
+        NLogFormat("peer %d requested too many cfilters/cfheaders: %d / %d", pfrom->GetId(),
+                   nStopHeight - nStartHeight + 1, nMaxHeightDiff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool PeerLogicValidation::ProcessGetCFiltersMsg(CNode *pfrom, CDataStream &vRecv)
+{
+    uint8_t nFilterType;
+    uint32_t nStartHeight;
+    uint256 hashStop;
+
+    vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+    const CBlockIndex *pindexStop;
+    CBlockFilterIndex *pFilterIndex;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop,
+                                   pFilterIndex))
+        return true;
+
+    std::vector<BlockFilter> filters;
+    if (!pFilterIndex->LookupFilterRange(nStartHeight, pindexStop, filters))
+    {
+        NLogFormat("Failed to find block filter in index: filter_type=%s, start height=%d, stop hash=%s",
+                   BlockFilterTypeName(pFilterIndex->GetFilterType()), nStartHeight, hashStop.ToString());
+        return true;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const BlockFilter &filter : filters)
+    {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+    return true;
+}
+
+bool PeerLogicValidation::ProcessGetCFHeadersMsg(CNode *pfrom, CDataStream &vRecv)
+{
+    uint8_t nFilterType;
+    uint32_t nStartHeight;
+    uint256 hashStop;
+
+    vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+    const CBlockIndex *pindexStop;
+    CBlockFilterIndex *pFilterIndex;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop,
+                                   pFilterIndex))
+        return true;
+
+    uint256 hashPrevHeader;
+    if (nStartHeight > 0)
+    {
+        const CBlockIndex *pindexPrev = pindexStop->GetAncestor(nStartHeight - 1);
+        if (!pFilterIndex->LookupFilterHeader(pindexPrev, hashPrevHeader))
+        {
+            NLogFormat("Failed to find block filter header in index: filter_type=%s, block_hash=%s",
+                       BlockFilterTypeName(pFilterIndex->GetFilterType()), pindexPrev->GetBlockHash().ToString());
+            return true;
+        }
+    }
+
+    std::vector<uint256> vFilterHashes;
+    if (!pFilterIndex->LookupFilterHashRange(nStartHeight, pindexStop, vFilterHashes))
+    {
+        NLogFormat("Failed to find block filter hashes in index: filter_type=%s, start height=%d, stop hash=%s",
+                   BlockFilterTypeName(pFilterIndex->GetFilterType()), nStartHeight, hashStop.ToString());
+        return true;
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFHEADERS, nFilterType,
+                                                                           pindexStop->GetBlockHash(),
+                                                                           hashPrevHeader, vFilterHashes));
+    return true;
+}
+
+bool PeerLogicValidation::ProcessGetCFCheckPtMsg(CNode *pfrom, CDataStream &vRecv)
+{
+    uint8_t nFilterType;
+    uint256 hashStop;
+
+    vRecv >> nFilterType >> hashStop;
+
+    const CBlockIndex *pindexStop;
+    CBlockFilterIndex *pFilterIndex;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, hashStop, std::numeric_limits<uint32_t>::max(),
+                                   pindexStop, pFilterIndex))
+        return true;
+
+    std::vector<uint256> vHeaders(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex *pindex = pindexStop;
+    for (int i = vHeaders.size() - 1; i >= 0; i--)
+    {
+        int nHeight = (i + 1) * CFCHECKPT_INTERVAL;
+        pindex = pindex->GetAncestor(nHeight);
+
+        if (!pFilterIndex->LookupFilterHeader(pindex, vHeaders[i]))
+        {
+            NLogFormat("Failed to find block filter header in index: filter_type=%s, block_hash=%s",
+                       BlockFilterTypeName(pFilterIndex->GetFilterType()), pindex->GetBlockHash().ToString());
+            return true;
+        }
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFCHECKPT, nFilterType,
+                                                                           pindexStop->GetBlockHash(), vHeaders));
+    return true;
+}
+
 bool
 PeerLogicValidation::ProcessGetBlockTxnMsg(CNode *pfrom, CDataStream &vRecv, const std::atomic<bool> &interruptMsgProc)
 {
@@ -3416,8 +3844,9 @@ void PeerLogicValidation::ProcessGetData(CNode *pfrom, const std::atomic<bool> &
 {
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    LOCK(cs_main);
 
+    // cs_main is only taken for each request, so that blocks are read from
+    // disk and sent without holding it.
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     while (it != pfrom->vRecvGetData.end())
     {
@@ -3471,7 +3900,10 @@ void PeerLogicValidation::ProcessGetData(CNode *pfrom, const std::atomic<bool> &
                         // wait for other stuff first.
                         std::vector<CInv> vInv;
                         uint256 tipHash;
-                        ifChainObj->GetActiveChainTipHash(tipHash);
+                        {
+                            LOCK(cs_main);
+                            ifChainObj->GetActiveChainTipHash(tipHash);
+                        }
                         vInv.push_back(CInv(MSG_BLOCK, tipHash));
                         connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
                         pfrom->hashContinue.SetNull();
@@ -3487,6 +3919,7 @@ void PeerLogicValidation::ProcessGetData(CNode *pfrom, const std::atomic<bool> &
             {
                 NodeExchangeInfo xnode = FromCNode(pfrom);
 
+                LOCK(cs_main);
                 GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
                 if (!ifTxMempoolObj->NetRequestTxData(&xnode, inv.hash, inv.type == MSG_WITNESS_TX,
                                                       pfrom->timeLastMempoolReq))
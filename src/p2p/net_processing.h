@@ -24,9 +24,12 @@ static constexpr int64_t STALE_CHECK_INTERVAL = 10 * 60; // 10 minutes
 static constexpr int64_t EXTRA_PEER_CHECK_INTERVAL = 45;
 /** Minimum time an outbound-peer-eviction candidate must be connected for, in order to evict, in seconds */
 static constexpr int64_t MINIMUM_CONNECT_TIME = 30;
+/** Maximum number of consecutive tx messages of a peer whose scripts are verified together */
+static constexpr size_t MAX_TX_PREVERIFY_BATCH = 64;
 
 class CArgsManager;
 class CChainParams;
+class CBlockFilterIndex;
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface
 {
 public:
@@ -116,6 +119,16 @@ private:
 
     bool ProcessCmpctBlockMsg(CNode *pfrom, CDataStream &vRecv, int64_t nTimeReceived, const std::atomic<bool> &interruptMsgProc);
 
+    bool ProcessGetCFiltersMsg(CNode *pfrom, CDataStream &vRecv);
+
+    bool ProcessGetCFHeadersMsg(CNode *pfrom, CDataStream &vRecv);
+
+    bool ProcessGetCFCheckPtMsg(CNode *pfrom, CDataStream &vRecv);
+
+    bool PrepareBlockFilterRequest(CNode *pfrom, uint8_t nFilterType, uint32_t nStartHeight, const uint256 &hashStop,
+                                   uint32_t nMaxHeightDiff, const CBlockIndex *&pindexStop,
+                                   CBlockFilterIndex *&pFilterIndex);
+
 
     void ProcessGetData(CNode *pfrom, const std::atomic<bool> &interruptMsgProc);
 
@@ -133,6 +146,7 @@ private:
 private:
     CConnman *const connman;
     int64_t m_stale_tip_check_time; //! Next time to check for stale tip
+    bool fTxBatchVerified; //! The tx message being processed had its scripts verified with its batch
 
     const CArgsManager &appArgs;
 
@@ -146,6 +160,13 @@ struct CNodeStateStats
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nMaxBlocksInFlight;
+    uint64_t nBlocksDelivered;
+    int64_t nBlockDownloadRate;
+    int64_t nBlockResponseMicros;
+    uint64_t nTxAccepted;
+    uint64_t nTxRejected;
+    int64_t nTxValidationMicros;
 };
 
 /** Get statistics from node state */
@@ -251,6 +251,7 @@ bool CNetComponent::ComponentStartup()
     netConnOptions.m_msgproc = peerLogic.get();
     netConnOptions.nSendBufferMaxSize = 1000 * Args().GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     netConnOptions.nReceiveFloodSize = 1000 * Args().GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    netConnOptions.nMessageHandlerThreads = Args().GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
 
     for (const std::string &strBind : Args().GetArgs("-bind"))
     {
@@ -350,6 +351,24 @@ bool CNetComponent::SendNetMessage(int64_t nodeID, const std::string &command, c
     return false;
 }
 
+bool CNetComponent::SendNetMessage(int64_t nodeID, const std::string &command, std::vector<unsigned char> &&data)
+{
+    if (netConnMgr && nodeID != -1)
+    {
+        if (CNode *node = netConnMgr->QueryNode(nodeID))
+        {
+            CSerializedNetMsg msg;
+            msg.command = command;
+            msg.data = std::move(data);
+            netConnMgr->PushMessage(node, std::move(msg));
+            return true;
+        }
+        return false;
+    }
+    // Broadcasts need a copy for each node.
+    return SendNetMessage(nodeID, command, static_cast<const std::vector<unsigned char> &>(data));
+}
+
 bool CNetComponent::BroadcastTransaction(uint256 txHash)
 {
     if (netConnMgr)
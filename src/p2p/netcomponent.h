@@ -19,6 +19,8 @@ public:
 
     bool SendNetMessage(int64_t nodeID, const std::string& command, const std::vector<unsigned char>& data) override;
 
+    bool SendNetMessage(int64_t nodeID, const std::string& command, std::vector<unsigned char>&& data) override;
+
     bool BroadcastTransaction(uint256 txHash) override;
 
     bool RelayCmpctBlock(const CBlockIndex *pindex, void* pcmpctblock, bool fWitnessEnabled) override;
@@ -42,6 +42,12 @@ namespace NetMsgType
     const char *CMPCTBLOCK = "cmpctblock";
     const char *GETBLOCKTXN = "getblocktxn";
     const char *BLOCKTXN = "blocktxn";
+    const char *GETCFILTERS = "getcfilters";
+    const char *CFILTER = "cfilter";
+    const char *GETCFHEADERS = "getcfheaders";
+    const char *CFHEADERS = "cfheaders";
+    const char *GETCFCHECKPT = "getcfcheckpt";
+    const char *CFCHECKPT = "cfcheckpt";
     const char *CHECKPOINT = "checkpiont";
     const char *GET_CHECKPOINT = "getcheckpiont";
 } // namespace NetMsgType
@@ -76,6 +82,12 @@ const static std::string allNetMessageTypes[] = {
         NetMsgType::CMPCTBLOCK,
         NetMsgType::GETBLOCKTXN,
         NetMsgType::BLOCKTXN,
+        NetMsgType::GETCFILTERS,
+        NetMsgType::CFILTER,
+        NetMsgType::GETCFHEADERS,
+        NetMsgType::CFHEADERS,
+        NetMsgType::GETCFCHECKPT,
+        NetMsgType::CFCHECKPT,
         NetMsgType::CHECKPOINT,
         NetMsgType::GET_CHECKPOINT,
 };
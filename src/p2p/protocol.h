@@ -244,6 +244,41 @@ namespace NetMsgType
      * @since protocol version 70014 as described by BIP 152
      */
     extern const char *BLOCKTXN;
+    /**
+     * getcfilters requests the compact filters of a range of blocks.
+     * Only available with service bit NODE_COMPACT_FILTERS as described by
+     * BIP 157 and 158.
+     */
+    extern const char *GETCFILTERS;
+    /**
+     * cfilter is a response to a getcfilters request containing a single
+     * compact filter.
+     */
+    extern const char *CFILTER;
+    /**
+     * getcfheaders requests the compact filter headers of a range of blocks.
+     * Only available with service bit NODE_COMPACT_FILTERS as described by
+     * BIP 157 and 158.
+     */
+    extern const char *GETCFHEADERS;
+    /**
+     * cfheaders is a response to a getcfheaders request containing a filter
+     * header and a vector of filter hashes for each subsequent block in the
+     * requested range.
+     */
+    extern const char *CFHEADERS;
+    /**
+     * getcfcheckpt requests evenly spaced compact filter headers, so that
+     * clients can download and check the headers of a range in parallel.
+     * Only available with service bit NODE_COMPACT_FILTERS as described by
+     * BIP 157 and 158.
+     */
+    extern const char *GETCFCHECKPT;
+    /**
+     * cfcheckpt is a response to a getcfcheckpt request containing a vector of
+     * evenly spaced filter headers for blocks on the requested chain.
+     */
+    extern const char *CFCHECKPT;
 
     /**
      * Contains  checkpoints.
@@ -286,6 +321,9 @@ enum ServiceFlags : uint64_t
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
             NODE_XTHIN = (1 << 4),
+    // NODE_COMPACT_FILTERS means the node will answer getcfilters, getcfheaders
+    // and getcfcheckpt with the basic filters of the blocks (BIP 157 and 158).
+            NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
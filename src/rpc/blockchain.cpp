@@ -12,6 +12,7 @@
 #include "chaincontrol/coins.h"
 #include "chaincontrol/validation.h"
 #include "chaincontrol/blockfilemanager.h"
+#include "chaincontrol/blockfilterindex.h"
 #include "chaincontrol/utils.h"
 #include "interface/ichaincomponent.h"
 #include "block/validation.h"
@@ -771,6 +772,68 @@ UniValue getblockheader(const JSONRPCRequest &request)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest &request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+                "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+                        "\nRetrieve a BIP 157 content filter for a particular block.\n"
+                        "\nArguments:\n"
+                        "1. \"blockhash\"          (string, required) The hash of the block\n"
+                        "2. \"filtertype\"         (string, optional, default=\"basic\") The type name of the filter\n"
+                        "\nResult:\n"
+                        "{\n"
+                        "  \"filter\" : \"hex\",    (string) the hex-encoded filter data\n"
+                        "  \"header\" : \"hash\"    (string) the hex-encoded filter header\n"
+                        "}\n"
+                        "\nExamples:\n"
+                +
+                HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+                +
+                HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 hash(uint256S(request.params[0].get_str()));
+
+    std::string strFilterType = "basic";
+    if (!request.params[1].isNull())
+        strFilterType = request.params[1].get_str();
+
+    BlockFilterType filterType;
+    if (!BlockFilterTypeByName(strFilterType, filterType))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+
+    GET_CHAIN_INTERFACE(ifChainObj);
+    CBlockFilterIndex *pFilterIndex = ifChainObj->GetBlockFilterIndex();
+    if (!pFilterIndex || pFilterIndex->GetFilterType() != filterType)
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + strFilterType);
+
+    const CBlockIndex *pblockindex;
+    {
+        LOCK(cs_main);
+        if (!ifChainObj->DoesBlockExist(hash))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = ifChainObj->GetBlockIndex(hash);
+    }
+
+    BlockFilter filter;
+    uint256 header;
+    if (!pFilterIndex->LookupFilter(pblockindex, filter) || !pFilterIndex->LookupFilterHeader(pblockindex, header))
+    {
+        std::string strError = "Filter not found.";
+        if (!pFilterIndex->IsSynced())
+            strError += " Block filters are still in the process of being indexed.";
+        else
+            strError += " This error is unexpected and indicates index corruption.";
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", header.GetHex()));
+    return ret;
+}
+
 UniValue getblock(const JSONRPCRequest &request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -975,21 +1038,12 @@ UniValue getstorage(const JSONRPCRequest &request)
             {
                 uint256 hashStateRoot;
                 uint256 hashUTXORoot;
-                CBlock block;
-                if (!ReadBlockFromDisk(block, chainActive[blockNum], Params().GetConsensus()))
+                if (GetBlockVMState(chainActive[blockNum], hashStateRoot, hashUTXORoot, Params().GetConsensus()) ==
+                    RET_VM_STATE_ERR)
                 {
-                    std::ostringstream stringStream;
-                    stringStream << "ReadBlockFromDisk failed at hegiht " << chainActive[blockNum]->nHeight << " hash: " << chainActive[blockNum]->GetBlockHash().ToString();
-                    throw JSONRPCError(RPC_INVALID_PARAMS, stringStream.str());
-                } else
-                {
-                    if(block.GetVMState(hashStateRoot, hashUTXORoot) == RET_VM_STATE_ERR){
-                        throw JSONRPCError(RPC_INVALID_PARAMS, "Incorrect GetVMState");
-                    }
+                    throw JSONRPCError(RPC_INVALID_PARAMS, "Incorrect GetVMState");
                 }
                 ifContractObj->SetTemporaryState(hashStateRoot, hashUTXORoot);
-                //                ifContractObj->SetTemporaryState(chainActive[blockNum]->hashStateRoot,
-                //                                                 chainActive[blockNum]->hashUTXORoot);
             }
         } else
         {
@@ -1115,6 +1169,65 @@ UniValue callcontract(const JSONRPCRequest &request)
     return result;
 }
 
+UniValue estimategas(const JSONRPCRequest &request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+                "estimategas \"txid\"\n"
+                        "\nReturns the gas the contract transaction txid in the mempool is expected to use.\n"
+                        "With -mempoolcontractexec it comes from executing the transaction on top of the active tip,\n"
+                        "done again here if the tip moved since. Otherwise it is the gas the transaction used when a\n"
+                        "block template was assembled, or its gas limit if it was never executed.\n"
+                        "\nArguments:\n"
+                        "1. \"txid\"                 (string, required) The transaction id (must be in mempool)\n"
+                        "\nResult:\n"
+                        "{\n"
+                        "  \"gasLimit\" : n,          (numeric) The sum of the gas limits of the contract outputs\n"
+                        "  \"gasUsed\" : n,           (numeric) The gas the transaction is expected to use\n"
+                        "  \"executed\" : true|false, (boolean) If the mempool executed it, on top of blockhash\n"
+                        "  \"blockhash\" : \"hash\",    (string, optional) The tip it was executed on top of\n"
+                        "  \"excepted\" : \"xxx\",      (string, optional) The exception it raised, None if it succeeded\n"
+                        "}\n"
+                        "\nExamples:\n"
+                + HelpExampleCli("estimategas", "\"mytxid\"")
+                + HelpExampleRpc("estimategas", "\"mytxid\"")
+        );
+
+    uint256 hash = ParseHashV(request.params[0], "parameter 1");
+
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
+
+    LOCK2(cs_main, mempool.cs);
+
+    CTxMemPool::txiter it = mempool.mapTx.find(hash);
+    if (it == mempool.mapTx.end())
+    {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+    }
+    if (!it->GetTx().HasCreateOrCall())
+    {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Not a contract transaction");
+    }
+
+    if (Args().GetArg<bool>("-mempoolcontractexec", DEFAULT_MEMPOOL_CONTRACT_EXEC))
+    {
+        mempool.UpdateContractExec(it);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("gasLimit", it->GetGasLimit()));
+    result.push_back(Pair("gasUsed", it->GetGasEstimate()));
+    result.push_back(Pair("executed", it->GetExecTip() != nullptr));
+    if (it->GetExecTip())
+    {
+        GET_CONTRACT_INTERFACE(ifContractObj);
+        result.push_back(Pair("blockhash", it->GetExecTip()->GetBlockHash().GetHex()));
+        result.push_back(Pair("excepted", ifContractObj->GetExceptedInfo(it->GetExcepted())));
+    }
+    return result;
+}
+
 void assignJSON(UniValue &entry, const TransactionReceiptInfo &resExec)
 {
     entry.push_back(Pair("blockHash", resExec.blockHash.GetHex()));
@@ -2394,6 +2507,7 @@ static const CRPCCommand commands[] =
                 {"blockchain", "getblock",              &getblock,              true, {"blockhash",  "verbosity|verbose"}},
                 {"blockchain", "getblockhash",          &getblockhash,          true, {"height"}},
                 {"blockchain", "getblockheader",        &getblockheader,        true, {"blockhash",  "verbose"}},
+                {"blockchain", "getblockfilter",        &getblockfilter,        true, {"blockhash",  "filtertype"}},
                 {"blockchain", "getchaintips",          &getchaintips,          true, {}},
                 {"blockchain", "getdifficulty",         &getdifficulty,         true, {}},
                 {"blockchain", "getmempoolancestors",   &getmempoolancestors,   true, {"txid",       "verbose"}},
@@ -2418,6 +2532,7 @@ static const CRPCCommand commands[] =
                 {"blockchain", "getaccountinfo",        &getaccountinfo,        true, {"contract_address"}},
                 {"blockchain", "getstorage",            &getstorage,            true, {"address, index, blockNum"}},
                 {"blockchain", "callcontract",          &callcontract,          true, {"address",    "data"}},
+                {"blockchain", "estimategas",           &estimategas,           true, {"txid"}},
                 {"blockchain", "listcontracts",         &listcontracts,         true, {"start",      "maxDisplay"}},
                 {"blockchain", "gettransactionreceipt", &gettransactionreceipt, true, {"hash"}},
                 {"blockchain", "searchlogs",            &searchlogs,            true, {"fromBlock",  "toBlock", "address", "topics"}},
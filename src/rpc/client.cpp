@@ -126,6 +126,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
                 {"getmempoolancestors",   1, "verbose"},
                 {"getmempooldescendants", 1, "verbose"},
                 {"bumpfee",               1, "options"},
+                {"getlockstats",          0, "reset"},
                 {"logging",               0, "include"},
                 {"logging",               1, "exclude"},
                 {"disconnectnode",        1, "nodeid"},
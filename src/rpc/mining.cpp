@@ -26,6 +26,7 @@
 #include "framework/warnings.h"
 #include "sbtcd/baseimpl.hpp"
 #include "interface/ichaincomponent.h"
+#include "interface/iminercomponent.h"
 
 #include <memory>
 #include <stdint.h>
@@ -143,12 +144,13 @@ generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, ui
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount &&
-               !CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus()))
-        {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
+        uint32_t nBegin = pblock->nNonce;
+        uint32_t nEnd = (uint32_t)std::min<uint64_t>(nInnerLoopCount, nBegin + nMaxTries);
+        uint32_t nNonce;
+        if (!CNonceScanner(*pblock, Params().GetConsensus()).Scan(nBegin, nEnd, nNonce))
+            nNonce = nEnd;
+        pblock->nNonce = nNonce;
+        nMaxTries -= nNonce - nBegin;
         if (nMaxTries == 0)
         {
             break;
@@ -553,11 +555,28 @@ UniValue getblocktemplate(const JSONRPCRequest &request)
         nStart = GetTime();
         fLastTemplateSupportsSegwit = fSupportsSegwit;
 
-        // Create new block
+        // Bring the kept template up to date instead of assembling a new block. Its contracts
+        // run without cs_main, so release it, and ask again if the tip moved meanwhile.
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
-        if (!pblocktemplate)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+        GET_MINER_INTERFACE(ifMinerObj);
+        std::unique_ptr<CBlockTemplate> pblocktemplateNew;
+        do
+        {
+            LEAVE_CRITICAL_SECTION(cs_main);
+            try
+            {
+                pblocktemplateNew = ifMinerObj->GetBlockTemplate(scriptDummy, fSupportsSegwit);
+            } catch (...)
+            {
+                ENTER_CRITICAL_SECTION(cs_main);
+                throw;
+            }
+            ENTER_CRITICAL_SECTION(cs_main);
+            if (!pblocktemplateNew)
+                throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+            pindexPrevNew = chainActive.Tip();
+        } while (pblocktemplateNew->block.hashPrevBlock != pindexPrevNew->GetBlockHash());
+        pblocktemplate = std::move(pblocktemplateNew);
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
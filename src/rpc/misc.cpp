@@ -12,11 +12,13 @@
 #include "block/validation.h"
 #include "utils/net/httpserver.h"
 #include "p2p/net.h"
+#include "p2p/net_processing.h"
 #include "p2p/netbase.h"
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
 #include "timedata.h"
 #include "utils/util.h"
+#include "utils/asynclog.h"
 #include "utils/utilstrencodings.h"
 #include "reverse_iterator.h"
 
@@ -620,6 +622,94 @@ UniValue getmemoryinfo(const JSONRPCRequest &request)
     }
 }
 
+UniValue getlockstats(const JSONRPCRequest &request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+                "getlockstats ( reset )\n"
+                        "Returns where the locks were waited for and held, and how long the transactions of each peer took to handle.\n"
+                        "The locks are only profiled while the node runs with -lockprofile.\n"
+                        "Arguments:\n"
+                        "1. reset        (boolean, optional, default=false) Clear the lock statistics after returning them\n"
+                        "\nResult:\n"
+                        "{\n"
+                        "  \"enabled\": true|false,     (boolean) Whether locks are being profiled\n"
+                        "  \"locks\": [                 (json array) The call sites, most waited for and held first\n"
+                        "    {\n"
+                        "      \"lock\": \"name\",         (string) The lock, as written at the call site\n"
+                        "      \"site\": \"file:line\",    (string) The call site\n"
+                        "      \"count\": n,            (numeric) Times the lock was taken there\n"
+                        "      \"contended\": n,        (numeric) Times it was held by another thread already\n"
+                        "      \"wait_us\": n,          (numeric) Total time waited for it, in microseconds\n"
+                        "      \"maxwait_us\": n,       (numeric) Longest wait, in microseconds\n"
+                        "      \"hold_us\": n,          (numeric) Total time it was held, in microseconds\n"
+                        "      \"maxhold_us\": n        (numeric) Longest hold, in microseconds\n"
+                        "    }\n"
+                        "    ,...\n"
+                        "  ],\n"
+                        "  \"peers\": [                 (json array) The connected peers\n"
+                        "    {\n"
+                        "      \"id\": n,               (numeric) Peer index\n"
+                        "      \"addr\": \"host:port\",    (string) The IP address and port of the peer\n"
+                        "      \"txaccepted\": n,       (numeric) Transactions from the peer accepted to the mempool\n"
+                        "      \"txrejected\": n,       (numeric) Transactions from the peer found invalid or refused by policy\n"
+                        "      \"txvalidation_us\": n   (numeric) Time spent handling the transactions of the peer, in microseconds\n"
+                        "    }\n"
+                        "    ,...\n"
+                        "  ]\n"
+                        "}\n"
+                        "\nExamples:\n"
+                + HelpExampleCli("getlockstats", "")
+                + HelpExampleCli("getlockstats", "true")
+                + HelpExampleRpc("getlockstats", "")
+        );
+
+    bool fReset = request.params.size() > 0 && !request.params[0].isNull() && request.params[0].get_bool();
+
+    UniValue locks(UniValue::VARR);
+    for (const CLockSiteStats &stats : GetLockProfile())
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lock", stats.strName));
+        obj.push_back(Pair("site", strprintf("%s:%d", stats.strFile, stats.nLine)));
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("contended", stats.nContended));
+        obj.push_back(Pair("wait_us", stats.nWaitMicros));
+        obj.push_back(Pair("maxwait_us", stats.nMaxWaitMicros));
+        obj.push_back(Pair("hold_us", stats.nHoldMicros));
+        obj.push_back(Pair("maxhold_us", stats.nMaxHoldMicros));
+        locks.push_back(obj);
+    }
+    if (fReset)
+        ResetLockProfile();
+
+    UniValue peers(UniValue::VARR);
+    if (g_connman)
+    {
+        std::vector<CNodeStats> vstats;
+        g_connman->GetNodeStats(vstats);
+        for (const CNodeStats &stats : vstats)
+        {
+            CNodeStateStats statestats;
+            if (!GetNodeStateStats(stats.nodeid, statestats))
+                continue;
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("id", stats.nodeid));
+            obj.push_back(Pair("addr", stats.addrName));
+            obj.push_back(Pair("txaccepted", statestats.nTxAccepted));
+            obj.push_back(Pair("txrejected", statestats.nTxRejected));
+            obj.push_back(Pair("txvalidation_us", statestats.nTxValidationMicros));
+            peers.push_back(obj);
+        }
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", fLockProfiling.load()));
+    ret.push_back(Pair("locks", locks));
+    ret.push_back(Pair("peers", peers));
+    return ret;
+}
+
 uint32_t getCategoryMask(UniValue cats)
 {
     cats = cats.get_array();
@@ -651,7 +741,17 @@ UniValue logging(const JSONRPCRequest &request)
                         "Arguments:\n"
                         "1. \"include\" (array of strings) add debug logging for these categories.\n"
                         "2. \"exclude\" (array of strings) remove debug logging for these categories.\n"
-                        "\nResult: <categories>  (string): a list of the logging categories that are active.\n"
+                        "\nResult:\n"
+                        "{\n"
+                        "  \"async\": {               (json object) background log writer\n"
+                        "    \"running\": true|false,  (boolean) whether records are written asynchronously\n"
+                        "    \"capacity\": n,         (numeric) size of the record queue\n"
+                        "    \"depth\": n,            (numeric) records currently waiting to be written\n"
+                        "    \"queued\": n,           (numeric) records queued since startup\n"
+                        "    \"dropped\": n,          (numeric) records dropped because the queue was full\n"
+                        "    \"written\": n,          (numeric) records written since startup\n"
+                        "  }\n"
+                        "}\n"
                         "\nExamples:\n"
                 + HelpExampleCli("logging", "\"[\\\"all\\\"]\" \"[\\\"http\\\"]\"")
                 + HelpExampleRpc("logging", "[\"all\"], \"[libevent]\"")
@@ -689,6 +789,17 @@ UniValue logging(const JSONRPCRequest &request)
 //    }
 
     UniValue result(UniValue::VOBJ);
+
+    CAsyncLogStats stats = GetAsyncLogStats();
+    UniValue async(UniValue::VOBJ);
+    async.pushKV("running", UniValue(stats.fRunning));
+    async.pushKV("capacity", (uint64_t)stats.nCapacity);
+    async.pushKV("depth", (uint64_t)stats.nDepth);
+    async.pushKV("queued", stats.nQueued);
+    async.pushKV("dropped", stats.nDropped);
+    async.pushKV("written", stats.nWritten);
+    result.pushKV("async", async);
+
 //    std::vector<CLogCategoryActive> vLogCatActive = ListActiveLogCategories();
 //    for (const auto &logCatActive : vLogCatActive)
 //    {
@@ -895,6 +1006,7 @@ static const CRPCCommand commands[] =
                 //  --------------------- ------------------------  -----------------------  ----------
                 {"control", "getinfo",                &getinfo,                true, {}}, /* uses wallet if enabled */
                 {"control", "getmemoryinfo",          &getmemoryinfo,          true, {"mode"}},
+                {"control", "getlockstats",           &getlockstats,           true, {"reset"}},
                 {"control", "setcheckpoint",          &setcheckpoint,          true, {"filepath"}},
                 {"control", "gencheckpoint",          &gencheckpoint,          true, {"private_key", "checkpoint_file", "height"}},
                 {"control", "listcheckpoint",         &listcheckpoint,         true, {}},
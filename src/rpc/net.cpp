@@ -102,6 +102,10 @@ UniValue getpeerinfo(const JSONRPCRequest &request)
                         "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
                         "       ...\n"
                         "    ],\n"
+                        "    \"maxinflight\": n,          (numeric) How many blocks can be asked from this peer at a time, from its download rate\n"
+                        "    \"blocksdelivered\": n,      (numeric) The blocks this peer sent after we asked for them\n"
+                        "    \"blockdownloadrate\": n,    (numeric) Average bytes per second this peer sends requested blocks at\n"
+                        "    \"blockresponsetime\": n,    (numeric) Average seconds from asking this peer for a block to receiving it\n"
                         "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
                         "    \"bytessent_per_msg\": {\n"
                         "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -171,6 +175,10 @@ UniValue getpeerinfo(const JSONRPCRequest &request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("maxinflight", statestats.nMaxBlocksInFlight));
+            obj.push_back(Pair("blocksdelivered", statestats.nBlocksDelivered));
+            obj.push_back(Pair("blockdownloadrate", statestats.nBlockDownloadRate));
+            obj.push_back(Pair("blockresponsetime", statestats.nBlockResponseMicros / 1000000.0));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
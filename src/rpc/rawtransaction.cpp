@@ -1006,7 +1006,6 @@ UniValue sendrawtransaction(const JSONRPCRequest &request)
                 + HelpExampleRpc("sendrawtransaction", "\"signedhex\"")
         );
 
-    LOCK(cs_main);
     RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VBOOL});
 
     // parse hex string from parameter
@@ -1020,6 +1019,13 @@ UniValue sendrawtransaction(const JSONRPCRequest &request)
     if (request.params.size() > 1 && request.params[1].get_bool())
         nMaxRawTxFee = 0;
 
+    // Verify the scripts before taking cs_main
+    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+    const std::vector<CTransactionRef> vtx{tx};
+    std::vector<std::vector<COutPoint>> vCoinsToUncache;
+    ifTxMempoolObj->PreVerifyTransactions(vtx, vCoinsToUncache);
+
+    LOCK(cs_main);
     GET_CHAIN_INTERFACE(ifChainObj);
     CCoinsViewCache *pcoinsTip = ifChainObj->GetCoinsTip();
     CCoinsViewCache &view = *pcoinsTip;
@@ -1030,7 +1036,6 @@ UniValue sendrawtransaction(const JSONRPCRequest &request)
         fHaveChain = !existingCoin.IsSpent();
     }
 
-    GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
     CTxMemPool &mempool = ifTxMempoolObj->GetMemPool();
     bool fHaveMempool = mempool.exists(hashTx);
     if (!fHaveMempool && !fHaveChain)
@@ -1042,6 +1047,7 @@ UniValue sendrawtransaction(const JSONRPCRequest &request)
         if (!mempool.AcceptToMemoryPool(state, std::move(tx), fLimitFree, &fMissingInputs, nullptr, false,
                                         nMaxRawTxFee,true))
         {
+            ifTxMempoolObj->UncacheUnaccepted(vtx, vCoinsToUncache);
             if (state.IsInvalid())
             {
                 throw JSONRPCError(RPC_TRANSACTION_REJECTED,
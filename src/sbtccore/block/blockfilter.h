@@ -0,0 +1,176 @@
+#pragma once
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "sbtccore/serialize.h"
+#include "utils/uint256.h"
+
+class CBlock;
+
+class CBlockUndo;
+
+/**
+ * A Golomb-coded set (BIP 158): a compact probabilistic set of byte strings,
+ * which can be tested for membership with a false positive rate of 1/M.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params
+    {
+        uint64_t m_siphash_k0;
+        uint64_t m_siphash_k1;
+        uint8_t m_P;  //!< Golomb-Rice coding parameter
+        uint32_t m_M;  //!< Inverse false positive rate
+
+        Params(uint64_t siphash_k0 = 0, uint64_t siphash_k1 = 0, uint8_t P = 0, uint32_t M = 1)
+                : m_siphash_k0(siphash_k0), m_siphash_k1(siphash_k1), m_P(P), m_M(M)
+        {
+        }
+    };
+
+    /** An empty filter. */
+    explicit GCSFilter(const Params &params = Params());
+
+    /** A filter from its encoding, throwing std::ios_base::failure if it is malformed. */
+    GCSFilter(const Params &params, std::vector<unsigned char> encoded_filter);
+
+    /** A filter holding the elements. */
+    GCSFilter(const Params &params, const ElementSet &elements);
+
+    uint32_t GetN() const
+    {
+        return m_N;
+    }
+
+    const Params &GetParams() const
+    {
+        return m_params;
+    }
+
+    const std::vector<unsigned char> &GetEncoded() const
+    {
+        return m_encoded;
+    }
+
+    /** Whether the element may be in the set. False positives happen with probability 1/M. */
+    bool Match(const Element &element) const;
+
+    /** Whether any of the elements may be in the set, decoding the filter only once. */
+    bool MatchAny(const ElementSet &elements) const;
+
+private:
+    Params m_params;
+    uint32_t m_N;  //!< Number of elements in the filter
+    uint64_t m_F;  //!< Range of element hashes, F = N * M
+    std::vector<unsigned char> m_encoded;
+
+    /** Hash a data element to an integer in the range [0, N * M). */
+    uint64_t HashToRange(const Element &element) const;
+
+    std::vector<uint64_t> BuildHashedSet(const ElementSet &elements) const;
+
+    /** Helper method used to implement Match and MatchAny */
+    bool MatchInternal(const uint64_t *element_hashes, size_t size) const;
+};
+
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+enum BlockFilterType : uint8_t
+{
+    BASIC_FILTER = 0,
+    INVALID_FILTER = 255,
+};
+
+/** Name of a filter type, or an empty string for an unknown one. */
+const std::string &BlockFilterTypeName(BlockFilterType filter_type);
+
+/** Find the filter type of a name. */
+bool BlockFilterTypeByName(const std::string &name, BlockFilterType &filter_type);
+
+/**
+ * The filter of a block (BIP 158), keyed by the block hash. The basic filter
+ * holds the scriptPubKeys of the block's outputs, and of the outputs its
+ * transactions spend, except empty and OP_RETURN ones.
+ */
+class BlockFilter
+{
+private:
+    BlockFilterType m_filter_type;
+    uint256 m_block_hash;
+    GCSFilter m_filter;
+
+    bool BuildParams(GCSFilter::Params &params) const;
+
+public:
+    BlockFilter() : m_filter_type(INVALID_FILTER)
+    {
+    }
+
+    /** Reconstruct a filter from its parts, throwing std::invalid_argument for an unknown type. */
+    BlockFilter(BlockFilterType filter_type, const uint256 &block_hash, std::vector<unsigned char> filter);
+
+    /** Compute the filter of a block, with the undo data of its inputs. */
+    BlockFilter(BlockFilterType filter_type, const CBlock &block, const CBlockUndo &block_undo);
+
+    BlockFilterType GetFilterType() const
+    {
+        return m_filter_type;
+    }
+
+    const uint256 &GetBlockHash() const
+    {
+        return m_block_hash;
+    }
+
+    const GCSFilter &GetFilter() const
+    {
+        return m_filter;
+    }
+
+    const std::vector<unsigned char> &GetEncodedFilter() const
+    {
+        return m_filter.GetEncoded();
+    }
+
+    /** Hash of the encoded filter, committed to by the filter headers. */
+    uint256 GetHash() const;
+
+    /** Filter header: the hash of this filter's hash and the previous block's filter header. */
+    uint256 ComputeHeader(const uint256 &prev_header) const;
+
+    template<typename Stream>
+    void Serialize(Stream &s) const
+    {
+        s << static_cast<uint8_t>(m_filter_type)
+          << m_block_hash
+          << m_filter.GetEncoded();
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s)
+    {
+        std::vector<unsigned char> encoded_filter;
+        uint8_t filter_type;
+
+        s >> filter_type
+          >> m_block_hash
+          >> encoded_filter;
+
+        m_filter_type = static_cast<BlockFilterType>(filter_type);
+
+        GCSFilter::Params params;
+        if (!BuildParams(params))
+        {
+            throw std::ios_base::failure("unknown filter_type");
+        }
+        m_filter = GCSFilter(params, std::move(encoded_filter));
+    }
+};
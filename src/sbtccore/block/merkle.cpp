@@ -4,6 +4,7 @@
 
 #include "merkle.h"
 #include "hash.h"
+#include "crypto/sha256.h"
 #include "utils/utilstrencodings.h"
 
 /*     WARNING! If you're reading this because you're learning about crypto
@@ -42,7 +43,7 @@
        root.
 */
 
-/* This implements a constant-space merkle root/path calculator, limited to 2^32 leaves. */
+/* This implements a constant-space merkle path calculator, limited to 2^32 leaves. */
 static void MerkleComputation(const std::vector<uint256> &leaves, uint256 *proot, bool *pmutated, uint32_t branchpos,
                               std::vector<uint256> *pbranch)
 {
@@ -151,11 +152,33 @@ static void MerkleComputation(const std::vector<uint256> &leaves, uint256 *proot
         *proot = h;
 }
 
-uint256 ComputeMerkleRoot(const std::vector<uint256> &leaves, bool *mutated)
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool *mutated)
 {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, nullptr);
-    return hash;
+    bool mutation = false;
+    while (hashes.size() > 1)
+    {
+        if (mutated)
+        {
+            for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2)
+            {
+                if (hashes[pos] == hashes[pos + 1])
+                    mutation = true;
+            }
+        }
+        if (hashes.size() & 1)
+        {
+            hashes.push_back(hashes.back());
+        }
+        // Hash every pair of the level in one batch, writing each parent over
+        // the first half of the vector.
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+    }
+    if (mutated)
+        *mutated = mutation;
+    if (hashes.size() == 0)
+        return uint256();
+    return hashes[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256> &leaves, uint32_t position)
@@ -190,7 +213,7 @@ uint256 BlockMerkleRoot(const CBlock &block, bool *mutated)
     {
         leaves[s] = block.vtx[s]->GetHash();
     }
-    return ComputeMerkleRoot(leaves, mutated);
+    return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 uint256 BlockWitnessMerkleRoot(const CBlock &block, bool *mutated)
@@ -202,7 +225,7 @@ uint256 BlockWitnessMerkleRoot(const CBlock &block, bool *mutated)
     {
         leaves[s] = block.vtx[s]->GetWitnessHash();
     }
-    return ComputeMerkleRoot(leaves, mutated);
+    return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 std::vector<uint256> BlockMerkleBranch(const CBlock &block, uint32_t position)
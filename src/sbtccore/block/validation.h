@@ -90,8 +90,16 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -parmempool default (number of threads verifying transactions before mempool acceptance, 0 = auto) */
+static const int DEFAULT_MEMPOOL_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Fewest blocks requested at a time from a peer delivering them slower than the others. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** Most blocks requested at a time from a peer delivering them faster than the others. */
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/** Shortest time in microseconds a block must be in flight before it can be asked from a faster peer instead. */
+static const int64_t BLOCK_REASSIGN_MIN_TIMEOUT = 1000000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -140,6 +148,8 @@ static const bool DEFAULT_LOGEVENTS = false;  //sbtc-vm
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -mempooldumpinterval, in minutes */
+static const unsigned int DEFAULT_MEMPOOL_DUMP_INTERVAL = 15;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -3,6 +3,7 @@
 #include "base/base.hpp"
 #include "scriptcheck.h"
 #include "utils/util.h"
+#include "utils/crypto/sha256.h"
 
 bool CScriptCheck::operator()()
 {
@@ -25,3 +26,16 @@ void InitScriptExecutionCache(int64_t maxsigcachesize)
     NLogFormat("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements",
               (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
+
+uint256 GetScriptExecutionCacheEntry(const CTransaction &tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128 / 8,
+                  "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(
+            tx.GetWitnessHash().begin(), 32).Write((unsigned char *)&flags, sizeof(flags)).Finalize(
+            hashCacheEntry.begin());
+    return hashCacheEntry;
+}
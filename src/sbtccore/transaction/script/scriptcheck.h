@@ -63,4 +63,7 @@ extern CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache(int64_t maxsigcachesize);
 
+/** The script-execution cache entry for all the inputs of tx passing with flags */
+uint256 GetScriptExecutionCacheEntry(const CTransaction &tx, unsigned int flags);
+
 
@@ -18,6 +18,7 @@
 #include "config/sbtc-config.h"
 #include "sbtccore/clientversion.h"
 #include "utils/util.h"
+#include "utils/asynclog.h"
 #include "utils/utilstrencodings.h"
 #include "rpc/server.h"
 #include "p2p/net.h"
@@ -28,9 +29,12 @@
 #include "wallet/key.h"
 #include "wallet/feerate.h"
 #include "sbtccore/block/validation.h"
+#include "chaincontrol/blockfilterindex.h"
 #include "sbtccore/transaction/policy.h"
+#include "contract-api/contractconfig.h"
 #include "config/consensus.h"
 #include "framework/validationinterface.h"
+#include "framework/sync.h"
 #include "wallet/wallet.h"
 
 void CApp::InitOptionMap()
@@ -84,10 +88,20 @@ void CApp::InitOptionMap()
                     "minimumchainwork", bpo::value<string>(),
                     "Minimum work assumed to exist on a valid chain in hex"
             },   // -help-debug
+            {
+                    "mempoolcontractexec", bpo::value<string>(), strprintf(
+                    _("Execute contract transactions on top of the tip when they enter the mempool, for the gas they use (parameters: n, no, y, yes, default: %u)"),
+                    DEFAULT_MEMPOOL_CONTRACT_EXEC).c_str()
+            },
             {
                     "persistmempool", bpo::value<string>(),
                     "Whether to save the mempool on shutdown and load on restart (parameters: n, no, y, yes)"
             },
+            {
+                    "mempooldumpinterval", bpo::value<unsigned int>(), strprintf(
+                    _("Minutes between saving the changes to the mempool, so that most of it survives an unclean shutdown, 0 to only save it on shutdown (default: %u)"),
+                    DEFAULT_MEMPOOL_DUMP_INTERVAL).c_str()
+            },
             {
                     "blockreconstructionextratxn", bpo::value<unsigned int>(),
                     "Extra transactions to keep in memory for compact block reconstructions"
@@ -96,6 +110,10 @@ void CApp::InitOptionMap()
                     "par", bpo::value<int>(), strprintf(
                     _("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
                     -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS).c_str()},
+            {
+                    "parmempool", bpo::value<int>(), strprintf(
+                    _("Set the number of threads verifying transaction scripts before mempool acceptance (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+                    -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_MEMPOOL_SCRIPTCHECK_THREADS).c_str()},
 
 #ifndef WIN32
             {"pid", bpo::value<string>(), "Specify pid file"},
@@ -124,6 +142,11 @@ void CApp::InitOptionMap()
             },
 #endif
 
+            {
+                    "blockfilterindex", bpo::value<string>(),
+                    "Maintain an index of the compact filters (BIP 158) of the blocks, served to peers and by the getblockfilter rpc call(parameters: n, no, y, yes)"
+            },
+
             {
                     "txindex", bpo::value<string>(),
                     "Maintain a full transaction index, used by the getrawtransaction rpc call(parameters: n, no, y, yes)"
@@ -161,6 +184,9 @@ void CApp::InitOptionMap()
             {"maxconnections", bpo::value<unsigned int>(), "Maintain at most <n> connections to peers"},
             {"maxreceivebuffer", bpo::value<size_t>(), "Maximum per-connection receive buffer, <n>*1000 bytes"},
             {"maxsendbuffer", bpo::value<size_t>(), "Maximum per-connection send buffer, <n>*1000 bytes"},
+            {"msghandlerthreads", bpo::value<int>(),
+             strprintf("Number of threads processing peer messages, each peer always handled by the same one (1 to %d, default: %d)",
+                       MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS).c_str()},
             {"maxtimeadjustment", bpo::value<int64_t>(),
              "Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount."},
             {"onion", bpo::value<string>(),
@@ -328,9 +354,21 @@ void CApp::InitOptionMap()
                                                                                   "Show all debugging options, usage: --help -help-debug(parameters:: n, no, y, yes)"},
             {"logips",               bpo::value<string>(),                        "Include IP addresses in debug output(parameters:: n, no, y, yes)"},
             {"logtimestamps",        bpo::value<string>(),                        "Prepend debug output with timestamp(parameters:: n, no, y, yes)"},
+            {"logasync",             bpo::value<string>(),                        strprintf(
+                    "Write log records from a background thread (parameters:: n, no, y, yes, default: %u)",
+                    DEFAULT_LOGASYNC).c_str()},
+            {"logqueuedepth",        bpo::value<unsigned int>(),                  strprintf(
+                    "Number of log records that can wait for the background writer (default: %u)",
+                    DEFAULT_LOG_QUEUE_DEPTH).c_str()},
+            {"logoverflow",          bpo::value<string>(),                        strprintf(
+                    "What to do when the log queue is full: drop the record or block the caller (drop, block, default: %s)",
+                    DEFAULT_LOG_OVERFLOW).c_str()},
             /********************************-help-debug begin*********************************************/
             {"logtimemicros",        bpo::value<string>(),
                                                                                   "Add microsecond precision to debug timestamps(parameters:: n, no, y, yes)"},
+            {"lockprofile",          bpo::value<string>(),                        strprintf(
+                    "Record how long each lock is waited for and held, by call site, see getlockstats (parameters:: n, no, y, yes, default: %u)",
+                    DEFAULT_LOCKPROFILE).c_str()},
             {"mocktime",             bpo::value<int32_t>(),                       "Replace actual time with <n> seconds since epoch (default: 0)"},
             {"maxsigcachesize",      bpo::value<unsigned int>(),
                                                                                   "Limit sum of signature cache and script execution cache sizes to <n> MiB"},
@@ -394,6 +432,9 @@ void CApp::InitOptionMap()
             {"blockmintxfee",  bpo::value<string>(), strprintf(
                     _("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)"),
                     CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)).c_str()},
+            {"blockgasranking", bpo::value<string>(), strprintf(
+                    _("Rank contract transactions by fee per gas when creating blocks, skipping those not expected to fit the gas left without executing them (parameters:: n, no, y, yes, default: %u)"),
+                    DEFAULT_BLOCK_GAS_RANKING).c_str()},
             {"blockversion",   bpo::value<int32_t>(),
                                                            "Override block version to test forking scenarios"}
     };
@@ -626,6 +667,20 @@ bool CApp::AppInitParameterInteraction()
         {
             return rLogError("Prune mode is incompatible with -txindex.");
         }
+        if (pArgs->GetArg<bool>("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        {
+            return rLogError("Prune mode is incompatible with -blockfilterindex.");
+        }
+    }
+
+    LogOverflow logOverflow;
+    if (!ParseLogOverflow(pArgs->GetArg<std::string>("-logoverflow", DEFAULT_LOG_OVERFLOW), logOverflow))
+    {
+        return rLogError("Unknown -logoverflow value, expected drop or block.");
+    }
+    if (pArgs->GetArg<unsigned int>("-logqueuedepth", DEFAULT_LOG_QUEUE_DEPTH) == 0)
+    {
+        return rLogError("-logqueuedepth must be greater than 0.");
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -653,6 +708,8 @@ bool CApp::AppInitParameterInteraction()
         return rLogError("Unsupported argument -tor found, use -onion.");
     }
 
+    fLockProfiling = pArgs->GetArg<bool>("-lockprofile", DEFAULT_LOCKPROFILE);
+
     if (pArgs->GetArg<bool>("-benchmark", false))
         WLogFormat("Unsupported argument -benchmark ignored, use -debug=bench.");
 
@@ -1008,6 +1065,14 @@ bool CApp::Initialize(int argc, char **argv)
     CreatePidFile(GetPidFile(), getpid());
 #endif
 
+    // The writer thread has to be started after daemon(), threads do not survive fork.
+    if (pArgs->GetArg<bool>("-logasync", DEFAULT_LOGASYNC))
+    {
+        LogOverflow logOverflow = LogOverflow::BLOCK;
+        ParseLogOverflow(pArgs->GetArg<std::string>("-logoverflow", DEFAULT_LOG_OVERFLOW), logOverflow);
+        StartAsyncLogging(pArgs->GetArg<unsigned int>("-logqueuedepth", DEFAULT_LOG_QUEUE_DEPTH), logOverflow);
+    }
+
     NLogFormat("Default data directory %s.", GetDefaultDataDir().string());
     NLogFormat("Using data directory %s.", GetDataDir().string());
     NLogFormat("Using config file %s.",
@@ -1081,6 +1146,7 @@ bool CApp::Shutdown()
     ECC_Stop();
 
     NLogFormat("sbtcd shutdown!\n\n\n\n\n\n\n");
+    StopAsyncLogging();
     return fRet;
 }
 
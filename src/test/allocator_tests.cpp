@@ -5,8 +5,11 @@
 #include "utils/util.h"
 
 #include "utils/crypto/allocators/secure.h"
+#include "utils/crypto/allocators/pool.h"
 #include "test/test_bitcoin.h"
 
+#include <map>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
@@ -245,4 +248,49 @@ BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
         BOOST_CHECK(pool.stats().used == initial.used);
     }
 
+    BOOST_AUTO_TEST_CASE(nodepool_tests)
+    {
+        CNodePool pool;
+        BOOST_CHECK(pool.DynamicMemoryUsage() == 0);
+        BOOST_CHECK(pool.ReservedMemoryUsage() == 0);
+
+        // Small blocks are rounded up to the alignment and recycled
+        void *a0 = pool.Allocate(20, 8);
+        void *a1 = pool.Allocate(24, 8);
+        BOOST_CHECK(a0 != a1);
+        BOOST_CHECK(reinterpret_cast<uintptr_t>(a0) % CNodePool::ALIGNMENT == 0);
+        BOOST_CHECK(pool.DynamicMemoryUsage() == 48);
+        size_t reserved = pool.ReservedMemoryUsage();
+        BOOST_CHECK(reserved > 0);
+        pool.Deallocate(a0, 20, 8);
+        BOOST_CHECK(pool.DynamicMemoryUsage() == 24);
+        void *a2 = pool.Allocate(24, 8);
+        BOOST_CHECK(a2 == a0);
+        pool.Deallocate(a1, 24, 8);
+        pool.Deallocate(a2, 24, 8);
+        BOOST_CHECK(pool.DynamicMemoryUsage() == 0);
+        BOOST_CHECK(pool.ReservedMemoryUsage() == reserved);
+
+        // Blocks too large for the chunks are counted as malloc would
+        void *b0 = pool.Allocate(CNodePool::MAX_BLOCK_SIZE + 1, 8);
+        BOOST_CHECK(pool.DynamicMemoryUsage() == memusage::MallocUsage(CNodePool::MAX_BLOCK_SIZE + 1));
+        pool.Deallocate(b0, CNodePool::MAX_BLOCK_SIZE + 1, 8);
+        BOOST_CHECK(pool.DynamicMemoryUsage() == 0);
+
+        // Containers allocate their nodes from the pool and give them back
+        {
+            node_pool_allocator<std::pair<const int, int> > alloc(&pool);
+            std::map<int, int, std::less<int>, node_pool_allocator<std::pair<const int, int> > > m(alloc);
+            for (int i = 0; i < 10000; i++)
+                m[i] = i;
+            BOOST_CHECK(pool.DynamicMemoryUsage() >= 10000 * (3 * sizeof(void *) + 2 * sizeof(int)));
+            BOOST_CHECK(pool.ReservedMemoryUsage() > reserved);
+            for (int i = 0; i < 10000; i += 2)
+                m.erase(i);
+            BOOST_CHECK(m.size() == 5000);
+            BOOST_CHECK(m.at(4001) == 4001);
+        }
+        BOOST_CHECK(pool.DynamicMemoryUsage() == 0);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
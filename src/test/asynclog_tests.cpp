@@ -0,0 +1,94 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utils/asynclog.h"
+
+#include "test/test_bitcoin.h"
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(asynclog_tests, BasicTestingSetup)
+
+    BOOST_AUTO_TEST_CASE(ringbuffer_bounded)
+    {
+        CMPSCRingBuffer<int> queue(5);
+        BOOST_CHECK_EQUAL(queue.capacity(), 8U);
+
+        for (int i = 0; i < 8; i++)
+        {
+            BOOST_CHECK(queue.TryPush(int(i)));
+        }
+        BOOST_CHECK(!queue.TryPush(8));
+
+        int n = -1;
+        BOOST_CHECK(queue.TryPop(n));
+        BOOST_CHECK_EQUAL(n, 0);
+        BOOST_CHECK(queue.TryPush(8));
+
+        for (int i = 1; i <= 8; i++)
+        {
+            BOOST_CHECK(queue.TryPop(n));
+            BOOST_CHECK_EQUAL(n, i);
+        }
+        BOOST_CHECK(!queue.TryPop(n));
+    }
+
+    BOOST_AUTO_TEST_CASE(ringbuffer_multiple_producers)
+    {
+        static const int PRODUCERS = 4;
+        static const int ITEMS = 20000;
+        CMPSCRingBuffer<int> queue(64);
+
+        std::vector<std::thread> threads;
+        for (int p = 0; p < PRODUCERS; p++)
+        {
+            threads.emplace_back([&queue, p]
+                                 {
+                                     for (int i = 0; i < ITEMS; i++)
+                                     {
+                                         while (!queue.TryPush(p * ITEMS + i))
+                                             std::this_thread::yield();
+                                     }
+                                 });
+        }
+
+        // Every record arrives exactly once, and each producer's records in order.
+        std::vector<int> last(PRODUCERS, -1);
+        int received = 0;
+        while (received < PRODUCERS * ITEMS)
+        {
+            int n;
+            if (!queue.TryPop(n))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            int p = n / ITEMS;
+            BOOST_REQUIRE(n % ITEMS == last[p] + 1);
+            last[p] = n % ITEMS;
+            received++;
+        }
+
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        int n;
+        BOOST_CHECK(!queue.TryPop(n));
+    }
+
+    BOOST_AUTO_TEST_CASE(logoverflow_parse)
+    {
+        LogOverflow overflow = LogOverflow::BLOCK;
+        BOOST_CHECK(ParseLogOverflow("drop", overflow));
+        BOOST_CHECK(overflow == LogOverflow::DROP);
+        BOOST_CHECK(ParseLogOverflow("block", overflow));
+        BOOST_CHECK(overflow == LogOverflow::BLOCK);
+        BOOST_CHECK(!ParseLogOverflow("wait", overflow));
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
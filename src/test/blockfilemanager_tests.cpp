@@ -0,0 +1,55 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chaincontrol/blockfilemanager.h"
+#include "config/chainparams.h"
+#include "sbtccore/block/merkle.h"
+#include "sbtccore/clientversion.h"
+#include "sbtccore/streams.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemanager_tests, TestingSetup)
+
+    BOOST_AUTO_TEST_CASE(read_raw_block)
+    {
+        CBlock block;
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig.resize(10);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 42;
+        block.vtx.push_back(MakeTransactionRef(tx));
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(20, 1));
+        block.vtx.push_back(MakeTransactionRef(tx));
+        block.nVersion = 42;
+        block.hashPrevBlock = InsecureRand256();
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        block.nBits = 0x207fffff;
+
+        const CMessageHeader::MessageStartChars &messageStart = Params().MessageStart();
+        CDiskBlockPos pos(9999, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos, messageStart));
+        CDiskBlockPos pos2(9999, pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos2, messageStart));
+
+        // The bytes read are those of the block with its witnesses, as sent to
+        // peers asking for them.
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        std::vector<unsigned char> vBlock;
+        BOOST_CHECK(ReadRawBlockFromDisk(vBlock, pos2, block.GetHash(), messageStart));
+        BOOST_CHECK(std::equal(vBlock.begin(), vBlock.end(), ss.begin()) && vBlock.size() == ss.size());
+
+        // A position or hash that doesn't match the index is refused.
+        BOOST_CHECK(!ReadRawBlockFromDisk(vBlock, pos2, InsecureRand256(), messageStart));
+        BOOST_CHECK(!ReadRawBlockFromDisk(vBlock, CDiskBlockPos(9999, pos2.nPos - 1), block.GetHash(), messageStart));
+        BOOST_CHECK(!ReadRawBlockFromDisk(vBlock, CDiskBlockPos(9999, 0), block.GetHash(), messageStart));
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,392 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chaincontrol/chain.h"
+#include "chaincontrol/blockfilterindex.h"
+#include "chaincontrol/blockfilemanager.h"
+#include "config/chainparams.h"
+#include "interface/ichaincomponent.h"
+#include "p2p/net_processing.h"
+#include "p2p/netmessagemaker.h"
+#include "sbtccore/block/blockfilter.h"
+#include "sbtccore/block/validation.h"
+#include "sbtccore/block/undo.h"
+#include "sbtccore/clientversion.h"
+#include "sbtccore/streams.h"
+#include "sbtccore/transaction/script/script.h"
+#include "random.h"
+#include "utils/utilstrencodings.h"
+#include "utils/utiltime.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+    BOOST_AUTO_TEST_CASE(gcsfilter_test)
+    {
+        GCSFilter::ElementSet included_elements, excluded_elements;
+        for (int i = 0; i < 100; ++i)
+        {
+            GCSFilter::Element element1(32);
+            element1[0] = i;
+            included_elements.insert(std::move(element1));
+
+            GCSFilter::Element element2(32);
+            element2[1] = i;
+            excluded_elements.insert(std::move(element2));
+        }
+
+        GCSFilter filter({0, 0, 10, 1 << 10}, included_elements);
+        for (const auto &element : included_elements)
+        {
+            BOOST_CHECK(filter.Match(element));
+
+            auto insertion = excluded_elements.insert(element);
+            BOOST_CHECK(filter.MatchAny(excluded_elements));
+            excluded_elements.erase(insertion.first);
+        }
+
+        // Decoding the encoded filter gives back the same filter
+        GCSFilter decoded(filter.GetParams(), filter.GetEncoded());
+        BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+        for (const auto &element : included_elements)
+        {
+            BOOST_CHECK(decoded.Match(element));
+        }
+
+        // Trailing bytes are rejected
+        std::vector<unsigned char> encoded = filter.GetEncoded();
+        encoded.push_back(0);
+        BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), encoded), std::ios_base::failure);
+    }
+
+    BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
+    {
+        GCSFilter filter;
+        BOOST_CHECK_EQUAL(filter.GetN(), 0U);
+        BOOST_CHECK_EQUAL(filter.GetEncoded().size(), 1U);
+
+        const GCSFilter::Params &params = filter.GetParams();
+        BOOST_CHECK_EQUAL(params.m_siphash_k0, 0U);
+        BOOST_CHECK_EQUAL(params.m_siphash_k1, 0U);
+        BOOST_CHECK_EQUAL(params.m_P, 0);
+        BOOST_CHECK_EQUAL(params.m_M, 1U);
+    }
+
+    BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+    {
+        CScript included_scripts[5], excluded_scripts[3];
+
+        // First two are outputs on a single transaction.
+        included_scripts[0] << std::vector<unsigned char>(0, 65) << OP_CHECKSIG;
+        included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(1, 20) << OP_EQUALVERIFY
+                            << OP_CHECKSIG;
+
+        // Third is an output on in a second transaction.
+        included_scripts[2] << OP_1 << std::vector<unsigned char>(2, 33) << OP_1 << OP_CHECKMULTISIG;
+
+        // Last two are spent by a single transaction.
+        included_scripts[3] << OP_0 << std::vector<unsigned char>(3, 32);
+        included_scripts[4] << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+
+        // OP_RETURN output is excluded.
+        excluded_scripts[0] << OP_RETURN << std::vector<unsigned char>(4, 40);
+
+        // This script is not related to the block at all.
+        excluded_scripts[1] << std::vector<unsigned char>(5, 33) << OP_CHECKSIG;
+
+        // Empty output script is excluded.
+        excluded_scripts[2] = CScript();
+
+        CMutableTransaction tx_1;
+        tx_1.vout.emplace_back(100, included_scripts[0]);
+        tx_1.vout.emplace_back(200, included_scripts[1]);
+        tx_1.vout.emplace_back(0, excluded_scripts[0]);
+
+        CMutableTransaction tx_2;
+        tx_2.vout.emplace_back(300, included_scripts[2]);
+        tx_2.vout.emplace_back(0, excluded_scripts[2]);
+
+        CBlock block;
+        block.nNonce = 1;
+        block.vtx.push_back(MakeTransactionRef(tx_1));
+        block.vtx.push_back(MakeTransactionRef(tx_2));
+
+        CBlockUndo block_undo;
+        block_undo.vtxundo.emplace_back();
+        block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(400, included_scripts[3]), 1000, true);
+        block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(500, included_scripts[4]), 10000, false);
+        block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(600, excluded_scripts[2]), 100000, false);
+
+        BlockFilter block_filter(BASIC_FILTER, block, block_undo);
+        const GCSFilter &filter = block_filter.GetFilter();
+
+        for (const CScript &script : included_scripts)
+        {
+            BOOST_CHECK(filter.Match(GCSFilter::Element(script.begin(), script.end())));
+        }
+        for (const CScript &script : excluded_scripts)
+        {
+            BOOST_CHECK(!filter.Match(GCSFilter::Element(script.begin(), script.end())));
+        }
+
+        // Test serialization/unserialization.
+        BlockFilter block_filter2;
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << block_filter;
+        stream >> block_filter2;
+
+        BOOST_CHECK_EQUAL(block_filter.GetFilterType(), block_filter2.GetFilterType());
+        BOOST_CHECK(block_filter.GetBlockHash() == block_filter2.GetBlockHash());
+        BOOST_CHECK(block_filter.GetEncodedFilter() == block_filter2.GetEncodedFilter());
+        BOOST_CHECK(block_filter.GetHash() == block_filter2.GetHash());
+
+        // Filter headers chain the filter hashes
+        uint256 prev_header = GetRandHash();
+        BOOST_CHECK(block_filter.ComputeHeader(prev_header) != block_filter.ComputeHeader(uint256()));
+        BOOST_CHECK(block_filter.ComputeHeader(prev_header) == block_filter2.ComputeHeader(prev_header));
+
+        BlockFilter default_ctor_block_filter_1;
+        BlockFilter default_ctor_block_filter_2;
+        BOOST_CHECK_EQUAL(default_ctor_block_filter_1.GetFilterType(), default_ctor_block_filter_2.GetFilterType());
+    }
+
+    BOOST_AUTO_TEST_CASE(blockfilters_bip158_vectors)
+    {
+        // Testnet blocks of the BIP 158 test vectors without spent outputs: the block, the filter
+        // header of its parent, and the basic filter and filter header it must give
+        struct TestVector
+        {
+            int nHeight;
+            const char *pszBlockHash;
+            const char *pszBlock;
+            const char *pszPrevHeader;
+            const char *pszFilter;
+            const char *pszHeader;
+        };
+        static const TestVector vectors[] = {
+                {0, "000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943",
+                 "0100000000000000000000000000000000000000000000000000000000000000000000003ba3edfd7a7b12b27ac72c3e6776"
+                 "8f617fc81bc3888a51323a9fb8aa4b1e5e4adae5494dffff001d1aa4ae180101000000010000000000000000000000000000"
+                 "000000000000000000000000000000000000ffffffff4d04ffff001d0104455468652054696d65732030332f4a616e2f3230"
+                 "3039204368616e63656c6c6f72206f6e206272696e6b206f66207365636f6e64206261696c6f757420666f722062616e6b73"
+                 "ffffffff0100f2052a01000000434104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6"
+                 "bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac00000000",
+                 "0000000000000000000000000000000000000000000000000000000000000000",
+                 "019dfca8", "21584579b7eb08997773e5aeff3a7f932700042d0ed2a6129012b7d7ae81b750"},
+                {3, "000000008b896e272758da5297bcd98fdc6d97c9b765ecec401e286dc1fdbe10",
+                 "0100000020782a005255b657696ea057d5b98f34defcf75196f64f6eeac8026c0000000041ba5afc532aae03151b8aa87b65"
+                 "e1594f97504a768e010c98c0add79216247186e7494dffff001d058dc2b60101000000010000000000000000000000000000"
+                 "000000000000000000000000000000000000ffffffff0e0486e7494d0151062f503253482fffffffff0100f2052a01000000"
+                 "232103f6d9ff4c12959445ca5549c811683bf9c88e637b222dd2e0311154c4c85cf423ac00000000",
+                 "186afd11ef2b5e7e3504f2e8cbf8df28a1fd251fe53d60dff8b1467d1b386cf0",
+                 "016cf7a0", "8d63aadf5ab7257cb6d2316a57b16f517bff1c6388f124ec4c04af1212729d2a"}
+        };
+
+        for (const TestVector &vector : vectors)
+        {
+            CBlock block;
+            CDataStream stream(ParseHex(vector.pszBlock), SER_NETWORK, PROTOCOL_VERSION);
+            stream >> block;
+            BOOST_CHECK_EQUAL(block.GetHash().GetHex(), vector.pszBlockHash);
+
+            BlockFilter filter(BASIC_FILTER, block, CBlockUndo());
+            BOOST_CHECK_MESSAGE(HexStr(filter.GetEncodedFilter()) == vector.pszFilter,
+                                "filter of block " << vector.nHeight);
+            BOOST_CHECK_MESSAGE(filter.ComputeHeader(uint256S(vector.pszPrevHeader)).GetHex() == vector.pszHeader,
+                                "filter header of block " << vector.nHeight);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+    {
+        BOOST_CHECK_EQUAL(BlockFilterTypeName(BASIC_FILTER), "basic");
+        BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(1)), "");
+
+        BlockFilterType filter_type;
+        BOOST_CHECK(BlockFilterTypeByName("basic", filter_type));
+        BOOST_CHECK_EQUAL(filter_type, BASIC_FILTER);
+
+        BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
+    }
+
+    /** Waits for the index to have reached pindex, at most 10 seconds. */
+    static bool WaitForIndex(const CBlockFilterIndex &index, const CBlockIndex *pindex)
+    {
+        int64_t nStart = GetTimeMillis();
+        while (index.GetBestBlockIndex() != pindex || !index.IsSynced())
+        {
+            if (GetTimeMillis() - nStart > 10000)
+                return false;
+            MilliSleep(10);
+        }
+        return true;
+    }
+
+    /** Checks the filter and header indexed for pindex against the ones computed from disk. */
+    static void CheckIndexedFilter(const CBlockFilterIndex &index, const CBlockIndex *pindex,
+                                   const uint256 &prev_header, uint256 &header)
+    {
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+        CBlockUndo block_undo;
+        if (pindex->pprev)
+        {
+            BOOST_REQUIRE(UndoReadFromDisk(block_undo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()));
+        }
+        BlockFilter expected(BASIC_FILTER, block, block_undo);
+
+        BlockFilter filter;
+        BOOST_REQUIRE(index.LookupFilter(pindex, filter));
+        BOOST_CHECK(filter.GetBlockHash() == pindex->GetBlockHash());
+        BOOST_CHECK(filter.GetEncodedFilter() == expected.GetEncodedFilter());
+
+        BOOST_REQUIRE(index.LookupFilterHeader(pindex, header));
+        BOOST_CHECK(header == expected.ComputeHeader(prev_header));
+    }
+
+    BOOST_FIXTURE_TEST_CASE(blockfilter_index_sync_and_reorg, TestChain100Setup)
+    {
+        GET_CHAIN_INTERFACE(ifChainObj);
+        CBlockFilterIndex index(BASIC_FILTER, 1 << 20, true);
+        BOOST_CHECK(!index.IsSynced());
+        BOOST_CHECK(index.GetBestBlockIndex() == nullptr);
+
+        // The blocks connected before the index started are caught up with
+        index.Start();
+        const CBlockIndex *pindexTip;
+        {
+            LOCK(cs_main);
+            pindexTip = chainActive.Tip();
+        }
+        BOOST_REQUIRE(WaitForIndex(index, pindexTip));
+
+        // The headers chain from the genesis block on
+        uint256 header;
+        {
+            LOCK(cs_main);
+            uint256 prev_header;
+            for (const CBlockIndex *pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex))
+            {
+                CheckIndexedFilter(index, pindex, prev_header, header);
+                prev_header = header;
+            }
+        }
+
+        std::vector<BlockFilter> filters;
+        std::vector<uint256> hashes;
+        BOOST_CHECK(index.LookupFilterRange(1, pindexTip, filters));
+        BOOST_CHECK(index.LookupFilterHashRange(1, pindexTip, hashes));
+        BOOST_REQUIRE_EQUAL(filters.size(), (size_t)pindexTip->nHeight);
+        BOOST_REQUIRE_EQUAL(hashes.size(), (size_t)pindexTip->nHeight);
+        for (size_t i = 0; i < filters.size(); i++)
+        {
+            BOOST_CHECK(filters[i].GetHash() == hashes[i]);
+        }
+
+        // Blocks connected while it runs are indexed as they come
+        CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+        CreateAndProcessBlock({}, scriptPubKey);
+        const CBlockIndex *pindexOld;
+        {
+            LOCK(cs_main);
+            pindexOld = chainActive.Tip();
+        }
+        BOOST_REQUIRE(WaitForIndex(index, pindexOld));
+        uint256 old_header;
+        CheckIndexedFilter(index, pindexOld, header, old_header);
+
+        // Replace that block by a longer branch: the index follows the new chain
+        {
+            CValidationState state;
+            {
+                LOCK(cs_main);
+                BOOST_REQUIRE(ifChainObj->InvalidateBlock(state, Params(), const_cast<CBlockIndex *>(pindexOld)));
+            }
+            BOOST_REQUIRE(ifChainObj->ActivateBestChain(state, Params(), nullptr));
+        }
+        CScript scriptPubKeyOther = CScript() << OP_TRUE;
+        CreateAndProcessBlock({}, scriptPubKeyOther);
+        CreateAndProcessBlock({}, scriptPubKeyOther);
+        const CBlockIndex *pindexNew;
+        {
+            LOCK(cs_main);
+            pindexNew = chainActive.Tip();
+            BOOST_REQUIRE(pindexNew->pprev->pprev == pindexTip);
+            BOOST_REQUIRE(!chainActive.Contains(pindexOld));
+        }
+        BOOST_REQUIRE(WaitForIndex(index, pindexNew));
+
+        uint256 fork_header, new_header;
+        CheckIndexedFilter(index, pindexNew->pprev, header, fork_header);
+        BOOST_CHECK(fork_header != old_header);
+        CheckIndexedFilter(index, pindexNew, fork_header, new_header);
+        BOOST_CHECK(index.LookupFilterHashRange(pindexTip->nHeight, pindexNew, hashes));
+        BOOST_CHECK_EQUAL(hashes.size(), 3U);
+
+        // The filter of the block disconnected stays, as entries are keyed by block hash
+        BlockFilter filter;
+        BOOST_CHECK(index.LookupFilter(pindexOld, filter));
+
+        index.Stop();
+    }
+
+    /** Queues msg as received from node, as the socket handler does. */
+    static void ReceiveMessage(CNode &node, const CSerializedNetMsg &msg)
+    {
+        std::vector<unsigned char> bytes;
+        uint256 hash = Hash(msg.data.begin(), msg.data.end());
+        CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+        CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, bytes, 0, hdr};
+        bytes.insert(bytes.end(), msg.data.begin(), msg.data.end());
+
+        CNetMessage netmsg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+        int nHeader = netmsg.readHeader((const char *)bytes.data(), bytes.size());
+        BOOST_REQUIRE_EQUAL(nHeader, (int)CMessageHeader::HEADER_SIZE);
+        netmsg.readData((const char *)bytes.data() + nHeader, bytes.size() - nHeader);
+        BOOST_REQUIRE(netmsg.complete());
+        LOCK(node.cs_vProcessMsg);
+        node.vProcessMsg.push_back(std::move(netmsg));
+    }
+
+    BOOST_FIXTURE_TEST_CASE(blockfilter_requests_not_served, TestingSetup)
+    {
+        // Without a filter index, or to a peer we did not offer filters to,
+        // the requests get the peer disconnected and no reply.
+        const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+        const uint256 hashStop = chainActive.Tip()->GetBlockHash();
+        std::vector<CSerializedNetMsg> vRequests;
+        vRequests.push_back(msgMaker.Make(NetMsgType::GETCFILTERS, uint8_t(BASIC_FILTER), uint32_t(0), hashStop));
+        vRequests.push_back(msgMaker.Make(NetMsgType::GETCFHEADERS, uint8_t(BASIC_FILTER), uint32_t(0), hashStop));
+        vRequests.push_back(msgMaker.Make(NetMsgType::GETCFCHECKPT, uint8_t(BASIC_FILTER), hashStop));
+
+        NodeId id = 0;
+        for (ServiceFlags nLocalServices : {NODE_NETWORK, ServiceFlags(NODE_NETWORK | NODE_COMPACT_FILTERS)})
+        {
+            for (const CSerializedNetMsg &request : vRequests)
+            {
+                CAddress addr(CService(CNetAddr(), Params().GetDefaultPort()), NODE_NONE);
+                CNode node(id++, nLocalServices, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true);
+                node.SetSendVersion(PROTOCOL_VERSION);
+                peerLogic->InitializeNode(&node);
+                node.nVersion = PROTOCOL_VERSION;
+                node.fSuccessfullyConnected = true;
+
+                ReceiveMessage(node, request);
+                std::atomic<bool> interruptDummy(false);
+                peerLogic->ProcessMessages(&node, interruptDummy);
+                BOOST_CHECK(node.fDisconnect);
+                BOOST_CHECK(node.vSendMsg.empty());
+
+                bool dummy;
+                peerLogic->FinalizeNode(node.GetId(), dummy);
+            }
+        }
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,12 +4,14 @@
 
 #include "crypto/aes.h"
 #include "crypto/chacha20.h"
+#include "crypto/common.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "utils/utilstrencodings.h"
 #include "test/test_bitcoin.h"
@@ -296,6 +298,56 @@ BOOST_FIXTURE_TEST_SUITE(crypto_tests, BasicTestingSetup)
         TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
     }
 
+    BOOST_AUTO_TEST_CASE(sha256d64)
+    {
+        // Cover the 8-way, 4-way and single block paths as well as the tails between them.
+        for (int i = 0; i <= 32; ++i)
+        {
+            unsigned char in[64 * 32];
+            unsigned char out1[32 * 32], out2[32 * 32];
+            for (int j = 0; j < 64 * i; ++j)
+            {
+                in[j] = InsecureRandBits(8);
+            }
+            for (int j = 0; j < i; ++j)
+            {
+                CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+            }
+            SHA256D64(out2, in, i);
+            BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+
+            // The merkle code hashes a level in place.
+            SHA256D64(in, in, i);
+            BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(sha256d80_nonces)
+    {
+        unsigned char header[80];
+        for (int j = 0; j < 80; ++j)
+        {
+            header[j] = InsecureRandBits(8);
+        }
+        uint32_t midstate[8];
+        SHA256Midstate(midstate, header);
+
+        // Start right below the wrap-around so the nonce overflows inside a batch.
+        uint32_t nonce = 0xffffffe0ul + InsecureRandRange(16);
+        for (int i = 0; i <= 20; ++i)
+        {
+            unsigned char out[32 * 20];
+            SHA256D80Nonces(out, midstate, header + 64, nonce, i);
+            for (int j = 0; j < i; ++j)
+            {
+                unsigned char expected[32];
+                WriteLE32(header + 76, nonce + j);
+                CHash256().Write(header, 80).Finalize(expected);
+                BOOST_CHECK(memcmp(expected, out + 32 * j, 32) == 0);
+            }
+        }
+    }
+
     BOOST_AUTO_TEST_CASE(sha512_testvectors)
     {
         TestSHA512("",
@@ -4,7 +4,14 @@
 
 #include "sbtccore/transaction/policy.h"
 #include "mempool/txmempool.h"
+#include "mempool/mempooldump.h"
+#include "sbtccore/streams.h"
+#include "sbtccore/clientversion.h"
 #include "utils/util.h"
+#include "mempool/mempoolcomponent.h"
+#include "miner/miner.h"
+#include "script/sign.h"
+#include "fs.h"
 
 #include "test/test_bitcoin.h"
 
@@ -439,6 +446,311 @@ BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
     }
 
 
+    BOOST_AUTO_TEST_CASE(MempoolBlockUpdateTest)
+    {
+        CTxMemPool pool;
+        TestMemPoolEntryHelper entry;
+
+        // tx0 -> tx1 -> tx2, tx3 -> tx4 -> tx5 -> ... -> tx10:
+        // a diamond followed by a chain.
+        std::vector<CMutableTransaction> vtx(11);
+        vtx[0].vin.resize(1);
+        vtx[0].vin[0].scriptSig = CScript() << OP_11;
+        for (size_t i = 0; i < vtx.size(); i++)
+        {
+            if (i > 0)
+            {
+                size_t nParent = i == 3 ? 1 : i == 4 ? 2 : i - 1;
+                vtx[i].vin.resize(1);
+                vtx[i].vin[0].prevout = COutPoint(vtx[nParent].GetHash(), i == 3 ? 1 : 0);
+                vtx[i].vin[0].scriptSig = CScript() << OP_11;
+            }
+            if (i == 4)
+            {
+                vtx[i].vin.resize(2);
+                vtx[i].vin[1].prevout = COutPoint(vtx[3].GetHash(), 0);
+                vtx[i].vin[1].scriptSig = CScript() << OP_11;
+            }
+            vtx[i].vout.resize(i == 1 ? 2 : 1);
+            for (CTxOut &txout : vtx[i].vout)
+            {
+                txout.scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+                txout.nValue = COIN;
+            }
+            pool.addUnchecked(vtx[i].GetHash(), entry.Fee(1000LL * (i + 1)).FromTx(vtx[i]));
+        }
+        BOOST_CHECK_EQUAL(pool.size(), vtx.size());
+
+        std::vector<CTxMemPoolEntry> vBefore;
+        for (const CMutableTransaction &tx : vtx)
+        {
+            vBefore.push_back(*pool.mapTx.find(tx.GetHash()));
+        }
+        BOOST_CHECK_EQUAL(vBefore[4].GetCountWithAncestors(), 5);
+        BOOST_CHECK_EQUAL(vBefore[10].GetCountWithAncestors(), 11);
+        BOOST_CHECK_EQUAL(vBefore[1].GetCountWithDescendants(), 10);
+
+        // tx0 and tx1 are mined: everything else loses two ancestors.
+        std::vector<CTransactionRef> vBlock;
+        vBlock.push_back(MakeTransactionRef(vtx[0]));
+        vBlock.push_back(MakeTransactionRef(vtx[1]));
+        pool.removeForBlock(vBlock, 1);
+        BOOST_CHECK_EQUAL(pool.size(), vtx.size() - 2);
+        for (size_t i = 2; i < vtx.size(); i++)
+        {
+            const CTxMemPoolEntry &e = *pool.mapTx.find(vtx[i].GetHash());
+            BOOST_CHECK_EQUAL(e.GetCountWithAncestors(), vBefore[i].GetCountWithAncestors() - 2);
+            BOOST_CHECK_EQUAL(e.GetSizeWithAncestors(),
+                              vBefore[i].GetSizeWithAncestors() - vBefore[0].GetTxSize() - vBefore[1].GetTxSize());
+            BOOST_CHECK_EQUAL(e.GetModFeesWithAncestors(), vBefore[i].GetModFeesWithAncestors() - 3000LL);
+            BOOST_CHECK_EQUAL(e.GetSigOpCostWithAncestors(), vBefore[i].GetSigOpCostWithAncestors() - 8);
+            BOOST_CHECK_EQUAL(e.GetCountWithDescendants(), vBefore[i].GetCountWithDescendants());
+        }
+
+        // The block is disconnected again: once its transactions are back and
+        // linked to their children, the state is as before.
+        std::vector<uint256> vHashesToUpdate;
+        for (size_t i = 0; i < 2; i++)
+        {
+            pool.addUnchecked(vtx[i].GetHash(), entry.Fee(1000LL * (i + 1)).FromTx(vtx[i]));
+            vHashesToUpdate.push_back(vtx[i].GetHash());
+        }
+        pool.UpdateTransactionsFromBlock(vHashesToUpdate);
+        for (size_t i = 0; i < vtx.size(); i++)
+        {
+            const CTxMemPoolEntry &e = *pool.mapTx.find(vtx[i].GetHash());
+            BOOST_CHECK_EQUAL(e.GetCountWithAncestors(), vBefore[i].GetCountWithAncestors());
+            BOOST_CHECK_EQUAL(e.GetSizeWithAncestors(), vBefore[i].GetSizeWithAncestors());
+            BOOST_CHECK_EQUAL(e.GetModFeesWithAncestors(), vBefore[i].GetModFeesWithAncestors());
+            BOOST_CHECK_EQUAL(e.GetSigOpCostWithAncestors(), vBefore[i].GetSigOpCostWithAncestors());
+            BOOST_CHECK_EQUAL(e.GetCountWithDescendants(), vBefore[i].GetCountWithDescendants());
+            BOOST_CHECK_EQUAL(e.GetSizeWithDescendants(), vBefore[i].GetSizeWithDescendants());
+            BOOST_CHECK_EQUAL(e.GetModFeesWithDescendants(), vBefore[i].GetModFeesWithDescendants());
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(MempoolDumpBatchTest)
+    {
+        TestMemPoolEntryHelper entry;
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        CTxMemPoolEntry e = entry.Fee(12345LL).Time(42).Height(7).SpendsCoinbase(true).SigOpsCost(8).FromTx(tx);
+
+        CMempoolDumpBatch batch;
+        batch.hashTip = tx.GetHash();
+        batch.vEntries.emplace_back(e);
+        batch.vRemoved.push_back(uint256S("0x01"));
+        batch.mapDeltas[tx.GetHash()] = 100;
+
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << batch;
+        CMempoolDumpBatch batchRead;
+        ss >> batchRead;
+        BOOST_CHECK(ss.empty());
+
+        BOOST_CHECK(batchRead.hashTip == batch.hashTip);
+        BOOST_CHECK(batchRead.vRemoved == batch.vRemoved);
+        BOOST_CHECK(batchRead.mapDeltas == batch.mapDeltas);
+        BOOST_CHECK_EQUAL(batchRead.vEntries.size(), 1);
+        const CMempoolDumpEntry &dumped = batchRead.vEntries[0];
+        BOOST_CHECK(dumped.tx->GetWitnessHash() == CTransaction(tx).GetWitnessHash());
+        BOOST_CHECK_EQUAL(dumped.nTime, 42);
+        BOOST_CHECK_EQUAL(dumped.nFee, 12345LL);
+        BOOST_CHECK_EQUAL(dumped.nSigOpCost, 8);
+        BOOST_CHECK_EQUAL(dumped.nHeight, 7);
+        BOOST_CHECK(dumped.fSpendsCoinbase);
+        BOOST_CHECK(dumped.hashExecTip.IsNull());
+    }
+
+    /** Writes mempool.dat, or its journal, as DumpMempool and DumpMempoolIncremental do. */
+    static void WriteMempoolFile(const fs::path &path, uint64_t nDumpId, const std::vector<CMempoolDumpBatch> &vBatches)
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+        file << nDumpId;
+        for (const CMempoolDumpBatch &batch : vBatches)
+        {
+            file << batch;
+        }
+    }
+
+    struct MempoolPersistSetup : public TestChain100Setup
+    {
+        CMempoolComponent *pComponent;
+        CScript scriptPubKey;
+
+        MempoolPersistSetup()
+        {
+            GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+            pComponent = static_cast<CMempoolComponent *>(ifTxMempoolObj);
+            scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+            // Mature a few more coinbases to spend
+            for (int i = 0; i < 3; i++)
+            {
+                CreateAndProcessBlock({}, scriptPubKey);
+            }
+        }
+
+        CTransactionRef Spend(int nCoinbase, CAmount nFee)
+        {
+            CMutableTransaction tx;
+            tx.nVersion = 1;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(coinbaseTxns[nCoinbase].GetHash(), 0);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = coinbaseTxns[nCoinbase].vout[0].nValue - nFee;
+            tx.vout[0].scriptPubKey = scriptPubKey;
+
+            std::vector<unsigned char> vchSig;
+            uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL | SIGHASH_SBTC_FORK, 0, SIGVERSION_BASE);
+            BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+            vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_SBTC_FORK));
+            tx.vin[0].scriptSig << vchSig;
+            return MakeTransactionRef(tx);
+        }
+
+        CMempoolDumpEntry Dumped(const CTransactionRef &tx, CAmount nFee)
+        {
+            TestMemPoolEntryHelper entry;
+            return CMempoolDumpEntry(entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(true).FromTx(*tx));
+        }
+
+        CMempoolDumpBatch Batch(const uint256 &hashTip, const std::vector<CMempoolDumpEntry> &vEntries)
+        {
+            CMempoolDumpBatch batch;
+            batch.hashTip = hashTip;
+            batch.vEntries = vEntries;
+            return batch;
+        }
+
+        /** Empties the mempool, and loads it from the files written. */
+        void Reload()
+        {
+            pComponent->GetMemPool().clear();
+            BOOST_CHECK(pComponent->LoadMempool());
+        }
+
+        bool Exists(const CTransactionRef &tx)
+        {
+            return pComponent->GetMemPool().exists(tx->GetHash());
+        }
+
+        const CTxMemPoolEntry &Entry(const CTransactionRef &tx)
+        {
+            CTxMemPool &pool = pComponent->GetMemPool();
+            LOCK(pool.cs);
+            return *pool.mapTx.find(tx->GetHash());
+        }
+    };
+
+    BOOST_FIXTURE_TEST_CASE(MempoolLoadTrustedTest, MempoolPersistSetup)
+    {
+        // A fee AcceptToMemoryPool would not work out tells which way the entry came back.
+        CTransactionRef tx = Spend(0, 10000);
+        fs::path path = Args().GetDataDir() / "mempool.dat";
+
+        // On top of the tip it was stored on, the entry is added back as it was
+        WriteMempoolFile(path, 1, {Batch(chainActive.Tip()->GetBlockHash(), {Dumped(tx, 777)})});
+        Reload();
+        BOOST_REQUIRE(Exists(tx));
+        BOOST_CHECK_EQUAL(Entry(tx).GetFee(), 777);
+
+        // On top of another tip, it is accepted again
+        WriteMempoolFile(path, 1, {Batch(chainActive.Tip()->pprev->GetBlockHash(), {Dumped(tx, 777)})});
+        Reload();
+        BOOST_REQUIRE(Exists(tx));
+        BOOST_CHECK_EQUAL(Entry(tx).GetFee(), 10000);
+        pComponent->GetMemPool().clear();
+    }
+
+    BOOST_FIXTURE_TEST_CASE(MempoolLoadJournalTest, MempoolPersistSetup)
+    {
+        CTransactionRef txA = Spend(0, 10000);
+        CTransactionRef txB = Spend(1, 10000);
+        const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+        WriteMempoolFile(Args().GetDataDir() / "mempool.dat", 42, {Batch(hashTip, {Dumped(txA, 10000)})});
+
+        CMempoolDumpBatch change = Batch(hashTip, {Dumped(txB, 10000)});
+        change.vRemoved.push_back(txA->GetHash());
+
+        // The journal of this mempool.dat is replayed on top of it
+        WriteMempoolFile(Args().GetDataDir() / "mempool.journal", 42, {change});
+        Reload();
+        BOOST_CHECK(!Exists(txA));
+        BOOST_CHECK(Exists(txB));
+
+        // The journal of another one is ignored
+        WriteMempoolFile(Args().GetDataDir() / "mempool.journal", 43, {change});
+        Reload();
+        BOOST_CHECK(Exists(txA));
+        BOOST_CHECK(!Exists(txB));
+        pComponent->GetMemPool().clear();
+    }
+
+    BOOST_FIXTURE_TEST_CASE(MempoolLoadExecTipTest, MempoolPersistSetup)
+    {
+        CTransactionRef txFresh = Spend(0, 10000);
+        CTransactionRef txStale = Spend(1, 10000);
+        TestMemPoolEntryHelper entry;
+        entry.Time(GetTime()).Fee(10000).SpendsCoinbase(true).Gas(40, 100000);
+
+        // Results worked out on top of the tip are kept, the others dropped
+        CMempoolDumpEntry fresh(entry.FromTx(*txFresh));
+        fresh.nGasEstimate = 21000;
+        fresh.hashExecTip = chainActive.Tip()->GetBlockHash();
+        CMempoolDumpEntry stale(entry.FromTx(*txStale));
+        stale.nGasEstimate = 21000;
+        stale.hashExecTip = chainActive.Tip()->pprev->GetBlockHash();
+
+        WriteMempoolFile(Args().GetDataDir() / "mempool.dat", 1,
+                         {Batch(chainActive.Tip()->GetBlockHash(), {fresh, stale})});
+        Reload();
+        BOOST_REQUIRE(Exists(txFresh));
+        BOOST_REQUIRE(Exists(txStale));
+        BOOST_CHECK(Entry(txFresh).GetExecTip() == chainActive.Tip());
+        BOOST_CHECK_EQUAL(Entry(txFresh).GetGasEstimate(), 21000U);
+        BOOST_CHECK(Entry(txStale).GetExecTip() == nullptr);
+        BOOST_CHECK_EQUAL(Entry(txStale).GetGasEstimate(), 100000U);
+        pComponent->GetMemPool().clear();
+    }
+
+    BOOST_FIXTURE_TEST_CASE(MempoolLoadVerifyTest, MempoolPersistSetup)
+    {
+        CTransactionRef txValid = Spend(0, 10000);
+        CMutableTransaction bad(*Spend(1, 10000));
+        bad.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+        CTransactionRef txBad = MakeTransactionRef(bad);
+
+        // Added back before their scripts are verified, and removed if they fail
+        WriteMempoolFile(Args().GetDataDir() / "mempool.dat", 1,
+                         {Batch(chainActive.Tip()->GetBlockHash(), {Dumped(txValid, 10000), Dumped(txBad, 10000)})});
+        Reload();
+        BOOST_CHECK(Exists(txValid));
+        BOOST_CHECK(Exists(txBad));
+
+        // Until then they are neither relayed nor mined
+        CTxMemPool &pool = pComponent->GetMemPool();
+        BOOST_CHECK(pool.isUnverified(txBad->GetHash()));
+        BOOST_CHECK(!pool.info(txBad->GetHash()).tx);
+        BOOST_CHECK(pool.infoAll().empty());
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(Params()).CreateNewBlock(
+                CScript() << OP_TRUE);
+        BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+
+        pComponent->ThreadVerifyLoaded();
+        BOOST_CHECK(Exists(txValid));
+        BOOST_CHECK(!Exists(txBad));
+        BOOST_CHECK(!pool.isUnverified(txValid->GetHash()));
+        BOOST_CHECK(pool.info(txValid->GetHash()).tx);
+        pool.clear();
+    }
+
     BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     {
         CTxMemPool pool;
@@ -555,7 +867,8 @@ BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
             pool.addUnchecked(tx5.GetHash(), entry.Fee(1000LL).FromTx(tx5));
         pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7));
 
-        pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+        // Removing 5/7 halves the entries, but not the capacity of vTxHashes and vTxLinks, so leave some room.
+        pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 5); // should maximize mempool size by only removing 5/7
         BOOST_CHECK(pool.exists(tx4.GetHash()));
         BOOST_CHECK(!pool.exists(tx5.GetHash()));
         BOOST_CHECK(pool.exists(tx6.GetHash()));
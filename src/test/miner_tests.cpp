@@ -13,10 +13,17 @@
 #include "sbtccore/transaction/policy.h"
 #include "pubkey.h"
 #include "script/standard.h"
+#include "script/sign.h"
+#include "wallet/key.h"
 #include "mempool/txmempool.h"
+#include "interface/ichaincomponent.h"
+#include "interface/icontractcomponent.h"
+#include "contract-api/contractconfig.h"
+#include "contract-api/sbtctransaction.h"
 #include "uint256.h"
 #include "utils/util.h"
 #include "utils/utilstrencodings.h"
+#include "utils/hash.h"
 
 #include "test/test_bitcoin.h"
 
@@ -24,6 +31,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <univalue.h>
+
+extern UniValue CallRPC(std::string args);
+
 BOOST_FIXTURE_TEST_SUITE(miner_tests, TestingSetup)
 
     static CFeeRate blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
@@ -609,4 +620,390 @@ BOOST_FIXTURE_TEST_SUITE(miner_tests, TestingSetup)
         fCheckpointsEnabled = true;
     }
 
+    // Regtest chain up to the contract fork, so that the next block can hold contract transactions
+    struct ContractChainSetup : public TestChain100Setup
+    {
+        CScript scriptCoinbase;
+
+        ContractChainSetup()
+        {
+            scriptCoinbase = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+            while (chainActive.Height() < Params().GetConsensus().SBTCContractForkHeight)
+            {
+                std::vector<CMutableTransaction> noTxns;
+                CBlock b = CreateAndProcessBlock(noTxns, scriptCoinbase);
+                coinbaseTxns.push_back(*b.vtx[0]);
+            }
+        }
+
+        // Spend coinbase nCoinbase, paying nFee, to scriptPubKey and change back to the coinbase key
+        CMutableTransaction Spend(int nCoinbase, const CScript &scriptPubKey, CAmount nFee)
+        {
+            return Spend(coinbaseTxns[nCoinbase], 0, scriptPubKey, nFee);
+        }
+
+        // Spend output nOut of txFrom, which pays to the coinbase key, the same way
+        CMutableTransaction Spend(const CTransaction &txFrom, uint32_t nOut, const CScript &scriptPubKey, CAmount nFee)
+        {
+            CMutableTransaction tx;
+            tx.nVersion = 1;
+            tx.vin.resize(1);
+            tx.vin[0].prevout.hash = txFrom.GetHash();
+            tx.vin[0].prevout.n = nOut;
+            tx.vout.resize(2);
+            tx.vout[0].nValue = 0;
+            tx.vout[0].scriptPubKey = scriptPubKey;
+            tx.vout[1].nValue = txFrom.vout[nOut].nValue - nFee;
+            tx.vout[1].scriptPubKey = scriptCoinbase;
+
+            std::vector<unsigned char> vchSig;
+            uint256 hash = SignatureHash(scriptCoinbase, tx, 0, SIGHASH_ALL | SIGHASH_SBTC_FORK, 0, SIGVERSION_BASE);
+            BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+            vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_SBTC_FORK));
+            tx.vin[0].scriptSig << vchSig;
+            return tx;
+        }
+
+        // A contract creation that runs almost no code, whatever gas limit it declares
+        CMutableTransaction CreateContract(int nCoinbase, uint64_t nGasLimit, CAmount nGasPrice, CAmount nFee)
+        {
+            return Spend(coinbaseTxns[nCoinbase], 0, CreateScript(nGasLimit, nGasPrice), nFee);
+        }
+
+        CScript CreateScript(uint64_t nGasLimit, CAmount nGasPrice)
+        {
+            return CScript() << CScriptNum(VersionVM::GetEVMDefault().toRaw()) << CScriptNum(nGasLimit)
+                             << CScriptNum(nGasPrice) << ParseHex("00") << OP_CREATE;
+        }
+
+        bool InBlock(const CBlockTemplate &blocktemplate, const uint256 &hash)
+        {
+            for (const CTransactionRef &tx : blocktemplate.block.vtx)
+            {
+                if (tx->GetHash() == hash)
+                    return true;
+            }
+            return false;
+        }
+
+        // Mine the mempool into a block on top of the tip, contracts executed
+        void MineMempool()
+        {
+            const CChainParams &chainparams = Params();
+            GET_CHAIN_INTERFACE(ifChainObj);
+            std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(
+                    scriptCoinbase);
+            CBlock &block = pblocktemplate->block;
+            block.hashMerkleRoot = BlockMerkleRoot(block);
+            while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus()))
+                ++block.nNonce;
+            BOOST_CHECK(ifChainObj->ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true,
+                                                    nullptr));
+            BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+        }
+
+        std::string RPCError(const std::string &args)
+        {
+            try
+            {
+                CallRPC(args);
+            }
+            catch (const std::runtime_error &e)
+            {
+                return e.what();
+            }
+            return "";
+        }
+    };
+
+    BOOST_FIXTURE_TEST_CASE(GasRanking_below_min_fee_package, ContractChainSetup)
+    {
+        const CChainParams &chainparams = Params();
+        GET_CONTRACT_INTERFACE(ifContractObj);
+        CAmount nGasPrice = ifContractObj->GetMinGasPrice(chainActive.Height() + 1);
+        TestMemPoolEntryHelper entry;
+        LOCK(cs_main);
+
+        // A contract transaction paying for all of its gas
+        uint64_t nGasLimit = DEFAULT_GAS_LIMIT_OP_CREATE;
+        CMutableTransaction txContract = CreateContract(0, nGasLimit, nGasPrice, nGasLimit * nGasPrice + COIN / 100);
+        mempool.addUnchecked(txContract.GetHash(),
+                             entry.Fee(nGasLimit * nGasPrice + COIN / 100).Time(GetTime()).SpendsCoinbase(true)
+                                     .Gas(nGasPrice, nGasLimit).FromTx(txContract));
+
+        // A package below -blockmintxfee ends the walk by fee rate, which must not leave out
+        // the contract packages set aside to be ranked by gas
+        CMutableTransaction txFree = Spend(1, CScript() << OP_TRUE, 0);
+        mempool.addUnchecked(txFree.GetHash(),
+                             entry.Fee(0).Time(GetTime()).SpendsCoinbase(true).Gas(0, 0).FromTx(txFree));
+
+        BlockAssembler::Options options;
+        options.blockMinFeeRate = blockMinFeeRate;
+        options.fGasRanking = true;
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams, options).CreateNewBlock(
+                scriptCoinbase);
+        BOOST_CHECK(InBlock(*pblocktemplate, txContract.GetHash()));
+        BOOST_CHECK(!InBlock(*pblocktemplate, txFree.GetHash()));
+
+        mempool.clear();
+    }
+
+    BOOST_FIXTURE_TEST_CASE(GasRanking_unexecuted_gas_limit, ContractChainSetup)
+    {
+        const CChainParams &chainparams = Params();
+        GET_CONTRACT_INTERFACE(ifContractObj);
+        int nHeight = chainActive.Height() + 1;
+        CAmount nGasPrice = ifContractObj->GetMinGasPrice(nHeight);
+        uint64_t nBlockGasLimit = ifContractObj->GetBlockGasLimit(nHeight);
+        TestMemPoolEntryHelper entry;
+        LOCK(cs_main);
+
+        // A parent and a child, each declaring more than half the gas of the block and using little
+        // of it, so each runs next to the other. Neither has been executed by the mempool, so the
+        // estimate of the package is the sum of their gas limits, more than the block has: it must
+        // still be attempted rather than skipped on that estimate.
+        uint64_t nGasLimit = nBlockGasLimit / 10 * 6;
+        BOOST_REQUIRE(2 * nGasLimit > nBlockGasLimit);
+        CAmount nFee = nGasLimit * nGasPrice + COIN / 100;
+        std::vector<uint256> vContracts;
+        CMutableTransaction txParent = CreateContract(0, nGasLimit, nGasPrice, nFee);
+        mempool.addUnchecked(txParent.GetHash(), entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(true)
+                .Gas(nGasPrice, nGasLimit).FromTx(txParent));
+        vContracts.push_back(txParent.GetHash());
+        CMutableTransaction txChild = Spend(CTransaction(txParent), 1, CreateScript(nGasLimit, nGasPrice), nFee);
+        mempool.addUnchecked(txChild.GetHash(), entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(false)
+                .Gas(nGasPrice, nGasLimit).FromTx(txChild));
+        vContracts.push_back(txChild.GetHash());
+        for (const uint256 &hash : vContracts)
+        {
+            CTxMemPool::txiter it = mempool.mapTx.find(hash);
+            BOOST_REQUIRE(it != mempool.mapTx.end());
+            BOOST_CHECK(!it->GetExecTip());
+            BOOST_CHECK_EQUAL(it->GetGasEstimate(), nGasLimit);
+        }
+
+        BlockAssembler::Options options;
+        options.blockMinFeeRate = blockMinFeeRate;
+        options.fGasRanking = true;
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams, options).CreateNewBlock(
+                scriptCoinbase);
+        for (const uint256 &hash : vContracts)
+        {
+            BOOST_CHECK(InBlock(*pblocktemplate, hash));
+        }
+
+        // They ran without the mempool, on the coins copied for their senders, whose gas is refunded
+        CScript scriptRefund = CScript() << OP_DUP << OP_HASH160 << ToByteVector(coinbaseKey.GetPubKey().GetID())
+                                         << OP_EQUALVERIFY << OP_CHECKSIG;
+        const CTransaction &txRefund = *pblocktemplate->block.vtx[1];
+        BOOST_CHECK_EQUAL(std::count_if(txRefund.vout.begin(), txRefund.vout.end(), [&](const CTxOut &out)
+        {
+            return out.scriptPubKey == scriptRefund;
+        }), 2);
+
+        // Executing them lowered their estimates to what they used, which is what ranks them next time
+        for (const uint256 &hash : vContracts)
+        {
+            CTxMemPool::txiter it = mempool.mapTx.find(hash);
+            BOOST_REQUIRE(it != mempool.mapTx.end());
+            BOOST_CHECK(it->GetGasEstimate() < nGasLimit);
+        }
+
+        mempool.clear();
+    }
+
+    BOOST_FIXTURE_TEST_CASE(TemplateBuilder_coinbase_script, ContractChainSetup)
+    {
+        const CChainParams &chainparams = Params();
+        GET_CHAIN_INTERFACE(ifChainObj);
+        GET_CONTRACT_INTERFACE(ifContractObj);
+        CScript scriptOther = CScript() << OP_TRUE;
+        CBlockTemplateBuilder builder(chainparams);
+
+        // Without contracts the block is kept and only its coinbase script is replaced
+        std::unique_ptr<CBlockTemplate> pfirst = builder.GetBlockTemplate(scriptCoinbase);
+        std::unique_ptr<CBlockTemplate> psecond = builder.GetBlockTemplate(scriptOther);
+        BOOST_CHECK(pfirst->block.vtx[0]->vout[0].scriptPubKey == scriptCoinbase);
+        BOOST_CHECK(psecond->block.vtx[0]->vout[0].scriptPubKey == scriptOther);
+        BOOST_CHECK(psecond->block.hashMerkleRoot == BlockMerkleRoot(psecond->block));
+        BOOST_CHECK(psecond->block.hashMerkleRoot != pfirst->block.hashMerkleRoot);
+        BOOST_CHECK_EQUAL(psecond->block.vtx.size(), pfirst->block.vtx.size());
+        {
+            LOCK(cs_main);
+            CValidationState state;
+            BOOST_CHECK(ifChainObj->TestBlockValidity(state, chainparams, psecond->block, chainActive.Tip(), false,
+                                                      false));
+        }
+
+        // A contract reads the coinbase script as the block author, so that block is assembled again
+        int nHeight = chainActive.Height() + 1;
+        CAmount nGasPrice = ifContractObj->GetMinGasPrice(nHeight);
+        CAmount nFee = MINIMUM_GAS_LIMIT * nGasPrice + COIN / 100;
+        CMutableTransaction tx = CreateContract(0, MINIMUM_GAS_LIMIT, nGasPrice, nFee);
+        TestMemPoolEntryHelper entry;
+        {
+            LOCK(cs_main);
+            mempool.addUnchecked(tx.GetHash(), entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(true)
+                    .Gas(nGasPrice, MINIMUM_GAS_LIMIT).FromTx(tx));
+        }
+        pfirst = builder.GetBlockTemplate(scriptCoinbase);
+        psecond = builder.GetBlockTemplate(scriptOther);
+        BOOST_CHECK(InBlock(*pfirst, tx.GetHash()));
+        BOOST_CHECK(InBlock(*psecond, tx.GetHash()));
+        BOOST_CHECK(psecond->block.vtx[0]->vout[0].scriptPubKey == scriptOther);
+        {
+            LOCK(cs_main);
+            CValidationState state;
+            BOOST_CHECK(ifChainObj->TestBlockValidity(state, chainparams, psecond->block, chainActive.Tip(), false,
+                                                      false));
+        }
+
+        mempool.clear();
+    }
+
+    BOOST_FIXTURE_TEST_CASE(ContractExec_estimate, ContractChainSetup)
+    {
+        GET_CHAIN_INTERFACE(ifChainObj);
+        GET_CONTRACT_INTERFACE(ifContractObj);
+        CAmount nGasPrice = ifContractObj->GetMinGasPrice(chainActive.Height() + 1);
+        uint64_t nGasLimit = DEFAULT_GAS_LIMIT_OP_CREATE;
+        CAmount nFee = nGasLimit * nGasPrice + COIN / 100;
+        TestMemPoolEntryHelper entry;
+        LOCK2(cs_main, mempool.cs);
+
+        CMutableTransaction tx = CreateContract(0, nGasLimit, nGasPrice, nFee);
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(true)
+                .Gas(nGasPrice, nGasLimit).FromTx(tx));
+
+        // Executed on top of the tip, the creation uses far less than it declares and raises nothing
+        CCoinsViewMemPool viewMemPool(ifChainObj->GetCoinsTip(), mempool);
+        CCoinsViewCache view(&viewMemPool);
+        uint64_t nGasUsed = 0;
+        uint32_t nExcepted = 1;
+        BOOST_CHECK(ifContractObj->PreExecuteContractTx(CTransaction(tx), &view, nGasUsed, nExcepted));
+        BOOST_CHECK(nGasUsed > 0);
+        BOOST_CHECK(nGasUsed < nGasLimit);
+        BOOST_CHECK_EQUAL(nExcepted, 0U);
+
+        // The entry takes that estimate, recorded against the tip
+        CTxMemPool::txiter it = mempool.mapTx.find(tx.GetHash());
+        BOOST_REQUIRE(it != mempool.mapTx.end());
+        BOOST_CHECK(!it->GetExecTip());
+        BOOST_CHECK_EQUAL(it->GetGasEstimate(), nGasLimit);
+        BOOST_CHECK(mempool.UpdateContractExec(it));
+        BOOST_CHECK(it->GetExecTip() == chainActive.Tip());
+        BOOST_CHECK_EQUAL(it->GetGasEstimate(), nGasUsed);
+        BOOST_CHECK_EQUAL(it->GetExcepted(), 0U);
+
+        mempool.clear();
+    }
+
+    BOOST_FIXTURE_TEST_CASE(ContractExec_snapshot_follows_tip, ContractChainSetup)
+    {
+        GET_CONTRACT_INTERFACE(ifContractObj);
+        CAmount nGasPrice = ifContractObj->GetMinGasPrice(chainActive.Height() + 1);
+        uint64_t nGasLimit = DEFAULT_GAS_LIMIT_OP_SEND;
+        CAmount nFee = DEFAULT_GAS_LIMIT_OP_CREATE * nGasPrice + COIN / 100;
+        TestMemPoolEntryHelper entry;
+
+        // A contract whose code stores 1 in its slot 0:
+        // PUSH1 1 PUSH1 0 SSTORE STOP, returned by its init code
+        CScript scriptCreate = CScript() << CScriptNum(VersionVM::GetEVMDefault().toRaw())
+                                         << CScriptNum(DEFAULT_GAS_LIMIT_OP_CREATE) << CScriptNum(nGasPrice)
+                                         << ParseHex("656001600055006000526006601af3") << OP_CREATE;
+        CMutableTransaction txCreate = Spend(0, scriptCreate, nFee);
+        {
+            LOCK(cs_main);
+            mempool.addUnchecked(txCreate.GetHash(), entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(true)
+                    .Gas(nGasPrice, DEFAULT_GAS_LIMIT_OP_CREATE).FromTx(txCreate));
+        }
+        MineMempool();
+        BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+        std::vector<unsigned char> vchTxOut(txCreate.GetHash().begin(), txCreate.GetHash().end());
+        vchTxOut.resize(vchTxOut.size() + sizeof(uint32_t), 0);
+        uint160 address = Hash160(vchTxOut);
+        CScript scriptCall = CScript() << CScriptNum(VersionVM::GetEVMDefault().toRaw()) << CScriptNum(nGasLimit)
+                                       << CScriptNum(nGasPrice) << ParseHex("00")
+                                       << std::vector<unsigned char>(address.begin(), address.end()) << OP_CALL;
+
+        // The first call finds slot 0 empty
+        CMutableTransaction txFirst = Spend(1, scriptCall, nFee);
+        uint64_t nFirstGas;
+        {
+            LOCK2(cs_main, mempool.cs);
+            mempool.addUnchecked(txFirst.GetHash(), entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(true)
+                    .Gas(nGasPrice, nGasLimit).FromTx(txFirst));
+            CTxMemPool::txiter it = mempool.mapTx.find(txFirst.GetHash());
+            BOOST_REQUIRE(it != mempool.mapTx.end());
+            BOOST_CHECK(mempool.UpdateContractExec(it));
+            BOOST_CHECK_EQUAL(it->GetExcepted(), 0U);
+            nFirstGas = it->GetGasEstimate();
+        }
+        const CBlockIndex *pindexFirst = chainActive.Tip();
+        MineMempool();
+        BOOST_CHECK(chainActive.Tip() != pindexFirst);
+
+        // The same call on top of the new tip must see the slot the block set: had the mempool
+        // kept executing on the state of the old tip, it would be estimated the same
+        CMutableTransaction txSecond = Spend(2, scriptCall, nFee);
+        {
+            LOCK2(cs_main, mempool.cs);
+            mempool.addUnchecked(txSecond.GetHash(), entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(true)
+                    .Gas(nGasPrice, nGasLimit).FromTx(txSecond));
+            CTxMemPool::txiter it = mempool.mapTx.find(txSecond.GetHash());
+            BOOST_REQUIRE(it != mempool.mapTx.end());
+            BOOST_CHECK(mempool.UpdateContractExec(it));
+            BOOST_CHECK(it->GetExecTip() == chainActive.Tip());
+            BOOST_CHECK_EQUAL(it->GetExcepted(), 0U);
+            BOOST_CHECK(it->GetGasEstimate() < nFirstGas);
+        }
+
+        mempool.clear();
+    }
+
+    BOOST_FIXTURE_TEST_CASE(ContractExec_estimategas_rpc, ContractChainSetup)
+    {
+        GET_CONTRACT_INTERFACE(ifContractObj);
+        CAmount nGasPrice = ifContractObj->GetMinGasPrice(chainActive.Height() + 1);
+        uint64_t nGasLimit = DEFAULT_GAS_LIMIT_OP_CREATE;
+        CAmount nFee = nGasLimit * nGasPrice + COIN / 100;
+        TestMemPoolEntryHelper entry;
+
+        CMutableTransaction txContract = CreateContract(0, nGasLimit, nGasPrice, nFee);
+        CMutableTransaction txPlain = Spend(1, CScript() << OP_TRUE, COIN / 100);
+        {
+            LOCK(cs_main);
+            mempool.addUnchecked(txContract.GetHash(), entry.Fee(nFee).Time(GetTime()).SpendsCoinbase(true)
+                    .Gas(nGasPrice, nGasLimit).FromTx(txContract));
+            mempool.addUnchecked(txPlain.GetHash(), entry.Fee(COIN / 100).Time(GetTime()).SpendsCoinbase(true)
+                    .Gas(0, 0).FromTx(txPlain));
+        }
+
+        BOOST_CHECK_EQUAL(RPCError("estimategas " + coinbaseTxns[2].GetHash().GetHex()),
+                          "Transaction not in mempool");
+        BOOST_CHECK_EQUAL(RPCError("estimategas " + txPlain.GetHash().GetHex()), "Not a contract transaction");
+
+        // Not executed by the mempool, the estimate is the gas limit
+        UniValue result = CallRPC("estimategas " + txContract.GetHash().GetHex());
+        BOOST_CHECK_EQUAL(find_value(result.get_obj(), "gasLimit").get_int64(), (int64_t)nGasLimit);
+        BOOST_CHECK_EQUAL(find_value(result.get_obj(), "gasUsed").get_int64(), (int64_t)nGasLimit);
+        BOOST_CHECK(!find_value(result.get_obj(), "executed").get_bool());
+
+        // Once the mempool executed it on top of the tip, that is what is reported
+        {
+            LOCK2(cs_main, mempool.cs);
+            CTxMemPool::txiter it = mempool.mapTx.find(txContract.GetHash());
+            BOOST_REQUIRE(it != mempool.mapTx.end());
+            BOOST_CHECK(mempool.UpdateContractExec(it));
+        }
+        result = CallRPC("estimategas " + txContract.GetHash().GetHex());
+        BOOST_CHECK(find_value(result.get_obj(), "executed").get_bool());
+        BOOST_CHECK(find_value(result.get_obj(), "gasUsed").get_int64() < (int64_t)nGasLimit);
+        BOOST_CHECK_EQUAL(find_value(result.get_obj(), "blockhash").get_str(),
+                          chainActive.Tip()->GetBlockHash().GetHex());
+
+        mempool.clear();
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include "chaincontrol/chain.h"
 #include "config/chainparams.h"
+#include "miner/miner.h"
 #include "miner/pow.h"
 #include "random.h"
 #include "utils/util.h"
@@ -89,4 +90,31 @@ BOOST_FIXTURE_TEST_SUITE(pow_tests, BasicTestingSetup)
         }
     }
 
+    BOOST_AUTO_TEST_CASE(nonce_scanner)
+    {
+        const auto chainParams = CreateChainParams(CChainParams::REGTEST);
+        const Consensus::Params &params = chainParams->GetConsensus();
+        CBlockHeader header = chainParams->GenesisBlock().GetBlockHeader();
+        header.nTime += 1;
+
+        // Every regtest nonce has about even odds, so this finds several solutions.
+        uint32_t nBegin = 0;
+        uint32_t nNonce;
+        for (int i = 0; i < 8; i++)
+        {
+            BOOST_REQUIRE(CNonceScanner(header, params).Scan(nBegin, nBegin + 1000, nNonce));
+            for (header.nNonce = nBegin; header.nNonce < nNonce; header.nNonce++)
+            {
+                BOOST_CHECK(!CheckProofOfWork(header.GetHash(), header.nBits, params));
+            }
+            BOOST_CHECK(CheckProofOfWork(header.GetHash(), header.nBits, params));
+            nBegin = nNonce + 1;
+        }
+
+        // An empty range and an invalid target never succeed.
+        BOOST_CHECK(!CNonceScanner(header, params).Scan(5, 5, nNonce));
+        header.nBits = 0;
+        BOOST_CHECK(!CNonceScanner(header, params).Scan(0, 1000, nNonce));
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "framework/sync.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+static const CLockSiteStats *FindSite(const std::vector<CLockSiteStats> &vStats, int nLine)
+{
+    for (const CLockSiteStats &stats : vStats)
+    {
+        if (stats.strFile == __FILE__ && stats.nLine == nLine)
+            return &stats;
+    }
+    return nullptr;
+}
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+    BOOST_AUTO_TEST_CASE(lockprofile_records_sites)
+    {
+        CCriticalSection cs;
+        ResetLockProfile();
+
+        // Nothing is recorded while profiling is off.
+        {
+            LOCK(cs);
+        }
+        BOOST_CHECK(GetLockProfile().empty());
+
+        fLockProfiling = true;
+        int nLineLock = 0;
+        int nLineTry = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            nLineLock = __LINE__ + 1;
+            LOCK(cs);
+            {
+                // Taken again recursively, without waiting.
+                nLineTry = __LINE__ + 1;
+                TRY_LOCK(cs, lockTry);
+                BOOST_CHECK(lockTry);
+            }
+        }
+        fLockProfiling = false;
+
+        std::vector<CLockSiteStats> vStats = GetLockProfile();
+
+        const CLockSiteStats *pLock = FindSite(vStats, nLineLock);
+        BOOST_REQUIRE(pLock != nullptr);
+        BOOST_CHECK_EQUAL(pLock->strName, "cs");
+        BOOST_CHECK_EQUAL(pLock->nCount, 3U);
+        BOOST_CHECK_EQUAL(pLock->nContended, 0U);
+        BOOST_CHECK(pLock->nMaxHoldMicros <= pLock->nHoldMicros);
+
+        const CLockSiteStats *pTry = FindSite(vStats, nLineTry);
+        BOOST_REQUIRE(pTry != nullptr);
+        BOOST_CHECK_EQUAL(pTry->nCount, 3U);
+        BOOST_CHECK_EQUAL(pTry->nWaitMicros, 0);
+
+        ResetLockProfile();
+        BOOST_CHECK(GetLockProfile().empty());
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
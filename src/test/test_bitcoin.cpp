@@ -175,5 +175,5 @@ CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CMutableTransaction &tx)
 CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CTransaction &txn)
 {
     return CTxMemPoolEntry(MakeTransactionRef(txn), nFee, nTime, nHeight,
-                           spendsCoinbase, sigOpCost, lp);
+                           spendsCoinbase, sigOpCost, lp, nMinGasPrice, nGasLimit);
 }
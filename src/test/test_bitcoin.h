@@ -134,10 +134,12 @@ struct TestMemPoolEntryHelper
     bool spendsCoinbase;
     unsigned int sigOpCost;
     LockPoints lp;
+    CAmount nMinGasPrice;
+    uint64_t nGasLimit;
 
     TestMemPoolEntryHelper() :
             nFee(0), nTime(0), nHeight(1),
-            spendsCoinbase(false), sigOpCost(4)
+            spendsCoinbase(false), sigOpCost(4), nMinGasPrice(0), nGasLimit(0)
     {
     }
 
@@ -175,6 +177,13 @@ struct TestMemPoolEntryHelper
         sigOpCost = _sigopsCost;
         return *this;
     }
+
+    TestMemPoolEntryHelper &Gas(CAmount _minGasPrice, uint64_t _gasLimit)
+    {
+        nMinGasPrice = _minGasPrice;
+        nGasLimit = _gasLimit;
+        return *this;
+    }
 };
 
 #endif
@@ -16,6 +16,8 @@
 #include "sbtccore/core_io.h"
 #include "wallet/keystore.h"
 #include "sbtccore/transaction/policy.h"
+#include "sbtccore/transaction/script/scriptcheck.h"
+#include "interface/imempoolcomponent.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -399,4 +401,90 @@ BOOST_AUTO_TEST_SUITE(tx_validationcache_tests)
         }
     }
 
+    static CTransactionRef SignedSpend(const CTransaction &coinbase, CAmount nFee, const CKey &key)
+    {
+        CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = coinbase.vout[0].nValue - nFee;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL | SIGHASH_SBTC_FORK, 0, SIGVERSION_BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_SBTC_FORK));
+        tx.vin[0].scriptSig << vchSig;
+        return MakeTransactionRef(tx);
+    }
+
+    static bool InScriptCache(const CTransactionRef &tx)
+    {
+        return scriptExecutionCache.contains(GetScriptExecutionCacheEntry(*tx, STANDARD_SCRIPT_VERIFY_FLAGS), false);
+    }
+
+    BOOST_FIXTURE_TEST_CASE(tx_preverify_cache_and_uncache, TestChain100Setup)
+    {
+        GET_TXMEMPOOL_INTERFACE(ifTxMempoolObj);
+        CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+        // Mature the second and third coinbase, and start from an empty coins cache
+        CreateAndProcessBlock({}, scriptPubKey);
+        CreateAndProcessBlock({}, scriptPubKey);
+        {
+            LOCK(cs_main);
+            pcoinsTip->Flush();
+        }
+
+        CTransactionRef txValid = SignedSpend(coinbaseTxns[0], 10000, coinbaseKey);
+        CTransactionRef txFree = SignedSpend(coinbaseTxns[1], 0, coinbaseKey);
+        CMutableTransaction badSig(*SignedSpend(coinbaseTxns[2], 10000, coinbaseKey));
+        badSig.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+        CTransactionRef txBadSig = MakeTransactionRef(badSig);
+
+        std::vector<CTransactionRef> vtx{txValid, txFree, txBadSig};
+        std::vector<std::vector<COutPoint>> vCoinsToUncache;
+        ifTxMempoolObj->PreVerifyTransactions(vtx, vCoinsToUncache);
+        BOOST_CHECK_EQUAL(vCoinsToUncache.size(), vtx.size());
+
+        // Only the valid transaction is verified and keeps the coin it fetched;
+        // the one below the relay fee is not verified at all.
+        BOOST_CHECK(InScriptCache(txValid));
+        BOOST_CHECK(!InScriptCache(txFree));
+        BOOST_CHECK(!InScriptCache(txBadSig));
+        BOOST_CHECK_EQUAL(vCoinsToUncache[0].size(), 1U);
+        BOOST_CHECK(vCoinsToUncache[1].empty());
+        BOOST_CHECK(vCoinsToUncache[2].empty());
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(pcoinsTip->HaveCoinInCache(txValid->vin[0].prevout));
+            BOOST_CHECK(!pcoinsTip->HaveCoinInCache(txFree->vin[0].prevout));
+            BOOST_CHECK(!pcoinsTip->HaveCoinInCache(txBadSig->vin[0].prevout));
+        }
+
+        // Not submitted: the coin of the verified transaction is dropped too
+        ifTxMempoolObj->UncacheUnaccepted(vtx, vCoinsToUncache);
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(!pcoinsTip->HaveCoinInCache(txValid->vin[0].prevout));
+        }
+
+        // Already verified, so not fetched again; once accepted the coin stays
+        ifTxMempoolObj->PreVerifyTransactions({txValid}, vCoinsToUncache);
+        BOOST_CHECK(vCoinsToUncache[0].empty());
+        {
+            LOCK(cs_main);
+            CValidationState state;
+            BOOST_CHECK(mempool.AcceptToMemoryPool(state, txValid, true, nullptr, nullptr));
+        }
+        ifTxMempoolObj->UncacheUnaccepted({txValid}, vCoinsToUncache);
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(pcoinsTip->HaveCoinInCache(txValid->vin[0].prevout));
+        }
+        mempool.clear();
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
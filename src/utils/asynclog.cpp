@@ -0,0 +1,215 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <log4cpp/LoggingEvent.hh>
+#include <log4cpp/TimeStamp.hh>
+
+#include "asynclog.h"
+#include "util.h"
+
+namespace
+{
+    struct CLogRecord
+    {
+        LogCategory *category = nullptr;
+        int priority = 0;
+        log4cpp::TimeStamp timeStamp;
+        std::string message;
+    };
+
+    class CAsyncLogWriter
+    {
+    public:
+        CAsyncLogWriter(size_t nDepth, LogOverflow overflowIn) : queue(nDepth), overflow(overflowIn)
+        {
+        }
+
+        //! Returns false only if the record could not be queued and must be written synchronously.
+        bool Push(CLogRecord &&record)
+        {
+            if (!queue.TryPush(std::move(record)))
+            {
+                if (overflow == LogOverflow::DROP)
+                {
+                    nDropped.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                while (!queue.TryPush(std::move(record)))
+                {
+                    if (!fRunning.load(std::memory_order_acquire))
+                        return false;
+                    if (fIdle.load(std::memory_order_acquire))
+                        Wake();
+                    std::this_thread::yield();
+                }
+            }
+            nQueued.fetch_add(1, std::memory_order_relaxed);
+            // Stop() may have made its last pass over the queue after we loaded the
+            // writer and before the record went in: then nobody else writes it out.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!fRunning.load(std::memory_order_relaxed))
+            {
+                Drain();
+                return true;
+            }
+            if (fIdle.load(std::memory_order_acquire))
+                Wake();
+            return true;
+        }
+
+        void Start()
+        {
+            fRunning = true;
+            thread = std::thread(&CAsyncLogWriter::ThreadWriter, this);
+        }
+
+        void Stop()
+        {
+            fRunning = false;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            Wake();
+            if (thread.joinable())
+                thread.join();
+            // Anything a producer slipped in while we were joining.
+            Drain();
+        }
+
+        void GetStats(CAsyncLogStats &stats) const
+        {
+            stats.fRunning = fRunning;
+            stats.nCapacity = queue.capacity();
+            stats.nQueued = nQueued.load(std::memory_order_relaxed);
+            stats.nDropped = nDropped.load(std::memory_order_relaxed);
+            stats.nWritten = nWritten.load(std::memory_order_relaxed);
+            stats.nDepth = stats.nQueued > stats.nWritten ? stats.nQueued - stats.nWritten : 0;
+        }
+
+    private:
+        void Wake()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cond.notify_one();
+        }
+
+        //! Producers that find the writer stopped drain too, one consumer at a time.
+        size_t Drain()
+        {
+            std::lock_guard<std::mutex> lock(mutexDrain);
+            size_t n = 0;
+            CLogRecord record;
+            while (queue.TryPop(record))
+            {
+                log4cpp::LoggingEvent event(record.category->getName(), record.message, "", record.priority);
+                event.timeStamp = record.timeStamp;
+                record.category->callAppenders(event);
+                record.message.clear();
+                nWritten.fetch_add(1, std::memory_order_relaxed);
+                n++;
+            }
+            return n;
+        }
+
+        void ThreadWriter()
+        {
+            RenameThread("sbtc-logwriter");
+            while (fRunning.load(std::memory_order_acquire))
+            {
+                if (Drain())
+                    continue;
+
+                std::unique_lock<std::mutex> lock(mutex);
+                fIdle = true;
+                // A producer that saw fIdle == false right before we set it
+                // does not notify; the timeout bounds how long its record waits.
+                cond.wait_for(lock, std::chrono::milliseconds(10));
+                fIdle = false;
+            }
+            Drain();
+        }
+
+        CMPSCRingBuffer<CLogRecord> queue;
+        const LogOverflow overflow;
+
+        std::atomic<bool> fRunning{false};
+        std::atomic<bool> fIdle{false};
+        std::mutex mutex;
+        std::mutex mutexDrain;
+        std::condition_variable cond;
+        std::thread thread;
+
+        std::atomic<uint64_t> nQueued{0};
+        std::atomic<uint64_t> nDropped{0};
+        std::atomic<uint64_t> nWritten{0};
+    };
+
+    std::atomic<CAsyncLogWriter *> pAsyncLogWriter{nullptr};
+    std::unique_ptr<CAsyncLogWriter> asyncLogWriterOwner;
+    CAsyncLogStats lastAsyncLogStats = {};
+}
+
+void LogWrite(LogCategory *logger, int prior, std::string &&message)
+{
+    CAsyncLogWriter *writer = pAsyncLogWriter.load(std::memory_order_acquire);
+    if (writer)
+    {
+        CLogRecord record;
+        record.category = logger;
+        record.priority = prior;
+        record.message = std::move(message);
+        if (writer->Push(std::move(record)))
+            return;
+        message = std::move(record.message);
+    }
+    logger->log(prior, message);
+}
+
+bool StartAsyncLogging(size_t nDepth, LogOverflow overflow)
+{
+    if (pAsyncLogWriter.load() || nDepth == 0)
+        return false;
+
+    asyncLogWriterOwner.reset(new CAsyncLogWriter(nDepth, overflow));
+    asyncLogWriterOwner->Start();
+    pAsyncLogWriter.store(asyncLogWriterOwner.get(), std::memory_order_release);
+    return true;
+}
+
+void StopAsyncLogging()
+{
+    CAsyncLogWriter *writer = pAsyncLogWriter.exchange(nullptr);
+    if (!writer)
+        return;
+
+    writer->Stop();
+    writer->GetStats(lastAsyncLogStats);
+    // The writer object itself is kept: a producer may still hold the pointer
+    // it loaded just before the exchange above.
+}
+
+bool ParseLogOverflow(const std::string &str, LogOverflow &overflow)
+{
+    if (str == "drop")
+    {
+        overflow = LogOverflow::DROP;
+        return true;
+    }
+    if (str == "block")
+    {
+        overflow = LogOverflow::BLOCK;
+        return true;
+    }
+    return false;
+}
+
+CAsyncLogStats GetAsyncLogStats()
+{
+    CAsyncLogWriter *writer = pAsyncLogWriter.load(std::memory_order_acquire);
+    if (!writer)
+        return lastAsyncLogStats;
+
+    CAsyncLogStats stats;
+    writer->GetStats(stats);
+    return stats;
+}
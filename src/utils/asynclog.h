@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "logger.h"
+
+/**
+ * Asynchronous delivery of log records.
+ *
+ * When enabled, the logging macros no longer call into log4cpp on the calling
+ * thread. They push the already formatted message into a bounded MPSC ring
+ * buffer and a single background thread hands it to the category's appenders,
+ * so the validation, network and EVM threads never wait on file I/O or on the
+ * appender locks.
+ */
+
+static const bool DEFAULT_LOGASYNC = true;
+static const size_t DEFAULT_LOG_QUEUE_DEPTH = 8192;
+static const char *const DEFAULT_LOG_OVERFLOW = "block";
+
+enum class LogOverflow
+{
+    DROP,   //!< discard the record when the queue is full
+    BLOCK,  //!< wait for the writer thread to make room
+};
+
+struct CAsyncLogStats
+{
+    bool fRunning;
+    size_t nCapacity;
+    size_t nDepth;       //!< records currently waiting to be written
+    uint64_t nQueued;    //!< records accepted into the queue since start
+    uint64_t nDropped;   //!< records discarded because the queue was full
+    uint64_t nWritten;   //!< records handed to the appenders
+};
+
+/**
+ * Bounded lock-free queue for any number of producers and one consumer
+ * (Vyukov's sequence-numbered ring). Capacity is rounded up to a power of two.
+ */
+template<typename T>
+class CMPSCRingBuffer
+{
+public:
+    explicit CMPSCRingBuffer(size_t nCapacity) : nMask(RoundUp(nCapacity) - 1), cells(new Cell[nMask + 1])
+    {
+        for (size_t i = 0; i <= nMask; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        nEnqueuePos.store(0, std::memory_order_relaxed);
+        nDequeuePos = 0;
+    }
+
+    CMPSCRingBuffer(const CMPSCRingBuffer &) = delete;
+
+    CMPSCRingBuffer &operator=(const CMPSCRingBuffer &) = delete;
+
+    size_t capacity() const
+    {
+        return nMask + 1;
+    }
+
+    //! Safe to call from any thread. Returns false if the queue is full.
+    bool TryPush(T &&item)
+    {
+        Cell *cell;
+        size_t pos = nEnqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[pos & nMask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0)
+            {
+                if (nEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (dif < 0)
+            {
+                return false;
+            } else
+            {
+                pos = nEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! Must only be called from the single consumer thread.
+    bool TryPop(T &item)
+    {
+        Cell *cell = &cells[nDequeuePos & nMask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(nDequeuePos + 1) < 0)
+            return false;
+        item = std::move(cell->item);
+        cell->sequence.store(nDequeuePos + nMask + 1, std::memory_order_release);
+        ++nDequeuePos;
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    static size_t RoundUp(size_t n)
+    {
+        size_t nPow = 2;
+        while (nPow < n)
+            nPow <<= 1;
+        return nPow;
+    }
+
+    const size_t nMask;
+    std::unique_ptr<Cell[]> cells;
+    std::atomic<size_t> nEnqueuePos;
+    size_t nDequeuePos;
+};
+
+/** Start the writer thread. Must be called after any fork(). */
+bool StartAsyncLogging(size_t nDepth, LogOverflow overflow);
+
+/** Write out everything still queued, stop the writer thread and go back to synchronous logging. */
+void StopAsyncLogging();
+
+bool ParseLogOverflow(const std::string &str, LogOverflow &overflow);
+
+CAsyncLogStats GetAsyncLogStats();
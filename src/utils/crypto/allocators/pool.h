@@ -0,0 +1,227 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include "utils/memusage.h"
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Arena for the nodes of node-based containers.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE bytes are carved out of CHUNK_SIZE chunks
+ * and recycled through one free list per multiple of ALIGNMENT, so nodes
+ * cost no malloc header and do not fragment the heap. The chunks are only
+ * released when the pool is destroyed. Larger or over-aligned requests, such
+ * as hash bucket arrays, go to operator new.
+ *
+ * Not thread safe: it is protected by whatever protects the containers
+ * allocating from it.
+ */
+class CNodePool
+{
+public:
+    static const size_t ALIGNMENT = 8;
+    static const size_t MAX_BLOCK_SIZE = 512;
+    static const size_t CHUNK_SIZE = 256 * 1024;
+
+    CNodePool() : vFree(MAX_BLOCK_SIZE / ALIGNMENT + 1, nullptr), pos(nullptr), end(nullptr), nUsed(0), nLargeUsage(0)
+    {
+    }
+
+    CNodePool(const CNodePool &) = delete;
+
+    CNodePool &operator=(const CNodePool &) = delete;
+
+    ~CNodePool()
+    {
+        for (char *chunk : vChunks)
+        {
+            ::operator delete(chunk);
+        }
+    }
+
+    void *Allocate(size_t nBytes, size_t nAlign)
+    {
+        if (!IsPooled(nBytes, nAlign))
+        {
+            void *p = ::operator new(nBytes);
+            nLargeUsage += memusage::MallocUsage(nBytes);
+            return p;
+        }
+
+        size_t nClass = BlockClass(nBytes);
+        void *p = vFree[nClass];
+        if (p)
+        {
+            vFree[nClass] = *static_cast<void **>(p);
+        } else
+        {
+            size_t nSize = nClass * ALIGNMENT;
+            if ((size_t)(end - pos) < nSize)
+            {
+                // The rest of the current chunk is given up.
+                vChunks.reserve(vChunks.size() + 1);
+                pos = static_cast<char *>(::operator new(CHUNK_SIZE));
+                end = pos + CHUNK_SIZE;
+                vChunks.push_back(pos);
+            }
+            p = pos;
+            pos += nSize;
+        }
+        nUsed += nClass * ALIGNMENT;
+        return p;
+    }
+
+    void Deallocate(void *p, size_t nBytes, size_t nAlign)
+    {
+        if (!IsPooled(nBytes, nAlign))
+        {
+            nLargeUsage -= memusage::MallocUsage(nBytes);
+            ::operator delete(p);
+            return;
+        }
+
+        size_t nClass = BlockClass(nBytes);
+        *static_cast<void **>(p) = vFree[nClass];
+        vFree[nClass] = p;
+        nUsed -= nClass * ALIGNMENT;
+    }
+
+    /**
+     * Memory handed out and not given back. Free blocks waiting to be reused
+     * are not included, so that the usage of a container goes down when it
+     * shrinks, as it would with malloc.
+     */
+    size_t DynamicMemoryUsage() const
+    {
+        return nUsed + nLargeUsage;
+    }
+
+    /** Memory held from the system: the chunks, and the blocks too large for them. */
+    size_t ReservedMemoryUsage() const
+    {
+        return memusage::MallocUsage(CHUNK_SIZE) * vChunks.size() + nLargeUsage;
+    }
+
+private:
+    std::vector<void *> vFree;
+    std::vector<char *> vChunks;
+    char *pos;
+    char *end;
+    size_t nUsed;
+    size_t nLargeUsage;
+
+    static bool IsPooled(size_t nBytes, size_t nAlign)
+    {
+        return nBytes <= MAX_BLOCK_SIZE && nAlign <= ALIGNMENT;
+    }
+
+    static size_t BlockClass(size_t nBytes)
+    {
+        // A free block holds the free list pointer.
+        return nBytes < sizeof(void *) ? sizeof(void *) / ALIGNMENT : (nBytes + ALIGNMENT - 1) / ALIGNMENT;
+    }
+};
+
+/**
+ * Allocator drawing from a CNodePool. A default constructed one has no pool
+ * and uses operator new.
+ */
+template<typename T>
+struct node_pool_allocator
+{
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind
+    {
+        typedef node_pool_allocator<U> other;
+    };
+
+    CNodePool *pool;
+
+    node_pool_allocator() noexcept : pool(nullptr)
+    {
+    }
+
+    explicit node_pool_allocator(CNodePool *poolIn) noexcept : pool(poolIn)
+    {
+    }
+
+    template<typename U>
+    node_pool_allocator(const node_pool_allocator<U> &other) noexcept : pool(other.pool)
+    {
+    }
+
+    T *allocate(std::size_t n, const void *hint = nullptr)
+    {
+        if (n > max_size())
+            throw std::bad_alloc();
+        if (!pool)
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(pool->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        if (!pool)
+            ::operator delete(p);
+        else
+            pool->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    std::size_t max_size() const noexcept
+    {
+        return std::numeric_limits<std::size_t>::max() / sizeof(T);
+    }
+
+    template<typename U, typename... Args>
+    void construct(U *p, Args &&... args)
+    {
+        ::new((void *)p) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    void destroy(U *p)
+    {
+        p->~U();
+    }
+
+    T *address(T &x) const noexcept
+    {
+        return &x;
+    }
+
+    const T *address(const T &x) const noexcept
+    {
+        return &x;
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const node_pool_allocator<T> &a, const node_pool_allocator<U> &b) noexcept
+{
+    return a.pool == b.pool;
+}
+
+template<typename T, typename U>
+bool operator!=(const node_pool_allocator<T> &a, const node_pool_allocator<U> &b) noexcept
+{
+    return a.pool != b.pool;
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
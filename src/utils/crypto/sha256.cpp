@@ -10,13 +10,36 @@
 #include <atomic>
 
 #if defined(__x86_64__) || defined(__amd64__)
-#if defined(EXPERIMENTAL_ASM)
+#if defined(EXPERIMENTAL_ASM) || defined(ENABLE_SSE41) || defined(ENABLE_AVX2) || defined(ENABLE_SHANI)
+#define HAVE_SHA256_CPUID
 #include <cpuid.h>
+#endif
+#if defined(EXPERIMENTAL_ASM)
 namespace sha256_sse4
 {
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 }
 #endif
+#if defined(ENABLE_SSE41)
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+void TransformD80_4way(unsigned char* out, const uint32_t* midstate, const unsigned char* tail, uint32_t nonce);
+}
+#endif
+#if defined(ENABLE_AVX2)
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+void TransformD80_8way(unsigned char* out, const uint32_t* midstate, const unsigned char* tail, uint32_t nonce);
+}
+#endif
+#if defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
 #endif
 
 // Internal implementation code.
@@ -171,6 +194,67 @@ namespace
 
     typedef void (*TransformType)(uint32_t *, const unsigned char *, size_t);
 
+    typedef void (*TransformD64Type)(unsigned char *, const unsigned char *);
+
+    /** Double-SHA256 of one 64-byte input, built on any single-lane Transform. */
+    template<TransformType tr>
+    void TransformD64Wrapper(unsigned char *out, const unsigned char *in)
+    {
+        static const unsigned char padding1[64] = {
+                0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+        };
+        unsigned char buffer2[64] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+        };
+        uint32_t s[8];
+        sha256::Initialize(s);
+        tr(s, in, 1);
+        tr(s, padding1, 1);
+        for (int i = 0; i < 8; i++)
+        {
+            WriteBE32(buffer2 + 4 * i, s[i]);
+        }
+        sha256::Initialize(s);
+        tr(s, buffer2, 1);
+        for (int i = 0; i < 8; i++)
+        {
+            WriteBE32(out + 4 * i, s[i]);
+        }
+    }
+
+    typedef void (*TransformD80Type)(unsigned char *, const uint32_t *, const unsigned char *, uint32_t);
+
+    /** Double-SHA256 of one 80-byte header from its midstate, built on any single-lane Transform. */
+    template<TransformType tr>
+    void TransformD80Wrapper(unsigned char *out, const uint32_t *midstate, const unsigned char *tail, uint32_t nonce)
+    {
+        unsigned char buffer1[64] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0x80
+        };
+        unsigned char buffer2[64] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+        };
+        uint32_t s[8];
+        memcpy(s, midstate, sizeof(s));
+        memcpy(buffer1, tail, 12);
+        WriteLE32(buffer1 + 12, nonce);
+        tr(s, buffer1, 1);
+        for (int i = 0; i < 8; i++)
+        {
+            WriteBE32(buffer2 + 4 * i, s[i]);
+        }
+        sha256::Initialize(s);
+        tr(s, buffer2, 1);
+        for (int i = 0; i < 8; i++)
+        {
+            WriteBE32(out + 4 * i, s[i]);
+        }
+    }
+
     bool SelfTest(TransformType tr)
     {
         static const unsigned char in1[65] = {0, 0x80};
@@ -207,23 +291,153 @@ namespace
         return true;
     }
 
+    /** Check a multi-way kernel against the single-lane one on 'ways' different inputs. */
+    bool SelfTestD64(TransformD64Type single, TransformD64Type multi, size_t ways)
+    {
+        unsigned char in[64 * 8], out1[32 * 8], out2[32 * 8];
+        for (size_t i = 0; i < sizeof(in); i++)
+        {
+            in[i] = (unsigned char)(i * 7 + (i >> 6));
+        }
+        for (size_t i = 0; i < ways; i++)
+        {
+            single(out1 + 32 * i, in + 64 * i);
+        }
+        multi(out2, in);
+        return memcmp(out1, out2, 32 * ways) == 0;
+    }
+
+    /** Check a multi-way header kernel against the single-lane one, across a nonce wrap-around. */
+    bool SelfTestD80(TransformD80Type single, TransformD80Type multi, size_t ways)
+    {
+        uint32_t midstate[8];
+        unsigned char tail[12], out1[32 * 8], out2[32 * 8];
+        for (int i = 0; i < 8; i++)
+        {
+            midstate[i] = 0x01234567ul * (i + 1);
+        }
+        for (int i = 0; i < 12; i++)
+        {
+            tail[i] = (unsigned char)(i * 29);
+        }
+        uint32_t nonce = 0xfffffffdul;
+        for (size_t i = 0; i < ways; i++)
+        {
+            single(out1 + 32 * i, midstate, tail, nonce + i);
+        }
+        multi(out2, midstate, tail, nonce);
+        return memcmp(out1, out2, 32 * ways) == 0;
+    }
+
     TransformType Transform = sha256::Transform;
+    TransformD64Type TransformD64 = TransformD64Wrapper<sha256::Transform>;
+    TransformD64Type TransformD64_4way = nullptr;
+    TransformD64Type TransformD64_8way = nullptr;
+    TransformD80Type TransformD80 = TransformD80Wrapper<sha256::Transform>;
+    TransformD80Type TransformD80_4way = nullptr;
+    TransformD80Type TransformD80_8way = nullptr;
+
+#if defined(HAVE_SHA256_CPUID)
+    void inline GetCPUID(uint32_t leaf, uint32_t subleaf, uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d)
+    {
+        __cpuid_count(leaf, subleaf, a, b, c, d);
+    }
+
+    /** Whether the OS saves the YMM registers across context switches (required for AVX). */
+    bool AVXEnabled()
+    {
+        uint32_t a, d;
+        __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+        return (a & 6) == 6;
+    }
+#endif
 
 } // namespace
 
 std::string SHA256AutoDetect()
 {
-#if defined(EXPERIMENTAL_ASM) && (defined(__x86_64__) || defined(__amd64__))
+    std::string ret = "standard";
+#if defined(HAVE_SHA256_CPUID)
+    bool have_sse4 = false;
+    bool have_xsave = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool have_shani = false;
+    bool enabled_avx = false;
+
+    (void)have_sse4;
+    (void)have_xsave;
+    (void)have_avx;
+    (void)have_avx2;
+    (void)have_shani;
+    (void)enabled_avx;
+
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
+    GetCPUID(0, 0, eax, ebx, ecx, edx);
+    uint32_t max_leaf = eax;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    have_sse4 = (ecx >> 19) & 1;
+    have_xsave = (ecx >> 27) & 1;
+    have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx)
+    {
+        enabled_avx = AVXEnabled();
+    }
+    if (max_leaf >= 7)
+    {
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+        have_shani = (ebx >> 29) & 1;
+    }
+
+#if defined(ENABLE_SHANI)
+    if (have_shani && have_sse4)
+    {
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+        TransformD80 = TransformD80Wrapper<sha256_shani::Transform>;
+        ret = "shani(1way)";
+    }
+#endif
+#if defined(EXPERIMENTAL_ASM)
+    if (have_sse4 && Transform == sha256::Transform)
+    {
         Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+        TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
+        TransformD80 = TransformD80Wrapper<sha256_sse4::Transform>;
+        ret = "sse4(1way)";
     }
+#endif
+#if defined(ENABLE_SSE41)
+    if (have_sse4)
+    {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        TransformD80_4way = sha256d64_sse41::TransformD80_4way;
+        ret += ",sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (have_avx2 && have_avx && enabled_avx)
+    {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformD80_8way = sha256d64_avx2::TransformD80_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
 #endif
 
     assert(SelfTest(Transform));
-    return "standard";
+    assert(SelfTestD64(TransformD64Wrapper<sha256::Transform>, TransformD64, 1));
+    if (TransformD64_4way)
+        assert(SelfTestD64(TransformD64Wrapper<sha256::Transform>, TransformD64_4way, 4));
+    if (TransformD64_8way)
+        assert(SelfTestD64(TransformD64Wrapper<sha256::Transform>, TransformD64_8way, 8));
+    assert(SelfTestD80(TransformD80Wrapper<sha256::Transform>, TransformD80, 1));
+    if (TransformD80_4way)
+        assert(SelfTestD80(TransformD80Wrapper<sha256::Transform>, TransformD80_4way, 4));
+    if (TransformD80_8way)
+        assert(SelfTestD80(TransformD80Wrapper<sha256::Transform>, TransformD80_8way, 8));
+    return ret;
 }
 
 ////// SHA-256
@@ -285,3 +499,72 @@ CSHA256 &CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char *out, const unsigned char *in, size_t blocks)
+{
+    if (TransformD64_8way)
+    {
+        while (blocks >= 8)
+        {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way)
+    {
+        while (blocks >= 4)
+        {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks)
+    {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
+
+void SHA256Midstate(uint32_t midstate[8], const unsigned char *data)
+{
+    sha256::Initialize(midstate);
+    Transform(midstate, data, 1);
+}
+
+void SHA256D80Nonces(unsigned char *out, const uint32_t midstate[8], const unsigned char *tail, uint32_t nonce,
+                     size_t count)
+{
+    if (TransformD80_8way)
+    {
+        while (count >= 8)
+        {
+            TransformD80_8way(out, midstate, tail, nonce);
+            out += 256;
+            nonce += 8;
+            count -= 8;
+        }
+    }
+    if (TransformD80_4way)
+    {
+        while (count >= 4)
+        {
+            TransformD80_4way(out, midstate, tail, nonce);
+            out += 128;
+            nonce += 4;
+            count -= 4;
+        }
+    }
+    while (count)
+    {
+        TransformD80(out, midstate, tail, nonce);
+        out += 32;
+        ++nonce;
+        --count;
+    }
+}
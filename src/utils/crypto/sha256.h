@@ -34,4 +34,25 @@ public:
  */
 std::string SHA256AutoDetect();
 
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ *  output may be equal to input, which lets merkle code hash a level in place.
+ */
+void SHA256D64(unsigned char *output, const unsigned char *input, size_t blocks);
+
+/** SHA-256 state after compressing the first 64-byte block of a message. */
+void SHA256Midstate(uint32_t midstate[8], const unsigned char *data);
+
+/** Compute the double-SHA256's of 80-byte messages that differ only in their
+ *  last 4 bytes, a little-endian counter (the nonce of a block header).
+ *  output:   pointer to a count*32 byte output buffer
+ *  midstate: SHA256Midstate of the first 64 bytes
+ *  tail:     the 12 bytes that follow them
+ *  nonce:    counter of the first message; message i uses nonce + i.
+ */
+void SHA256D80Nonces(unsigned char *output, const uint32_t midstate[8], const unsigned char *tail, uint32_t nonce,
+                     size_t count);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,270 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_SSE41
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64_sse41
+{
+    namespace
+    {
+        __m128i inline K(uint32_t x)
+        {
+            return _mm_set1_epi32(x);
+        }
+
+        __m128i inline Add(__m128i x, __m128i y)
+        {
+            return _mm_add_epi32(x, y);
+        }
+
+        __m128i inline Add(__m128i x, __m128i y, __m128i z)
+        {
+            return Add(Add(x, y), z);
+        }
+
+        __m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w)
+        {
+            return Add(Add(x, y), Add(z, w));
+        }
+
+        __m128i inline Xor(__m128i x, __m128i y)
+        {
+            return _mm_xor_si128(x, y);
+        }
+
+        __m128i inline Xor(__m128i x, __m128i y, __m128i z)
+        {
+            return Xor(Xor(x, y), z);
+        }
+
+        __m128i inline Or(__m128i x, __m128i y)
+        {
+            return _mm_or_si128(x, y);
+        }
+
+        __m128i inline And(__m128i x, __m128i y)
+        {
+            return _mm_and_si128(x, y);
+        }
+
+        __m128i inline ShR(__m128i x, int n)
+        {
+            return _mm_srli_epi32(x, n);
+        }
+
+        __m128i inline ShL(__m128i x, int n)
+        {
+            return _mm_slli_epi32(x, n);
+        }
+
+        __m128i inline Ch(__m128i x, __m128i y, __m128i z)
+        {
+            return Xor(z, And(x, Xor(y, z)));
+        }
+
+        __m128i inline Maj(__m128i x, __m128i y, __m128i z)
+        {
+            return Or(And(x, y), And(z, Or(x, y)));
+        }
+
+        __m128i inline Sigma0(__m128i x)
+        {
+            return Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19)), Or(ShR(x, 22), ShL(x, 10)));
+        }
+
+        __m128i inline Sigma1(__m128i x)
+        {
+            return Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21)), Or(ShR(x, 25), ShL(x, 7)));
+        }
+
+        __m128i inline sigma0(__m128i x)
+        {
+            return Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14)), ShR(x, 3));
+        }
+
+        __m128i inline sigma1(__m128i x)
+        {
+            return Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13)), ShR(x, 10));
+        }
+
+        /** One round of SHA-256, k already includes the message word. */
+        void inline
+        Round(__m128i a, __m128i b, __m128i c, __m128i &d, __m128i e, __m128i f, __m128i g, __m128i &h, __m128i k)
+        {
+            __m128i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+            __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+            d = Add(d, t1);
+            h = Add(t1, t2);
+        }
+
+        const uint32_t K256[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        const uint32_t IV[8] = {
+                0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul,
+                0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul
+        };
+
+        /** Run one SHA-256 compression on 4 independent states, consuming the message words in w. */
+        void inline Compress(__m128i s[8], const __m128i w[16])
+        {
+            __m128i W[64];
+            for (int t = 0; t < 16; t++)
+            {
+                W[t] = w[t];
+            }
+            for (int t = 16; t < 64; t++)
+            {
+                W[t] = Add(sigma1(W[t - 2]), W[t - 7], sigma0(W[t - 15]), W[t - 16]);
+            }
+
+            __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+            for (int t = 0; t < 64; t += 8)
+            {
+                Round(a, b, c, d, e, f, g, h, Add(K(K256[t + 0]), W[t + 0]));
+                Round(h, a, b, c, d, e, f, g, Add(K(K256[t + 1]), W[t + 1]));
+                Round(g, h, a, b, c, d, e, f, Add(K(K256[t + 2]), W[t + 2]));
+                Round(f, g, h, a, b, c, d, e, Add(K(K256[t + 3]), W[t + 3]));
+                Round(e, f, g, h, a, b, c, d, Add(K(K256[t + 4]), W[t + 4]));
+                Round(d, e, f, g, h, a, b, c, Add(K(K256[t + 5]), W[t + 5]));
+                Round(c, d, e, f, g, h, a, b, Add(K(K256[t + 6]), W[t + 6]));
+                Round(b, c, d, e, f, g, h, a, Add(K(K256[t + 7]), W[t + 7]));
+            }
+
+            s[0] = Add(s[0], a);
+            s[1] = Add(s[1], b);
+            s[2] = Add(s[2], c);
+            s[3] = Add(s[3], d);
+            s[4] = Add(s[4], e);
+            s[5] = Add(s[5], f);
+            s[6] = Add(s[6], g);
+            s[7] = Add(s[7], h);
+        }
+
+        /** Load word 'offset' (in bytes) of each of the 4 consecutive 64-byte inputs. */
+        __m128i inline Read(const unsigned char *in, int offset)
+        {
+            return _mm_set_epi32(ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset),
+                                 ReadBE32(in + 64 + offset), ReadBE32(in + 0 + offset));
+        }
+
+        /** Store each lane of v as word 'offset' (in bytes) of the 4 consecutive 32-byte outputs. */
+        void inline Write(unsigned char *out, int offset, __m128i v)
+        {
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128((__m128i *)lanes, v);
+            for (int i = 0; i < 4; i++)
+            {
+                WriteBE32(out + 32 * i + offset, lanes[i]);
+            }
+        }
+
+        /** Lane i holds nonce + i, as the big-endian message word its little-endian serialization forms. */
+        __m128i inline Nonces(uint32_t nonce)
+        {
+            alignas(16) uint32_t lanes[4];
+            for (int i = 0; i < 4; i++)
+            {
+                unsigned char bytes[4];
+                WriteLE32(bytes, nonce + i);
+                lanes[i] = ReadBE32(bytes);
+            }
+            return _mm_load_si128((const __m128i *)lanes);
+        }
+
+        /** Second hash over the 32-byte digests in s, written to 4 consecutive 32-byte outputs. */
+        void inline Finish(unsigned char *out, __m128i s[8])
+        {
+            __m128i w[16];
+            for (int t = 0; t < 8; t++)
+            {
+                w[t] = s[t];
+                s[t] = K(IV[t]);
+            }
+            w[8] = K(0x80000000ul);
+            for (int t = 9; t < 15; t++)
+            {
+                w[t] = K(0);
+            }
+            w[15] = K(0x100);
+            Compress(s, w);
+
+            for (int i = 0; i < 8; i++)
+            {
+                Write(out, 4 * i, s[i]);
+            }
+        }
+    }
+
+    /** Double-SHA256 of 4 consecutive 64-byte inputs into 4 consecutive 32-byte outputs. */
+    void Transform_4way(unsigned char *out, const unsigned char *in)
+    {
+        __m128i s[8], w[16];
+
+        // First hash, data block.
+        for (int i = 0; i < 8; i++)
+        {
+            s[i] = K(IV[i]);
+        }
+        for (int t = 0; t < 16; t++)
+        {
+            w[t] = Read(in, 4 * t);
+        }
+        Compress(s, w);
+
+        // First hash, padding block for a 64-byte message.
+        w[0] = K(0x80000000ul);
+        for (int t = 1; t < 15; t++)
+        {
+            w[t] = K(0);
+        }
+        w[15] = K(0x200);
+        Compress(s, w);
+
+        Finish(out, s);
+    }
+
+    /**
+     * Double-SHA256 of 4 80-byte block headers that only differ in their nonce,
+     * nonce + 0 .. nonce + 3, into 4 consecutive 32-byte outputs. midstate is the
+     * state after the first 64 header bytes, tail the 12 bytes between them and the nonce.
+     */
+    void TransformD80_4way(unsigned char *out, const uint32_t *midstate, const unsigned char *tail, uint32_t nonce)
+    {
+        __m128i s[8], w[16];
+
+        for (int i = 0; i < 8; i++)
+        {
+            s[i] = K(midstate[i]);
+        }
+        w[0] = K(ReadBE32(tail));
+        w[1] = K(ReadBE32(tail + 4));
+        w[2] = K(ReadBE32(tail + 8));
+        w[3] = Nonces(nonce);
+        w[4] = K(0x80000000ul);
+        for (int t = 5; t < 15; t++)
+        {
+            w[t] = K(0);
+        }
+        w[15] = K(0x280);
+        Compress(s, w);
+
+        Finish(out, s);
+    }
+}
+
+#endif
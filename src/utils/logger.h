@@ -7,6 +7,10 @@
 typedef log4cpp::Category LogCategory;
 typedef log4cpp::Priority LogPriority;
 
+// Hands a formatted record to the category, through the async writer when it
+// is running (see asynclog.h).
+void LogWrite(LogCategory *logger, int prior, std::string &&message);
+
 //TODO: log priority enum
 //using LogPriority::EMERG;
 //using LogPriority::FATAL;
@@ -21,8 +25,19 @@ typedef log4cpp::Priority LogPriority;
 #define ENABLE_LOGGING
 #define LOG_SRC_LOC_INFO
 
+// Least severe log4cpp priority value that is compiled in at all, e.g. build
+// with -DLOG_MIN_LEVEL=500 to drop every info/debug statement (NOTICE = 500,
+// INFO = 600, DEBUG = 700). Statements above it fold to a constant false.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 700
+#endif
+
 #ifdef  ENABLE_LOGGING
 
+// Checked before any argument is formatted, so a suppressed statement costs a
+// priority lookup and nothing else.
+#define LogEnabled(prior) ((prior) <= LOG_MIN_LEVEL && s_logger->isPriorityEnabled(prior))
+
 #define DECLARE_DEFAULT_LOGGER(c)                                                 \
         static LogCategory* s_logger = &LogCategory::getInstance(#c)
 
@@ -42,15 +57,14 @@ typedef log4cpp::Priority LogPriority;
 #ifdef LOG_SRC_LOC_INFO
 # define __FILENAME__ (strrchr(__FILE__, '/') ? (strrchr(__FILE__, '/') + 1) : __FILE__)
 # define SrcLocInfo(file, line) tinyformat::format("%s(%d):  ", file, line)
-# define Logging(prior, fmt, a...) s_logger->log(prior, SrcLocInfo(__FILENAME__, __LINE__) + tinyformat::format(fmt, ##a))
-# define LoggingLevel(level, fmt, a...) s_logger->level(SrcLocInfo(__FILENAME__, __LINE__) + tinyformat::format(fmt, ##a))
-# define LogStream(prior) _LogStream(prior, __FILENAME__, __LINE__)
+# define Logging(prior, fmt, a...) (!LogEnabled(prior) ? (void)0 : \
+        LogWrite(s_logger, prior, SrcLocInfo(__FILENAME__, __LINE__) + tinyformat::format(fmt, ##a)))
+# define LogStream(prior) !LogEnabled(prior) ? (void)0 : _LogVoidify() & _LogStream(prior, __FILENAME__, __LINE__)
 # define LogRetV(prior, fmt, a...) _LogFormatRetV<prior>(__FILENAME__, __LINE__, fmt, ##a)
 #else
-# define Logging(prior, fmt, a...) s_logger->log(prior, tinyformat::format(fmt, ##a))
-# define LoggingLevel(level, fmt, a...) s_logger->level(tinyformat::format(fmt, ##a))
-# define LogStream(prior) _LogStream(prior)
-# define LogRetV(prior, fmt, a...) _LogFormatRetV<prior>(nullptr, 0, nullptr, fmt, ##a)
+# define Logging(prior, fmt, a...) (!LogEnabled(prior) ? (void)0 : LogWrite(s_logger, prior, tinyformat::format(fmt, ##a)))
+# define LogStream(prior) !LogEnabled(prior) ? (void)0 : _LogVoidify() & _LogStream(prior)
+# define LogRetV(prior, fmt, a...) _LogFormatRetV<prior>(nullptr, 0, fmt, ##a)
 #endif
 
 DECLARE_DEFAULT_LOGGER(CID_APP);
@@ -60,8 +74,8 @@ DECLARE_DEFAULT_LOGGER(CID_APP);
 #define DECLARE_SBTC_LOGGER(c)
 #define SET_CPP_SCOPED_LOG_CATEGORY(c)
 #define SET_TEMP_LOG_CATEGORY(c)
-#define Logging(level, fmt, a...)
-#define LoggingLevel(level, fmt, a...)
+#define LogEnabled(prior) false
+#define Logging(prior, fmt, a...) ((void)0)
 #define LogStream(prior) _LogStream(prior)
 #define LogRetV(prior, fmt, a...) (prior > LogPriority::ERROR)
 
@@ -70,14 +84,15 @@ DECLARE_DEFAULT_LOGGER(CID_APP);
 
 // TODO: formatted logging defines.
 // TODO: e.g. ELogFormat("This is %d line log.", 10);
-#define NLogFormat(fmt, a...) LoggingLevel(notice, fmt, ##a)
-#define ELogFormat(fmt, a...) LoggingLevel(error,  fmt, ##a)
-#define ILogFormat(fmt, a...) LoggingLevel(info,   fmt, ##a)
-#define WLogFormat(fmt, a...) LoggingLevel(warn,   fmt, ##a)
-#define FLogFormat(fmt, a...) LoggingLevel(fatal,  fmt, ##a)
-#define DLogFormat(fmt, a...) LoggingLevel(debug,  fmt, ##a)
+#define NLogFormat(fmt, a...) Logging(LogPriority::NOTICE, fmt, ##a)
+#define ELogFormat(fmt, a...) Logging(LogPriority::ERROR,  fmt, ##a)
+#define ILogFormat(fmt, a...) Logging(LogPriority::INFO,   fmt, ##a)
+#define WLogFormat(fmt, a...) Logging(LogPriority::WARN,   fmt, ##a)
+#define FLogFormat(fmt, a...) Logging(LogPriority::FATAL,  fmt, ##a)
+#define DLogFormat(fmt, a...) Logging(LogPriority::DEBUG,  fmt, ##a)
 #define LogFormat(prior, fmt, a...) Logging(prior, fmt, ##a)
-#define VMLog(fmt, a...) s_logger->log(LogPriority::NOTICE, tinyformat::format(fmt, ##a))
+#define VMLog(fmt, a...) (!LogEnabled(LogPriority::NOTICE) ? (void)0 : \
+        LogWrite(s_logger, LogPriority::NOTICE, tinyformat::format(fmt, ##a)))
 
 
 // TODO: stream logging defines
@@ -113,11 +128,11 @@ public:
     {
         if (!str().empty())
         {
-            s_logger->log(_prior,
+            LogWrite(s_logger, _prior,
 # ifdef LOG_SRC_LOC_INFO
-                          SrcLocInfo(_filename, _line) +
-                          # endif
-                          str());
+                     SrcLocInfo(_filename, _line) +
+                     # endif
+                     str());
         }
     }
 
@@ -129,15 +144,28 @@ private:
 };
 
 
+// Swallows the stream expression so both arms of the LogStream conditional are void.
+struct _LogVoidify
+{
+    template<typename T>
+    void operator&(T &&)
+    {
+    }
+};
+
+
 template<int prior, typename... TArgs>
 inline bool _LogFormatRetV(const char *filename, int line, const char *fmt, TArgs &&... args)
 {
 #ifdef ENABLE_LOGGING
-    s_logger->log(prior,
+    if (LogEnabled(prior))
+    {
+        LogWrite(s_logger, prior,
 # ifdef LOG_SRC_LOC_INFO
-                  SrcLocInfo(filename, line) +
-                  # endif
-                  tinyformat::format(fmt, args...));
+                 SrcLocInfo(filename, line) +
+                 # endif
+                 tinyformat::format(fmt, args...));
+    }
 #endif
     return prior > LogPriority::ERROR;
 }
@@ -14,6 +14,6 @@ bool SendNetMessage(int64_t nodeID, const std::string& command, int version, int
         CVectorWriter{SER_NETWORK, version | flags, msgData, 0, std::forward<TArgs>(args)...};
     }
     GET_NET_INTERFACE(ifNetObj);
-    return ifNetObj->SendNetMessage(nodeID, command, msgData);
+    return ifNetObj->SendNetMessage(nodeID, command, std::move(msgData));
 }
 
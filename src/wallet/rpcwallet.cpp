@@ -3681,6 +3681,7 @@ UniValue createcontract(const JSONRPCRequest &request)
         view.SetBackend(viewMemPool);
 
         CAmount nMinGasPrice = 0;
+        uint64_t nTxGasLimit = 0;
         CAmount nValueIn = view.GetValueIn(*(wtx.tx));
         CAmount nValueOut = wtx.tx->GetValueOut();
         CAmount nFees = nValueIn - nValueOut;
@@ -3694,7 +3695,7 @@ UniValue createcontract(const JSONRPCRequest &request)
         string errinfo;
 
         GET_CONTRACT_INTERFACE(ifContractObj);
-        if (!ifContractObj->CheckContractTx(*(wtx.tx), nFees, nMinGasPrice, level, errinfo))
+        if (!ifContractObj->CheckContractTx(*(wtx.tx), nFees, nMinGasPrice, nTxGasLimit, level, errinfo))
         {
             throw JSONRPCError(RPC_TYPE_ERROR, errinfo);
         }
@@ -4019,6 +4020,7 @@ UniValue sendtocontract(const JSONRPCRequest &request)
         view.SetBackend(viewMemPool);
 
         CAmount nMinGasPrice = 0;
+        uint64_t nTxGasLimit = 0;
         CAmount nValueIn = view.GetValueIn(*(wtx.tx));
         CAmount nValueOut = wtx.tx->GetValueOut();
         CAmount nFees = nValueIn - nValueOut;
@@ -4032,7 +4034,7 @@ UniValue sendtocontract(const JSONRPCRequest &request)
         string errinfo;
 
         GET_CONTRACT_INTERFACE(ifContractObj);
-        if (!ifContractObj->CheckContractTx(*(wtx.tx), nFees, nMinGasPrice, level, errinfo))
+        if (!ifContractObj->CheckContractTx(*(wtx.tx), nFees, nMinGasPrice, nTxGasLimit, level, errinfo))
         {
             throw JSONRPCError(RPC_TYPE_ERROR, errinfo);
         }